@@ -0,0 +1,337 @@
+#include "ble_adv_policy.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+
+#define TAG "ADV"
+
+#define MS_TO_ADV_INTERVAL(ms)  ((ms) * 8 / 5)  // 0.625 ms units
+#define FAST_WINDOW_US          (CONFIG_NOWA_ADV_FAST_WINDOW_S * 1000000LL)
+
+// Apple Accessory Design Guidelines: 20 ms for the first 30 s, then one of the longer intervals
+_Static_assert(CONFIG_NOWA_ADV_FAST_INTERVAL_MS < CONFIG_NOWA_ADV_SLOW_INTERVAL_MS, "Fast interval not below the slow one");
+
+typedef struct {
+    uint8_t bda[6];
+    uint8_t type;   // esp_ble_wl_addr_type_t
+} ble_adv_bond_t;
+
+static struct {
+    portMUX_TYPE lock;
+    esp_timer_handle_t timer;   // End of the fast window
+    esp_ble_adv_params_t base;
+    uint8_t phase;              // ble_adv_phase_t
+    int64_t fast_until;
+    ble_adv_bond_t bonds[BLE_ADV_POLICY_ACCEPT_MAX];
+    uint8_t bonds_len;
+    ble_adv_peer_t peers[BLE_ADV_POLICY_PEERS];
+    uint32_t fast_windows;
+    uint32_t restarts;
+} adv;
+
+static void ble_adv_policy_timer_cb(void *arg);
+
+esp_err_t ble_adv_policy_init(const esp_ble_adv_params_t *base)
+{
+    adv.base = *base;
+    if (adv.timer != NULL) {
+        return ESP_OK;
+    }
+    portMUX_INITIALIZE(&adv.lock);
+
+    esp_timer_create_args_t ta = {
+        .callback = ble_adv_policy_timer_cb,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "adv_policy"
+    };
+    esp_err_t ret = esp_timer_create(&ta, &adv.timer);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "%s: esp_timer_create failed, error code = %x", __func__, ret);
+    }
+    return ret;
+}
+
+/**@brief Bonds from the stack, up to BLE_ADV_POLICY_ACCEPT_MAX.
+ *
+ * @details The identity address goes on the list, with its type. A phone using a resolvable
+ *          private address only matches once the controller resolves it with the IRK of the bond.
+ */
+static uint8_t ble_adv_policy_load_bonds(ble_adv_bond_t *out)
+{
+    int num = esp_ble_get_bond_device_num();
+    if (num <= 0) {
+        return 0;
+    }
+    esp_ble_bond_dev_t *list = malloc(sizeof(esp_ble_bond_dev_t) * num);
+    if (list == NULL) {
+        ESP_LOGE(TAG, "%s: no memory for %d bonds", __func__, num);
+        return 0;
+    }
+    if (esp_ble_get_bond_device_list(&num, list) != ESP_OK) {
+        num = 0;
+    }
+    if (num > BLE_ADV_POLICY_ACCEPT_MAX) {
+        ESP_LOGW(TAG, "%d bonds, %d put on the accept list", num, BLE_ADV_POLICY_ACCEPT_MAX);
+        num = BLE_ADV_POLICY_ACCEPT_MAX;
+    }
+    for (int i = 0; i < num; i ++) {
+        memcpy(out[i].bda, list[i].bd_addr, sizeof(out[i].bda));
+        out[i].type = (list[i].bond_key.pid_key.addr_type == BLE_ADDR_TYPE_PUBLIC) ? BLE_WL_ADDR_TYPE_PUBLIC : BLE_WL_ADDR_TYPE_RANDOM;
+    }
+    free(list);
+    return num;
+}
+
+// Bonded phone with that address, lock held
+static bool ble_adv_policy_bonded(const uint8_t bda[6])
+{
+    for (uint8_t i = 0; i < adv.bonds_len; i ++) {
+        if (memcmp(adv.bonds[i].bda, bda, 6) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Statistics of a phone, the least recently seen one replaced if it has none, lock held
+static ble_adv_peer_t *ble_adv_policy_peer(const uint8_t bda[6], bool create)
+{
+    ble_adv_peer_t *oldest = &adv.peers[0];
+    for (size_t i = 0; i < BLE_ADV_POLICY_PEERS; i ++) {
+        ble_adv_peer_t *p = &adv.peers[i];
+        if (p->seen_at != 0 && memcmp(p->bda, bda, 6) == 0) {
+            return p;
+        }
+        if (p->seen_at < oldest->seen_at) {
+            oldest = p;
+        }
+    }
+    if (!create) {
+        return NULL;
+    }
+    memset(oldest, 0, sizeof(*oldest));
+    memcpy(oldest->bda, bda, 6);
+    return oldest;
+}
+
+/**@brief (Re)starts advertising with the parameters of the current phase.
+ *
+ * @details The controller refuses accept list changes while advertising uses it, so a new
+ *          list goes in between stopping and starting. Connecting also stops advertising.
+ */
+static void ble_adv_policy_apply(bool write_list)
+{
+    ble_adv_bond_t bonds[BLE_ADV_POLICY_ACCEPT_MAX];
+
+    portENTER_CRITICAL(&adv.lock);
+    if (adv.phase == BLE_ADV_PHASE_OFF) {
+        portEXIT_CRITICAL(&adv.lock);
+        return;
+    }
+    esp_ble_adv_params_t params = adv.base;
+    bool fast = (adv.phase == BLE_ADV_PHASE_FAST);
+    uint16_t interval = fast ? MS_TO_ADV_INTERVAL(CONFIG_NOWA_ADV_FAST_INTERVAL_MS) : MS_TO_ADV_INTERVAL(CONFIG_NOWA_ADV_SLOW_INTERVAL_MS);
+    params.adv_int_min = interval;
+    params.adv_int_max = interval;
+#ifdef CONFIG_NOWA_ADV_FILTER_BONDED
+    if (fast && adv.bonds_len > 0) {
+        params.adv_filter_policy = ADV_FILTER_ALLOW_SCAN_ANY_CON_WLST;
+    }
+#endif
+    uint8_t bonds_len = adv.bonds_len;
+    memcpy(bonds, adv.bonds, sizeof(bonds[0]) * bonds_len);
+    adv.restarts ++;
+    portEXIT_CRITICAL(&adv.lock);
+
+    esp_ble_gap_stop_advertising();
+    if (write_list) {
+        esp_ble_gap_clear_whitelist();
+        for (uint8_t i = 0; i < bonds_len; i ++) {
+            esp_err_t ret = esp_ble_gap_update_whitelist(true, bonds[i].bda, bonds[i].type);
+            if (ret != ESP_OK) {
+                ESP_LOGW(TAG, "%s: bond %u not on the accept list (%s)", __func__, i, esp_err_to_name(ret));
+            }
+        }
+    }
+    esp_err_t ret = esp_ble_gap_start_advertising(&params);
+    ESP_LOGD(TAG, "%s advertising every %u units%s: %x", fast ? "Fast" : "Slow", interval,
+             (params.adv_filter_policy == ADV_FILTER_ALLOW_SCAN_ANY_CON_WLST) ? ", bonded only" : "", ret);
+}
+
+// Fast window from now, lock held
+static void ble_adv_policy_open_window(int64_t now)
+{
+    adv.phase = BLE_ADV_PHASE_FAST;
+    adv.fast_until = now + FAST_WINDOW_US;
+    adv.fast_windows ++;
+    esp_timer_stop(adv.timer);
+    esp_timer_start_once(adv.timer, FAST_WINDOW_US);
+}
+
+static void ble_adv_policy_timer_cb(void *arg)
+{
+    (void)arg;
+    portENTER_CRITICAL(&adv.lock);
+    bool slow = (adv.phase == BLE_ADV_PHASE_FAST);
+    if (slow) {
+        adv.phase = BLE_ADV_PHASE_SLOW;
+    }
+    portEXIT_CRITICAL(&adv.lock);
+    if (slow) {
+        ESP_LOGI(TAG, "Fast window over, advertising to every phone");
+        ble_adv_policy_apply(false);
+    }
+}
+
+// Advertising data configured, bonded phones are timed from now as if they had just disconnected
+void ble_adv_policy_start(void)
+{
+    ble_adv_bond_t bonds[BLE_ADV_POLICY_ACCEPT_MAX];
+    uint8_t bonds_len = ble_adv_policy_load_bonds(bonds);
+
+    portENTER_CRITICAL(&adv.lock);
+    int64_t now = esp_timer_get_time();
+    memcpy(adv.bonds, bonds, sizeof(bonds[0]) * bonds_len);
+    adv.bonds_len = bonds_len;
+    for (uint8_t i = 0; i < bonds_len; i ++) {
+        ble_adv_peer_t *p = ble_adv_policy_peer(bonds[i].bda, true);
+        p->disconnected_at = now;
+        p->seen_at = now;
+    }
+    ble_adv_policy_open_window(now);
+    portEXIT_CRITICAL(&adv.lock);
+
+    ESP_LOGI(TAG, "Advertising, %u bonds on the accept list", bonds_len);
+    ble_adv_policy_apply(true);
+}
+
+void ble_adv_policy_stop(void)
+{
+    if (adv.timer == NULL) {
+        return; // Never initialized
+    }
+    portENTER_CRITICAL(&adv.lock);
+    adv.phase = BLE_ADV_PHASE_OFF;
+    esp_timer_stop(adv.timer);
+    portEXIT_CRITICAL(&adv.lock);
+}
+
+// Link up, advertising stopped by the controller goes on for the other profiles
+void ble_adv_policy_connected(const uint8_t bda[6])
+{
+    portENTER_CRITICAL(&adv.lock);
+    int64_t now = esp_timer_get_time();
+    int64_t took = -1;
+    ble_adv_peer_t *p = ble_adv_policy_bonded(bda) ? ble_adv_policy_peer(bda, true) : NULL;
+    if (p != NULL) {
+        if (p->disconnected_at != 0) {
+            took = now - p->disconnected_at;
+            p->reconnects ++;
+            p->total_us += took;
+            p->last_us = took;
+            p->min_us = (p->min_us == 0 || took < p->min_us) ? took : p->min_us;
+            p->max_us = (took > p->max_us) ? took : p->max_us;
+            if (adv.phase == BLE_ADV_PHASE_FAST) {
+                p->in_fast ++;
+            }
+        }
+        p->disconnected_at = 0;
+        p->seen_at = now;
+    }
+    portEXIT_CRITICAL(&adv.lock);
+
+    if (took >= 0) {
+        ESP_LOGD(TAG, "Bonded phone back after %" PRId64 " ms", took / 1000);
+    }
+    ble_adv_policy_apply(false);
+}
+
+// Link down, a bonded phone is expected back: fast window from now
+void ble_adv_policy_disconnected(const uint8_t bda[6])
+{
+    portENTER_CRITICAL(&adv.lock);
+    if (adv.phase == BLE_ADV_PHASE_OFF) {
+        portEXIT_CRITICAL(&adv.lock);
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+    if (ble_adv_policy_bonded(bda)) {
+        ble_adv_peer_t *p = ble_adv_policy_peer(bda, true);
+        p->disconnected_at = now;
+        p->seen_at = now;
+    }
+    ble_adv_policy_open_window(now);
+    portEXIT_CRITICAL(&adv.lock);
+
+    ble_adv_policy_apply(false);
+}
+
+// Pairing completed or a bond removed, the accept list is rewritten if it changed
+void ble_adv_policy_bonds_changed(void)
+{
+    ble_adv_bond_t bonds[BLE_ADV_POLICY_ACCEPT_MAX];
+    uint8_t bonds_len = ble_adv_policy_load_bonds(bonds);
+
+    portENTER_CRITICAL(&adv.lock);
+    bool changed = (bonds_len != adv.bonds_len || memcmp(bonds, adv.bonds, sizeof(bonds[0]) * bonds_len) != 0);
+    if (changed) {
+        memcpy(adv.bonds, bonds, sizeof(bonds[0]) * bonds_len);
+        adv.bonds_len = bonds_len;
+    }
+    bool on = (adv.phase != BLE_ADV_PHASE_OFF);
+    portEXIT_CRITICAL(&adv.lock);
+
+    if (changed && on) {
+        ESP_LOGI(TAG, "Bonds changed, %u on the accept list", bonds_len);
+        ble_adv_policy_apply(true);
+    }
+}
+
+void ble_adv_policy_state(ble_adv_state_t *state)
+{
+    portENTER_CRITICAL(&adv.lock);
+    bool fast = (adv.phase == BLE_ADV_PHASE_FAST);
+    state->phase = adv.phase;
+    state->accept_list = adv.bonds_len;
+#ifdef CONFIG_NOWA_ADV_FILTER_BONDED
+    state->filtered = fast && adv.bonds_len > 0;
+#else
+    state->filtered = false;
+#endif
+    state->interval = fast ? MS_TO_ADV_INTERVAL(CONFIG_NOWA_ADV_FAST_INTERVAL_MS) : MS_TO_ADV_INTERVAL(CONFIG_NOWA_ADV_SLOW_INTERVAL_MS);
+    state->fast_until = fast ? adv.fast_until : 0;
+    state->fast_windows = adv.fast_windows;
+    state->restarts = adv.restarts;
+    portEXIT_CRITICAL(&adv.lock);
+}
+
+// Reconnection statistics of the bonded phones seen since boot, most recently seen first
+size_t ble_adv_policy_peers(ble_adv_peer_t *out, size_t max)
+{
+    size_t n = 0;
+    portENTER_CRITICAL(&adv.lock);
+    for (size_t i = 0; i < BLE_ADV_POLICY_PEERS; i ++) {
+        const ble_adv_peer_t *p = &adv.peers[i];
+        if (p->seen_at == 0) {
+            continue;
+        }
+        size_t at = (n < max) ? n : max;
+        while (at > 0 && out[at - 1].seen_at < p->seen_at) {
+            if (at < max) {
+                out[at] = out[at - 1];
+            }
+            at --;
+        }
+        if (at < max) {
+            out[at] = *p;
+            n = (n < max) ? n + 1 : n;
+        }
+    }
+    portEXIT_CRITICAL(&adv.lock);
+    return n;
+}
@@ -18,26 +18,29 @@
 #include "esp_gatt_defs.h"
 #include "esp_gatt_common_api.h"
 #include "ble_utils.h"
+#include "ble_handle_cache.h"
+#include "ble_gatt_ops.h"
+#include "ble_conn_ctrl.h"
+#include "ble_adv_policy.h"
 #include "esp_timer.h"
+#include "sdkconfig.h"
 
 #define BLE_SVC_GAP_UUID16                                  0x1800
 #define BLE_SVC_GAP_CHR_UUID16_DEVICE_NAME                  0x2a00
 #define BLE_SVC_GAP_CHR_UUID16_APPEARANCE                   0x2a01
 #define BLE_SVC_GAP_CHR_UUID16_PERIPH_PREF_CONN_PARAMS      0x2a04
 #define BLE_SVC_GAP_CHR_UUID16_CENTRAL_ADDRESS_RESOLUTION   0x2aa6
+#define BLE_SVC_GATT_UUID16                                 0x1801
+#define BLE_SVC_GATT_CHR_UUID16_SERVICE_CHANGED             0x2a05
 
 #define TAG                                       "ANCS"
 #define DEVICE_NAME                               "Nowa"
-#define PROFILE_A_APP_ID                          0
-#define PROFILE_B_APP_ID                          1
-#define PROFILE_C_APP_ID                          2
-#define PROFILE_D_APP_ID                          3
+#define PROFILE_A_APP_ID                          0      // Also gets the link events, see esp_gattc_cb()
+#define PROFILE_NONE                              0xff   // Not routed to any profile
 #define ADV_CONFIG_FLAG                           (1 << 0)
 #define SCAN_RSP_CONFIG_FLAG                      (1 << 1)
 #define MESSAGE_BUFFER_STORAGE_SIZE               8192
 
-#define MAX_NOTIF_ATTR_SIZE                       511
-
 static uint8_t adv_config_done = 0;
 
 static bool ble_already_init = false;
@@ -69,7 +72,8 @@ static const esp_bt_uuid_t data_source_char_uuid = {
     .uuid.uuid128 = {0xfb, 0x7b, 0x7c, 0xce, 0x6a, 0xb3, 0x44, 0xbe, 0xb5, 0x4b, 0xd6, 0x24, 0xe9, 0xc6, 0xea, 0x22}
 };
 
-static void gattc_profile_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param);
+static void gattc_profile_event_handler(uint8_t idx, esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param);
+static void gattc_link_event_handler(esp_gattc_cb_event_t event, esp_ble_gattc_cb_param_t *param);
 
 static esp_bt_uuid_t anc_service_uuid = {
     .len = ESP_UUID_LEN_128,
@@ -91,6 +95,16 @@ static const esp_bt_uuid_t appearance_char_uuid = {
     .uuid.uuid16 = BLE_SVC_GAP_CHR_UUID16_APPEARANCE
 };
 
+static const esp_bt_uuid_t gatt_service_uuid = {
+    .len = ESP_UUID_LEN_16,
+    .uuid.uuid16 = BLE_SVC_GATT_UUID16
+};
+
+static const esp_bt_uuid_t service_changed_char_uuid = {
+    .len = ESP_UUID_LEN_16,
+    .uuid.uuid16 = BLE_SVC_GATT_CHR_UUID16_SERVICE_CHANGED
+};
+
 static uint8_t hidd_service_uuid128[] = {
     /* LSB <--------------------------------------------------------------------------------> MSB */
     //first uuid, 16bit, [12],[13] is the value
@@ -116,6 +130,7 @@ static esp_ble_adv_data_t scan_rsp_config = {
     .p_manufacturer_data = NULL,
 };
 
+// Intervals and filter policy set by ble_adv_policy for the phase
 static esp_ble_adv_params_t adv_params = {
     .adv_int_min        = 0x100,
     .adv_int_max        = 0x100,
@@ -125,8 +140,24 @@ static esp_ble_adv_params_t adv_params = {
     .adv_filter_policy = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY,
 };
 
+// Notification attribute requests plus one Get App Attributes request
+#define ANCS_REQUEST_SLOTS (ANCS_PIPELINE_DEPTH + 1)
+
+// Command written to the Control Point, response not complete yet
+typedef struct {
+    bool used;
+    bool acked;         // Write response received
+    uint8_t command_id; // BLE_ANCS_COMMAND_ID_GET_NOTIF_ATTRIBUTES or BLE_ANCS_COMMAND_ID_GET_APP_ATTRIBUTES
+    uint32_t uid;       // Notification attributes only, the app identifier is app_request_id
+    uint32_t seq;       // Order of the writes, their write responses come back in the same order
+    int64_t sent;       // Claimed, right before the write
+    int64_t deadline;
+    const ancs_attr_frame_t *frame;                     // Notification attributes requested
+    uint8_t *attr_data[BLE_ANCS_NB_OF_NOTIF_ATTR];      // Where the parser puts each of them
+    uint16_t attr_len[BLE_ANCS_NB_OF_NOTIF_ATTR];
+} ancs_request_t;
+
 struct gattc_profile_inst {
-    esp_gattc_cb_t gattc_cb;
     uint16_t gattc_if;
     uint16_t conn_id;
     struct {
@@ -137,6 +168,8 @@ struct gattc_profile_inst {
         esp_gattc_char_elem_t notification_source_char_elem;
         esp_gattc_char_elem_t data_source_char_elem;
         esp_gattc_char_elem_t control_point_char_elem;
+        uint16_t notification_source_cccd;
+        uint16_t data_source_cccd;
     } anc;
     struct {
         uint16_t service_start_handle;
@@ -146,20 +179,105 @@ struct gattc_profile_inst {
         esp_gattc_char_elem_t device_name_elem;
         esp_gattc_char_elem_t appearance_elem;
     } gap;
+    struct {
+        uint16_t service_start_handle;
+        uint16_t service_end_handle;
+        bool service_found;
+
+        esp_gattc_char_elem_t service_changed_elem;
+        uint16_t service_changed_cccd;
+    } gatt;
     esp_bd_addr_t remote_bda;
-    uint16_t MTU_size;
 
     ble_ancs_c_t ble_ancs_inst;
 
     uint8_t attr_buffer[MAX_NOTIF_ATTR_SIZE];
     uint8_t device_name[64]; // Must be <= MAX_NOTIF_ATTR_SIZE
 
-    esp_timer_handle_t timer;
+    // Written by the sender task, completed by the BT task or the timer, see requests_lock
+    ancs_request_t requests[ANCS_REQUEST_SLOTS];
+    uint32_t request_seq;
+    char app_request_id[BLE_ANCS_APP_ID_MAX];
+    uint8_t app_name[64];
+    bool resync;              // Out of step with the responses, see ancs_response_expected()
+    ancs_request_t parse_request; // Whose response the parser is in, see ancs_parser_detach()
+    bool parse_attached;
+    bool parsing;             // The BT task is inside a Data Source packet
+    bool parse_timed_out;     // The attached request expired meanwhile, reported after the packet
+    esp_timer_handle_t timer; // Earliest deadline of the requests
 
     uint16_t appearance;
+
+    // Connection setup on the BT task, see ancs_setup_start()
+    ble_gatt_ops_t ops;       // Reads and CCCD writes of the setup
+    ble_handle_cache_t cache; // As loaded or last saved, version 0 if there is none
+    bool mtu_done;
+    bool setup_started;
+    bool discovering;
+    uint8_t subscribed;       // SUBSCRIBED_* bits of the CCCDs written
+    ancs_setup_times_t setup;
+    ancs_link_info_t link;    // MTU and data length, see ancs_mtu_done() and ancs_dle_next()
+    ble_conn_ctrl_t conn;     // Connection parameters, following the backlog of the Dispatcher
+    struct {
+        int64_t at;
+        uint32_t ns_notifs;
+        uint32_t ds_notifs;
+        uint32_t ds_bytes;
+    } rate_base;              // Counters at the previous telemetry tick
 };
 
+#define SUBSCRIBED_NOTIFICATION_SOURCE  (1 << 0)
+#define SUBSCRIBED_DATA_SOURCE          (1 << 1)
+#define SUBSCRIBED_ALL                  (SUBSCRIBED_NOTIFICATION_SOURCE | SUBSCRIBED_DATA_SOURCE)
+
 static struct gattc_profile_inst gl_profile_tab[ANCS_PROFILE_NUM];
+static portMUX_TYPE requests_lock = portMUX_INITIALIZER_UNLOCKED;
+static ancs_setup_stats_t setup_stats;
+
+// Event routing, gattc_if and conn_id (the link index in Bluedroid) both fit a byte
+static uint8_t profile_by_if[256];
+static uint8_t profile_by_conn[256];
+static uint32_t free_profiles;  // Bit per profile not bound to a link
+_Static_assert(ANCS_PROFILE_NUM < 32, "Profile bits must fit free_profiles");
+
+// Data Length Extension requests go one at a time, their completion does not tell the link
+static bool dle_busy;
+static esp_bd_addr_t dle_bda;
+
+// Link telemetry, RSSI reads go one at a time through the links of a round like DLE requests
+static esp_timer_handle_t telemetry_timer;
+static portMUX_TYPE telemetry_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t rssi_pending;   // Bit per profile still to read this round
+static bool rssi_busy;
+static int64_t rssi_issued_at;
+static esp_bd_addr_t rssi_bda;
+
+static ancs_request_t *ancs_request_find(uint32_t idx, uint8_t command_id, uint32_t uid);
+static ancs_request_t *ancs_request_claim(uint32_t idx, uint8_t command_id);
+static bool ancs_request_pending(uint32_t idx);
+static bool ancs_response_expected(uint32_t idx, const ancs_request_t *r);
+static void ancs_request_arm_timer(uint32_t idx);
+static void ancs_request_timed_out(uint32_t idx, const ancs_request_t *r);
+static void ancs_parser_detach(uint32_t idx);
+static bool ancs_write_request(uint8_t idx, ancs_request_t *r, uint32_t seq, uint8_t *data, uint32_t len);
+
+static int ancs_profile_by_bda(const uint8_t *bda);
+static void ancs_setup_reset(int idx);
+static void ancs_setup_start(int idx);
+static void ancs_setup_from_cache(int idx);
+static void ancs_setup_done(int idx);
+static void ancs_setup_abort(int idx, const char *why);
+static void ancs_gatt_op_given_up(void *ctx, const ble_gatt_op_t *op);
+static void ancs_discover(int idx);
+static bool ancs_find_char(int idx, uint16_t start, uint16_t end, esp_bt_uuid_t uuid, esp_gatt_char_prop_t props, esp_gattc_char_elem_t *elem);
+static void ancs_subscribe(int idx);
+static uint16_t *ancs_cccd_of(int idx, uint16_t char_handle);
+static void ancs_cache_update(int idx);
+static void ancs_cache_invalidate(int idx);
+static void ancs_services_changed(int idx);
+static void ancs_mtu_done(int idx, uint16_t mtu, bool refused);
+static void ancs_dle_next(void);
+static void ancs_rssi_next(void);
 
 typedef enum {
     Unknown_command   = (0xA0), //The commandID was not recognized by the NP.
@@ -200,13 +318,13 @@ static void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param
     case ESP_GAP_BLE_SCAN_RSP_DATA_SET_COMPLETE_EVT:
         adv_config_done &= (~SCAN_RSP_CONFIG_FLAG);
         if (adv_config_done == 0) {
-            esp_ble_gap_start_advertising(&adv_params);
+            ble_adv_policy_start();
         }
         break;
     case ESP_GAP_BLE_ADV_DATA_SET_COMPLETE_EVT:
         adv_config_done &= (~ADV_CONFIG_FLAG);
         if (adv_config_done == 0) {
-            esp_ble_gap_start_advertising(&adv_params);
+            ble_adv_policy_start();
         }
         break;
     case ESP_GAP_BLE_ADV_START_COMPLETE_EVT:
@@ -249,8 +367,30 @@ static void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param
         if (!param->ble_security.auth_cmpl.success) {
             ESP_LOGE(TAG, "fail reason = 0x%x",param->ble_security.auth_cmpl.fail_reason);
         }
+
+        // Encryption lets CCCD writes through, a lost bond takes the cached handles along
+        int idx = ancs_profile_by_bda(param->ble_security.auth_cmpl.bd_addr);
+        if (idx >= 0) {
+            struct gattc_profile_inst *p = &gl_profile_tab[idx];
+            if (param->ble_security.auth_cmpl.success) {
+                p->setup.encrypted = esp_timer_get_time();
+                ble_adv_policy_bonds_changed(); // May be a new bond
+                if (p->setup_started && !p->discovering && p->subscribed != SUBSCRIBED_ALL) {
+                    ancs_subscribe(idx); // CCCD writes refused before encryption
+                }
+            } else {
+                ancs_cache_invalidate(idx);
+            }
+        }
         break;
     }
+    case ESP_GAP_BLE_REMOVE_BOND_DEV_COMPLETE_EVT:
+        if (param->remove_bond_dev_cmpl.status == ESP_BT_STATUS_SUCCESS) {
+            ble_adv_policy_bonds_changed();
+            ble_handle_cache_erase(param->remove_bond_dev_cmpl.bd_addr);
+            if (handlers.bond_removed) handlers.bond_removed(context, param->remove_bond_dev_cmpl.bd_addr);
+        }
+        break;
     case ESP_GAP_BLE_SET_LOCAL_PRIVACY_COMPLETE_EVT:
         if (param->local_privacy_cmpl.status != ESP_BT_STATUS_SUCCESS) {
             ESP_LOGE(TAG, "config local privacy failed, error status = %x", param->local_privacy_cmpl.status);
@@ -272,37 +412,66 @@ static void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param
         }
 
         break;
-    case ESP_GAP_BLE_READ_RSSI_COMPLETE_EVT:
+    case ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT: {
+        dle_busy = false;
+        int idx = ancs_profile_by_bda(dle_bda);
+        if (idx >= 0 && gl_profile_tab[idx].link.dle_state == ANCS_NEGOTIATION_PENDING) {
+            ancs_link_info_t *link = &gl_profile_tab[idx].link;
+            if (param->pkt_data_length_cmpl.status != ESP_BT_STATUS_SUCCESS) {
+                ESP_LOGW(TAG, "Data length [%d] refused, status %x, staying at %d", idx, param->pkt_data_length_cmpl.status, ANCS_DEFAULT_DATA_LEN);
+                link->dle_state = ANCS_NEGOTIATION_REFUSED;
+                setup_stats.dle_refused ++;
+            } else {
+                link->tx_octets = param->pkt_data_length_cmpl.params.tx_len;
+                link->rx_octets = param->pkt_data_length_cmpl.params.rx_len;
+                link->dle_state = ANCS_NEGOTIATION_DONE;
+                ESP_LOGI(TAG, "Data length [%d] tx %u, rx %u", idx, link->tx_octets, link->rx_octets);
+            }
+        }
+        ancs_dle_next();
+        break;
+    }
+    case ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT: {
+        bool ok = (param->update_conn_params.status == ESP_BT_STATUS_SUCCESS);
+        ESP_LOGD(TAG, "Connection parameters: status %x, interval %u, latency %u, timeout %u", param->update_conn_params.status,
+                 param->update_conn_params.conn_int, param->update_conn_params.latency, param->update_conn_params.timeout);
+        int idx = ancs_profile_by_bda(param->update_conn_params.bda);
+        if (idx >= 0) {
+            ble_conn_ctrl_updated(&gl_profile_tab[idx].conn, ok, param->update_conn_params.conn_int,
+                                  param->update_conn_params.latency, param->update_conn_params.timeout);
+        }
+        break;
+    }
+    case ESP_GAP_BLE_READ_RSSI_COMPLETE_EVT: {
+        portENTER_CRITICAL(&telemetry_lock);
+        rssi_busy = false;
+        portEXIT_CRITICAL(&telemetry_lock);
+
+        int idx = ancs_profile_by_bda(param->read_rssi_cmpl.remote_addr);
         if (param->read_rssi_cmpl.status != ESP_BT_STATUS_SUCCESS) {
             ESP_LOGE(TAG, "read RSSI failed, error status = %x", param->read_rssi_cmpl.status);
-            break;
+        } else if (idx >= 0) {
+            ESP_LOGV(TAG, "RSSI [%d] = %d", idx, param->read_rssi_cmpl.rssi);
+            gl_profile_tab[idx].link.rssi = param->read_rssi_cmpl.rssi;
+            gl_profile_tab[idx].link.rssi_at = esp_timer_get_time();
         }
-        ESP_LOGI(TAG, "RSSI = %d", param->read_rssi_cmpl.rssi);
+        ancs_rssi_next();
         break;
+    }
     default:
         break;
     }
 }
 
-static void gattc_profile_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param)
+static void gattc_profile_event_handler(uint8_t idx, esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param)
 {
-    // Get profile by GATT if number
-    int idx;
-    for (idx = 0; idx < ANCS_PROFILE_NUM; idx++) {
-        if (gattc_if == gl_profile_tab[idx].gattc_if) {
-            break;
-        }
-    }
-
-    ESP_ERROR_CHECK(idx == ANCS_PROFILE_NUM);
-
     ESP_LOGV(TAG, "GATT_EVT[%u], event %d", idx, event);
 
     switch (event) {
     case ESP_GATTC_REG_EVT:
         ESP_LOGV(TAG, "REG_EVT: AppId=%u GattcIf=%u", param->reg.app_id, gattc_if);
 
-        if (gattc_if == gl_profile_tab[PROFILE_A_APP_ID].gattc_if) { // Run only once
+        if (idx == PROFILE_A_APP_ID) { // Run only once
             esp_ble_gap_set_device_name(DEVICE_NAME);
             esp_ble_gap_config_local_icon (ESP_BLE_APPEARANCE_GENERIC_WATCH);
             // generate a resolvable random address
@@ -318,21 +487,24 @@ static void gattc_profile_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_
         }
         ESP_LOGV(TAG, "ESP_GATTC_OPEN_EVT conn_id=%u", param->open.conn_id);
         gl_profile_tab[idx].conn_id = param->open.conn_id;
+        gl_profile_tab[idx].setup.open = esp_timer_get_time();
+        ble_gatt_ops_bind(&gl_profile_tab[idx].ops, gattc_if, param->open.conn_id);
+        ble_gatt_ops_hold(&gl_profile_tab[idx].ops, true); // GAP reads go after the subscriptions
         esp_ble_set_encryption(param->open.remote_bda, ESP_BLE_SEC_ENCRYPT_MITM);
         esp_err_t mtu_ret = esp_ble_gattc_send_mtu_req (gattc_if, param->open.conn_id);
         if (mtu_ret) {
             ESP_LOGE(TAG, "config MTU error, error code = %x", mtu_ret);
+            ancs_mtu_done(idx, ANCS_DEFAULT_MTU, true); // No CFG_MTU_EVT follows
         }
         break;
     case ESP_GATTC_CFG_MTU_EVT:
+        ESP_LOGV(TAG, "ESP_GATTC_CFG_MTU_EVT, Status %d, MTU %d, conn_id %d", param->cfg_mtu.status, param->cfg_mtu.mtu, param->cfg_mtu.conn_id);
         if (param->cfg_mtu.status != ESP_GATT_OK) {
-            ESP_LOGE(TAG,"config mtu failed, error status = %x", param->cfg_mtu.status);
+            ESP_LOGW(TAG, "MTU exchange [%d] refused, status %x, staying at %d", idx, param->cfg_mtu.status, ANCS_DEFAULT_MTU);
+            ancs_mtu_done(idx, ANCS_DEFAULT_MTU, true);
+        } else {
+            ancs_mtu_done(idx, param->cfg_mtu.mtu, false);
         }
-        ESP_LOGV(TAG, "ESP_GATTC_CFG_MTU_EVT, Status %d, MTU %d, conn_id %d", param->cfg_mtu.status, param->cfg_mtu.mtu, param->cfg_mtu.conn_id);
-        gl_profile_tab[idx].MTU_size = param->cfg_mtu.mtu;
-        // memcpy(anc_service_uuid.uuid.uuid128, Apple_NC_UUID, 16);
-        // esp_ble_gattc_search_service(gl_profile_tab[idx].gattc_if, gl_profile_tab[idx].conn_id, &apple_nc_uuid);
-        esp_ble_gattc_search_service(gl_profile_tab[idx].gattc_if, gl_profile_tab[idx].conn_id, NULL);
         break;
     case ESP_GATTC_SEARCH_RES_EVT: {
         // ESP_LOGD(TAG, "ESP_GATTC_SEARCH_RES_EVT len=%u", param->search_res.srvc_id.uuid.len);
@@ -360,128 +532,73 @@ static void gattc_profile_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_
             gl_profile_tab[idx].gap.service_end_handle = param->search_res.end_handle;
             gl_profile_tab[idx].gap.service_found = true;
             ESP_LOGI(TAG, "Found GAP service");
+        } else if (memcmp (&param->search_res.srvc_id.uuid, &gatt_service_uuid, sizeof(gatt_service_uuid)) == 0) {
+            gl_profile_tab[idx].gatt.service_start_handle = param->search_res.start_handle;
+            gl_profile_tab[idx].gatt.service_end_handle = param->search_res.end_handle;
+            gl_profile_tab[idx].gatt.service_found = true;
+            ESP_LOGI(TAG, "Found GATT service");
         }
         break;
     }
-    case ESP_GATTC_SEARCH_CMPL_EVT:
+    case ESP_GATTC_SEARCH_CMPL_EVT: {
         ESP_LOGV(TAG, "ESP_GATTC_SEARCH_CMPL_EVT");
+        struct gattc_profile_inst *p = &gl_profile_tab[idx];
+        p->discovering = false;
 
         if (param->search_cmpl.status != ESP_GATT_OK) {
             ESP_LOGE(TAG, "search service failed, error status = %x", param->search_cmpl.status);
+            ble_gatt_ops_hold(&p->ops, false);
             break;
         }
 
-        if (gl_profile_tab[idx].gap.service_found) {
-            esp_gatt_status_t ret_status = ble_utils_get_char (
-                gattc_if,
-                gl_profile_tab[idx].conn_id,
-                gl_profile_tab[idx].gap.service_start_handle,
-                gl_profile_tab[idx].gap.service_end_handle,
-                device_name_char_uuid,
-                ESP_GATT_CHAR_PROP_BIT_READ,
-                &gl_profile_tab[idx].gap.device_name_elem
-            );
-            if (ret_status != ESP_GATT_OK) {
-                ESP_LOGE(TAG, "ble_utils_get_char_handle error, %d", __LINE__);
-                goto gap_done;
+        // Queued behind the subscriptions, they are not needed to get notifications
+        if (p->gap.service_found) {
+            if (ancs_find_char(idx, p->gap.service_start_handle, p->gap.service_end_handle, device_name_char_uuid,
+                               ESP_GATT_CHAR_PROP_BIT_READ, &p->gap.device_name_elem) &&
+                !ble_gatt_ops_read(&p->ops, p->gap.device_name_elem.char_handle, false)) {
+                ESP_LOGW(TAG, "Device name of [%d] left to the next connection", idx);
             }
-            ret_status = esp_ble_gattc_read_char(
-                gattc_if,
-                gl_profile_tab[idx].conn_id,
-                gl_profile_tab[idx].gap.device_name_elem.char_handle,
-                ESP_GATT_AUTH_REQ_NONE
-            );
-            if (ret_status != ESP_GATT_OK) {
-                ESP_LOGE(TAG, "esp_ble_gattc_read_char error, %d", __LINE__);
-                goto gap_done;
+            if (ancs_find_char(idx, p->gap.service_start_handle, p->gap.service_end_handle, appearance_char_uuid,
+                               ESP_GATT_CHAR_PROP_BIT_READ, &p->gap.appearance_elem) &&
+                !ble_gatt_ops_read(&p->ops, p->gap.appearance_elem.char_handle, false)) {
+                ESP_LOGW(TAG, "Appearance of [%d] left to the next connection", idx);
             }
+        }
 
-            ret_status = ble_utils_get_char (gattc_if,
-                                              gl_profile_tab[idx].conn_id,
-                                              gl_profile_tab[idx].gap.service_start_handle,
-                                              gl_profile_tab[idx].gap.service_end_handle,
-                                              appearance_char_uuid,
-                                              ESP_GATT_CHAR_PROP_BIT_READ,
-                                              &gl_profile_tab[idx].gap.appearance_elem);
-            if (ret_status != ESP_GATT_OK) {
-                ESP_LOGE(TAG, "ble_utils_get_char_handle error, %d", __LINE__);
-                goto gap_done;
-            }
-            ret_status = esp_ble_gattc_read_char(
-                gattc_if,
-                gl_profile_tab[idx].conn_id,
-                gl_profile_tab[idx].gap.appearance_elem.char_handle,
-                ESP_GATT_AUTH_REQ_NONE
-            );
-            if (ret_status != ESP_GATT_OK) {
-                ESP_LOGE(TAG, "esp_ble_gattc_read_char error, %d", __LINE__);
-                goto gap_done;
-            }
-            gap_done:
+        if (p->gatt.service_found) {
+            ancs_find_char(idx, p->gatt.service_start_handle, p->gatt.service_end_handle, service_changed_char_uuid,
+                           ESP_GATT_CHAR_PROP_BIT_INDICATE, &p->gatt.service_changed_elem);
         }
 
-        if (gl_profile_tab[idx].anc.service_found) {
-            esp_gatt_status_t ret_status = ble_utils_get_char (
-                gattc_if,
-                gl_profile_tab[idx].conn_id,
-                gl_profile_tab[idx].anc.service_start_handle,
-                gl_profile_tab[idx].anc.service_end_handle,
-                notification_source_char_uuid,
-                ESP_GATT_CHAR_PROP_BIT_NOTIFY,
-                &gl_profile_tab[idx].anc.notification_source_char_elem
-            );
-            if (ret_status != ESP_GATT_OK) {
-                ESP_LOGE(TAG, "ble_utils_get_char_handle error, %d", __LINE__);
-                goto anc_done;
+        if (p->anc.service_found) {
+            if (ancs_find_char(idx, p->anc.service_start_handle, p->anc.service_end_handle, notification_source_char_uuid,
+                               ESP_GATT_CHAR_PROP_BIT_NOTIFY, &p->anc.notification_source_char_elem)) {
+                ESP_LOGI(TAG, "Found Apple notification source char");
             }
-            esp_ble_gattc_register_for_notify(
-                gattc_if,
-                gl_profile_tab[idx].remote_bda,
-                gl_profile_tab[idx].anc.notification_source_char_elem.char_handle
-            );
-            ESP_LOGI(TAG, "Found Apple notification source char");
-
-            ret_status = ble_utils_get_char (
-                gattc_if,
-                gl_profile_tab[idx].conn_id,
-                gl_profile_tab[idx].anc.service_start_handle,
-                gl_profile_tab[idx].anc.service_end_handle,
-                data_source_char_uuid,
-                ESP_GATT_CHAR_PROP_BIT_NOTIFY,
-                &gl_profile_tab[idx].anc.data_source_char_elem
-            );
-            if (ret_status != ESP_GATT_OK) {
-                ESP_LOGE(TAG, "ble_utils_get_char_handle error, %d", __LINE__);
-                goto anc_done;
+            if (ancs_find_char(idx, p->anc.service_start_handle, p->anc.service_end_handle, data_source_char_uuid,
+                               ESP_GATT_CHAR_PROP_BIT_NOTIFY, &p->anc.data_source_char_elem)) {
+                ESP_LOGI(TAG, "Found Apple data source char");
             }
-            esp_ble_gattc_register_for_notify(
-                gattc_if,
-                gl_profile_tab[idx].remote_bda,
-                gl_profile_tab[idx].anc.data_source_char_elem.char_handle
-            );
-            ESP_LOGI(TAG, "Found Apple data source char");
-
-            ret_status = ble_utils_get_char (
-                gattc_if,
-                gl_profile_tab[idx].conn_id,
-                gl_profile_tab[idx].anc.service_start_handle,
-                gl_profile_tab[idx].anc.service_end_handle,
-                control_point_char_uuid,
-                ESP_GATT_CHAR_PROP_BIT_WRITE,
-                &gl_profile_tab[idx].anc.control_point_char_elem
-            );
-            if (ret_status != ESP_GATT_OK) {
-                ESP_LOGE(TAG, "ble_utils_get_char_handle error, %d", __LINE__);
-                goto anc_done;
+            if (ancs_find_char(idx, p->anc.service_start_handle, p->anc.service_end_handle, control_point_char_uuid,
+                               ESP_GATT_CHAR_PROP_BIT_WRITE, &p->anc.control_point_char_elem)) {
+                ESP_LOGI(TAG, "Found Apple control point char");
             }
-            ESP_LOGI(TAG, "Found Apple control point char");
-
-            anc_done:
         }
 
+        if (p->setup.discovered == 0) {
+            p->setup.discovered = esp_timer_get_time();
+        }
+        if (p->anc.notification_source_char_elem.char_handle == 0 || p->anc.data_source_char_elem.char_handle == 0) {
+            ble_gatt_ops_hold(&p->ops, false); // Nothing to wait for
+        }
+        ancs_subscribe(idx);
         break;
+    }
 
     case ESP_GATTC_READ_CHAR_EVT:
+        if (!ble_gatt_ops_complete(&gl_profile_tab[idx].ops, BLE_GATT_OP_READ_CHAR, param->read.handle, param->read.status)) {
+            break; // Busy, read again
+        }
         if (param->read.status != ESP_GATT_OK) {
             ESP_LOGE(TAG, "ESP_GATTC_READ_CHAR_EVT status %d", param->reg_for_notify.status);
             break;
@@ -496,10 +613,15 @@ static void gattc_profile_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_
             gl_profile_tab[idx].device_name[len] = '\0';
 
             if (handlers.device_name) handlers.device_name(context, idx, (char *)gl_profile_tab[idx].device_name);
+            if (gl_profile_tab[idx].setup.gap_read == 0) {
+                gl_profile_tab[idx].setup.gap_read = esp_timer_get_time();
+            }
+            ancs_cache_update(idx);
 
         } else if (param->read.handle == gl_profile_tab[idx].gap.appearance_elem.char_handle) {
             // Store device appearance
             gl_profile_tab[idx].appearance = ((uint16_t)param->read.value[1] << 8) + param->read.value[0];
+            ancs_cache_update(idx);
         }
 
         ESP_LOGD(TAG, "Read char: %u bytes", param->read.value_len);
@@ -512,29 +634,33 @@ static void gattc_profile_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_
             break;
         }
 
-        esp_gattc_descr_elem_t descr_elem;
-        esp_gatt_status_t ret_status = ble_utils_get_descr (
-            gattc_if,
-            gl_profile_tab[idx].conn_id,
-            gl_profile_tab[idx].anc.service_start_handle,
-            gl_profile_tab[idx].anc.service_end_handle,
-            param->reg_for_notify.handle,
-            &descr_elem
-        );
-        if (ret_status != ESP_GATT_OK) {
-            ESP_LOGE(TAG, "ble_utils_get_descr error, %d", __LINE__);
+        uint16_t handle = param->reg_for_notify.handle;
+        uint16_t *cccd = ancs_cccd_of(idx, handle);
+        if (cccd == NULL) {
             break;
         }
-        uint8_t notify_en[2] = {0x01, 0x00};
-        esp_ble_gattc_write_char_descr (
-            gattc_if,
-            gl_profile_tab[idx].conn_id,
-            descr_elem.handle,
-            sizeof(notify_en),
-            (uint8_t *)&notify_en,
-            ESP_GATT_WRITE_TYPE_RSP,
-            ESP_GATT_AUTH_REQ_NONE
-        );
+        bool indicate = (handle == gl_profile_tab[idx].gatt.service_changed_elem.char_handle);
+        if (*cccd == 0) {
+            // Not cached, look it up in the service of the characteristic
+            esp_gattc_descr_elem_t descr_elem;
+            esp_gatt_status_t ret_status = ble_utils_get_descr (
+                gattc_if,
+                gl_profile_tab[idx].conn_id,
+                indicate ? gl_profile_tab[idx].gatt.service_start_handle : gl_profile_tab[idx].anc.service_start_handle,
+                indicate ? gl_profile_tab[idx].gatt.service_end_handle : gl_profile_tab[idx].anc.service_end_handle,
+                handle,
+                &descr_elem
+            );
+            if (ret_status != ESP_GATT_OK) {
+                ESP_LOGE(TAG, "ble_utils_get_descr error, %d", __LINE__);
+                break;
+            }
+            *cccd = descr_elem.handle;
+        }
+        uint8_t notify_en[2] = {indicate ? 0x02 : 0x01, 0x00};
+        if (!ble_gatt_ops_write_descr(&gl_profile_tab[idx].ops, *cccd, notify_en, sizeof(notify_en), true)) {
+            ancs_setup_abort(idx, "CCCD write not queued");
+        }
         break;
     }
 
@@ -543,129 +669,873 @@ static void gattc_profile_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_
         ESP_LOG_BUFFER_HEX_LEVEL(TAG, param->notify.value, param->notify.value_len, ESP_LOG_DEBUG);
 
         if (param->notify.handle == gl_profile_tab[idx].anc.notification_source_char_elem.char_handle) {
+            gl_profile_tab[idx].link.ns_notifs ++;
+            gl_profile_tab[idx].link.ns_bytes += param->notify.value_len;
+            ancs_setup_times_t *t = &gl_profile_tab[idx].setup;
+            if (t->first_notif == 0 && t->subscribed != 0) {
+                t->first_notif = esp_timer_get_time();
+                ancs_setup_path_t *path = t->cached ? &setup_stats.cached : &setup_stats.discovered;
+                path->first_notifs ++;
+                path->first_notif_total_us += t->first_notif - t->connect;
+                ESP_LOGI(TAG, "First notification [%d] %" PRId64 " ms after connect", idx, (t->first_notif - t->connect) / 1000);
+            }
             esp_err_t ret_status = ble_ancs_parse_notif(&gl_profile_tab[idx].ble_ancs_inst, param->notify.value, param->notify.value_len);
             if (ret_status != ESP_GATT_OK) {
                 ESP_LOGE(TAG, "ble_ancs_parse_notif failed, error status = %x", ret_status);
             }
         } else if (param->notify.handle == gl_profile_tab[idx].anc.data_source_char_elem.char_handle) {
-            ble_ancs_parse_get_attrs_response(&gl_profile_tab[idx].ble_ancs_inst, param->notify.value, param->notify.value_len);
+            ble_ancs_c_t *p_ancs = &gl_profile_tab[idx].ble_ancs_inst;
+            gl_profile_tab[idx].link.ds_notifs ++;
+            gl_profile_tab[idx].link.ds_bytes += param->notify.value_len;
+
+            // Responses come one after the other, a new one starts once the previous one is parsed.
+            // Out of step, every packet may start one until a response is recognized.
+            portENTER_CRITICAL(&requests_lock);
+            if (gl_profile_tab[idx].resync) {
+                p_ancs->parse_info.parse_state = BLE_ANCS_ATTR_DONE;
+            }
+            if (p_ancs->parse_info.parse_state == BLE_ANCS_ATTR_DONE && ancs_request_pending(idx)) {
+                p_ancs->parse_info.parse_state = BLE_ANCS_COMMAND_ID;
+            }
+            gl_profile_tab[idx].parsing = true;
+            portEXIT_CRITICAL(&requests_lock);
+
+            ble_ancs_parse_get_attrs_response(p_ancs, param->notify.value, param->notify.value_len);
+
+            // A request that expired during the packet gives its buffers back only now
+            ancs_request_t expired = gl_profile_tab[idx].parse_request;
+            portENTER_CRITICAL(&requests_lock);
+            gl_profile_tab[idx].parsing = false;
+            bool timed_out = gl_profile_tab[idx].parse_timed_out;
+            if (timed_out) {
+                ancs_parser_detach(idx);
+            }
+            portEXIT_CRITICAL(&requests_lock);
+            if (timed_out) {
+                ancs_request_timed_out(idx, &expired);
+            }
 
             /* Get other pending notifications */
-            if (ble_ancs_all_req_attrs_parsed(&gl_profile_tab[idx].ble_ancs_inst) &&
-                gl_profile_tab[idx].ble_ancs_inst.parse_info.parse_state == BLE_ANCS_ATTR_DONE) {
-                ESP_LOGD(TAG, "All attrs processed, uid=%" PRIu32, gl_profile_tab[idx].ble_ancs_inst.evt.notif_uid);
-
-                if (handlers.attributes_done) handlers.attributes_done(context, idx, gl_profile_tab[idx].ble_ancs_inst.evt.notif_uid);
+            if (ble_ancs_all_req_attrs_parsed(p_ancs) && p_ancs->parse_info.parse_state == BLE_ANCS_ATTR_DONE) {
+                uint8_t command_id = p_ancs->parse_info.command_id;
+                uint32_t uid = p_ancs->evt.notif_uid;
+                ESP_LOGD(TAG, "All attrs processed, command=%u uid=%" PRIu32, command_id, uid);
+
+                int64_t sent = 0;
+                portENTER_CRITICAL(&requests_lock);
+                ancs_request_t *r = gl_profile_tab[idx].parse_attached ? ancs_request_find(idx, command_id, uid) : NULL;
+                gl_profile_tab[idx].parse_attached = false;
+                if (r != NULL) {
+                    r->used = false;
+                    sent = r->sent;
+                    ancs_request_arm_timer(idx);
+                } else {
+                    gl_profile_tab[idx].resync = true;
+                }
+                portEXIT_CRITICAL(&requests_lock);
+
+                if (r == NULL) {
+                    // Late answer to a request that already timed out, or one never asked for
+                    ESP_LOGW(TAG, "Stale response, uid=%" PRIu32, uid);
+                    break;
+                }
+                if (command_id == BLE_ANCS_COMMAND_ID_GET_NOTIF_ATTRIBUTES) {
+                    ancs_link_info_t *link = &gl_profile_tab[idx].link;
+                    link->rtt_last_us = esp_timer_get_time() - sent;
+                    link->rtt_total_us += link->rtt_last_us;
+                    link->rtt_max_us = (link->rtt_last_us > link->rtt_max_us) ? link->rtt_last_us : link->rtt_max_us;
+                    link->rtt_count ++;
+                }
+                if (command_id == BLE_ANCS_COMMAND_ID_GET_APP_ATTRIBUTES) {
+                    if (handlers.app_name) handlers.app_name(context, idx, (const char *)gl_profile_tab[idx].app_name, ESP_GATT_OK);
+                } else {
+                    if (handlers.attributes_done) handlers.attributes_done(context, idx, uid);
+                }
+            } else if (p_ancs->parse_info.parse_state == BLE_ANCS_ATTR_DONE) {
+                // Gave up on a response, the rest of it may still come
+                portENTER_CRITICAL(&requests_lock);
+                gl_profile_tab[idx].resync = true;
+                portEXIT_CRITICAL(&requests_lock);
             } else {
                 ESP_LOGD(TAG, "Ignoring");
             }
 
+        } else if (param->notify.handle == gl_profile_tab[idx].gatt.service_changed_elem.char_handle) {
+            // Set up from cached handles the stack has no database to match the indication against
+            ancs_services_changed(idx);
         } else {
             ESP_LOGW(TAG, "Unknown RX notif handle");
         }
         break;
-    case ESP_GATTC_WRITE_DESCR_EVT:
+    case ESP_GATTC_WRITE_DESCR_EVT: {
+        struct gattc_profile_inst *p = &gl_profile_tab[idx];
+        if (!ble_gatt_ops_complete(&p->ops, BLE_GATT_OP_WRITE_DESCR, param->write.handle, param->write.status)) {
+            break; // Busy, written again
+        }
+        uint8_t bit = (param->write.handle == p->anc.notification_source_cccd) ? SUBSCRIBED_NOTIFICATION_SOURCE :
+                      (param->write.handle == p->anc.data_source_cccd) ? SUBSCRIBED_DATA_SOURCE : 0;
         if (param->write.status != ESP_GATT_OK) {
             ESP_LOGE(TAG, "Write descr failed, error status = %x", param->write.status);
+            bool refused = (param->write.status == ESP_GATT_INSUF_AUTHENTICATION ||
+                            param->write.status == ESP_GATT_INSUF_ENCRYPTION);
+            if (bit != 0 && p->setup.cached && !refused) {
+                // The phone changed its handles without the cache noticing
+                ancs_cache_invalidate(idx);
+                ancs_discover(idx);
+            }
             break;
         }
         ESP_LOGI(TAG, "Descriptor written successfully");
-        break;
-    case ESP_GATTC_SRVC_CHG_EVT: {
-        ESP_LOGD(TAG, "Service changed on BDA");
-        ESP_LOG_BUFFER_HEX_LEVEL(TAG, param->srvc_chg.remote_bda, 6, ESP_LOG_DEBUG);
+        p->subscribed |= bit;
+        if (bit != 0 && p->subscribed == SUBSCRIBED_ALL) {
+            ancs_setup_done(idx);
+        }
         break;
     }
-    case ESP_GATTC_WRITE_CHAR_EVT:
+    case ESP_GATTC_WRITE_CHAR_EVT: {
+        // Write responses come in the order of the writes, this one is for the oldest not acked yet
+        ancs_request_t *r = NULL;
+        uint32_t uid = 0;
+        uint8_t command_id = 0;
+        if (param->write.handle == gl_profile_tab[idx].anc.control_point_char_elem.char_handle) {
+            portENTER_CRITICAL(&requests_lock);
+            for (uint32_t i = 0; i < ANCS_REQUEST_SLOTS; i ++) {
+                ancs_request_t *c = &gl_profile_tab[idx].requests[i];
+                if (c->used && !c->acked && (r == NULL || (int32_t)(c->seq - r->seq) < 0)) {
+                    r = c;
+                }
+            }
+            if (r != NULL) {
+                r->acked = true;
+                uid = r->uid;
+                command_id = r->command_id;
+                if (param->write.status != ESP_GATT_OK) {
+                    r->used = false; // No response is coming
+                    ancs_request_arm_timer(idx);
+                }
+            }
+            portEXIT_CRITICAL(&requests_lock);
+        }
+
         if (param->write.status != ESP_GATT_OK) {
             char *Errstr = Errcode_to_String(param->write.status);
             if (Errstr) {
                  ESP_LOGE(TAG, "Write control point error %s", Errstr);
             }
+            // Let the owner of the request decide what next
+            if (r != NULL && command_id == BLE_ANCS_COMMAND_ID_GET_APP_ATTRIBUTES) {
+                if (handlers.app_name) handlers.app_name(context, idx, NULL, param->write.status);
+            } else if (r != NULL) {
+                if (handlers.request_error) handlers.request_error(context, idx, uid, param->write.status);
+            }
             break;
         }
         ESP_LOGI(TAG, "Write char successful");
         break;
-    case ESP_GATTC_DISCONNECT_EVT:
-        // Every profile gets this notification
-        ESP_LOGV(TAG, "ESP_GATTC_DISCONNECT_EVT reason=0x%x", param->disconnect.reason);
+    }
+    case ESP_GATTC_DIS_SRVC_CMPL_EVT:
+        ESP_LOGV(TAG, "ESP_GATTC_DIS_SRVC_CMPL_EVT");
+        break;
+    default:
+        break;
+    }
+}
 
-        if (memcmp(gl_profile_tab[idx].remote_bda, param->disconnect.remote_bda, 6) != 0) {
+/**@brief Connect, disconnect and Service Changed, which Bluedroid reports to every registered app.
+ *
+ * @details Handled once, for the first app. A new link is bound to a free profile through
+ *          profile_by_conn, the app of that profile then opens the GATT connection and gets the
+ *          rest of its events.
+ */
+static void gattc_link_event_handler(esp_gattc_cb_event_t event, esp_ble_gattc_cb_param_t *param)
+{
+    switch (event) {
+    case ESP_GATTC_CONNECT_EVT: {
+        ESP_LOGV(TAG, "ESP_GATTC_CONNECT_EVT conn_id=%u", param->connect.conn_id);
+
+        ble_adv_policy_connected(param->connect.remote_bda); // Advertising restart
+
+        uint16_t conn_id = param->connect.conn_id;
+        if (conn_id >= sizeof(profile_by_conn) || profile_by_conn[conn_id] != PROFILE_NONE) {
+            break; // This link is already being handled
+        }
+        if (free_profiles == 0) {
+            ESP_LOGW(TAG, "All %d profiles in use, link not served", ANCS_PROFILE_NUM);
             break;
         }
+        uint8_t idx = __builtin_ctz(free_profiles);
+        free_profiles &= ~(1u << idx);
+        profile_by_conn[conn_id] = idx;
+
+        ESP_LOGV(TAG, "Binding BDA to profile %d", idx);
+        ESP_LOG_BUFFER_HEX_LEVEL(TAG, param->connect.remote_bda, 6, ESP_LOG_VERBOSE);
+
+        memcpy(gl_profile_tab[idx].remote_bda, param->connect.remote_bda, 6);
+        gl_profile_tab[idx].conn_id = conn_id;
+        ancs_setup_reset(idx);
+        gl_profile_tab[idx].setup.connect = esp_timer_get_time();
+        if (ble_handle_cache_load(gl_profile_tab[idx].remote_bda, &gl_profile_tab[idx].cache) != ESP_OK) {
+            memset(&gl_profile_tab[idx].cache, 0, sizeof(gl_profile_tab[idx].cache)); // Discovered on MTU exchange
+        }
+
+        ancs_dle_next();
+        ble_conn_ctrl_start(&gl_profile_tab[idx].conn, param->connect.remote_bda, param->connect.conn_params.interval,
+                            param->connect.conn_params.latency, param->connect.conn_params.timeout);
+
+        if (handlers.connect) handlers.connect(context, idx, param->connect.remote_bda);
+
+        // create gattc virtual connection
+        esp_ble_gattc_open(gl_profile_tab[idx].gattc_if, gl_profile_tab[idx].remote_bda, BLE_ADDR_TYPE_RANDOM, true);
+        break;
+    }
+    case ESP_GATTC_DISCONNECT_EVT: {
+        ESP_LOGV(TAG, "ESP_GATTC_DISCONNECT_EVT reason=0x%x", param->disconnect.reason);
+
+        uint16_t conn_id = param->disconnect.conn_id;
+        if (conn_id >= sizeof(profile_by_conn) || profile_by_conn[conn_id] == PROFILE_NONE) {
+            break; // Link was never bound
+        }
+        uint8_t idx = profile_by_conn[conn_id];
+        profile_by_conn[conn_id] = PROFILE_NONE;
+        free_profiles |= 1u << idx;
 
         if (handlers.disconnect) handlers.disconnect(context, idx);
 
-        ESP_LOGV(TAG, "Disconnecting this profile");
-        gl_profile_tab[idx].anc.service_found = false;
-        gl_profile_tab[idx].gap.service_found = false;
+        ESP_LOGV(TAG, "Disconnecting profile %d", idx);
+        ble_gatt_ops_reset(&gl_profile_tab[idx].ops);
+        ble_conn_ctrl_stop(&gl_profile_tab[idx].conn);
+        ble_adv_policy_disconnected(gl_profile_tab[idx].remote_bda);
+        ancs_setup_reset(idx);
         memset(gl_profile_tab[idx].remote_bda, 0, sizeof(gl_profile_tab[idx].remote_bda));
 
-        // esp_timer_stop(gl_profile_tab[idx].timer);
+        portENTER_CRITICAL(&requests_lock);
+        // The next link starts without a response in progress
+        memset(gl_profile_tab[idx].requests, 0, sizeof(gl_profile_tab[idx].requests));
+        ancs_parser_detach(idx);
+        gl_profile_tab[idx].ble_ancs_inst.parse_info.parse_state = BLE_ANCS_ATTR_DONE;
+        gl_profile_tab[idx].resync = false;
+        ancs_request_arm_timer(idx);
+        portEXIT_CRITICAL(&requests_lock);
+        break;
+    }
+    case ESP_GATTC_SRVC_CHG_EVT: {
+        ESP_LOGD(TAG, "Service changed on BDA");
+        ESP_LOG_BUFFER_HEX_LEVEL(TAG, param->srvc_chg.remote_bda, 6, ESP_LOG_DEBUG);
+        int idx = ancs_profile_by_bda(param->srvc_chg.remote_bda);
+        if (idx >= 0) {
+            ancs_services_changed(idx);
+        } else {
+            ble_handle_cache_erase(param->srvc_chg.remote_bda); // Not connected, its next connection discovers
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
 
-        // must already be enabled
-        // esp_ble_gap_start_advertising(&adv_params);
+static void ancs_timer_cb(void *ctx)
+{
+    uint32_t idx = (uint32_t)ctx;
+    struct gattc_profile_inst *p = &gl_profile_tab[idx];
+    ancs_request_t expired[ANCS_REQUEST_SLOTS];
+    uint32_t n = 0;
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&requests_lock);
+    for (uint32_t i = 0; i < ANCS_REQUEST_SLOTS; i ++) {
+        ancs_request_t *r = &p->requests[i];
+        if (r->used && r->deadline <= now) {
+            r->used = false;
+            p->resync = true;
+            if (p->parse_attached && p->parse_request.seq == r->seq) {
+                if (p->parsing) {
+                    p->parse_timed_out = true; // Buffers in use on the BT task until the end of its packet
+                    continue;
+                }
+                ancs_parser_detach(idx);
+            }
+            expired[n ++] = *r;
+        }
+    }
+    ancs_request_arm_timer(idx);
+    portEXIT_CRITICAL(&requests_lock);
 
-        break;
-    case ESP_GATTC_CONNECT_EVT:
-        // Every profile gets this notification
-        ESP_LOGV(TAG, "ESP_GATTC_CONNECT_EVT");
+    for (uint32_t i = 0; i < n; i ++) {
+        ancs_request_timed_out(idx, &expired[i]);
+    }
+}
+
+// Owner of a request told it ended without a response, once the parser let go of its buffers
+static void ancs_request_timed_out(uint32_t idx, const ancs_request_t *r)
+{
+    if (r->command_id == BLE_ANCS_COMMAND_ID_GET_APP_ATTRIBUTES) {
+        ESP_LOGW(TAG, "App attrs request timeout [%" PRIu32 "]", idx);
+        if (handlers.app_name) handlers.app_name(context, idx, NULL, ANCS_STATUS_TIMEOUT);
+    } else {
+        ESP_LOGW(TAG, "Attrs request timeout [%" PRIu32 "], uid=%" PRIu32, idx, r->uid);
+        gl_profile_tab[idx].link.rtt_timeouts ++;
+        if (handlers.request_error) handlers.request_error(context, idx, r->uid, ANCS_STATUS_TIMEOUT);
+    }
+}
+
+// The parser drops the buffers of the request it was parsing the response of, and that response
+// with them. Call with requests_lock held, never while the BT task parses.
+static void ancs_parser_detach(uint32_t idx)
+{
+    ble_ancs_c_t *p_ancs = &gl_profile_tab[idx].ble_ancs_inst;
+    if (gl_profile_tab[idx].parse_attached) {
+        p_ancs->parse_info.parse_state = BLE_ANCS_ATTR_DONE;
+    }
+    for (uint32_t id = 0; id < BLE_ANCS_NB_OF_NOTIF_ATTR; id ++) {
+        p_ancs->ancs_notif_attr_list[id].attr_len = 0;
+        p_ancs->ancs_notif_attr_list[id].p_attr_data = NULL;
+    }
+    p_ancs->evt.attr.p_attr_data = NULL;
+    gl_profile_tab[idx].parse_attached = false;
+    gl_profile_tab[idx].parse_timed_out = false;
+}
 
-        if (idx == PROFILE_A_APP_ID) {
-            esp_err_t ret = esp_ble_gap_start_advertising(&adv_params);
-            ESP_LOGV(TAG, "Advertising restart: %x", ret);
+// Oldest outstanding request for the UID, or the app request, call with requests_lock held
+static ancs_request_t *ancs_request_find(uint32_t idx, uint8_t command_id, uint32_t uid)
+{
+    ancs_request_t *found = NULL;
+    for (uint32_t i = 0; i < ANCS_REQUEST_SLOTS; i ++) {
+        ancs_request_t *r = &gl_profile_tab[idx].requests[i];
+        if (r->used && r->command_id == command_id && (command_id == BLE_ANCS_COMMAND_ID_GET_APP_ATTRIBUTES || r->uid == uid) &&
+            (found == NULL || (int32_t)(r->seq - found->seq) < 0)) {
+            found = r;
         }
+    }
+    return found;
+}
 
-        bool handled = false;
-        for (int new_idx = 0; new_idx < ANCS_PROFILE_NUM; new_idx++) {
-            if (memcmp(gl_profile_tab[new_idx].remote_bda, param->connect.remote_bda, 6) == 0) {
-                handled = true;
-                break;
+// Free slot within the limit of the command, call with requests_lock held
+static ancs_request_t *ancs_request_claim(uint32_t idx, uint8_t command_id)
+{
+    uint32_t limit = (command_id == BLE_ANCS_COMMAND_ID_GET_APP_ATTRIBUTES) ? 1 : ANCS_PIPELINE_DEPTH;
+    ancs_request_t *free_slot = NULL;
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < ANCS_REQUEST_SLOTS; i ++) {
+        ancs_request_t *r = &gl_profile_tab[idx].requests[i];
+        if (r->used) {
+            n += (r->command_id == command_id) ? 1 : 0;
+        } else if (free_slot == NULL) {
+            free_slot = r;
+        }
+    }
+    if (n >= limit || free_slot == NULL) {
+        return NULL;
+    }
+
+    free_slot->used = true;
+    free_slot->acked = false;
+    free_slot->command_id = command_id;
+    free_slot->seq = gl_profile_tab[idx].request_seq ++;
+    free_slot->sent = esp_timer_get_time();
+    free_slot->deadline = free_slot->sent + CONFIG_NOWA_ATTR_TIMEOUT_MS * 1000LL;
+    return free_slot;
+}
+
+static bool ancs_request_pending(uint32_t idx)
+{
+    for (uint32_t i = 0; i < ANCS_REQUEST_SLOTS; i ++) {
+        if (gl_profile_tab[idx].requests[i].used) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**@brief Whether a header the parser found starts the response of r, call with requests_lock held.
+ *
+ * @details Once a request timed out or a response matched none, the rest of that response may still
+ *          come, and a packet of it that starts with a command ID and an outstanding UID would parse
+ *          as a header. Until a response is recognized again, only one for the oldest outstanding
+ *          request is, which phones answer first. A request answered out of order meanwhile times
+ *          out and is sent again.
+ */
+static bool ancs_response_expected(uint32_t idx, const ancs_request_t *r)
+{
+    struct gattc_profile_inst *p = &gl_profile_tab[idx];
+    if (r == NULL) {
+        p->resync = true;
+        return false;
+    }
+    if (p->resync) {
+        for (uint32_t i = 0; i < ANCS_REQUEST_SLOTS; i ++) {
+            const ancs_request_t *c = &p->requests[i];
+            if (c->used && (int32_t)(c->seq - r->seq) < 0) {
+                return false;
             }
         }
+        p->resync = false;
+    }
+    return true;
+}
 
-        if (handled) {
-            break; // This device is already being handled by new_idx profile
+// Timer follows the earliest deadline, call with requests_lock held so that a concurrent
+// re-arm cannot leave it stopped while a request is outstanding
+static void ancs_request_arm_timer(uint32_t idx)
+{
+    int64_t deadline = 0;
+    for (uint32_t i = 0; i < ANCS_REQUEST_SLOTS; i ++) {
+        const ancs_request_t *r = &gl_profile_tab[idx].requests[i];
+        if (r->used && (deadline == 0 || r->deadline < deadline)) {
+            deadline = r->deadline;
         }
+    }
+
+    esp_timer_stop(gl_profile_tab[idx].timer);
+    if (deadline != 0) {
+        int64_t delay = deadline - esp_timer_get_time();
+        esp_timer_start_once(gl_profile_tab[idx].timer, (delay > 0) ? delay : 1);
+    }
+}
 
-        if (memcmp(gl_profile_tab[idx].remote_bda, "\x00\x00\x00\x00\x00\x00", 6) != 0) {
-            break; // This profile is already in use
+static int ancs_profile_by_bda(const uint8_t *bda)
+{
+    for (int idx = 0; idx < ANCS_PROFILE_NUM; idx ++) {
+        if (memcmp(gl_profile_tab[idx].remote_bda, bda, 6) == 0) {
+            return idx;
         }
+    }
+    return -1;
+}
 
-        ESP_LOGV(TAG, "Binding BDA to profile %d", idx);
-        ESP_LOG_BUFFER_HEX_LEVEL(TAG, param->connect.remote_bda, 6, ESP_LOG_VERBOSE);
+// Per-connection setup state back to that of a new link
+static void ancs_setup_reset(int idx)
+{
+    struct gattc_profile_inst *p = &gl_profile_tab[idx];
+    memset(&p->anc, 0, sizeof(p->anc));
+    memset(&p->gap, 0, sizeof(p->gap));
+    memset(&p->gatt, 0, sizeof(p->gatt));
+    memset(&p->cache, 0, sizeof(p->cache));
+    memset(&p->setup, 0, sizeof(p->setup));
+    p->mtu_done = false;
+    p->setup_started = false;
+    p->discovering = false;
+    p->subscribed = 0;
+
+    memset(&p->link, 0, sizeof(p->link));
+    memset(&p->rate_base, 0, sizeof(p->rate_base));
+    p->link.mtu = ANCS_DEFAULT_MTU;
+    p->link.tx_octets = ANCS_DEFAULT_DATA_LEN;
+    p->link.rx_octets = ANCS_DEFAULT_DATA_LEN;
+    p->link.mtu_state = ANCS_NEGOTIATION_PENDING;
+    p->link.dle_state = ANCS_NEGOTIATION_PENDING;
+}
 
-        memcpy(gl_profile_tab[idx].remote_bda, param->connect.remote_bda, 6);
+/**@brief MTU of the link known, from the exchange or ANCS_DEFAULT_MTU when it failed.
+ *
+ * @details The parser takes whatever a notification carries, up to mtu - 3 bytes, so nothing
+ *          else depends on it. Setup goes on either way, a refused exchange only makes long
+ *          responses take more notifications.
+ */
+static void ancs_mtu_done(int idx, uint16_t mtu, bool refused)
+{
+    struct gattc_profile_inst *p = &gl_profile_tab[idx];
+    p->link.mtu = mtu;
+    p->link.mtu_state = refused ? ANCS_NEGOTIATION_REFUSED : ANCS_NEGOTIATION_DONE;
+    if (refused) {
+        setup_stats.mtu_refused ++;
+    } else {
+        ESP_LOGI(TAG, "MTU [%d] %u", idx, mtu);
+    }
+    p->setup.mtu = esp_timer_get_time();
+    p->mtu_done = true;
+    ancs_setup_start(idx);
+}
 
-        // esp_timer_start_periodic(gl_profile_tab[idx].timer, 100000ULL);
+// Read the RSSI of the next link of the round, if no read is in progress
+static void ancs_rssi_next(void)
+{
+    for (;;) {
+        esp_bd_addr_t bda;
+        portENTER_CRITICAL(&telemetry_lock);
+        int idx = (rssi_busy || rssi_pending == 0) ? -1 : __builtin_ctz(rssi_pending);
+        if (idx >= 0) {
+            rssi_pending &= ~(1u << idx);
+            rssi_busy = true;
+            rssi_issued_at = esp_timer_get_time();
+            memcpy(rssi_bda, gl_profile_tab[idx].remote_bda, sizeof(rssi_bda));
+            memcpy(bda, rssi_bda, sizeof(bda));
+        }
+        portEXIT_CRITICAL(&telemetry_lock);
 
-        if (handlers.connect) handlers.connect(context, idx, param->connect.remote_bda);
+        if (idx < 0 || esp_ble_gap_read_rssi(bda) == ESP_OK) {
+            return;
+        }
+        portENTER_CRITICAL(&telemetry_lock);
+        rssi_busy = false;
+        portEXIT_CRITICAL(&telemetry_lock);
+    }
+}
 
-        // create gattc virtual connection
-        esp_ble_gattc_open(gl_profile_tab[idx].gattc_if, gl_profile_tab[idx].remote_bda, BLE_ADDR_TYPE_RANDOM, true);
-        break;
-    case ESP_GATTC_DIS_SRVC_CMPL_EVT:
-        ESP_LOGV(TAG, "ESP_GATTC_DIS_SRVC_CMPL_EVT");
-        break;
-    default:
-        break;
+/**@brief Telemetry tick: rates of every connected link over the last period, then a new RSSI round.
+ *
+ * @details On the esp_timer task. Counters are written by the BT task, a rate can be off by a
+ *          notification counted during the read, which the next period makes up for.
+ */
+static void ancs_telemetry_cb(void *arg)
+{
+    (void)arg;
+    int64_t now = esp_timer_get_time();
+    uint32_t connected = 0;
+    for (uint32_t idx = 0; idx < ANCS_PROFILE_NUM; idx ++) {
+        struct gattc_profile_inst *p = &gl_profile_tab[idx];
+        if (p->setup.connect == 0) {
+            continue;
+        }
+        connected |= 1u << idx;
+
+        ancs_link_info_t *link = &p->link;
+        if (p->rate_base.at != 0) {
+            int64_t dt = now - p->rate_base.at;
+            link->ns_per_s = (uint32_t)((link->ns_notifs - p->rate_base.ns_notifs) * 1000000LL / dt);
+            link->ds_per_s = (uint32_t)((link->ds_notifs - p->rate_base.ds_notifs) * 1000000LL / dt);
+            link->ds_bytes_per_s = (uint32_t)((link->ds_bytes - p->rate_base.ds_bytes) * 1000000LL / dt);
+        }
+        p->rate_base.at = now;
+        p->rate_base.ns_notifs = link->ns_notifs;
+        p->rate_base.ds_notifs = link->ds_notifs;
+        p->rate_base.ds_bytes = link->ds_bytes;
+    }
+
+    portENTER_CRITICAL(&telemetry_lock);
+    if (rssi_busy && now - rssi_issued_at > CONFIG_NOWA_TELEMETRY_PERIOD_MS * 1000LL) {
+        rssi_busy = false; // Link gone before the completion
+    }
+    rssi_pending = connected;
+    portEXIT_CRITICAL(&telemetry_lock);
+    ancs_rssi_next();
+}
+
+// Request the data length of the next bound link still waiting for it, if none is in progress
+static void ancs_dle_next(void)
+{
+    if (dle_busy) {
+        return;
+    }
+    for (int idx = 0; idx < ANCS_PROFILE_NUM; idx ++) {
+        struct gattc_profile_inst *p = &gl_profile_tab[idx];
+        if ((free_profiles & (1u << idx)) != 0 || p->link.dle_state != ANCS_NEGOTIATION_PENDING) {
+            continue;
+        }
+        esp_err_t ret = esp_ble_gap_set_pkt_data_len(p->remote_bda, CONFIG_NOWA_DATA_LENGTH);
+        if (ret == ESP_OK) {
+            memcpy(dle_bda, p->remote_bda, sizeof(dle_bda));
+            dle_busy = true;
+            return;
+        }
+        ESP_LOGW(TAG, "Data length [%d] not requested (%s), staying at %d", idx, esp_err_to_name(ret), ANCS_DEFAULT_DATA_LEN);
+        p->link.dle_state = ANCS_NEGOTIATION_REFUSED;
+        setup_stats.dle_refused ++;
+    }
+}
+
+/**@brief Next step once the MTU is exchanged: enable notifications with the cached handles, or
+ *        discover them.
+ *
+ * @details The ANCS CCCDs refuse a write until the link is encrypted. Such a refusal is retried on
+ *          ESP_GAP_BLE_AUTH_CMPL_EVT, any other one means the cached handles are stale.
+ */
+static void ancs_setup_start(int idx)
+{
+    struct gattc_profile_inst *p = &gl_profile_tab[idx];
+    if (p->setup_started || !p->mtu_done) {
+        return;
+    }
+
+    p->setup_started = true;
+    if (p->cache.version == BLE_HANDLE_CACHE_VERSION) {
+        ancs_setup_from_cache(idx);
+    } else {
+        ancs_discover(idx);
+    }
+}
+
+static void ancs_setup_from_cache(int idx)
+{
+    struct gattc_profile_inst *p = &gl_profile_tab[idx];
+    const ble_handle_cache_t *c = &p->cache;
+    ESP_LOGI(TAG, "Using cached handles for [%d]", idx);
+
+    p->anc.service_start_handle = c->anc_start;
+    p->anc.service_end_handle = c->anc_end;
+    p->anc.service_found = true;
+    p->anc.notification_source_char_elem.char_handle = c->notification_source;
+    p->anc.notification_source_cccd = c->notification_source_cccd;
+    p->anc.data_source_char_elem.char_handle = c->data_source;
+    p->anc.data_source_cccd = c->data_source_cccd;
+    p->anc.control_point_char_elem.char_handle = c->control_point;
+
+    p->gap.service_start_handle = c->gap_start;
+    p->gap.service_end_handle = c->gap_end;
+    p->gap.service_found = (c->gap_start != 0);
+    p->gap.device_name_elem.char_handle = c->device_name;
+    p->gap.appearance_elem.char_handle = c->appearance_char;
+
+    p->gatt.service_start_handle = c->gatt_start;
+    p->gatt.service_end_handle = c->gatt_end;
+    p->gatt.service_found = (c->gatt_start != 0);
+    p->gatt.service_changed_elem.char_handle = c->service_changed;
+    p->gatt.service_changed_cccd = c->service_changed_cccd;
+
+    strlcpy((char *)p->device_name, c->name, sizeof(p->device_name));
+    p->appearance = c->appearance;
+    if (handlers.device_name && p->device_name[0] != '\0') handlers.device_name(context, idx, (char *)p->device_name);
+
+    p->setup.cached = true;
+    p->setup.discovered = esp_timer_get_time();
+    ancs_subscribe(idx);
+}
+
+// Notification Source and Data Source enabled: account the setup, keep the handles for next time
+static void ancs_setup_done(int idx)
+{
+    struct gattc_profile_inst *p = &gl_profile_tab[idx];
+    ancs_setup_times_t *t = &p->setup;
+    if (t->subscribed == 0) {
+        t->subscribed = esp_timer_get_time();
+        ancs_setup_path_t *path = t->cached ? &setup_stats.cached : &setup_stats.discovered;
+        path->setups ++;
+        path->subscribed_total_us += t->subscribed - t->connect;
+        ESP_LOGI(TAG, "Setup [%d] %s, ms after connect: open %" PRId64 ", MTU %" PRId64 ", encrypted %" PRId64
+                 ", handles %" PRId64 ", subscribed %" PRId64,
+                 idx, t->cached ? "cached" : "discovered",
+                 (t->open - t->connect) / 1000, (t->mtu - t->connect) / 1000,
+                 t->encrypted ? (t->encrypted - t->connect) / 1000 : -1,
+                 (t->discovered - t->connect) / 1000, (t->subscribed - t->connect) / 1000);
+
+        ble_conn_ctrl_ready(&p->conn);
+
+        // The name can change without Service Changed, refresh it off the critical path
+        if (t->cached && p->gap.device_name_elem.char_handle != 0 &&
+            !ble_gatt_ops_read(&p->ops, p->gap.device_name_elem.char_handle, false)) {
+            ESP_LOGW(TAG, "Device name of [%d] left to the next connection", idx);
+        }
+    }
+    ble_gatt_ops_hold(&p->ops, false);
+    ancs_cache_update(idx);
+}
+
+// Setup cannot complete on this link: drop it, the phone reconnects and setup starts over.
+// esp_ble_gap_disconnect() only posts to the BT task, so any task may call this.
+static void ancs_setup_abort(int idx, const char *why)
+{
+    ESP_LOGE(TAG, "Setup [%d] aborted, %s", idx, why);
+    esp_err_t ret = esp_ble_gap_disconnect(gl_profile_tab[idx].remote_bda);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ble_gap_disconnect failed, error code = %x", ret);
+    }
+}
+
+// Operation of the setup out of tries. Without a CCCD notifications never come; a GAP read only
+// leaves the name or appearance as cached until the next connection.
+static void ancs_gatt_op_given_up(void *ctx, const ble_gatt_op_t *op)
+{
+    uint32_t idx = (uint32_t)ctx;
+    if (op->type == BLE_GATT_OP_WRITE_DESCR) {
+        ancs_setup_abort(idx, "CCCD write given up");
+    } else {
+        ESP_LOGW(TAG, "Read of handle %u on [%" PRIu32 "] given up", op->handle, idx);
+    }
+}
+
+// Full service discovery, handles are resolved on ESP_GATTC_SEARCH_CMPL_EVT
+static void ancs_discover(int idx)
+{
+    struct gattc_profile_inst *p = &gl_profile_tab[idx];
+    if (p->discovering) {
+        return;
+    }
+    memset(&p->anc, 0, sizeof(p->anc));
+    memset(&p->gap, 0, sizeof(p->gap));
+    memset(&p->gatt, 0, sizeof(p->gatt));
+    p->subscribed = 0;
+    if (p->setup.subscribed == 0) {
+        // Cache turned out stale during setup, account it as a discovered one
+        p->setup.cached = false;
+        p->setup.discovered = 0;
     }
+    p->discovering = true;
+    ble_gatt_ops_hold(&p->ops, true);
+    esp_ble_gattc_search_service(p->gattc_if, p->conn_id, NULL);
+}
+
+// Characteristic by UUID in a discovered service, its handle is left 0 if not found
+static bool ancs_find_char(int idx, uint16_t start, uint16_t end, esp_bt_uuid_t uuid, esp_gatt_char_prop_t props, esp_gattc_char_elem_t *elem)
+{
+    esp_gatt_status_t ret_status = ble_utils_get_char(gl_profile_tab[idx].gattc_if, gl_profile_tab[idx].conn_id, start, end, uuid, props, elem);
+    if (ret_status != ESP_GATT_OK) {
+        ESP_LOGW(TAG, "Char %04x not found, status %d", uuid.uuid.uuid16, ret_status);
+        memset(elem, 0, sizeof(*elem));
+        return false;
+    }
+    return true;
 }
 
-/*static void ancs_timer_cb(void *ctx)
+// Register for what the phone pushes, the CCCDs are written on ESP_GATTC_REG_FOR_NOTIFY_EVT
+static void ancs_subscribe(int idx)
+{
+    struct gattc_profile_inst *p = &gl_profile_tab[idx];
+    const uint16_t handles[] = {
+        p->anc.notification_source_char_elem.char_handle,
+        p->anc.data_source_char_elem.char_handle,
+        p->gatt.service_changed_elem.char_handle,
+    };
+    for (size_t i = 0; i < sizeof(handles) / sizeof(handles[0]); i ++) {
+        if (handles[i] != 0) {
+            esp_ble_gattc_register_for_notify(p->gattc_if, p->remote_bda, handles[i]);
+        }
+    }
+}
+
+// CCCD handle of a characteristic subscribed to, 0 until known, NULL for any other characteristic
+static uint16_t *ancs_cccd_of(int idx, uint16_t char_handle)
+{
+    struct gattc_profile_inst *p = &gl_profile_tab[idx];
+    if (char_handle == 0) {
+        return NULL;
+    } else if (char_handle == p->anc.notification_source_char_elem.char_handle) {
+        return &p->anc.notification_source_cccd;
+    } else if (char_handle == p->anc.data_source_char_elem.char_handle) {
+        return &p->anc.data_source_cccd;
+    } else if (char_handle == p->gatt.service_changed_elem.char_handle) {
+        return &p->gatt.service_changed_cccd;
+    }
+    return NULL;
+}
+
+// Save the handles once notifications work with them, only when something changed
+static void ancs_cache_update(int idx)
+{
+    struct gattc_profile_inst *p = &gl_profile_tab[idx];
+    if (p->subscribed != SUBSCRIBED_ALL) {
+        return;
+    }
+
+    ble_handle_cache_t c;
+    memset(&c, 0, sizeof(c));
+    c.version = BLE_HANDLE_CACHE_VERSION;
+    c.anc_start = p->anc.service_start_handle;
+    c.anc_end = p->anc.service_end_handle;
+    c.notification_source = p->anc.notification_source_char_elem.char_handle;
+    c.notification_source_cccd = p->anc.notification_source_cccd;
+    c.data_source = p->anc.data_source_char_elem.char_handle;
+    c.data_source_cccd = p->anc.data_source_cccd;
+    c.control_point = p->anc.control_point_char_elem.char_handle;
+    if (p->gap.service_found) {
+        c.gap_start = p->gap.service_start_handle;
+        c.gap_end = p->gap.service_end_handle;
+        c.device_name = p->gap.device_name_elem.char_handle;
+        c.appearance_char = p->gap.appearance_elem.char_handle;
+    }
+    if (p->gatt.service_found) {
+        c.gatt_start = p->gatt.service_start_handle;
+        c.gatt_end = p->gatt.service_end_handle;
+        c.service_changed = p->gatt.service_changed_elem.char_handle;
+        c.service_changed_cccd = p->gatt.service_changed_cccd;
+    }
+    c.appearance = p->appearance;
+    strlcpy(c.name, (const char *)p->device_name, sizeof(c.name));
+
+    if (memcmp(&c, &p->cache, sizeof(c)) != 0 && ble_handle_cache_save(p->remote_bda, &c) == ESP_OK) {
+        p->cache = c;
+        ESP_LOGI(TAG, "Handles of [%d] cached", idx);
+    }
+}
+
+static void ancs_cache_invalidate(int idx)
+{
+    struct gattc_profile_inst *p = &gl_profile_tab[idx];
+    if (p->cache.version == BLE_HANDLE_CACHE_VERSION) {
+        ble_handle_cache_erase(p->remote_bda);
+        setup_stats.invalidations ++;
+    }
+    memset(&p->cache, 0, sizeof(p->cache));
+}
+
+// Handles may have moved: drop the cache, and discover again unless setup is still to start
+static void ancs_services_changed(int idx)
+{
+    ESP_LOGI(TAG, "Services changed on [%d]", idx);
+    ancs_cache_invalidate(idx);
+    if (gl_profile_tab[idx].setup_started) {
+        ancs_discover(idx);
+    }
+}
+
+/**@brief Load the attribute list of the request a response answers into the parser, run by the
+ *        parser on the BT task once the UID of the response is known.
+ */
+static bool ancs_uid_handler(uint32_t uid, void *ctx)
 {
     uint32_t idx = (uint32_t)ctx;
+    ble_ancs_c_t *p_ancs = &gl_profile_tab[idx].ble_ancs_inst;
 
-    //ESP_LOGV(TAG, "Timer CB [%"PRIu32"]", idx);
-    esp_ble_gap_read_rssi(gl_profile_tab[idx].remote_bda);
-}*/
+    portENTER_CRITICAL(&requests_lock);
+    ancs_request_t *r = ancs_request_find(idx, BLE_ANCS_COMMAND_ID_GET_NOTIF_ATTRIBUTES, uid);
+    if (!ancs_response_expected(idx, r)) {
+        r = NULL;
+    }
+    if (r != NULL) {
+        for (uint32_t id = 0; id < BLE_ANCS_NB_OF_NOTIF_ATTR; id ++) {
+            p_ancs->ancs_notif_attr_list[id].get = (r->frame->mask & (1u << id)) != 0;
+            p_ancs->ancs_notif_attr_list[id].attr_len = r->attr_len[id];
+            p_ancs->ancs_notif_attr_list[id].p_attr_data = r->attr_data[id];
+        }
+        p_ancs->number_of_requested_attr = r->frame->count;
+        p_ancs->parse_info.expected_number_of_attrs = r->frame->count;
+        gl_profile_tab[idx].parse_request = *r;
+    }
+    gl_profile_tab[idx].parse_attached = (r != NULL);
+    portEXIT_CRITICAL(&requests_lock);
+
+    if (r == NULL) {
+        ESP_LOGW(TAG, "Response for unknown uid=%" PRIu32, uid);
+        return false;
+    }
+    return true;
+}
+
+// Same for a Get App Attributes response, only ever one of them is outstanding
+static bool ancs_app_id_handler(const char *app_id, void *ctx)
+{
+    uint32_t idx = (uint32_t)ctx;
+    ble_ancs_c_t *p_ancs = &gl_profile_tab[idx].ble_ancs_inst;
+
+    portENTER_CRITICAL(&requests_lock);
+    ancs_request_t *r = ancs_request_find(idx, BLE_ANCS_COMMAND_ID_GET_APP_ATTRIBUTES, 0);
+    if (r != NULL && strcmp(gl_profile_tab[idx].app_request_id, app_id) != 0) {
+        r = NULL;
+    }
+    if (!ancs_response_expected(idx, r)) {
+        r = NULL;
+    }
+    if (r != NULL) {
+        gl_profile_tab[idx].app_name[0] = '\0';
+        p_ancs->parse_info.expected_number_of_attrs = 1;
+        gl_profile_tab[idx].parse_request = *r;
+    }
+    gl_profile_tab[idx].parse_attached = (r != NULL);
+    portEXIT_CRITICAL(&requests_lock);
+
+    if (r == NULL) {
+        ESP_LOGW(TAG, "Response for unknown app %s", app_id);
+        return false;
+    }
+    return true;
+}
 
 static void esp_gattc_cb(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param)
 {
     /* If event is register event, store the gattc_if for each profile */
     if (event == ESP_GATTC_REG_EVT) {
-        if (param->reg.status == ESP_GATT_OK) {
+        if (param->reg.status == ESP_GATT_OK && param->reg.app_id < ANCS_PROFILE_NUM) {
             gl_profile_tab[param->reg.app_id].gattc_if = gattc_if;
+            profile_by_if[gattc_if] = param->reg.app_id;
         } else {
             ESP_LOGE(TAG, "Reg app failed, app_id %04x, status %d",
                     param->reg.app_id,
@@ -674,49 +1544,156 @@ static void esp_gattc_cb(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp
         }
     }
 
-    /* Every profile has the same callback so call it directly */
-    gattc_profile_event_handler(event, gattc_if, param);
+    /* Link events reach every app, handle them once */
+    if (event == ESP_GATTC_CONNECT_EVT || event == ESP_GATTC_DISCONNECT_EVT || event == ESP_GATTC_SRVC_CHG_EVT) {
+        if (profile_by_if[gattc_if] == PROFILE_A_APP_ID) {
+            gattc_link_event_handler(event, param);
+        }
+        return;
+    }
+
+    uint8_t idx = profile_by_if[gattc_if];
+    if (idx == PROFILE_NONE) {
+        ESP_LOGW(TAG, "Event %d for unknown gattc_if %u", event, gattc_if);
+        return;
+    }
+    gattc_profile_event_handler(idx, event, gattc_if, param);
 }
 
-bool ancs_send_attrs_request(uint8_t idx, uint32_t uid, const ble_ancs_c_notif_attr_id_val_t attrs[], uint32_t attrs_length)
+/**@brief Write a Get Notification Attributes command, up to ANCS_PIPELINE_DEPTH may be outstanding.
+ *
+ * @details The command is the encoded frame with the UID patched in. The response is matched to
+ *          the request by the UID it echoes, its attributes land in the buffers given by the
+ *          attribute_buffer handler, or are streamed to attribute_chunk. Must always be called
+ *          from the same task, and frame must outlive the request.
+ */
+bool ancs_send_attrs_request(uint8_t idx, uint32_t uid, const ancs_attr_frame_t *frame)
 {
-    static uint8_t attrs_request_buffer[BLE_ANCS_ATTR_DATA_MAX];
+    static uint8_t attrs_request_buffer[ANCS_ATTR_FRAME_MAX];
+    uint8_t *attr_data[BLE_ANCS_NB_OF_NOTIF_ATTR] = { NULL };
+    uint16_t attr_len[BLE_ANCS_NB_OF_NOTIF_ATTR] = { 0 };
 
-    // Reinit requested attribute list
-    memset(gl_profile_tab[idx].ble_ancs_inst.ancs_notif_attr_list, 0, sizeof(gl_profile_tab[idx].ble_ancs_inst.ancs_notif_attr_list));
-    for (uint32_t i = 0; i < attrs_length; i ++) {
-        esp_err_t ret = ble_ancs_add_notif_attr(&gl_profile_tab[idx].ble_ancs_inst, attrs[i], (uint8_t *)gl_profile_tab[idx].attr_buffer, sizeof(gl_profile_tab[idx].attr_buffer));
-        if (ret) {
-            ESP_LOGE(TAG, "%s: ble_ancs_add_notif_attr(%u) failed, error code = %x", __func__, attrs[i], ret);
-            return ret;
+    if (frame->len < ANCS_ATTR_FRAME_UID_OFFSET + sizeof(uint32_t) || frame->len > sizeof(attrs_request_buffer)) {
+        ESP_LOGE(TAG, "%s: invalid frame of %u bytes", __func__, frame->len);
+        return false;
+    }
+
+    // The parser may be busy with the response of another request, these only go live with the response
+    for (uint32_t id = 0; id < BLE_ANCS_NB_OF_NOTIF_ATTR; id ++) {
+        if ((frame->mask & (1u << id)) == 0) {
+            continue;
+        }
+        if (handlers.attribute_buffer) {
+            attr_data[id] = handlers.attribute_buffer(context, idx, uid, id, &attr_len[id]);
         }
+        if (attr_data[id] == NULL && (attr_len[id] == 0 || handlers.attribute_chunk == NULL)) {
+            // Attributes are delivered one by one, so they can share the profile buffer
+            attr_data[id] = gl_profile_tab[idx].attr_buffer;
+            attr_len[id] = sizeof(gl_profile_tab[idx].attr_buffer);
+        }
+    }
+
+    memcpy(attrs_request_buffer, frame->data, frame->len);
+    uint8_t *p_uid = &attrs_request_buffer[ANCS_ATTR_FRAME_UID_OFFSET];
+    p_uid[0] = (uint8_t)uid;
+    p_uid[1] = (uint8_t)(uid >> 8);
+    p_uid[2] = (uint8_t)(uid >> 16);
+    p_uid[3] = (uint8_t)(uid >> 24);
+
+    ESP_LOGD(TAG, "Sending attrs request of %u bytes", frame->len);
+    ESP_LOG_BUFFER_HEX_LEVEL(TAG, attrs_request_buffer, frame->len, ESP_LOG_DEBUG);
+
+    // Register before the write: the caller is not the BT task, so the response may be parsed before we return
+    uint32_t seq = 0;
+    portENTER_CRITICAL(&requests_lock);
+    ancs_request_t *r = ancs_request_claim(idx, BLE_ANCS_COMMAND_ID_GET_NOTIF_ATTRIBUTES);
+    if (r != NULL) {
+        seq = r->seq;
+        r->uid = uid;
+        r->frame = frame;
+        memcpy(r->attr_data, attr_data, sizeof(r->attr_data));
+        memcpy(r->attr_len, attr_len, sizeof(r->attr_len));
+        ancs_request_arm_timer(idx);
+    }
+    portEXIT_CRITICAL(&requests_lock);
+
+    if (r == NULL) {
+        ESP_LOGE(TAG, "%s: %d requests outstanding already", __func__, ANCS_PIPELINE_DEPTH);
+        return false;
     }
 
-    uint32_t len = ble_ancs_build_notif_attrs_request (&gl_profile_tab[idx].ble_ancs_inst, uid, attrs_request_buffer, sizeof(attrs_request_buffer));
+    return ancs_write_request(idx, r, seq, attrs_request_buffer, frame->len);
+}
+
+/**@brief Write a Get App Attributes command for the display name of an app, one may be outstanding
+ *        next to the notification attribute requests. The answer comes through the app_name handler.
+ */
+bool ancs_send_app_attrs_request(uint8_t idx, const char *app_id)
+{
+    static uint8_t app_request_buffer[sizeof(uint8_t) + BLE_ANCS_APP_ID_MAX + BLE_ANCS_NB_OF_APP_ATTR];
+
+    uint32_t count = 0;
+    uint32_t len = ble_ancs_encode_app_attrs_request(gl_profile_tab[idx].ble_ancs_inst.ancs_app_attr_list, app_id,
+                                                     app_request_buffer, sizeof(app_request_buffer), &count);
     if (len == 0) {
-        ESP_LOGE(TAG, "%s: ble_ancs_build_notif_attrs_request: out of memory", __func__);
+        ESP_LOGE(TAG, "%s: app identifier too long", __func__);
         return false;
     }
 
-    ESP_LOGD(TAG, "Sending attrs request of %" PRIu32 " bytes", len);
-    ESP_LOG_BUFFER_HEX_LEVEL(TAG, attrs_request_buffer, len, ESP_LOG_DEBUG);
+    ESP_LOGD(TAG, "Sending app attrs request of %" PRIu32 " bytes", len);
+    ESP_LOG_BUFFER_HEX_LEVEL(TAG, app_request_buffer, len, ESP_LOG_DEBUG);
+
+    uint32_t seq = 0;
+    portENTER_CRITICAL(&requests_lock);
+    ancs_request_t *r = ancs_request_claim(idx, BLE_ANCS_COMMAND_ID_GET_APP_ATTRIBUTES);
+    if (r != NULL) {
+        seq = r->seq;
+        r->uid = 0;
+        r->frame = NULL;
+        strlcpy(gl_profile_tab[idx].app_request_id, app_id, sizeof(gl_profile_tab[idx].app_request_id));
+        ancs_request_arm_timer(idx);
+    }
+    portEXIT_CRITICAL(&requests_lock);
+
+    if (r == NULL) {
+        ESP_LOGE(TAG, "%s: app request outstanding already", __func__);
+        return false;
+    }
+
+    return ancs_write_request(idx, r, seq, app_request_buffer, len);
+}
+
+// Write a command registered in the request table, the entry goes away again if it cannot be sent
+static bool ancs_write_request(uint8_t idx, ancs_request_t *r, uint32_t seq, uint8_t *data, uint32_t len)
+{
     esp_err_t ret_status = esp_ble_gattc_write_char(gl_profile_tab[idx].gattc_if,
                                                     gl_profile_tab[idx].conn_id,
                                                     gl_profile_tab[idx].anc.control_point_char_elem.char_handle,
                                                     len,
-                                                    attrs_request_buffer,
+                                                    data,
                                                     ESP_GATT_WRITE_TYPE_RSP,
                                                     ESP_GATT_AUTH_REQ_NONE);
     if (ret_status != ESP_GATT_OK) {
         ESP_LOGE(TAG, "%s: esp_ble_gattc_write_char failed", __func__);
+        portENTER_CRITICAL(&requests_lock);
+        if (r->used && r->seq == seq) {
+            r->used = false;
+            ancs_request_arm_timer(idx);
+        }
+        portEXIT_CRITICAL(&requests_lock);
         return false;
     }
 
-    gl_profile_tab[idx].ble_ancs_inst.parse_info.parse_state = BLE_ANCS_COMMAND_ID;
-
     return true;
 }
 
+// Part of a streamed attribute, straight from the Data Source packet
+static void ancs_c_chunk_handler(ble_ancs_c_evt_t const * p_evt, uint16_t offset, uint8_t const * p_data, uint16_t len, void *ctx)
+{
+    uint32_t idx = (uint32_t)ctx;
+    if (handlers.attribute_chunk) handlers.attribute_chunk(context, idx, p_evt->notif_uid, p_evt->attr.attr_id, offset, p_data, len);
+}
+
 /**@brief Function for handling the Apple Notification Service client.
  *
  * @details This function is called for all events in the Apple Notification client that
@@ -730,8 +1707,6 @@ static void ancs_c_evt_handler(ble_ancs_c_evt_t * p_evt, void *ctx)
 
     ESP_LOGV(TAG, "ancs_c_evt_handler(%u) uid=%" PRIu32 " ~uid=%" PRIu32, p_evt->evt_type, p_evt->notif.notif_uid, p_evt->notif_uid);
 
-    vTaskDelay(1); // Reset WDT in case of multiple consecutive reads
-
     switch (p_evt->evt_type)
     {
         case BLE_ANCS_C_EVT_NOTIF:
@@ -751,26 +1726,45 @@ static void ancs_c_evt_handler(ble_ancs_c_evt_t * p_evt, void *ctx)
 static esp_err_t ancs_profile_init(int idx) {
     esp_err_t ret;
 
-    gl_profile_tab[idx].gattc_cb = gattc_profile_event_handler,
     gl_profile_tab[idx].gattc_if = ESP_GATT_IF_NONE,       /* Not get the gatt_if, so initial is ESP_GATT_IF_NONE */
 
     // Init the ANCS client module
     memset(&gl_profile_tab[idx].ble_ancs_inst, 0, sizeof(gl_profile_tab[idx].ble_ancs_inst));
     gl_profile_tab[idx].ble_ancs_inst.evt_handler = ancs_c_evt_handler;
+    gl_profile_tab[idx].ble_ancs_inst.uid_handler = ancs_uid_handler;
+    gl_profile_tab[idx].ble_ancs_inst.app_id_handler = ancs_app_id_handler;
+    gl_profile_tab[idx].ble_ancs_inst.chunk_handler = ancs_c_chunk_handler;
     gl_profile_tab[idx].ble_ancs_inst.ctx = (void *)idx;
 
-    // ret = ble_ancs_add_app_attr(&gl_profile_tab[idx].ble_ancs_inst, BLE_ANCS_APP_ATTR_ID_DISPLAY_NAME, gl_profile_tab[idx].attr_buffer, sizeof(gl_profile_tab[idx].attr_buffer));
+    // Get App Attributes only ever asks for the display name, the list stays as registered here
+    ret = ble_ancs_add_app_attr(&gl_profile_tab[idx].ble_ancs_inst, BLE_ANCS_APP_ATTR_ID_DISPLAY_NAME, gl_profile_tab[idx].app_name, sizeof(gl_profile_tab[idx].app_name));
+    if (ret) {
+        ESP_LOGE(TAG, "%s: ble_ancs_add_app_attr failed, error code = %x", __func__, ret);
+        return ret;
+    }
 
-    /*esp_timer_create_args_t ta = {
-        .arg = idx,
-        .dispatch_method = ESP_TIMER_TASK,
-        .callback = ancs_timer_cb
-    };
-    ret = esp_timer_create(&ta, &gl_profile_tab[idx].timer);
+    ret = ble_gatt_ops_init(&gl_profile_tab[idx].ops, ancs_gatt_op_given_up, (void *)idx);
     if (ret) {
-        ESP_LOGE(TAG, "%s: esp_timer_create failed, error code = %x", __func__, ret);
         return ret;
-    }*/
+    }
+    ret = ble_conn_ctrl_init(&gl_profile_tab[idx].conn);
+    if (ret) {
+        return ret;
+    }
+
+    esp_timer_create_args_t ta = {
+        .callback = ancs_timer_cb,
+        .arg = (void *)idx,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "ancs_req"
+    };
+    if (gl_profile_tab[idx].timer == NULL) {
+        ret = esp_timer_create(&ta, &gl_profile_tab[idx].timer);
+        if (ret) {
+            ESP_LOGE(TAG, "%s: esp_timer_create failed, error code = %x", __func__, ret);
+            return ret;
+        }
+    }
 
     ret = esp_ble_gattc_app_register(idx);
     if (ret) {
@@ -829,6 +1823,10 @@ esp_err_t ancs_init(void *ctx, ancs_handlers_t *h)
         return ret;
     }
 
+    memset(profile_by_if, PROFILE_NONE, sizeof(profile_by_if));
+    memset(profile_by_conn, PROFILE_NONE, sizeof(profile_by_conn));
+    free_profiles = (1u << ANCS_PROFILE_NUM) - 1;
+
     //register the callback function to the gattc module
     ret = esp_ble_gattc_register_callback(esp_gattc_cb);
     if (ret) {
@@ -842,32 +1840,39 @@ esp_err_t ancs_init(void *ctx, ancs_handlers_t *h)
         return ret;
     }
 
-    ret = ancs_profile_init(PROFILE_A_APP_ID);
-    if (ret) {
-        ESP_LOGE(TAG, "%s: ancs_profile_init failed, error code = %x", __func__, ret);
-        return ret;
-    }
-    ret = ancs_profile_init(PROFILE_B_APP_ID);
-    if (ret) {
-        ESP_LOGE(TAG, "%s: ancs_profile_init failed, error code = %x", __func__, ret);
-        return ret;
-    }
-    ret = ancs_profile_init(PROFILE_C_APP_ID);
-    if (ret) {
-        ESP_LOGE(TAG, "%s: ancs_profile_init failed, error code = %x", __func__, ret);
-        return ret;
+    for (int idx = 0; idx < ANCS_PROFILE_NUM; idx ++) {
+        ret = ancs_profile_init(idx);
+        if (ret) {
+            ESP_LOGE(TAG, "%s: ancs_profile_init failed, error code = %x", __func__, ret);
+            return ret;
+        }
     }
-    ret = ancs_profile_init(PROFILE_D_APP_ID);
+
+    ret = ble_adv_policy_init(&adv_params);
     if (ret) {
-        ESP_LOGE(TAG, "%s: ancs_profile_init failed, error code = %x", __func__, ret);
         return ret;
     }
 
-    ret = esp_ble_gatt_set_local_mtu(131/*500*/);
+    ret = esp_ble_gatt_set_local_mtu(CONFIG_NOWA_LOCAL_MTU);
     if (ret) {
         ESP_LOGE(TAG, "%s: set local MTU failed, error code = %x", __func__, ret);
     }
 
+    if (telemetry_timer == NULL) {
+        esp_timer_create_args_t ta = {
+            .callback = ancs_telemetry_cb,
+            .arg = NULL,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "ancs_tlm"
+        };
+        ret = esp_timer_create(&ta, &telemetry_timer);
+        if (ret) {
+            ESP_LOGE(TAG, "%s: esp_timer_create failed, error code = %x", __func__, ret);
+            return ret;
+        }
+    }
+    esp_timer_start_periodic(telemetry_timer, CONFIG_NOWA_TELEMETRY_PERIOD_MS * 1000LL);
+
     /* set the security iocap & auth_req & key size & init key response key parameters to the stack*/
     esp_ble_auth_req_t auth_req = ESP_LE_AUTH_REQ_SC_MITM_BOND;     //bonding with peer device after authentication
     esp_ble_io_cap_t iocap = ESP_IO_CAP_NONE;           //set the IO capability to No output No input
@@ -905,6 +1910,10 @@ esp_err_t ancs_deinit(void *ctx) {
     }
 
     ble_already_init = false; // Clear before deinit to enable partial recovery via ancs_init()
+    if (telemetry_timer != NULL) {
+        esp_timer_stop(telemetry_timer);
+    }
+    ble_adv_policy_stop();
 
     ret = esp_bluedroid_disable();
     if (ret) {
@@ -934,3 +1943,67 @@ esp_err_t ancs_deinit(void *ctx) {
 bool ancs_is_initialized(void) {
     return ble_already_init;
 }
+
+// Stage times of the link on profile idx, false if it is not connected
+bool ancs_get_setup_times(uint8_t idx, ancs_setup_times_t *times) {
+    if (idx >= ANCS_PROFILE_NUM || gl_profile_tab[idx].setup.connect == 0) {
+        return false;
+    }
+    *times = gl_profile_tab[idx].setup;
+    return true;
+}
+
+// Negotiated MTU and data length of the link on profile idx, false if it is not connected
+bool ancs_get_link_info(uint8_t idx, ancs_link_info_t *info) {
+    if (idx >= ANCS_PROFILE_NUM || gl_profile_tab[idx].setup.connect == 0) {
+        return false;
+    }
+    *info = gl_profile_tab[idx].link;
+    const ble_conn_ctrl_t *c = &gl_profile_tab[idx].conn;
+    info->conn_interval = c->interval;
+    info->conn_latency = c->latency;
+    info->conn_timeout = c->timeout;
+    info->conn_mode = c->mode;
+    return true;
+}
+
+// Connection parameter changes of the link on profile idx, oldest first, 0 if it is not connected
+size_t ancs_get_conn_history(uint8_t idx, ble_conn_sample_t *out, size_t max) {
+    if (idx >= ANCS_PROFILE_NUM || gl_profile_tab[idx].setup.connect == 0) {
+        return 0;
+    }
+    return ble_conn_ctrl_history(&gl_profile_tab[idx].conn, out, max);
+}
+
+// Attribute requests queued or in flight for profile idx, drives its connection parameters
+void ancs_set_backlog(uint8_t idx, uint32_t pending) {
+    if (idx < ANCS_PROFILE_NUM) {
+        ble_conn_ctrl_backlog(&gl_profile_tab[idx].conn, pending);
+    }
+}
+
+void ancs_get_adv_state(ble_adv_state_t *state) {
+    ble_adv_policy_state(state);
+}
+
+// Reconnection times of the bonded phones seen since boot, most recently seen first
+size_t ancs_get_reconnect_stats(ble_adv_peer_t *out, size_t max) {
+    return ble_adv_policy_peers(out, max);
+}
+
+void ancs_get_setup_stats(ancs_setup_stats_t *stats) {
+    *stats = setup_stats;
+    for (uint32_t idx = 0; idx < ANCS_PROFILE_NUM; idx ++) {
+        const ble_gatt_ops_t *q = &gl_profile_tab[idx].ops;
+        stats->gatt_ops += q->issued;
+        stats->gatt_retries += q->retried;
+        stats->gatt_failures += q->failed;
+        stats->gatt_dropped += q->dropped;
+        stats->gatt_max_in_flight = (q->max_in_flight > stats->gatt_max_in_flight) ? q->max_in_flight : stats->gatt_max_in_flight;
+
+        const ble_conn_ctrl_t *c = &gl_profile_tab[idx].conn;
+        stats->conn_fast_requests += c->fast_requests;
+        stats->conn_idle_requests += c->idle_requests;
+        stats->conn_rejected += c->rejected;
+    }
+}
@@ -67,6 +67,12 @@ static uint32_t uint32_decode(const uint8_t * p_encoded_data)
 }
 
 
+static uint32_t min_u32(uint32_t a, uint32_t b)
+{
+    return (a < b) ? a : b;
+}
+
+
 bool ble_ancs_all_req_attrs_parsed(ble_ancs_c_t * p_ancs)
 {
     if (p_ancs->parse_info.expected_number_of_attrs == 0)
@@ -127,35 +133,83 @@ static ble_ancs_c_parse_state_t command_id_parse(ble_ancs_c_t  * p_ancs,
             parse_state = BLE_ANCS_ATTR_DONE;
             break;
     }
+    p_ancs->parse_info.current_uid_index = 0;
+    p_ancs->parse_info.current_app_id_index = 0;
     return parse_state;
 }
 
 
+/**@brief Function for parsing the notification UID.
+ *        Used in the @ref parse_get_notif_attrs_response state machine.
+ *
+ * @details The UID is decoded straight from the buffer when all 4 bytes are present in the current
+ *          GATTC notification. Otherwise it is accumulated byte by byte across notifications.
+ *
+ * @param[in] p_ancs     Pointer to an ANCS instance to which the event belongs.
+ * @param[in] p_data_src Pointer to data that was received from the Notification Provider.
+ * @param[in] index      Pointer to an index that helps us keep track of the current data to be parsed.
+ * @param[in] data_len   Length of the data that was received from the Notification Provider.
+ *
+ * @return The next parse state.
+ */
 static ble_ancs_c_parse_state_t notif_uid_parse(ble_ancs_c_t  * p_ancs,
                                                 const uint8_t * p_data_src,
-                                                uint32_t      * index)
+                                                uint32_t      * index,
+                                                uint32_t        data_len)
 {
-     p_ancs->evt.notif_uid = uint32_decode(&p_data_src[*index]);
-     ESP_LOGD(TAG, "Notif UID %"PRIu32" ", p_ancs->evt.notif_uid);
-     *index               += sizeof(uint32_t);
-     return BLE_ANCS_ATTR_ID;
+    if ((p_ancs->parse_info.current_uid_index == 0) && (data_len - *index >= sizeof(uint32_t)))
+    {
+        p_ancs->evt.notif_uid = uint32_decode(&p_data_src[*index]);
+        *index               += sizeof(uint32_t);
+    }
+    else
+    {
+        if (p_ancs->parse_info.current_uid_index == 0)
+        {
+            p_ancs->evt.notif_uid = 0;
+        }
+        p_ancs->evt.notif_uid |= (uint32_t)p_data_src[(*index)++] << (8 * p_ancs->parse_info.current_uid_index++);
+        if (p_ancs->parse_info.current_uid_index < sizeof(uint32_t))
+        {
+            return BLE_ANCS_NOTIF_UID;
+        }
+        p_ancs->parse_info.current_uid_index = 0;
+    }
+    ESP_LOGD(TAG, "Notif UID %"PRIu32" ", p_ancs->evt.notif_uid);
+
+    if ((p_ancs->uid_handler != NULL) && !p_ancs->uid_handler(p_ancs->evt.notif_uid, p_ancs->ctx))
+    {
+        ESP_LOGD(TAG, "Notif UID not requested");
+        return BLE_ANCS_ATTR_DONE;
+    }
+    return BLE_ANCS_ATTR_ID;
 }
 
 static ble_ancs_c_parse_state_t app_id_parse(ble_ancs_c_t  * p_ancs,
                                              const uint8_t * p_data_src,
                                              uint32_t      * index)
 {
-    p_ancs->evt.app_id[p_ancs->parse_info.current_app_id_index] = p_data_src[(*index)++];
+    uint8_t c = p_data_src[(*index)++];
 
-    if (p_ancs->evt.app_id[p_ancs->parse_info.current_app_id_index] != '\0')
+    if (c != '\0')
     {
-        p_ancs->parse_info.current_app_id_index++;
+        // A longer identifier is truncated, the rest of it is consumed all the same
+        if (p_ancs->parse_info.current_app_id_index < sizeof(p_ancs->evt.app_id) - 1)
+        {
+            p_ancs->evt.app_id[p_ancs->parse_info.current_app_id_index++] = c;
+        }
         return BLE_ANCS_APP_ID;
     }
-    else
+
+    p_ancs->evt.app_id[p_ancs->parse_info.current_app_id_index] = '\0';
+    ESP_LOGD(TAG, "App ID %s", p_ancs->evt.app_id);
+
+    if ((p_ancs->app_id_handler != NULL) && !p_ancs->app_id_handler((const char *)p_ancs->evt.app_id, p_ancs->ctx))
     {
-        return BLE_ANCS_ATTR_ID;
+        ESP_LOGD(TAG, "App ID not requested");
+        return BLE_ANCS_ATTR_DONE;
     }
+    return BLE_ANCS_ATTR_ID;
 }
 
 /**@brief Function for parsing the id of an iOS attribute.
@@ -200,44 +254,29 @@ static ble_ancs_c_parse_state_t attr_id_parse(ble_ancs_c_t  * p_ancs,
 }
 
 
-/**@brief Function for parsing the length of an iOS attribute.
- *        Used in the @ref parse_get_notif_attrs_response state machine.
+/**@brief Function for handling a fully received attribute length.
  *
- * @details The Length is 2 bytes. Since there is a chance we reveice the bytes in two different
- *          GATTC notifications, we parse only the first byte here and then set the state machine
- *          ready to parse the next byte.
+ * @details If the length is zero, it means that the attribute is not present and the state
+ *          machine is set to parse the next attribute.
  *
  * @param[in] p_ancs     Pointer to an ANCS instance to which the event belongs.
- * @param[in] p_data_src Pointer to data that was received from the Notification Provider.
- * @param[in] index      Pointer to an index that helps us keep track of the current data to be parsed.
  *
  * @return The next parse state.
  */
-static ble_ancs_c_parse_state_t attr_len1_parse(ble_ancs_c_t * p_ancs, const uint8_t * p_data_src, uint32_t * index)
+static ble_ancs_c_parse_state_t attr_len_done(ble_ancs_c_t * p_ancs)
 {
-    p_ancs->evt.attr.attr_len = p_data_src[(*index)++];
-    return BLE_ANCS_ATTR_LEN2;
-}
-
-/**@brief Function for parsing the length of an iOS attribute.
- *        Used in the @ref parse_get_notif_attrs_response state machine.
- *
- * @details Second byte of the length field. If the length is zero, it means that the attribute is not
- *          present and the state machine is set to parse the next attribute.
- *
- * @param[in] p_ancs     Pointer to an ANCS instance to which the event belongs.
- * @param[in] p_data_src Pointer to data that was received from the Notification Provider.
- * @param[in] index      Pointer to an index that helps us keep track of the current data to be parsed.
- *
- * @return The next parse state.
- */
-static ble_ancs_c_parse_state_t attr_len2_parse(ble_ancs_c_t * p_ancs, const uint8_t * p_data_src, uint32_t * index)
-{
-    p_ancs->evt.attr.attr_len |= (p_data_src[(*index)++] << 8);
     p_ancs->parse_info.current_attr_index = 0;
 
     if (p_ancs->evt.attr.attr_len != 0)
     {
+        //A requested attribute without a buffer goes to the chunk handler piece by piece
+        if ((p_ancs->parse_info.p_attr_list[p_ancs->evt.attr.attr_id].attr_len != 0) &&
+           (p_ancs->parse_info.p_attr_list[p_ancs->evt.attr.attr_id].p_attr_data == NULL) &&
+           (p_ancs->chunk_handler != NULL) && attr_is_requested(p_ancs, p_ancs->evt.attr))
+        {
+            return BLE_ANCS_ATTR_CHUNK;
+        }
+
         //If the attribute has a length but there is no allocated space for this attribute
         if ((p_ancs->parse_info.p_attr_list[p_ancs->evt.attr.attr_id].attr_len == 0) ||
            (p_ancs->parse_info.p_attr_list[p_ancs->evt.attr.attr_id].p_attr_data == NULL))
@@ -269,34 +308,82 @@ static ble_ancs_c_parse_state_t attr_len2_parse(ble_ancs_c_t * p_ancs, const uin
 }
 
 
-/**@brief Function for parsing the data of an iOS attribute.
+/**@brief Function for parsing the length of an iOS attribute.
  *        Used in the @ref parse_get_notif_attrs_response state machine.
  *
- * @details Read the data of the attribute into our local buffer.
+ * @details The Length is 2 bytes. It is decoded at once when both bytes are in the current
+ *          GATTC notification. Otherwise we parse only the first byte here and then set the
+ *          state machine ready to parse the next byte.
  *
  * @param[in] p_ancs     Pointer to an ANCS instance to which the event belongs.
  * @param[in] p_data_src Pointer to data that was received from the Notification Provider.
  * @param[in] index      Pointer to an index that helps us keep track of the current data to be parsed.
+ * @param[in] data_len   Length of the data that was received from the Notification Provider.
  *
  * @return The next parse state.
  */
-static ble_ancs_c_parse_state_t attr_data_parse(ble_ancs_c_t  * p_ancs,
+static ble_ancs_c_parse_state_t attr_len1_parse(ble_ancs_c_t  * p_ancs,
                                                 const uint8_t * p_data_src,
-                                                uint32_t      * index)
+                                                uint32_t      * index,
+                                                uint32_t        data_len)
 {
-    // We have not reached the end of the attribute, nor our max allocated internal size.
-    // Proceed with copying data over to our buffer.
-    if (   (p_ancs->parse_info.current_attr_index < p_ancs->parse_info.p_attr_list[p_ancs->evt.attr.attr_id].attr_len)
-        && (p_ancs->parse_info.current_attr_index < p_ancs->evt.attr.attr_len))
+    if (data_len - *index >= sizeof(uint16_t))
     {
-        //ESP_LOGD(TAG, "Byte copied to buffer: %c", p_data_src[(*index)]); // Un-comment this line to see every byte of an attribute as it is parsed. Commented out by default since it can overflow the uart buffer.
-        p_ancs->evt.attr.p_attr_data[p_ancs->parse_info.current_attr_index++] = p_data_src[(*index)++];
+        p_ancs->evt.attr.attr_len = uint16_decode(&p_data_src[*index]);
+        *index                   += sizeof(uint16_t);
+        return attr_len_done(p_ancs);
     }
+    p_ancs->evt.attr.attr_len = p_data_src[(*index)++];
+    return BLE_ANCS_ATTR_LEN2;
+}
+
+/**@brief Function for parsing the second byte of the length of an iOS attribute,
+ *        when the length field is split across two GATTC notifications.
+ *        Used in the @ref parse_get_notif_attrs_response state machine.
+ *
+ * @param[in] p_ancs     Pointer to an ANCS instance to which the event belongs.
+ * @param[in] p_data_src Pointer to data that was received from the Notification Provider.
+ * @param[in] index      Pointer to an index that helps us keep track of the current data to be parsed.
+ *
+ * @return The next parse state.
+ */
+static ble_ancs_c_parse_state_t attr_len2_parse(ble_ancs_c_t * p_ancs, const uint8_t * p_data_src, uint32_t * index)
+{
+    p_ancs->evt.attr.attr_len |= (p_data_src[(*index)++] << 8);
+    return attr_len_done(p_ancs);
+}
+
+
+/**@brief Function for parsing the data of an iOS attribute.
+ *        Used in the @ref parse_get_notif_attrs_response state machine.
+ *
+ * @details Read the data of the attribute into our local buffer. The largest span available in the
+ *          current GATTC notification is copied at once.
+ *
+ * @param[in] p_ancs     Pointer to an ANCS instance to which the event belongs.
+ * @param[in] p_data_src Pointer to data that was received from the Notification Provider.
+ * @param[in] index      Pointer to an index that helps us keep track of the current data to be parsed.
+ * @param[in] data_len   Length of the data that was received from the Notification Provider.
+ *
+ * @return The next parse state.
+ */
+static ble_ancs_c_parse_state_t attr_data_parse(ble_ancs_c_t  * p_ancs,
+                                                const uint8_t * p_data_src,
+                                                uint32_t      * index,
+                                                uint32_t        data_len)
+{
+    // Copy up to the end of the attribute, or our max allocated internal size minus the NUL terminator.
+    uint32_t limit = min_u32(p_ancs->evt.attr.attr_len,
+                             p_ancs->parse_info.p_attr_list[p_ancs->evt.attr.attr_id].attr_len - 1);
+    uint32_t span  = min_u32(data_len - *index, limit - p_ancs->parse_info.current_attr_index);
+
+    memcpy(&p_ancs->evt.attr.p_attr_data[p_ancs->parse_info.current_attr_index], &p_data_src[*index], span);
+    p_ancs->parse_info.current_attr_index += span;
+    *index                                += span;
 
     // We have reached the end of the attribute, or our max allocated internal size.
     // Stop copying data over to our buffer. NUL-terminate at the current index.
-    if ( (p_ancs->parse_info.current_attr_index == p_ancs->evt.attr.attr_len) ||
-         (p_ancs->parse_info.current_attr_index == p_ancs->parse_info.p_attr_list[p_ancs->evt.attr.attr_id].attr_len - 1))
+    if (p_ancs->parse_info.current_attr_index == limit)
     {
         if (attr_is_requested(p_ancs, p_ancs->evt.attr))
         {
@@ -327,15 +414,25 @@ static ble_ancs_c_parse_state_t attr_data_parse(ble_ancs_c_t  * p_ancs,
 }
 
 
-static ble_ancs_c_parse_state_t attr_skip(ble_ancs_c_t * p_ancs, const uint8_t * p_data_src, uint32_t * index)
+/**@brief Function for skipping the data of an iOS attribute that does not fit into our buffer.
+ *        Used in the @ref parse_get_notif_attrs_response state machine.
+ *
+ * @details The largest span available in the current GATTC notification is skipped at once.
+ *
+ * @param[in] p_ancs     Pointer to an ANCS instance to which the event belongs.
+ * @param[in] index      Pointer to an index that helps us keep track of the current data to be parsed.
+ * @param[in] data_len   Length of the data that was received from the Notification Provider.
+ *
+ * @return The next parse state.
+ */
+static ble_ancs_c_parse_state_t attr_skip(ble_ancs_c_t * p_ancs, uint32_t * index, uint32_t data_len)
 {
-    // We have not reached the end of the attribute, nor our max allocated internal size.
-    // Proceed with copying data over to our buffer.
-    if (p_ancs->parse_info.current_attr_index < p_ancs->evt.attr.attr_len)
-    {
-        p_ancs->parse_info.current_attr_index++;
-        (*index)++;
-    }
+    // Skip up to the end of the attribute.
+    uint32_t span = min_u32(data_len - *index, p_ancs->evt.attr.attr_len - p_ancs->parse_info.current_attr_index);
+
+    p_ancs->parse_info.current_attr_index += span;
+    *index                                += span;
+
     // At the end of the attribute, determine if it should be passed to event handler and
     // continue parsing the next attribute ID if we are not done with all the attributes.
     if (p_ancs->parse_info.current_attr_index == p_ancs->evt.attr.attr_len)
@@ -357,6 +454,46 @@ static ble_ancs_c_parse_state_t attr_skip(ble_ancs_c_t * p_ancs, const uint8_t *
 }
 
 
+/**@brief Function for streaming the data of an iOS attribute to the chunk handler.
+ *        Used in the @ref parse_get_notif_attrs_response state machine.
+ *
+ * @details The largest span available in the current GATTC notification is handed over at once,
+ *          without a copy and without a limit besides the length requested from the Notification
+ *          Provider.
+ *
+ * @param[in] p_ancs     Pointer to an ANCS instance to which the event belongs.
+ * @param[in] p_data_src Pointer to data that was received from the Notification Provider.
+ * @param[in] index      Pointer to an index that helps us keep track of the current data to be parsed.
+ * @param[in] data_len   Length of the data that was received from the Notification Provider.
+ *
+ * @return The next parse state.
+ */
+static ble_ancs_c_parse_state_t attr_chunk_parse(ble_ancs_c_t  * p_ancs,
+                                                 const uint8_t * p_data_src,
+                                                 uint32_t      * index,
+                                                 uint32_t        data_len)
+{
+    uint32_t span = min_u32(data_len - *index, p_ancs->evt.attr.attr_len - p_ancs->parse_info.current_attr_index);
+
+    p_ancs->chunk_handler(&p_ancs->evt, p_ancs->parse_info.current_attr_index, &p_data_src[*index], span, p_ancs->ctx);
+    p_ancs->parse_info.current_attr_index += span;
+    *index                                += span;
+
+    if (p_ancs->parse_info.current_attr_index < p_ancs->evt.attr.attr_len)
+    {
+        return BLE_ANCS_ATTR_CHUNK;
+    }
+
+    ESP_LOGD(TAG, "Attribute streamed, %u bytes", p_ancs->evt.attr.attr_len);
+    p_ancs->evt_handler(&p_ancs->evt, p_ancs->ctx);
+    if (ble_ancs_all_req_attrs_parsed(p_ancs))
+    {
+        return BLE_ANCS_ATTR_DONE;
+    }
+    return BLE_ANCS_ATTR_ID;
+}
+
+
 /**@brief Function for checking whether the data in an iOS notification is out of bounds.
  *
  * @param[in] notif  An iOS notification.
@@ -391,7 +528,7 @@ void ble_ancs_parse_get_attrs_response(ble_ancs_c_t  * p_ancs,
                 break;
 
             case BLE_ANCS_NOTIF_UID:
-                p_ancs->parse_info.parse_state = notif_uid_parse(p_ancs, p_data_src, &index);
+                p_ancs->parse_info.parse_state = notif_uid_parse(p_ancs, p_data_src, &index, hvx_data_len);
                 break;
 
             case BLE_ANCS_APP_ID:
@@ -403,7 +540,7 @@ void ble_ancs_parse_get_attrs_response(ble_ancs_c_t  * p_ancs,
                 break;
 
             case BLE_ANCS_ATTR_LEN1:
-                p_ancs->parse_info.parse_state = attr_len1_parse(p_ancs, p_data_src, &index);
+                p_ancs->parse_info.parse_state = attr_len1_parse(p_ancs, p_data_src, &index, hvx_data_len);
                 break;
 
             case BLE_ANCS_ATTR_LEN2:
@@ -411,11 +548,15 @@ void ble_ancs_parse_get_attrs_response(ble_ancs_c_t  * p_ancs,
                 break;
 
             case BLE_ANCS_ATTR_DATA:
-                p_ancs->parse_info.parse_state = attr_data_parse(p_ancs, p_data_src, &index);
+                p_ancs->parse_info.parse_state = attr_data_parse(p_ancs, p_data_src, &index, hvx_data_len);
                 break;
 
             case BLE_ANCS_ATTR_SKIP:
-                p_ancs->parse_info.parse_state = attr_skip(p_ancs, p_data_src, &index);
+                p_ancs->parse_info.parse_state = attr_skip(p_ancs, &index, hvx_data_len);
+                break;
+
+            case BLE_ANCS_ATTR_CHUNK:
+                p_ancs->parse_info.parse_state = attr_chunk_parse(p_ancs, p_data_src, &index, hvx_data_len);
                 break;
 
             case BLE_ANCS_ATTR_DONE:
@@ -437,6 +578,20 @@ uint32_t ble_ancs_build_notif_attrs_request(ble_ancs_c_t * p_ancs,
                                             uint32_t const p_uid,
                                             uint8_t      * p_data,
                                             uint16_t const len)
+{
+    uint32_t index = ble_ancs_encode_notif_attrs_request(p_ancs->ancs_notif_attr_list, p_uid, p_data, len,
+                                                         &p_ancs->number_of_requested_attr);
+
+    p_ancs->parse_info.expected_number_of_attrs = p_ancs->number_of_requested_attr;
+
+    return index;
+}
+
+uint32_t ble_ancs_encode_notif_attrs_request(ble_ancs_c_attr_list_t const * p_attr_list,
+                                             uint32_t const                 uid,
+                                             uint8_t                      * p_data,
+                                             uint16_t const                 len,
+                                             uint32_t                     * p_count)
 {
     uint32_t index = 0;
 
@@ -444,7 +599,7 @@ uint32_t ble_ancs_build_notif_attrs_request(ble_ancs_c_t * p_ancs,
     index = sizeof(uint8_t) + sizeof(uint32_t); /*Command ID & Notification UID*/
     for (uint32_t attr = 0; attr < BLE_ANCS_NB_OF_NOTIF_ATTR; attr++)
     {
-        if (p_ancs->ancs_notif_attr_list[attr].get == true)
+        if (p_attr_list[attr].get == true)
         {
             index += sizeof(uint8_t); /*Attr*/
 
@@ -462,18 +617,18 @@ uint32_t ble_ancs_build_notif_attrs_request(ble_ancs_c_t * p_ancs,
     }
 
     index = 0;
-    p_ancs->number_of_requested_attr = 0;
+    *p_count = 0;
 
     //Encode Command ID.
     p_data[index++] = BLE_ANCS_COMMAND_ID_GET_NOTIF_ATTRIBUTES;
 
     //Encode Notification UID.
-    index += uint32_encode(p_uid, &(p_data[index]));
+    index += uint32_encode(uid, &(p_data[index]));
 
     //Encode Attribute ID.
     for (uint32_t attr = 0; attr < BLE_ANCS_NB_OF_NOTIF_ATTR; attr++)
     {
-        if (p_ancs->ancs_notif_attr_list[attr].get == true)
+        if (p_attr_list[attr].get == true)
         {
             p_data[index++] = (uint8_t)attr;
 
@@ -482,20 +637,74 @@ uint32_t ble_ancs_build_notif_attrs_request(ble_ancs_c_t * p_ancs,
                 (attr == BLE_ANCS_NOTIF_ATTR_ID_MESSAGE))
             {
                 //Encode Length field. Only applicable for Title, Subtitle, and Message.
-                index += uint16_encode(p_ancs->ancs_notif_attr_list[attr].attr_len,
+                index += uint16_encode(p_attr_list[attr].attr_len,
                                        &(p_data[index]));
             }
 
-            p_ancs->number_of_requested_attr++;
+            (*p_count)++;
         }
     }
 
-    p_ancs->parse_info.expected_number_of_attrs = p_ancs->number_of_requested_attr;
+    return index;
+}
+
+uint32_t ble_ancs_build_app_attrs_request(ble_ancs_c_t * p_ancs,
+                                          const char   * app_id,
+                                          uint8_t      * p_data,
+                                          uint16_t const len)
+{
+    uint32_t count = 0;
+    uint32_t index = ble_ancs_encode_app_attrs_request(p_ancs->ancs_app_attr_list, app_id, p_data, len, &count);
+
+    p_ancs->parse_info.expected_number_of_attrs = count;
 
     return index;
 }
 
-//TODO: uint32_t ble_ancs_build_app_attrs_request()
+uint32_t ble_ancs_encode_app_attrs_request(ble_ancs_c_attr_list_t const * p_attr_list,
+                                           const char                   * app_id,
+                                           uint8_t                      * p_data,
+                                           uint16_t const                 len,
+                                           uint32_t                     * p_count)
+{
+    uint32_t id_len = strlen(app_id) + 1; /*App Identifier with its NUL terminator*/
+    uint32_t index  = sizeof(uint8_t) + id_len; /*Command ID & App Identifier*/
+
+    //Make sure the command fits, app attributes carry no length field.
+    for (uint32_t attr = 0; attr < BLE_ANCS_NB_OF_APP_ATTR; attr++)
+    {
+        if (p_attr_list[attr].get == true)
+        {
+            index += sizeof(uint8_t); /*Attr*/
+        }
+    }
+    if ((index > len) || (id_len > BLE_ANCS_APP_ID_MAX))
+    {
+        return 0;
+    }
+
+    index    = 0;
+    *p_count = 0;
+
+    //Encode Command ID.
+    p_data[index++] = BLE_ANCS_COMMAND_ID_GET_APP_ATTRIBUTES;
+
+    //Encode App Identifier.
+    memcpy(&p_data[index], app_id, id_len);
+    index += id_len;
+
+    //Encode Attribute ID.
+    for (uint32_t attr = 0; attr < BLE_ANCS_NB_OF_APP_ATTR; attr++)
+    {
+        if (p_attr_list[attr].get == true)
+        {
+            p_data[index++] = (uint8_t)attr;
+            (*p_count)++;
+        }
+    }
+
+    return index;
+}
 
 esp_err_t ble_ancs_add_notif_attr(ble_ancs_c_t                       * p_ancs,
                                   ble_ancs_c_notif_attr_id_val_t const id,
@@ -0,0 +1,277 @@
+#include "ble_conn_ctrl.h"
+#include <inttypes.h>
+#include <string.h>
+#include "esp_gap_ble_api.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+#define TAG "CONN"
+
+#define MS_TO_INTERVAL(ms)  ((ms) * 4 / 5)      // 1.25 ms units
+#define SUPERVISION_TIMEOUT 600                 // 10 ms units, 6 s
+#define IDLE_DELAY_US       (CONFIG_NOWA_CONN_IDLE_DELAY_MS * 1000LL)
+
+_Static_assert(CONFIG_NOWA_CONN_IDLE_BACKLOG < CONFIG_NOWA_CONN_BURST_BACKLOG, "No hysteresis between idle and burst");
+// Apple Accessory Design Guidelines: Interval Max * (Latency + 1) <= 2 s, and times 3 below the timeout
+_Static_assert((CONFIG_NOWA_CONN_IDLE_INTERVAL_MS + 15) * (CONFIG_NOWA_CONN_IDLE_LATENCY + 1) <= 2000, "Idle parameters refused by iOS");
+_Static_assert((CONFIG_NOWA_CONN_IDLE_INTERVAL_MS + 15) * (CONFIG_NOWA_CONN_IDLE_LATENCY + 1) * 3 < SUPERVISION_TIMEOUT * 10, "Idle parameters refused by iOS");
+
+static const char *const mode_names[] = { "peer", "fast", "idle" };
+
+static void ble_conn_ctrl_timer_cb(void *arg);
+
+esp_err_t ble_conn_ctrl_init(ble_conn_ctrl_t *c)
+{
+    if (c->timer != NULL) {
+        return ESP_OK;
+    }
+    portMUX_INITIALIZE(&c->lock);
+
+    esp_timer_create_args_t ta = {
+        .callback = ble_conn_ctrl_timer_cb,
+        .arg = c,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "conn_ctrl"
+    };
+    esp_err_t ret = esp_timer_create(&ta, &c->timer);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "%s: esp_timer_create failed, error code = %x", __func__, ret);
+    }
+    return ret;
+}
+
+// Timer follows the next point a decision can change without an event, 0 for none. Lock held.
+static void ble_conn_ctrl_arm(ble_conn_ctrl_t *c, int64_t due)
+{
+    if (due == c->timer_due) {
+        return;
+    }
+    esp_timer_stop(c->timer);
+    c->timer_due = due;
+    if (due != 0) {
+        int64_t delay = due - esp_timer_get_time();
+        esp_timer_start_once(c->timer, (delay > 0) ? delay : 1);
+    }
+}
+
+// Parameters in effect from now, lock held
+static void ble_conn_ctrl_record(ble_conn_ctrl_t *c, uint8_t mode, uint16_t interval, uint16_t latency, uint16_t timeout)
+{
+    c->interval = interval;
+    c->latency = latency;
+    c->timeout = timeout;
+
+    ble_conn_sample_t *s = &c->history[c->history_next];
+    s->at = esp_timer_get_time();
+    s->interval = interval;
+    s->latency = latency;
+    s->timeout = timeout;
+    s->mode = mode;
+    s->backlog = (c->backlog > UINT16_MAX) ? UINT16_MAX : c->backlog;
+    c->history_next = (c->history_next + 1) % BLE_CONN_CTRL_HISTORY;
+    if (c->history_len < BLE_CONN_CTRL_HISTORY) {
+        c->history_len ++;
+    }
+}
+
+/**@brief Mode to ask the phone for now, BLE_CONN_MODE_PEER for none. Lock held.
+ *
+ * @details A mode returned counts as outstanding, the caller asks for it once the lock is released.
+ */
+static uint8_t ble_conn_ctrl_evaluate(ble_conn_ctrl_t *c, int64_t now)
+{
+#ifndef CONFIG_NOWA_CONN_CONTROL
+    return BLE_CONN_MODE_PEER;
+#else
+    if (!c->active) {
+        ble_conn_ctrl_arm(c, 0);
+        return BLE_CONN_MODE_PEER;
+    }
+
+    if (c->updating) {
+        if (now - c->update_at < BLE_CONN_CTRL_UPDATE_US) {
+            ble_conn_ctrl_arm(c, c->update_at + BLE_CONN_CTRL_UPDATE_US);
+            return BLE_CONN_MODE_PEER; // Decided again on completion
+        }
+        c->updating = false; // Never completed
+        c->rejected ++;
+        c->retry_after = now + IDLE_DELAY_US;
+    }
+
+    if (c->backlog > CONFIG_NOWA_CONN_IDLE_BACKLOG) {
+        c->low_since = 0;
+    } else if (c->low_since == 0) {
+        c->low_since = now;
+    }
+
+    uint8_t want = BLE_CONN_MODE_PEER;
+    int64_t due = 0;
+    if (now < c->retry_after) {
+        due = c->retry_after;
+    } else if (c->backlog >= CONFIG_NOWA_CONN_BURST_BACKLOG && c->mode != BLE_CONN_MODE_FAST) {
+        want = BLE_CONN_MODE_FAST;
+    } else if (c->low_since != 0 && c->ready && c->mode != BLE_CONN_MODE_IDLE) {
+        if (now - c->low_since >= IDLE_DELAY_US) {
+            want = BLE_CONN_MODE_IDLE;
+        } else {
+            due = c->low_since + IDLE_DELAY_US;
+        }
+    }
+
+    if (want != BLE_CONN_MODE_PEER) {
+        c->updating = true;
+        c->want = want;
+        c->update_at = now;
+        due = now + BLE_CONN_CTRL_UPDATE_US;
+        if (want == BLE_CONN_MODE_FAST) {
+            c->fast_requests ++;
+        } else {
+            c->idle_requests ++;
+        }
+    }
+    ble_conn_ctrl_arm(c, due);
+    return want;
+#endif
+}
+
+// Ask for the parameters of a mode returned by ble_conn_ctrl_evaluate()
+static void ble_conn_ctrl_request(ble_conn_ctrl_t *c, uint8_t mode)
+{
+    if (mode == BLE_CONN_MODE_PEER) {
+        return;
+    }
+    bool fast = (mode == BLE_CONN_MODE_FAST);
+    uint32_t ms = fast ? CONFIG_NOWA_CONN_FAST_INTERVAL_MS : CONFIG_NOWA_CONN_IDLE_INTERVAL_MS;
+    esp_ble_conn_update_params_t params = {
+        .min_int = MS_TO_INTERVAL(ms),
+        .max_int = MS_TO_INTERVAL(ms + 15),     // iOS wants Interval Min + 15 ms <= Interval Max
+        .latency = fast ? 0 : CONFIG_NOWA_CONN_IDLE_LATENCY,
+        .timeout = SUPERVISION_TIMEOUT,
+    };
+    portENTER_CRITICAL(&c->lock);
+    memcpy(params.bda, c->bda, sizeof(params.bda));
+    uint32_t backlog = c->backlog;
+    portEXIT_CRITICAL(&c->lock);
+
+    ESP_LOGI(TAG, "Asking for %s: %" PRIu32 "-%" PRIu32 " ms, latency %u, backlog %" PRIu32,
+             mode_names[mode], ms, ms + 15, params.latency, backlog);
+    esp_err_t ret = esp_ble_gap_update_conn_params(&params);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "%s: update not sent (%s)", __func__, esp_err_to_name(ret));
+        portENTER_CRITICAL(&c->lock);
+        c->updating = false;
+        c->rejected ++;
+        c->retry_after = esp_timer_get_time() + IDLE_DELAY_US;
+        ble_conn_ctrl_arm(c, c->retry_after);
+        portEXIT_CRITICAL(&c->lock);
+    }
+}
+
+static void ble_conn_ctrl_timer_cb(void *arg)
+{
+    ble_conn_ctrl_t *c = (ble_conn_ctrl_t *)arg;
+    portENTER_CRITICAL(&c->lock);
+    c->timer_due = 0;
+    uint8_t mode = ble_conn_ctrl_evaluate(c, esp_timer_get_time());
+    portEXIT_CRITICAL(&c->lock);
+    ble_conn_ctrl_request(c, mode);
+}
+
+// Link up with the parameters the phone connected with
+void ble_conn_ctrl_start(ble_conn_ctrl_t *c, const uint8_t bda[6], uint16_t interval, uint16_t latency, uint16_t timeout)
+{
+    portENTER_CRITICAL(&c->lock);
+    memcpy(c->bda, bda, sizeof(c->bda));
+    c->active = true;
+    c->ready = false;
+    c->updating = false;
+    c->mode = BLE_CONN_MODE_PEER;
+    c->retry_after = 0;
+    c->low_since = 0;
+    c->backlog = 0;
+    c->history_len = 0;
+    c->history_next = 0;
+    ble_conn_ctrl_record(c, BLE_CONN_MODE_PEER, interval, latency, timeout);
+    portEXIT_CRITICAL(&c->lock);
+}
+
+// Setup of the link done, the idle delay counts from now
+void ble_conn_ctrl_ready(ble_conn_ctrl_t *c)
+{
+    portENTER_CRITICAL(&c->lock);
+    int64_t now = esp_timer_get_time();
+    c->ready = true;
+    c->low_since = (c->backlog <= CONFIG_NOWA_CONN_IDLE_BACKLOG) ? now : 0;
+    uint8_t mode = ble_conn_ctrl_evaluate(c, now);
+    portEXIT_CRITICAL(&c->lock);
+    ble_conn_ctrl_request(c, mode);
+}
+
+void ble_conn_ctrl_stop(ble_conn_ctrl_t *c)
+{
+    portENTER_CRITICAL(&c->lock);
+    c->active = false;
+    c->updating = false;
+    if (c->timer != NULL) {
+        ble_conn_ctrl_arm(c, 0);
+    }
+    portEXIT_CRITICAL(&c->lock);
+}
+
+// Attribute requests queued or in flight on the link, from the Dispatcher worker
+void ble_conn_ctrl_backlog(ble_conn_ctrl_t *c, uint32_t backlog)
+{
+    portENTER_CRITICAL(&c->lock);
+    if (!c->active) {
+        portEXIT_CRITICAL(&c->lock);
+        return;
+    }
+    c->backlog = backlog;
+    uint8_t mode = ble_conn_ctrl_evaluate(c, esp_timer_get_time());
+    portEXIT_CRITICAL(&c->lock);
+    ble_conn_ctrl_request(c, mode);
+}
+
+/**@brief Connection parameters changed, or an update failed.
+ *
+ * @details Completes the update outstanding, if any. A change the phone made on its own is
+ *          recorded but not fought, the mode stays until the backlog calls for another one.
+ */
+void ble_conn_ctrl_updated(ble_conn_ctrl_t *c, bool ok, uint16_t interval, uint16_t latency, uint16_t timeout)
+{
+    portENTER_CRITICAL(&c->lock);
+    if (!c->active) {
+        portEXIT_CRITICAL(&c->lock);
+        return;
+    }
+    uint8_t granted = BLE_CONN_MODE_PEER;
+    if (c->updating) {
+        c->updating = false;
+        if (ok) {
+            c->mode = c->want;
+            granted = c->want;
+        } else {
+            c->rejected ++;
+            c->retry_after = esp_timer_get_time() + IDLE_DELAY_US;
+        }
+    }
+    if (ok) {
+        ble_conn_ctrl_record(c, granted, interval, latency, timeout);
+    }
+    uint8_t mode = ble_conn_ctrl_evaluate(c, esp_timer_get_time());
+    portEXIT_CRITICAL(&c->lock);
+    ble_conn_ctrl_request(c, mode);
+}
+
+// Parameter changes of the current connection, oldest first
+size_t ble_conn_ctrl_history(ble_conn_ctrl_t *c, ble_conn_sample_t *out, size_t max)
+{
+    portENTER_CRITICAL(&c->lock);
+    size_t n = (c->history_len < max) ? c->history_len : max;
+    size_t first = (c->history_next + BLE_CONN_CTRL_HISTORY - c->history_len) % BLE_CONN_CTRL_HISTORY;
+    for (size_t i = 0; i < n; i ++) {
+        out[i] = c->history[(first + c->history_len - n + i) % BLE_CONN_CTRL_HISTORY];
+    }
+    portEXIT_CRITICAL(&c->lock);
+    return n;
+}
@@ -0,0 +1,290 @@
+#include "ble_gatt_ops.h"
+#include <string.h>
+#include "esp_log.h"
+
+#define TAG "GOPS"
+
+static void ble_gatt_ops_timer_cb(void *arg)
+{
+    ble_gatt_ops_pump((ble_gatt_ops_t *)arg);
+}
+
+esp_err_t ble_gatt_ops_init(ble_gatt_ops_t *q, ble_gatt_ops_given_up_t given_up, void *ctx)
+{
+    if (q->timer != NULL) {
+        return ESP_OK;
+    }
+    portMUX_INITIALIZE(&q->lock);
+    q->given_up = given_up;
+    q->ctx = ctx;
+
+    esp_timer_create_args_t ta = {
+        .callback = ble_gatt_ops_timer_cb,
+        .arg = q,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "gatt_ops"
+    };
+    esp_err_t ret = esp_timer_create(&ta, &q->timer);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "%s: esp_timer_create failed, error code = %x", __func__, ret);
+    }
+    return ret;
+}
+
+// Timer follows the earliest retry, lock held
+static void ble_gatt_ops_arm_timer(ble_gatt_ops_t *q)
+{
+    int64_t due = 0;
+    for (uint32_t i = 0; i < BLE_GATT_OPS_MAX; i ++) {
+        const ble_gatt_op_t *o = &q->ops[i];
+        if (o->state == BLE_GATT_OP_QUEUED && o->due != 0 && (due == 0 || o->due < due)) {
+            due = o->due;
+        }
+    }
+
+    esp_timer_stop(q->timer);
+    if (due != 0) {
+        int64_t delay = due - esp_timer_get_time();
+        esp_timer_start_once(q->timer, (delay > 0) ? delay : 1);
+    }
+}
+
+// Queue the operation again after a busy refusal, false once out of tries and freed, for the
+// caller to report once the lock is released. Lock held.
+static bool ble_gatt_ops_retry(ble_gatt_ops_t *q, ble_gatt_op_t *o)
+{
+    if (++ o->tries >= BLE_GATT_OPS_TRIES) {
+        o->state = BLE_GATT_OP_FREE;
+        q->failed ++;
+        return false;
+    }
+    o->state = BLE_GATT_OP_QUEUED;
+    o->due = esp_timer_get_time() + ((int64_t)BLE_GATT_OPS_RETRY_US << (o->tries - 1));
+    q->retried ++;
+    ble_gatt_ops_arm_timer(q);
+    return true;
+}
+
+static void ble_gatt_ops_give_up(ble_gatt_ops_t *q, const ble_gatt_op_t *op)
+{
+    ESP_LOGE(TAG, "Operation on handle %u given up after %u tries", op->handle, BLE_GATT_OPS_TRIES);
+    if (q->given_up != NULL) {
+        q->given_up(q->ctx, op);
+    }
+}
+
+void ble_gatt_ops_bind(ble_gatt_ops_t *q, esp_gatt_if_t gattc_if, uint16_t conn_id)
+{
+    portENTER_CRITICAL(&q->lock);
+    memset(q->ops, 0, sizeof(q->ops));
+    q->gattc_if = gattc_if;
+    q->conn_id = conn_id;
+    q->bound = true;
+    q->held = false;
+    q->in_flight = 0;
+    portEXIT_CRITICAL(&q->lock);
+}
+
+// Link gone, so are the completions of what is in flight
+void ble_gatt_ops_reset(ble_gatt_ops_t *q)
+{
+    portENTER_CRITICAL(&q->lock);
+    memset(q->ops, 0, sizeof(q->ops));
+    q->bound = false;
+    q->held = false;
+    q->in_flight = 0;
+    if (q->timer != NULL) {
+        esp_timer_stop(q->timer);
+    }
+    portEXIT_CRITICAL(&q->lock);
+}
+
+void ble_gatt_ops_hold(ble_gatt_ops_t *q, bool held)
+{
+    portENTER_CRITICAL(&q->lock);
+    q->held = held;
+    portEXIT_CRITICAL(&q->lock);
+    ble_gatt_ops_pump(q);
+}
+
+static bool ble_gatt_ops_queue(ble_gatt_ops_t *q, const ble_gatt_op_t *op)
+{
+    ble_gatt_op_t *o = NULL;
+    portENTER_CRITICAL(&q->lock);
+    for (uint32_t i = 0; q->bound && i < BLE_GATT_OPS_MAX; i ++) {
+        if (q->ops[i].state == BLE_GATT_OP_FREE) {
+            o = &q->ops[i];
+            *o = *op;
+            o->state = BLE_GATT_OP_QUEUED;
+            o->seq = q->seq ++;
+            break;
+        }
+    }
+    if (o == NULL && q->bound) {
+        q->dropped ++;
+    }
+    portEXIT_CRITICAL(&q->lock);
+
+    if (o == NULL) {
+        ESP_LOGE(TAG, "Operation on handle %u not queued", op->handle);
+        return false;
+    }
+    ble_gatt_ops_pump(q);
+    return true;
+}
+
+bool ble_gatt_ops_read(ble_gatt_ops_t *q, uint16_t handle, bool urgent)
+{
+    ble_gatt_op_t op = {
+        .type = BLE_GATT_OP_READ_CHAR,
+        .urgent = urgent,
+        .handle = handle,
+    };
+    return ble_gatt_ops_queue(q, &op);
+}
+
+bool ble_gatt_ops_write_descr(ble_gatt_ops_t *q, uint16_t handle, const uint8_t *value, uint8_t len, bool urgent)
+{
+    ble_gatt_op_t op = {
+        .type = BLE_GATT_OP_WRITE_DESCR,
+        .urgent = urgent,
+        .handle = handle,
+        .len = len,
+    };
+    if (len > sizeof(op.value)) {
+        return false;
+    }
+    memcpy(op.value, value, len);
+    return ble_gatt_ops_queue(q, &op);
+}
+
+/**@brief Account the completion event of an operation, false if it was refused as busy and is
+ *        retried or given up, so the caller is to ignore the event.
+ *
+ * @details Completions come in the order the operations went on air, so the oldest one in flight
+ *          with the same type and handle is the one completed. Events of operations not issued
+ *          here are passed through.
+ */
+bool ble_gatt_ops_complete(ble_gatt_ops_t *q, ble_gatt_op_type_t type, uint16_t handle, esp_gatt_status_t status)
+{
+    bool final = true;
+    bool given_up = false;
+    ble_gatt_op_t op;
+    portENTER_CRITICAL(&q->lock);
+    ble_gatt_op_t *o = NULL;
+    for (uint32_t i = 0; i < BLE_GATT_OPS_MAX; i ++) {
+        ble_gatt_op_t *c = &q->ops[i];
+        if (c->state == BLE_GATT_OP_IN_FLIGHT && c->type == type && c->handle == handle &&
+            (o == NULL || (int32_t)(c->seq - o->seq) < 0)) {
+            o = c;
+        }
+    }
+    if (o != NULL) {
+        q->in_flight --;
+        bool busy = (status == ESP_GATT_BUSY || status == ESP_GATT_NO_RESOURCES || status == ESP_GATT_CONGESTED);
+        if (busy) {
+            op = *o;
+            final = false;
+            given_up = !ble_gatt_ops_retry(q, o);
+        } else {
+            o->state = BLE_GATT_OP_FREE;
+            q->failed += (status != ESP_GATT_OK) ? 1 : 0;
+        }
+    }
+    portEXIT_CRITICAL(&q->lock);
+
+    if (given_up) {
+        ble_gatt_ops_give_up(q, &op);
+    }
+    ble_gatt_ops_pump(q);
+    return final;
+}
+
+// Next to issue: urgent first, then in queueing order. Lock held.
+static ble_gatt_op_t *ble_gatt_ops_next(ble_gatt_ops_t *q, int64_t now)
+{
+    ble_gatt_op_t *next = NULL;
+    bool urgent_pending = false;
+    for (uint32_t i = 0; i < BLE_GATT_OPS_MAX; i ++) {
+        ble_gatt_op_t *o = &q->ops[i];
+        if (o->state == BLE_GATT_OP_FREE) {
+            continue;
+        }
+        urgent_pending |= o->urgent;
+        if (o->state != BLE_GATT_OP_QUEUED || o->due > now) {
+            continue;
+        }
+        if (next == NULL || (o->urgent && !next->urgent) ||
+            (o->urgent == next->urgent && (int32_t)(o->seq - next->seq) < 0)) {
+            next = o;
+        }
+    }
+    if (next != NULL && !next->urgent && (q->held || urgent_pending)) {
+        return NULL;
+    }
+    return next;
+}
+
+static esp_err_t ble_gatt_ops_issue(esp_gatt_if_t gattc_if, uint16_t conn_id, ble_gatt_op_t *op)
+{
+    switch (op->type) {
+    case BLE_GATT_OP_READ_CHAR:
+        return esp_ble_gattc_read_char(gattc_if, conn_id, op->handle, ESP_GATT_AUTH_REQ_NONE);
+    case BLE_GATT_OP_WRITE_DESCR:
+        return esp_ble_gattc_write_char_descr(gattc_if, conn_id, op->handle, op->len, op->value,
+                                              ESP_GATT_WRITE_TYPE_RSP, ESP_GATT_AUTH_REQ_NONE);
+    default:
+        return ESP_ERR_INVALID_ARG;
+    }
+}
+
+// Hand queued operations to the stack, up to BLE_GATT_OPS_DEPTH in flight
+void ble_gatt_ops_pump(ble_gatt_ops_t *q)
+{
+    for (;;) {
+        ble_gatt_op_t op;
+        esp_gatt_if_t gattc_if = 0;
+        uint16_t conn_id = 0;
+        uint32_t slot = 0;
+
+        portENTER_CRITICAL(&q->lock);
+        ble_gatt_op_t *next = (q->bound && q->in_flight < BLE_GATT_OPS_DEPTH) ? ble_gatt_ops_next(q, esp_timer_get_time()) : NULL;
+        if (next != NULL) {
+            next->state = BLE_GATT_OP_IN_FLIGHT;
+            next->due = 0;
+            q->in_flight ++;
+            q->max_in_flight = (q->in_flight > q->max_in_flight) ? q->in_flight : q->max_in_flight;
+            q->issued ++;
+            op = *next;
+            slot = next - q->ops;
+            gattc_if = q->gattc_if;
+            conn_id = q->conn_id;
+        }
+        portEXIT_CRITICAL(&q->lock);
+
+        if (next == NULL) {
+            return;
+        }
+
+        esp_err_t ret = ble_gatt_ops_issue(gattc_if, conn_id, &op);
+        if (ret == ESP_OK) {
+            continue;
+        }
+
+        // Refused at the call, no completion event is coming
+        bool retried = false, given_up = false;
+        portENTER_CRITICAL(&q->lock);
+        ble_gatt_op_t *o = &q->ops[slot];
+        if (o->state == BLE_GATT_OP_IN_FLIGHT && o->seq == op.seq) {
+            q->in_flight --;
+            retried = ble_gatt_ops_retry(q, o);
+            given_up = !retried;
+        }
+        portEXIT_CRITICAL(&q->lock);
+        ESP_LOGW(TAG, "Operation on handle %u refused (%s)%s", op.handle, esp_err_to_name(ret), retried ? ", retrying" : "");
+        if (!given_up) {
+            return; // The timer pumps again
+        }
+        ble_gatt_ops_give_up(q, &op);
+    }
+}
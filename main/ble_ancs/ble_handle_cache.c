@@ -0,0 +1,97 @@
+#include "ble_handle_cache.h"
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+
+#define TAG "HCACHE"
+#define NVS_NAMESPACE "nowa_gatt"
+
+void ble_bda_key(const uint8_t bda[6], char out[BLE_BDA_KEY_LEN])
+{
+    snprintf(out, BLE_BDA_KEY_LEN, "%02x%02x%02x%02x%02x%02x", bda[0], bda[1], bda[2], bda[3], bda[4], bda[5]);
+}
+
+/**@brief Cached handles of a phone, ESP_ERR_NVS_NOT_FOUND if there are none.
+ *
+ * @details An entry of another size or version is ignored, which only costs a discovery.
+ */
+esp_err_t ble_handle_cache_load(const uint8_t bda[6], ble_handle_cache_t *entry)
+{
+#ifndef CONFIG_NOWA_GATT_HANDLE_CACHE
+    return ESP_ERR_NOT_SUPPORTED;
+#else
+    nvs_handle_t h;
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READONLY, &h);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    char k[BLE_BDA_KEY_LEN];
+    ble_bda_key(bda, k);
+    size_t len = sizeof(*entry);
+    ret = nvs_get_blob(h, k, entry, &len);
+    nvs_close(h);
+    bool outdated = (ret == ESP_OK && (len != sizeof(*entry) || entry->version != BLE_HANDLE_CACHE_VERSION));
+    if (outdated || ret == ESP_ERR_NVS_INVALID_LENGTH) {
+        ESP_LOGW(TAG, "%s: outdated entry, ignored", k);
+        ret = ESP_ERR_INVALID_VERSION;
+    }
+    if (ret == ESP_OK) {
+        entry->name[sizeof(entry->name) - 1] = '\0';
+    }
+    return ret;
+#endif
+}
+
+esp_err_t ble_handle_cache_save(const uint8_t bda[6], const ble_handle_cache_t *entry)
+{
+#ifndef CONFIG_NOWA_GATT_HANDLE_CACHE
+    return ESP_ERR_NOT_SUPPORTED;
+#else
+    nvs_handle_t h;
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &h);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "%s: nvs_open failed (%s)", __func__, esp_err_to_name(ret));
+        return ret;
+    }
+
+    char k[BLE_BDA_KEY_LEN];
+    ble_bda_key(bda, k);
+    ret = nvs_set_blob(h, k, entry, sizeof(*entry));
+    if (ret == ESP_OK) {
+        ret = nvs_commit(h);
+    }
+    nvs_close(h);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "%s: %s failed (%s)", __func__, k, esp_err_to_name(ret));
+    }
+    return ret;
+#endif
+}
+
+esp_err_t ble_handle_cache_erase(const uint8_t bda[6])
+{
+#ifndef CONFIG_NOWA_GATT_HANDLE_CACHE
+    return ESP_ERR_NOT_SUPPORTED;
+#else
+    nvs_handle_t h;
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &h);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    char k[BLE_BDA_KEY_LEN];
+    ble_bda_key(bda, k);
+    ret = nvs_erase_key(h, k);
+    if (ret == ESP_OK) {
+        ret = nvs_commit(h);
+    } else if (ret == ESP_ERR_NVS_NOT_FOUND) {
+        ret = ESP_OK;
+    }
+    nvs_close(h);
+    return ret;
+#endif
+}
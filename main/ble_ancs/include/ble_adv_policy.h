@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_gap_ble_api.h"
+
+#define BLE_ADV_POLICY_ACCEPT_MAX   12  // Bonds put on the filter accept list
+#define BLE_ADV_POLICY_PEERS        8   // Bonded phones with reconnection statistics, least recently seen replaced
+
+typedef enum {
+    BLE_ADV_PHASE_OFF,      // Advertising data not configured yet
+    BLE_ADV_PHASE_FAST,     // After boot or a disconnection, bonded phones only if there are any
+    BLE_ADV_PHASE_SLOW,     // Open to every phone
+} ble_adv_phase_t;
+
+// Time from the disconnection of a bonded phone, or from boot, to its next connection
+typedef struct {
+    uint8_t bda[6];
+    int64_t disconnected_at;    // esp_timer time, 0 while connected
+    int64_t seen_at;            // Last connection or disconnection
+    uint32_t reconnects;
+    uint32_t in_fast;           // Within the fast window
+    int64_t total_us;
+    int64_t min_us;
+    int64_t max_us;
+    int64_t last_us;
+} ble_adv_peer_t;
+
+typedef struct {
+    uint8_t phase;              // ble_adv_phase_t
+    uint8_t accept_list;        // Bonds on the filter accept list
+    bool filtered;              // Connections from the accept list only
+    uint16_t interval;          // 0.625 ms units
+    int64_t fast_until;         // End of the fast window, esp_timer time
+    uint32_t fast_windows;
+    uint32_t restarts;          // Advertising (re)started
+} ble_adv_state_t;
+
+/**@brief Advertising of the accessory, fast for bonded phones coming back, slow for everyone else.
+ *
+ * @details Boot and every disconnection open a window of NOWA_ADV_FAST_WINDOW_S at the fast
+ *          interval, during which only phones on the filter accept list, the bonded ones, may
+ *          connect (NOWA_ADV_FILTER_BONDED). After it, the slow interval accepts any phone, so a
+ *          new one can pair and a bonded one the controller failed to resolve still gets in. The
+ *          accept list follows the bonds. Calls come from the BT task, the end of the window from
+ *          a timer, the lock covers the state, not the calls into the stack.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t ble_adv_policy_init(const esp_ble_adv_params_t *base);
+void ble_adv_policy_start(void);
+void ble_adv_policy_stop(void);
+void ble_adv_policy_connected(const uint8_t bda[6]);
+void ble_adv_policy_disconnected(const uint8_t bda[6]);
+void ble_adv_policy_bonds_changed(void);
+void ble_adv_policy_state(ble_adv_state_t *state);
+size_t ble_adv_policy_peers(ble_adv_peer_t *out, size_t max);
+
+#ifdef __cplusplus
+}
+#endif
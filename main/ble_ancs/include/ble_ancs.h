@@ -1,9 +1,24 @@
 #pragma once
 
 #include "esp_system.h"
+#include "sdkconfig.h"
 #include "ble_ancs_utils.h"
+#include "ble_conn_ctrl.h"
+#include "ble_adv_policy.h"
 
-#define ANCS_PROFILE_NUM 4
+#define ANCS_PROFILE_NUM CONFIG_NOWA_PROFILE_COUNT // Phones connected at once, one GATT client app each
+#define ANCS_PIPELINE_DEPTH CONFIG_NOWA_ATTR_PIPELINE_DEPTH // Attribute requests in flight per profile
+#define MAX_NOTIF_ATTR_SIZE 511
+#define ANCS_DEFAULT_MTU 23         // ATT MTU before the exchange, or when the phone refuses it
+#define ANCS_DEFAULT_DATA_LEN 27    // LE payload per packet without Data Length Extension
+
+// Control Point errors, ATT status of the write as defined by the ANCS specification
+#define ANCS_STATUS_UNKNOWN_COMMAND     0xA0
+#define ANCS_STATUS_INVALID_COMMAND     0xA1
+#define ANCS_STATUS_INVALID_PARAMETER   0xA2 // Notification UID no longer exists on the phone
+#define ANCS_STATUS_ACTION_FAILED       0xA3
+// No complete response in time, outside the ATT status range
+#define ANCS_STATUS_TIMEOUT             0x0100
 
 typedef struct {
     void (*connect)(void *ctx, uint8_t idx, uint8_t bda[6]);
@@ -12,8 +27,114 @@ typedef struct {
     void (*notification)(void *ctx, uint8_t idx, ble_ancs_c_evt_notif_t *notif);
     void (*attribute)(void *ctx, uint8_t idx, uint32_t uid, ble_ancs_c_attr_t *attr);
     void (*attributes_done)(void *ctx, uint8_t idx, uint32_t uid);
+    // Optional: destination buffer for an attribute of the request being sent, NULL to use the driver buffer.
+    // NULL with a length streams the attribute, up to that length, to attribute_chunk instead
+    uint8_t *(*attribute_buffer)(void *ctx, uint8_t idx, uint32_t uid, uint32_t attr_id, uint16_t *len);
+    // Optional: part of a streamed attribute at offset, on the BT task as packets arrive. data is only
+    // valid during the call. attribute follows once it is complete, with the full length and no data
+    void (*attribute_chunk)(void *ctx, uint8_t idx, uint32_t uid, uint32_t attr_id, uint16_t offset, const uint8_t *data, uint16_t len);
+    // Request for uid ended without attributes_done: Control Point write status (NP error codes
+    // 0xA0-0xA3 or a GATT error) on the BT task, or ANCS_STATUS_TIMEOUT on the esp_timer task, on
+    // the BT task if it was parsing the response. Its attribute buffers are no longer written
+    void (*request_error)(void *ctx, uint8_t idx, uint32_t uid, uint16_t status);
+    // Display name answering ancs_send_app_attrs_request(), or NULL and the status of the failure,
+    // on the same tasks as request_error
+    void (*app_name)(void *ctx, uint8_t idx, const char *name, uint16_t status);
+    // Optional: the bond with a phone was removed, on the BT task. Whatever is kept for it is stale,
+    // the driver has already erased its cached handles
+    void (*bond_removed)(void *ctx, uint8_t bda[6]);
 } ancs_handlers_t;
 
+// Connection setup milestones of a profile, esp_timer time in us, 0 until reached
+typedef struct {
+    int64_t connect;        // Link up, bound to the profile
+    int64_t open;           // GATT client connection open
+    int64_t mtu;            // MTU exchanged
+    int64_t encrypted;      // Link encrypted
+    int64_t discovered;     // Handles known, by service discovery or from the handle cache
+    int64_t subscribed;     // Notification Source and Data Source enabled
+    int64_t first_notif;    // First Notification Source event
+    int64_t gap_read;       // Device Name read, after the subscriptions
+    bool cached;            // Handles came from the cache
+} ancs_setup_times_t;
+
+// Connect to subscribed and to first notification, by how the handles were found
+typedef struct {
+    uint32_t setups;
+    int64_t subscribed_total_us;
+    uint32_t first_notifs;
+    int64_t first_notif_total_us;
+} ancs_setup_path_t;
+
+typedef struct {
+    ancs_setup_path_t cached;
+    ancs_setup_path_t discovered;
+    uint32_t invalidations; // Cached handles dropped: Service Changed, a failed subscription or a lost bond
+
+    // Setup reads and CCCD writes, see ble_gatt_ops_t
+    uint32_t gatt_ops;
+    uint32_t gatt_retries;
+    uint32_t gatt_failures;
+    uint32_t gatt_dropped;
+    uint8_t gatt_max_in_flight;
+
+    uint32_t mtu_refused;   // Links left at ANCS_DEFAULT_MTU
+    uint32_t dle_refused;   // Links left at ANCS_DEFAULT_DATA_LEN
+
+    // Connection parameter updates, see ble_conn_ctrl_t
+    uint32_t conn_fast_requests;
+    uint32_t conn_idle_requests;
+    uint32_t conn_rejected;
+} ancs_setup_stats_t;
+
+typedef enum {
+    ANCS_NEGOTIATION_PENDING,
+    ANCS_NEGOTIATION_DONE,
+    ANCS_NEGOTIATION_REFUSED,   // Defaults kept
+} ancs_negotiation_t;
+
+// Telemetry of a profile's link: negotiated sizes, radio, traffic and attribute round trips, since connect
+typedef struct {
+    uint16_t mtu;           // ATT MTU in use
+    uint16_t tx_octets;     // LE payload per packet, from Data Length Extension
+    uint16_t rx_octets;
+    uint8_t mtu_state;      // ancs_negotiation_t
+    uint8_t dle_state;      // ancs_negotiation_t
+    uint32_t ns_notifs;     // Notification Source notifications
+    uint32_t ns_bytes;
+    uint32_t ds_notifs;     // Data Source notifications
+    uint32_t ds_bytes;      // Their payload, ds_bytes / ds_notifs is at most mtu - 3
+    uint16_t conn_interval; // 1.25 ms units
+    uint16_t conn_latency;
+    uint16_t conn_timeout;  // 10 ms units
+    uint8_t conn_mode;      // ble_conn_mode_t
+
+    // Sampled every NOWA_TELEMETRY_PERIOD_MS
+    int8_t rssi;            // dBm, 0 until read
+    int64_t rssi_at;        // esp_timer time of the reading
+    uint32_t ns_per_s;      // Over the last period
+    uint32_t ds_per_s;
+    uint32_t ds_bytes_per_s;
+
+    // Get Notification Attributes, Control Point write to the end of the response
+    uint32_t rtt_count;
+    uint32_t rtt_timeouts;
+    int64_t rtt_total_us;
+    int64_t rtt_max_us;
+    int64_t rtt_last_us;
+} ancs_link_info_t;
+
+// Get Notification Attributes command for a fixed attribute set, encoded ahead with the UID left 0
+#define ANCS_ATTR_FRAME_UID_OFFSET  1   // After the Command ID
+#define ANCS_ATTR_FRAME_MAX         (1 + sizeof(uint32_t) + BLE_ANCS_NB_OF_NOTIF_ATTR * (1 + sizeof(uint16_t)))
+
+typedef struct {
+    uint8_t mask;                       // Bit per ble_ancs_c_notif_attr_id_val_t requested
+    uint8_t count;                      // Attributes requested, as many come back in the response
+    uint8_t len;                        // Bytes of data used
+    uint8_t data[ANCS_ATTR_FRAME_MAX];
+} ancs_attr_frame_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -21,7 +142,15 @@ extern "C" {
 esp_err_t ancs_init(void *ctx, ancs_handlers_t *h);
 esp_err_t ancs_deinit(void *ctx);
 bool ancs_is_initialized(void);
-bool ancs_send_attrs_request(uint8_t idx, uint32_t uid, const ble_ancs_c_notif_attr_id_val_t attrs[], uint32_t attrs_length);
+bool ancs_send_attrs_request(uint8_t idx, uint32_t uid, const ancs_attr_frame_t *frame);
+bool ancs_send_app_attrs_request(uint8_t idx, const char *app_id);
+bool ancs_get_setup_times(uint8_t idx, ancs_setup_times_t *times);
+void ancs_get_setup_stats(ancs_setup_stats_t *stats);
+bool ancs_get_link_info(uint8_t idx, ancs_link_info_t *info);
+size_t ancs_get_conn_history(uint8_t idx, ble_conn_sample_t *out, size_t max);
+void ancs_set_backlog(uint8_t idx, uint32_t pending);
+void ancs_get_adv_state(ble_adv_state_t *state);
+size_t ancs_get_reconnect_stats(ble_adv_peer_t *out, size_t max);
 
 #ifdef __cplusplus
 }
@@ -16,6 +16,7 @@
 #define BLE_ANCS_NB_OF_NOTIF_ATTR           8   //!< Number of iOS notification attributes: AppIdentifier, Title, Subtitle, Message, MessageSize, Date, PositiveActionLabel, NegativeActionLabel.
 #define BLE_ANCS_NB_OF_APP_ATTR             1   //!< Number of iOS application attributes: DisplayName.
 #define BLE_ANCS_NB_OF_EVT_ID               3   //!< Number of iOS notification events: Added, Modified, Removed.
+#define BLE_ANCS_APP_ID_MAX                 128 //!< Longest app identifier handled, including the NUL terminator.
 
 #define BLE_ANCS_NOTIFICATION_DATA_LENGTH   8
 
@@ -128,6 +129,7 @@ typedef enum
     BLE_ANCS_ATTR_LEN2,     /**< Parsing the MSB of the attribute length. */
     BLE_ANCS_ATTR_DATA,     /**< Parsing the attribute data. */
     BLE_ANCS_ATTR_SKIP,     /**< Parsing is skipped for the rest of an attribute (or entire attribute). */
+    BLE_ANCS_ATTR_CHUNK,    /**< Attribute data is handed to the chunk handler as it arrives. */
     BLE_ANCS_ATTR_DONE,     /**< Parsing for one attribute is done. */
 } ble_ancs_c_parse_state_t;
 
@@ -168,7 +170,7 @@ typedef struct
 {
     bool                              get;          //!< Boolean to determine whether this attribute will be requested from the Notification Provider.
     uint32_t                          attr_id;      //!< Attribute ID: AppIdentifier(0), Title(1), Subtitle(2), Message(3), MessageSize(4), Date(5), PositiveActionLabel(6), NegativeActionLabel(7).
-    uint16_t                          attr_len;     //!< Length of the attribute. If more data is received from the Notification Provider, all the data beyond this length is discarded.
+    uint16_t                          attr_len;     //!< Length of the attribute. If more data is received from the Notification Provider, all the data beyond this length is discarded. Without @p p_attr_data, the longest streamed to @ref ble_ancs_c_t::chunk_handler.
     uint8_t                         * p_attr_data;  //!< Pointer to where the memory is allocated for storing incoming attributes.
 } ble_ancs_c_attr_list_t;
 
@@ -183,12 +185,33 @@ typedef struct
     uint16_t               err_code_np;                    //!< An error coming from the Notification Provider. This is filled with @ref BLE_ANCS_NP_ERROR_CODES if @p evt_type is @ref BLE_ANCS_C_EVT_NP_ERROR.
     ble_ancs_c_attr_t      attr;                           //!< iOS notification attribute or app attribute, depending on the event type.
     uint32_t               notif_uid;                      //!< Notification UID.
-    uint8_t                app_id[BLE_ANCS_ATTR_DATA_MAX]; //!< App identifier.
+    uint8_t                app_id[BLE_ANCS_APP_ID_MAX];    //!< App identifier, truncated if longer.
 } ble_ancs_c_evt_t;
 
 /**@brief iOS notification event handler type. */
 typedef void (*ble_ancs_c_evt_handler_t) (ble_ancs_c_evt_t * p_evt, void *ctx);
 
+/**@brief Response UID handler type. Called once the UID of a Get Notification Attributes response
+ *        is parsed, to load the attribute list of the request it answers into
+ *        @ref ble_ancs_c_t::ancs_notif_attr_list. Returns false for a UID that was not requested.
+ */
+typedef bool (*ble_ancs_c_uid_handler_t) (uint32_t uid, void *ctx);
+
+/**@brief Response app identifier handler type. The Get App Attributes counterpart of
+ *        @ref ble_ancs_c_uid_handler_t, loads @ref ble_ancs_c_t::ancs_app_attr_list.
+ */
+typedef bool (*ble_ancs_c_app_id_handler_t) (const char *app_id, void *ctx);
+
+/**@brief Attribute chunk handler type. Called for a requested attribute that has a length but no
+ *        buffer in the attribute list, with the part of it in the current GATTC notification.
+ *
+ * @details @p p_data points into the notification and is only valid during the call. @p offset is
+ *          the position of the chunk in the attribute. Once all of it is delivered, the event
+ *          handler gets the attribute with its full length and a NULL @p p_attr_data.
+ */
+typedef void (*ble_ancs_c_attr_chunk_handler_t) (ble_ancs_c_evt_t const * p_evt, uint16_t offset,
+                                                 uint8_t const * p_data, uint16_t len, void *ctx);
+
 typedef struct
 {
     ble_ancs_c_attr_list_t * p_attr_list;              //!< The current list of attributes that are being parsed. This will point to either @ref ble_ancs_c_t::ancs_notif_attr_list or @ref  ble_ancs_c_t::ancs_app_attr_list.
@@ -198,6 +221,7 @@ typedef struct
     ble_ancs_c_cmd_id_val_t  command_id;               //!< Variable to keep track of what command type is being parsed ( @ref BLE_ANCS_COMMAND_ID_GET_NOTIF_ATTRIBUTES or @ref BLE_ANCS_COMMAND_ID_GET_APP_ATTRIBUTES).
     uint8_t                * p_data_dest;              //!< Attribute that the parsed data is copied into.
     uint16_t                 current_attr_index;       //!< Variable to keep track of the parsing progress, for the given attribute.
+    uint8_t                  current_uid_index;        //!< Variable to keep track of the parsing progress, for a notification UID split across GATTC notifications.
     uint32_t                 current_app_id_index;     //!< Variable to keep track of the parsing progress, for the given app identifier.
 } ble_ancs_parse_sm_t;
 
@@ -206,6 +230,9 @@ typedef struct
 {
     void                            *ctx;
     ble_ancs_c_evt_handler_t         evt_handler;                                     //!< Event handler to be called for handling events in the Apple Notification client application.
+    ble_ancs_c_uid_handler_t         uid_handler;                                     //!< Optional, lets several requests be outstanding at once. Without it responses are parsed against the list of the last request built.
+    ble_ancs_c_app_id_handler_t      app_id_handler;                                  //!< Optional, same for Get App Attributes responses.
+    ble_ancs_c_attr_chunk_handler_t  chunk_handler;                                   //!< Optional, streams attributes registered without a buffer instead of skipping them.
     ble_ancs_c_attr_list_t           ancs_notif_attr_list[BLE_ANCS_NB_OF_NOTIF_ATTR]; //!< For all attributes: contains information about whether the attributes are to be requested upon attribute request, and the length and buffer of where to store attribute data.
     ble_ancs_c_attr_list_t           ancs_app_attr_list[BLE_ANCS_NB_OF_APP_ATTR];     //!< For all app attributes: contains information about whether the attributes are to be requested upon attribute request, and the length and buffer of where to store attribute data.
     uint32_t                         number_of_requested_attr;                        //!< The number of attributes that are to be requested when an iOS notification attribute request is made.
@@ -229,6 +256,8 @@ bool ble_ancs_all_req_attrs_parsed(ble_ancs_c_t * p_ancs);
  *          After this, we can loop several ATTR_ID > LENGTH > DATA > ATTR_ID > LENGTH > DATA until
  *          we have received all attributes we wanted as a Notification Consumer.
  *          The Notification Provider can also simply stop sending attributes.
+ *          Attribute data is copied or skipped in whole spans, and UID and LENGTH fields are decoded
+ *          straight from the buffer unless they are split across GATTC notifications.
  *
  * 1 byte  |  4 bytes    |1 byte |2 bytes |... X bytes ... |1 bytes| 2 bytes| ... X bytes ...
  * --------|-------------|-------|--------|----------------|-------|--------|----------------
@@ -247,6 +276,55 @@ uint32_t ble_ancs_build_notif_attrs_request(ble_ancs_c_t * p_ancs,
                                             uint8_t      * p_data,
                                             uint16_t const len);
 
+/**@brief Function for encoding a Get Notification Attributes command from an attribute list,
+ *        without touching the parser state of an ANCS instance.
+ *
+ * @param[in]  p_attr_list List of @ref BLE_ANCS_NB_OF_NOTIF_ATTR entries, those with get set are requested.
+ * @param[in]  uid         Notification UID.
+ * @param[out] p_data      Command buffer.
+ * @param[in]  len         Size of the command buffer.
+ * @param[out] p_count     Number of attributes requested.
+ *
+ * @return Length of the command, 0 if it does not fit.
+ */
+uint32_t ble_ancs_encode_notif_attrs_request(ble_ancs_c_attr_list_t const * p_attr_list,
+                                             uint32_t const                 uid,
+                                             uint8_t                      * p_data,
+                                             uint16_t const                 len,
+                                             uint32_t                     * p_count);
+
+/**@brief Function for creating a Get App Attributes command from the attributes registered with
+ *        @ref ble_ancs_add_app_attr.
+ *
+ * @param[in]  p_ancs  ANCS client instance.
+ * @param[in]  app_id  App identifier, NUL-terminated.
+ * @param[out] p_data  Command buffer.
+ * @param[in]  len     Size of the command buffer.
+ *
+ * @return Length of the command, 0 if it does not fit.
+ */
+uint32_t ble_ancs_build_app_attrs_request(ble_ancs_c_t * p_ancs,
+                                          const char   * app_id,
+                                          uint8_t      * p_data,
+                                          uint16_t const len);
+
+/**@brief Function for encoding a Get App Attributes command from an attribute list, without
+ *        touching the parser state of an ANCS instance.
+ *
+ * @param[in]  p_attr_list List of @ref BLE_ANCS_NB_OF_APP_ATTR entries, those with get set are requested.
+ * @param[in]  app_id      App identifier, NUL-terminated.
+ * @param[out] p_data      Command buffer.
+ * @param[in]  len         Size of the command buffer.
+ * @param[out] p_count     Number of attributes requested.
+ *
+ * @return Length of the command, 0 if it does not fit.
+ */
+uint32_t ble_ancs_encode_app_attrs_request(ble_ancs_c_attr_list_t const * p_attr_list,
+                                           const char                   * app_id,
+                                           uint8_t                      * p_data,
+                                           uint16_t const                 len,
+                                           uint32_t                     * p_count);
+
 /**@brief Function for registering attributes that will be requested when @ref ble_ancs_build_notif_attrs_request
  *        is called.
  *
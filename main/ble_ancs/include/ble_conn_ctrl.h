@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+#define BLE_CONN_CTRL_HISTORY       8   // Parameter changes kept per link
+#define BLE_CONN_CTRL_UPDATE_US     (5 * 1000 * 1000)  // An update not completed by then is given up
+
+typedef enum {
+    BLE_CONN_MODE_PEER,     // Whatever the phone chose, nothing asked for yet
+    BLE_CONN_MODE_FAST,     // Short interval, no latency, while attribute requests pile up
+    BLE_CONN_MODE_IDLE,     // Long interval with slave latency
+} ble_conn_mode_t;
+
+// Connection parameters in effect from a point in time, in the units of the Core specification
+typedef struct {
+    int64_t at;             // esp_timer time of the change
+    uint16_t interval;      // 1.25 ms units
+    uint16_t latency;       // Connection events
+    uint16_t timeout;       // 10 ms units
+    uint8_t mode;           // ble_conn_mode_t asked for, PEER if the phone changed them on its own
+    uint16_t backlog;       // Attribute requests pending then
+} ble_conn_sample_t;
+
+/**@brief Connection parameters of one link, following the backlog of attribute requests.
+ *
+ * @details A backlog of NOWA_CONN_BURST_BACKLOG or more asks the phone for the fast interval
+ *          right away. Once it has stayed at NOWA_CONN_IDLE_BACKLOG or less for
+ *          NOWA_CONN_IDLE_DELAY_MS, after the setup of the link, the idle interval and latency are
+ *          asked for. In between, the mode stays, so a sync does not flap between the two. One
+ *          update is outstanding at a time, a refused one is asked again after the idle delay.
+ *          The backlog comes from the Dispatcher worker, completions from the BT task and the
+ *          dwell from a timer, the lock covers the state, not the calls into the stack.
+ */
+typedef struct {
+    portMUX_TYPE lock;
+    esp_timer_handle_t timer;   // End of the idle dwell, of a retry wait or of an update
+    int64_t timer_due;
+    uint8_t bda[6];
+    bool active;                // Link up
+    bool ready;                 // Setup done, idle may be asked for
+    bool updating;
+    uint8_t mode;               // ble_conn_mode_t asked for and granted
+    uint8_t want;               // ble_conn_mode_t of the update outstanding
+    int64_t update_at;
+    int64_t retry_after;
+    int64_t low_since;          // Backlog at or below the idle threshold since, 0 if above
+    uint32_t backlog;
+
+    // Parameters in effect and how they got there, oldest first from history_next
+    uint16_t interval;
+    uint16_t latency;
+    uint16_t timeout;
+    ble_conn_sample_t history[BLE_CONN_CTRL_HISTORY];
+    uint8_t history_len;
+    uint8_t history_next;
+
+    // Since boot, every connection of the link
+    uint32_t fast_requests;
+    uint32_t idle_requests;
+    uint32_t rejected;          // Refused by the stack or the phone, or never completed
+} ble_conn_ctrl_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t ble_conn_ctrl_init(ble_conn_ctrl_t *c);
+void ble_conn_ctrl_start(ble_conn_ctrl_t *c, const uint8_t bda[6], uint16_t interval, uint16_t latency, uint16_t timeout);
+void ble_conn_ctrl_ready(ble_conn_ctrl_t *c);
+void ble_conn_ctrl_stop(ble_conn_ctrl_t *c);
+void ble_conn_ctrl_backlog(ble_conn_ctrl_t *c, uint32_t backlog);
+void ble_conn_ctrl_updated(ble_conn_ctrl_t *c, bool ok, uint16_t interval, uint16_t latency, uint16_t timeout);
+size_t ble_conn_ctrl_history(ble_conn_ctrl_t *c, ble_conn_sample_t *out, size_t max);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_gattc_api.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+#define BLE_GATT_OPS_MAX        8   // Queued and in flight per link
+#define BLE_GATT_OPS_DEPTH      2   // Handed to the stack at once, one on air and the next one queued there
+#define BLE_GATT_OPS_TRIES      4   // Attempts of an operation refused as busy
+#define BLE_GATT_OPS_RETRY_US   (20 * 1000)  // Before the first retry, doubled on each further one
+
+typedef enum {
+    BLE_GATT_OP_READ_CHAR,
+    BLE_GATT_OP_WRITE_DESCR,
+} ble_gatt_op_type_t;
+
+typedef enum {
+    BLE_GATT_OP_FREE,
+    BLE_GATT_OP_QUEUED,
+    BLE_GATT_OP_IN_FLIGHT,
+} ble_gatt_op_state_t;
+
+typedef struct {
+    uint8_t state;      // ble_gatt_op_state_t
+    uint8_t type;       // ble_gatt_op_type_t
+    bool urgent;        // Goes before every operation that is not
+    uint8_t tries;
+    uint16_t handle;
+    uint8_t len;
+    uint8_t value[2];   // Written value, CCCDs only
+    uint32_t seq;       // Order of queueing
+    int64_t due;        // Not issued before, after a busy refusal
+} ble_gatt_op_t;
+
+// An operation out of tries, taken off the queue
+typedef void (*ble_gatt_ops_given_up_t)(void *ctx, const ble_gatt_op_t *op);
+
+/**@brief GATT client operations of one link, issued back to back instead of one per callback.
+ *
+ * @details Operations are queued on the BT task, and up to BLE_GATT_OPS_DEPTH are handed to the
+ *          stack without waiting for the completion of the previous one. Urgent ones (the CCCD
+ *          writes on the way to notifications) go first, the others are held back while any
+ *          urgent one is pending or the queue is held. An operation the stack refuses as busy,
+ *          at the call or in its completion event, is retried with backoff from a timer. Once out
+ *          of tries it goes to given_up instead, on the BT task or the esp_timer task, and its
+ *          completion event is consumed. The lock covers the queue, not the calls into the stack.
+ */
+typedef struct {
+    portMUX_TYPE lock;
+    esp_timer_handle_t timer;   // Retry of a busy operation
+    ble_gatt_ops_given_up_t given_up;
+    void *ctx;
+    esp_gatt_if_t gattc_if;
+    uint16_t conn_id;
+    bool bound;
+    bool held;                  // Non-urgent operations wait
+    uint8_t in_flight;
+    uint32_t seq;
+    ble_gatt_op_t ops[BLE_GATT_OPS_MAX];
+
+    // Since boot, every connection of the link
+    uint32_t issued;
+    uint32_t retried;           // Busy refusals retried
+    uint32_t failed;            // Completed with an error, or out of tries
+    uint32_t dropped;           // Queue full
+    uint8_t max_in_flight;
+} ble_gatt_ops_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t ble_gatt_ops_init(ble_gatt_ops_t *q, ble_gatt_ops_given_up_t given_up, void *ctx);
+void ble_gatt_ops_bind(ble_gatt_ops_t *q, esp_gatt_if_t gattc_if, uint16_t conn_id);
+void ble_gatt_ops_reset(ble_gatt_ops_t *q);
+void ble_gatt_ops_hold(ble_gatt_ops_t *q, bool held);
+bool ble_gatt_ops_read(ble_gatt_ops_t *q, uint16_t handle, bool urgent);
+bool ble_gatt_ops_write_descr(ble_gatt_ops_t *q, uint16_t handle, const uint8_t *value, uint8_t len, bool urgent);
+bool ble_gatt_ops_complete(ble_gatt_ops_t *q, ble_gatt_op_type_t type, uint16_t handle, esp_gatt_status_t status);
+void ble_gatt_ops_pump(ble_gatt_ops_t *q);
+
+#ifdef __cplusplus
+}
+#endif
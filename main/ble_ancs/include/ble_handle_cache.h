@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#define BLE_HANDLE_CACHE_VERSION 1
+#define BLE_HANDLE_CACHE_NAME_MAX 64
+#define BLE_BDA_KEY_LEN 13  // BDA in hex and the terminator, NVS keys are limited to 15 characters
+
+/**@brief GATT handles and GAP values of a bonded phone, as found by service discovery.
+ *
+ * @details Lets a reconnection go straight to enabling notifications. Handles stay valid for a
+ *          bonded client until the phone indicates Service Changed, then the entry is erased and
+ *          discovery runs again. A handle of 0 was not found.
+ */
+typedef struct {
+    uint8_t version;
+    uint8_t reserved;
+    uint16_t anc_start;
+    uint16_t anc_end;
+    uint16_t notification_source;
+    uint16_t notification_source_cccd;
+    uint16_t data_source;
+    uint16_t data_source_cccd;
+    uint16_t control_point;
+    uint16_t gap_start;
+    uint16_t gap_end;
+    uint16_t device_name;
+    uint16_t appearance_char;
+    uint16_t gatt_start;
+    uint16_t gatt_end;
+    uint16_t service_changed;
+    uint16_t service_changed_cccd;
+    uint16_t appearance;
+    char name[BLE_HANDLE_CACHE_NAME_MAX];  // Null-terminated
+} ble_handle_cache_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t ble_handle_cache_load(const uint8_t bda[6], ble_handle_cache_t *entry);
+esp_err_t ble_handle_cache_save(const uint8_t bda[6], const ble_handle_cache_t *entry);
+esp_err_t ble_handle_cache_erase(const uint8_t bda[6]);
+
+// NVS key of what is kept per phone, in any namespace
+void ble_bda_key(const uint8_t bda[6], char out[BLE_BDA_KEY_LEN]);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,84 @@
+#include "AppIdTable.h"
+#include "esp_log.h"
+
+#define TAG "APPID"
+
+AppIdTable& AppIdTable::instance(void) {
+    static AppIdTable table;
+    return table;
+}
+
+AppIdTable::AppIdTable() {
+    m_entries.push_back({ String(), hash(std::string_view()), 0 });
+}
+
+uint16_t AppIdTable::intern(std::string_view appId) {
+    if (appId.empty()) {
+        return EMPTY;
+    }
+
+    uint16_t id = find(appId);
+    if (id != EMPTY) {
+        m_entries[id].refs ++;
+        return id;
+    }
+
+    uint32_t h = hash(appId);
+    if (!m_freeIds.empty()) {
+        id = m_freeIds.back();
+        m_freeIds.pop_back();
+        m_entries[id] = { String(appId), h, 1 };
+    } else if (m_entries.size() < UINT16_MAX) {
+        id = m_entries.size();
+        m_entries.push_back({ String(appId), h, 1 });
+    } else {
+        ESP_LOGE(TAG, "Table full");
+        return EMPTY;
+    }
+    m_bytes += sizeof(Entry) + appId.size() + 1;
+    return id;
+}
+
+// ID of an interned app identifier without taking a reference, EMPTY if not interned
+uint16_t AppIdTable::find(std::string_view appId) const {
+    if (appId.empty()) {
+        return EMPTY;
+    }
+
+    // A handful of apps in practice, a scan over cached hashes is enough
+    uint32_t h = hash(appId);
+    for (size_t i = 1; i < m_entries.size(); i ++) {
+        const Entry& e = m_entries[i];
+        if (e.refs != 0 && e.hash == h && e.str == appId) {
+            return i;
+        }
+    }
+    return EMPTY;
+}
+
+void AppIdTable::addRef(uint16_t id) {
+    if (id != EMPTY && id < m_entries.size()) {
+        m_entries[id].refs ++;
+    }
+}
+
+void AppIdTable::release(uint16_t id) {
+    if (id == EMPTY || id >= m_entries.size() || m_entries[id].refs == 0) {
+        return;
+    }
+    Entry& e = m_entries[id];
+    if (-- e.refs == 0) {
+        m_bytes -= sizeof(Entry) + e.str.size() + 1;
+        String().swap(e.str);
+        m_freeIds.push_back(id);
+    }
+}
+
+// FNV-1a
+uint32_t AppIdTable::hash(std::string_view s) {
+    uint32_t h = 2166136261u;
+    for (char c : s) {
+        h = (h ^ (uint8_t)c) * 16777619u;
+    }
+    return h;
+}
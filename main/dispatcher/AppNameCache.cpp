@@ -0,0 +1,171 @@
+#include "AppNameCache.h"
+#include "AppIdTable.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "nvs.h"
+
+#define TAG "APPNAME"
+
+// Blob layout: entries most recently used first, each app ID then name, both length prefixed (1 byte)
+static constexpr const char *NVS_KEY = "names";
+
+AppNameCache& AppNameCache::instance(void) {
+    static AppNameCache cache;
+    return cache;
+}
+
+/**@brief Read the names kept by a previous run, a missing or damaged blob leaves the cache empty.
+ */
+esp_err_t AppNameCache::load(void) {
+    if (m_loaded) {
+        return ESP_OK; // Driver restarted, the cache is still current
+    }
+    m_loaded = true;
+
+    nvs_handle_t h;
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READONLY, &h);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    size_t len = 0;
+    std::vector<uint8_t> blob;
+    ret = nvs_get_blob(h, NVS_KEY, NULL, &len);
+    if (ret == ESP_OK) {
+        blob.resize(len);
+        ret = nvs_get_blob(h, NVS_KEY, blob.data(), &len);
+    }
+    nvs_close(h);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    AppIdTable& apps = AppIdTable::instance();
+    size_t off = 0;
+    while (off < len && m_entries.size() < CAPACITY) {
+        size_t appLen = blob[off];
+        size_t nameOff = off + 1 + appLen;
+        if (nameOff >= len || nameOff + 1 + blob[nameOff] > len || blob[nameOff] >= NAME_SIZE) {
+            ESP_LOGW(TAG, "Damaged at %u, rest ignored", (unsigned)off);
+            break;
+        }
+        std::string_view app((const char *)&blob[off + 1], appLen);
+        std::string_view name((const char *)&blob[nameOff + 1], blob[nameOff]);
+        off = nameOff + 1 + name.size();
+
+        uint16_t id = apps.intern(app);
+        if (id == AppIdTable::EMPTY || find(id) >= 0) {
+            apps.release(id);
+            continue;
+        }
+        m_entries.push_back({ id, String(name) });
+    }
+
+    ESP_LOGI(TAG, "%u app names", (unsigned)m_entries.size());
+    return ESP_OK;
+}
+
+// False if unchanged since the last snapshot
+bool AppNameCache::snapshot(std::vector<uint8_t>& out) {
+    if (!m_dirty) {
+        return false;
+    }
+
+    const AppIdTable& apps = AppIdTable::instance();
+    out.clear();
+    for (const Entry& e : m_entries) {
+        const char *app = apps.get(e.appId);
+        size_t appLen = strlen(app);
+        if (appLen > UINT8_MAX) {
+            continue; // Cannot be requested anyway
+        }
+        out.push_back(appLen);
+        out.insert(out.end(), app, app + appLen);
+        out.push_back(e.name.size());
+        out.insert(out.end(), e.name.begin(), e.name.end());
+    }
+    m_dirty = false;
+    return true;
+}
+
+esp_err_t AppNameCache::write(const std::vector<uint8_t>& blob) {
+    nvs_handle_t h;
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &h);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "%s: nvs_open failed (%s)", __func__, esp_err_to_name(ret));
+        return ret;
+    }
+    ret = blob.empty() ? nvs_erase_key(h, NVS_KEY) : nvs_set_blob(h, NVS_KEY, blob.data(), blob.size());
+    if (ret == ESP_ERR_NVS_NOT_FOUND) {
+        ret = ESP_OK;
+    }
+    if (ret == ESP_OK) {
+        ret = nvs_commit(h);
+    }
+    nvs_close(h);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "%s: failed (%s)", __func__, esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+/**@brief Display name of an app, nullptr if not known yet. Counts as a use of the entry.
+ *
+ * @details The order of use is not worth an NVS write of its own, it is saved along with the
+ *          next new name.
+ */
+const char *AppNameCache::lookup(uint16_t appId) {
+    int i = find(appId);
+    if (i < 0) {
+        misses ++;
+        return nullptr;
+    }
+    hits ++;
+    if (i != 0) {
+        Entry e = std::move(m_entries[i]);
+        m_entries.erase(m_entries.begin() + i);
+        m_entries.insert(m_entries.begin(), std::move(e));
+    }
+    return m_entries.front().name.c_str();
+}
+
+// Display name of an app without touching the order of use, nullptr if not known
+const char *AppNameCache::get(uint16_t appId) const {
+    int i = find(appId);
+    return (i < 0) ? nullptr : m_entries[i].name.c_str();
+}
+
+void AppNameCache::put(uint16_t appId, std::string_view name) {
+    if (appId == AppIdTable::EMPTY) {
+        return;
+    }
+    name = name.substr(0, NAME_SIZE - 1);
+
+    int i = find(appId);
+    if (i >= 0) {
+        m_dirty |= (m_entries[i].name != name);
+        m_entries[i].name = String(name);
+        return;
+    }
+
+    if (m_entries.size() >= CAPACITY) {
+        AppIdTable::instance().release(m_entries.back().appId);
+        m_entries.pop_back();
+    }
+    AppIdTable::instance().addRef(appId);
+    m_entries.insert(m_entries.begin(), { appId, String(name) });
+    m_dirty = true;
+}
+
+// A handful of apps in practice, a scan is enough
+int AppNameCache::find(uint16_t appId) const {
+    for (size_t i = 0; i < m_entries.size(); i ++) {
+        if (m_entries[i].appId == appId) {
+            return i;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,259 @@
+#include "AttrRequestScheduler.h"
+#include "esp_log.h"
+
+#define TAG "SCHED"
+
+// Continuations jump every queue, their header is still in the notification buffer
+static constexpr uint8_t LEVEL_NEXT = UINT8_MAX;
+
+/**@brief Queue a request, or merge it into the one already pending for the same UID.
+ *
+ * @details The merged request takes the newer category, flags and filter state and the better
+ *          priority level. A new event restarts a pending full message fetch from the header, the
+ *          stored message would be outdated anyway. A header fetch already in flight for the UID
+ *          covers the new event as well, a body fetch in flight does not.
+ */
+bool AttrRequestScheduler::push(const AttrRequest& r, int64_t now) {
+    uint8_t lvl = level(r);
+
+    int slot = findPending(r.uid);
+    if (slot >= 0) {
+        Entry& e = m_entries[slot];
+        e.req.category = r.category;
+        e.req.flags = r.flags;
+        e.req.decided = r.decided;
+        e.req.stage = (r.stage == AttrRequest::HEADER) ? AttrRequest::HEADER : e.req.stage;
+        e.level = (lvl > e.level) ? lvl : e.level;
+        coalesced ++;
+        return true;
+    }
+
+    slot = findInFlight(r.uid);
+    if (slot >= 0 && !m_entries[slot].cancelled && m_entries[slot].req.stage == AttrRequest::HEADER) {
+        coalesced ++;
+        return true;
+    }
+
+    return insert(r, lvl, now);
+}
+
+bool AttrRequestScheduler::pushNext(const AttrRequest& r, int64_t now) {
+    // The continuation fetches the newest content anyway, a pending request for the UID is redundant
+    int slot = findPending(r.uid);
+    if (slot >= 0) {
+        remove(slot);
+        coalesced ++;
+    }
+    return insert(r, LEVEL_NEXT, now);
+}
+
+/**@brief Put the best ranked pending request in flight, nullptr if the pipeline is full or
+ *        nothing is due.
+ *
+ * @details A UID already in flight waits, its response could not be told apart.
+ */
+AttrRequest *AttrRequestScheduler::next(int64_t now) {
+    if (full() || m_count == m_inFlight) {
+        return nullptr;
+    }
+
+    size_t best = m_count;
+    for (size_t i = m_inFlight; i < m_count; i ++) {
+        if (m_entries[i].notBefore <= now && (best == m_count || ranksAbove(m_entries[i], m_entries[best])) &&
+            findInFlight(m_entries[i].req.uid) < 0) {
+            best = i;
+        }
+    }
+    if (best == m_count) {
+        return nullptr; // Everything still backs off
+    }
+    size_t slot = m_inFlight;
+    swapSlots(slot, best);
+    m_inFlight ++;
+    m_entries[slot].cancelled = false;
+
+    const Entry& e = m_entries[slot];
+    if (e.level != LEVEL_NEXT && e.level > CONFIG_NOWA_PRIO_DEFAULT) {
+        int64_t dt = now - e.queuedAt;
+        urgentStarted ++;
+        urgentWaitTotalUs += dt;
+        if (dt > urgentWaitMaxUs) {
+            urgentWaitMaxUs = dt;
+        }
+    }
+    return &m_entries[slot].req;
+}
+
+/**@brief Put the request in flight for a UID back as pending, restarting from its header, not to be
+ *        served before the delay is over.
+ *
+ * @details The body of a notification is only valid right after its header, so a retry fetches
+ *          both again. A full message fetch stands alone and is retried as is. Returns false
+ *          when the request went away instead: it was cancelled, or a newer event for the UID
+ *          already queued a request that covers it.
+ */
+bool AttrRequestScheduler::defer(uint32_t uid, int64_t now, int64_t delayUs) {
+    int slot = findInFlight(uid);
+    if (slot < 0) {
+        return false;
+    }
+    if (m_entries[slot].cancelled || findPending(uid) >= 0) {
+        removeInFlight(slot);
+        return false;
+    }
+
+    Entry& e = m_entries[slot];
+    e.req.stage = (e.req.stage == AttrRequest::BODY) ? AttrRequest::HEADER : e.req.stage;
+    e.req.attempts ++;
+    e.level = (e.level == LEVEL_NEXT) ? level(e.req) : e.level;
+    e.notBefore = now + delayUs;
+    m_inFlight --;
+    swapSlots(slot, m_inFlight);
+    return true;
+}
+
+// Earliest end of a backoff, 0 if no request is deferred
+int64_t AttrRequestScheduler::nextDue(void) const {
+    int64_t due = 0;
+    for (size_t i = m_inFlight; i < m_count; i ++) {
+        int64_t t = m_entries[i].notBefore;
+        if (t != 0 && (due == 0 || t < due)) {
+            due = t;
+        }
+    }
+    return due;
+}
+
+AttrRequest *AttrRequestScheduler::inFlight(uint32_t uid) {
+    int slot = findInFlight(uid);
+    return (slot >= 0) ? &m_entries[slot].req : nullptr;
+}
+
+bool AttrRequestScheduler::inFlightCancelled(uint32_t uid) const {
+    int slot = findInFlight(uid);
+    return slot >= 0 && m_entries[slot].cancelled;
+}
+
+bool AttrRequestScheduler::complete(uint32_t uid) {
+    int slot = findInFlight(uid);
+    if (slot < 0) {
+        return false;
+    }
+    removeInFlight(slot);
+    return true;
+}
+
+/**@brief Drop the pending request for a UID. One in flight cannot be recalled, it is only marked
+ *        so that its response gets discarded.
+ */
+bool AttrRequestScheduler::cancel(uint32_t uid) {
+    int slot = findPending(uid);
+    if (slot >= 0) {
+        remove(slot);
+        cancelled ++;
+        return true;
+    }
+
+    slot = findInFlight(uid);
+    if (slot >= 0 && !m_entries[slot].cancelled) {
+        m_entries[slot].cancelled = true;
+        cancelled ++;
+        return true;
+    }
+    return false;
+}
+
+void AttrRequestScheduler::clear(void) {
+    m_count = 0;
+    m_inFlight = 0;
+    m_reserved = 0;
+    m_index.clear();
+}
+
+uint8_t AttrRequestScheduler::level(const AttrRequest& r) {
+    if (r.stage == AttrRequest::FULL) {
+        return CONFIG_NOWA_PRIO_ON_DEMAND; // A client is waiting for it
+    }
+    uint8_t lvl = CONFIG_NOWA_PRIO_DEFAULT;
+    if (r.category == BLE_ANCS_CATEGORY_ID_INCOMING_CALL) {
+        lvl = CONFIG_NOWA_PRIO_INCOMING_CALL;
+    } else if (r.category == BLE_ANCS_CATEGORY_ID_MISSED_CALL) {
+        lvl = CONFIG_NOWA_PRIO_MISSED_CALL;
+    }
+    if ((r.flags & (1 << BLE_ANCS_EVENT_FLAG_IMPORTANT)) && CONFIG_NOWA_PRIO_IMPORTANT > lvl) {
+        lvl = CONFIG_NOWA_PRIO_IMPORTANT;
+    }
+    return lvl;
+}
+
+bool AttrRequestScheduler::ranksAbove(const Entry& a, const Entry& b) const {
+    if (a.level != b.level) {
+        return a.level > b.level;
+    }
+    // The phone hands out UIDs in increasing order, the higher one is the newer notification
+    return (int32_t)(a.req.uid - b.req.uid) > 0;
+}
+
+bool AttrRequestScheduler::insert(const AttrRequest& r, uint8_t lvl, int64_t now) {
+    Entry e { r, lvl, now, 0, false };
+
+    if (m_count < CAPACITY) {
+        m_entries[m_count] = e;
+        m_index.insert(r.uid, m_count);
+        m_count ++;
+        return true;
+    }
+
+    // Full: the new request replaces the lowest ranked pending one, if it ranks above it
+    dropped ++;
+    size_t first = m_inFlight;
+    size_t worst = first;
+    for (size_t i = first + 1; i < m_count; i ++) {
+        if (ranksAbove(m_entries[worst], m_entries[i])) {
+            worst = i;
+        }
+    }
+    if (worst >= m_count || !ranksAbove(e, m_entries[worst])) {
+        ESP_LOGW(TAG, "Queue full, dropped UID %" PRIu32, r.uid);
+        return false;
+    }
+    ESP_LOGW(TAG, "Queue full, dropped UID %" PRIu32, m_entries[worst].req.uid);
+    m_index.erase(m_entries[worst].req.uid, worst);
+    m_entries[worst] = e;
+    m_index.insert(r.uid, worst);
+    return true;
+}
+
+// Pending slot only, the last entry fills the hole
+void AttrRequestScheduler::remove(size_t slot) {
+    m_index.erase(m_entries[slot].req.uid, slot);
+    m_count --;
+    if (slot != m_count) {
+        m_index.move(m_entries[m_count].req.uid, m_count, slot);
+        m_entries[slot] = m_entries[m_count];
+    }
+}
+
+// Last request in flight fills the hole, then the last entry fills its slot
+void AttrRequestScheduler::removeInFlight(size_t slot) {
+    m_inFlight --;
+    swapSlots(slot, m_inFlight);
+    remove(m_inFlight);
+}
+
+void AttrRequestScheduler::swapSlots(size_t a, size_t b) {
+    if (a == b) {
+        return;
+    }
+    m_index.move(m_entries[a].req.uid, a, b);
+    m_index.move(m_entries[b].req.uid, b, a);
+    std::swap(m_entries[a], m_entries[b]);
+}
+
+int AttrRequestScheduler::findPending(uint32_t uid) const {
+    return m_index.find(uid, [this](size_t slot) { return slot >= m_inFlight; });
+}
+
+int AttrRequestScheduler::findInFlight(uint32_t uid) const {
+    return m_index.find(uid, [this](size_t slot) { return slot < m_inFlight; });
+}
@@ -0,0 +1,147 @@
+#include "AttrStream.h"
+
+#include <string.h>
+
+StreamPool& StreamPool::instance(void) {
+    static StreamPool pool;
+    return pool;
+}
+
+StreamPool::StreamPool() {
+    for (size_t b = 0; b < BLOCKS; b ++) {
+        m_next[b] = (b + 1 < BLOCKS) ? b + 1 : NONE;
+    }
+    m_free = 0;
+    m_freeCount = BLOCKS;
+}
+
+// Lock held
+uint16_t StreamPool::take(void) {
+    uint16_t b = m_free;
+    if (b == NONE) {
+        return NONE;
+    }
+    m_free = m_next[b];
+    m_next[b] = NONE;
+    m_freeCount --;
+    if (BLOCKS - m_freeCount > m_highWater) {
+        m_highWater = BLOCKS - m_freeCount;
+    }
+    return b;
+}
+
+// Whole chain from first on, lock held
+void StreamPool::give(uint16_t first) {
+    while (first != NONE) {
+        uint16_t next = m_next[first];
+        m_next[first] = m_free;
+        m_free = first;
+        m_freeCount ++;
+        first = next;
+    }
+}
+
+void AttrStream::open(uint32_t uid) {
+    StreamPool& pool = StreamPool::instance();
+    portENTER_CRITICAL(&pool.m_lock);
+    reset();
+    m_uid = uid;
+    m_open = true;
+    portEXIT_CRITICAL(&pool.m_lock);
+}
+
+void AttrStream::close(void) {
+    StreamPool& pool = StreamPool::instance();
+    portENTER_CRITICAL(&pool.m_lock);
+    reset();
+    m_open = false;
+    portEXIT_CRITICAL(&pool.m_lock);
+}
+
+/**@brief Add the chunk at offset of the attribute, false if it was dropped in whole or in part.
+ *
+ * @details A chunk at offset 0 starts the attribute over, the phone answers a repeated request
+ *          from the start.
+ */
+bool AttrStream::append(uint32_t uid, uint16_t offset, const uint8_t *data, size_t len) {
+    StreamPool& pool = StreamPool::instance();
+    portENTER_CRITICAL(&pool.m_lock);
+    if (!m_open || uid != m_uid) {
+        portEXIT_CRITICAL(&pool.m_lock);
+        return false;
+    }
+    if (offset == 0) {
+        reset();
+    }
+    if (offset != m_length) {
+        portEXIT_CRITICAL(&pool.m_lock);
+        return false; // After a gap, or the rest of a truncated attribute
+    }
+
+    while (len != 0) {
+        size_t used = m_length % StreamPool::BLOCK_SIZE;
+        if (used == 0) {
+            uint16_t b = pool.take();
+            if (b == StreamPool::NONE) {
+                m_truncated = true;
+                pool.exhausted ++;
+                break;
+            }
+            if (m_tail == StreamPool::NONE) {
+                m_head = b;
+            } else {
+                pool.m_next[m_tail] = b;
+            }
+            m_tail = b;
+        }
+        size_t n = StreamPool::BLOCK_SIZE - used;
+        n = (len < n) ? len : n;
+        memcpy(pool.block(m_tail) + used, data, n);
+        m_length += n;
+        data += n;
+        len -= n;
+    }
+    portEXIT_CRITICAL(&pool.m_lock);
+    return len == 0;
+}
+
+size_t AttrStream::length(void) const {
+    StreamPool& pool = StreamPool::instance();
+    portENTER_CRITICAL(&pool.m_lock);
+    size_t len = m_length;
+    portEXIT_CRITICAL(&pool.m_lock);
+    return len;
+}
+
+bool AttrStream::truncated(void) const {
+    StreamPool& pool = StreamPool::instance();
+    portENTER_CRITICAL(&pool.m_lock);
+    bool t = m_truncated;
+    portEXIT_CRITICAL(&pool.m_lock);
+    return t;
+}
+
+// Gather the chain into out, at most max bytes, returns the bytes copied
+size_t AttrStream::copy(uint8_t *out, size_t max) const {
+    StreamPool& pool = StreamPool::instance();
+    portENTER_CRITICAL(&pool.m_lock);
+    size_t total = (m_length < max) ? m_length : max;
+    size_t done = 0;
+    for (uint16_t b = m_head; b != StreamPool::NONE && done < total; b = pool.m_next[b]) {
+        size_t n = total - done;
+        n = (n < StreamPool::BLOCK_SIZE) ? n : StreamPool::BLOCK_SIZE;
+        memcpy(out + done, pool.block(b), n);
+        done += n;
+    }
+    portEXIT_CRITICAL(&pool.m_lock);
+    return done;
+}
+
+// Lock held
+void AttrStream::reset(void) {
+    StreamPool::instance().give(m_head);
+    m_head = StreamPool::NONE;
+    m_tail = StreamPool::NONE;
+    m_length = 0;
+    m_truncated = false;
+}
@@ -1,5 +1,8 @@
 #include "Dispatcher.h"
+#include "AppNameCache.h"
+#include "ble_handle_cache.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #define TAG "DISP"
 
@@ -21,15 +24,19 @@ bool Dispatcher::connectNP(uint8_t idx, const BDA& bda) {
 		return false;
     }
 
+	int64_t now = esp_timer_get_time();
 	if (m_providerList.count(bda) != 0) {
-		m_providerList[bda].setIsActive(true);
+		m_providerList[bda].setIsActive(true, now);
 	} else {
 		NotificationProvider np(bda);
-		np.setIsActive(true);
+		np.setIsActive(true, now);
+		np.setCapacity(m_retention.maxPerProvider);
+		np.expire(m_retentionTick); // Empty, only joins the timer wheel at the current tick
 		m_providerList.insert(std::make_pair(bda, np));
 	}
 
 	m_activeBDAs[idx] = bda;
+	enforceRetention();
 
 	return true;
 }
@@ -45,12 +52,13 @@ bool Dispatcher::disconnectNP(uint8_t idx, bool deleteAfter) {
 		return false;
 	}
 
-	m_providerList[m_activeBDAs[idx]].setIsActive(false);
+	m_providerList[m_activeBDAs[idx]].setIsActive(false, esp_timer_get_time());
 	if (deleteAfter) {
-		m_providerList.erase(m_activeBDAs[idx]);
+		retire(m_providerList.find(m_activeBDAs[idx]));
 	}
 
 	m_activeBDAs[idx].fill(0);
+	enforceRetention();
 
 	return true;
 }
@@ -89,3 +97,148 @@ NotificationProvider *Dispatcher::getNPByBDA(const BDA& bda)
 
 	return &m_providerList[bda];
 }
+
+void Dispatcher::setRetention(const RetentionConfig& cfg) {
+	bool ttlChanged = (cfg.ttlSeconds != m_retention.ttlSeconds);
+	m_retention = cfg;
+
+	for (auto& p : m_providerList) {
+		p.second.setCapacity(m_retention.maxPerProvider);
+	}
+	if (ttlChanged && m_retentionTimer != nullptr) {
+		startRetentionTimer();
+	}
+	enforceRetention();
+}
+
+/**@brief Bring storage back within the configured limits.
+ *
+ * @details Inactive devices beyond maxProviders are forgotten least recently active first.
+ *          Over the byte budget, the oldest records go first from the least recently active
+ *          inactive device, then from whichever connected device holds the most bytes.
+ */
+void Dispatcher::enforceRetention(void) {
+	while (m_providerList.size() > m_retention.maxProviders) {
+		auto lru = m_providerList.end();
+		for (auto it = m_providerList.begin(); it != m_providerList.end(); it ++) {
+			if (!it->second.isActive() && (lru == m_providerList.end() || it->second.lastActive() < lru->second.lastActive())) {
+				lru = it;
+			}
+		}
+		if (lru == m_providerList.end()) {
+			break; // All connected
+		}
+		ESP_LOGI(TAG, "Forgetting least recently active device");
+		retire(lru);
+		m_retired.evictedProviders ++;
+	}
+
+	size_t total = 0;
+	for (const auto& p : m_providerList) {
+		total += p.second.bytes();
+	}
+
+	while (total > m_retention.byteBudget) {
+		NotificationProvider *victim = nullptr;
+		for (auto& p : m_providerList) {
+			NotificationProvider& np = p.second;
+			if (np.size() == 0) {
+				continue;
+			}
+			if (victim == nullptr) {
+				victim = &np;
+			} else if (!np.isActive() && (victim->isActive() || np.lastActive() < victim->lastActive())) {
+				victim = &np;
+			} else if (np.isActive() && victim->isActive() && np.bytes() > victim->bytes()) {
+				victim = &np;
+			}
+		}
+		if (victim == nullptr) {
+			break;
+		}
+		size_t before = victim->bytes();
+		victim->evictOldest();
+		total -= before - victim->bytes();
+	}
+}
+
+RetentionUsage Dispatcher::retentionUsage(void) {
+	RetentionUsage u = m_retired;
+	u.providers = 0;
+	u.inactiveProviders = 0;
+	u.notifications = 0;
+	u.bytes = 0;
+	for (const auto& p : m_providerList) {
+		p.second.addUsage(u);
+	}
+	return u;
+}
+
+// Keep the eviction history of a provider that is about to be erased
+void Dispatcher::retire(std::map<BDA, NotificationProvider>::iterator it) {
+	if (it == m_providerList.end()) {
+		return;
+	}
+	RetentionUsage u {};
+	it->second.addUsage(u);
+	m_retired.evictedCapacity += u.evictedCapacity;
+	m_retired.evictedBudget += u.evictedBudget;
+	m_retired.evictedTtl += u.evictedTtl;
+	m_retired.removed += u.removed;
+	forgetDevice(it->first);
+	m_providerList.erase(it);
+}
+
+void Dispatcher::forgetDevice(const BDA& bda) {
+	for (KnownUids& known : m_knownUids) {
+		known.unload(bda);
+	}
+	m_nvsWrites.knownUids.push_back({ bda, {} });
+	m_nvsWrites.handleCaches.push_back(bda);
+	wakeForNvs();
+}
+
+void Dispatcher::loadKnownUids(uint8_t idx, const BDA& bda) {
+	saveKnownUids(idx); // Of the device that last used the profile
+
+	// A set of the device still to be written is newer than the saved one
+	const std::vector<KnownUids::Snapshot>& pending = m_nvsWrites.knownUids;
+	for (auto it = pending.rbegin(); it != pending.rend(); it ++) {
+		if (it->bda == bda) {
+			m_knownUids[idx].load(*it);
+			return;
+		}
+	}
+	m_knownUids[idx].load(bda);
+}
+
+void Dispatcher::saveKnownUids(uint8_t idx) {
+	KnownUids::Snapshot s;
+	if (m_knownUids[idx].snapshot(s)) {
+		m_nvsWrites.knownUids.push_back(std::move(s));
+	}
+}
+
+void Dispatcher::saveAppNames(void) {
+	m_nvsWrites.appNamesChanged |= AppNameCache::instance().snapshot(m_nvsWrites.appNames);
+}
+
+// Worker task, store lock released
+void Dispatcher::writeNvs(const NvsWrites& w) {
+	for (const KnownUids::Snapshot& s : w.knownUids) {
+		KnownUids::write(s);
+	}
+	for (const BDA& bda : w.handleCaches) {
+		ble_handle_cache_erase(bda.data());
+	}
+	if (w.appNamesChanged) {
+		AppNameCache::write(w.appNames);
+	}
+}
+
+// Queued from another task, the worker task may be waiting for anything else
+void Dispatcher::wakeForNvs(void) {
+	if (m_workerTask != nullptr) {
+		xTaskNotify(m_workerTask, NOTIFY_NVS, eSetBits);
+	}
+}
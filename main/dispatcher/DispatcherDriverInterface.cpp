@@ -1,39 +1,150 @@
 #include "Dispatcher.h"
 #include "DispatcherUtils.h"
+#include "AppIdTable.h"
+#include "AppNameCache.h"
+#include "AttrSet.h"
+#include "RecordPool.h"
+#include "esp_gatt_defs.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+
+#include <algorithm>
 
 #define TAG "DISP"
 
+// Driver callbacks, run on the BT task: copy the event and return
+static void drv_connect(void *ctx, uint8_t idx, uint8_t bda[6]);
+static void drv_disconnect(void *ctx, uint8_t idx);
+static void drv_device_name(void *ctx, uint8_t idx, char *name);
+static void drv_notification(void *ctx, uint8_t idx, ble_ancs_c_evt_notif_t *notif);
+static void drv_attribute(void *ctx, uint8_t idx, uint32_t uid, ble_ancs_c_attr_t *attr);
+static void drv_attributes_done(void *ctx, uint8_t idx, uint32_t uid);
+static void drv_request_error(void *ctx, uint8_t idx, uint32_t uid, uint16_t status);
+static void drv_attribute_chunk(void *ctx, uint8_t idx, uint32_t uid, uint32_t attr_id, uint16_t offset, const uint8_t *data, uint16_t len);
+static void drv_app_name(void *ctx, uint8_t idx, const char *name, uint16_t status);
+static void drv_bond_removed(void *ctx, uint8_t bda[6]);
+// Called synchronously from ancs_send_attrs_request() on the Dispatcher worker task
+static uint8_t *drv_attribute_buffer(void *ctx, uint8_t idx, uint32_t uid, uint32_t attr_id, uint16_t *len);
+
+// Event handlers, run on the Dispatcher worker task
 static void disp_connect(void *ctx, uint8_t idx, uint8_t bda[6]);
 static void disp_disconnect(void *ctx, uint8_t idx);
 static void disp_device_name(void *ctx, uint8_t idx, char *name);
 static void disp_notification(void *ctx, uint8_t idx, ble_ancs_c_evt_notif_t *notif);
 static void disp_attribute(void *ctx, uint8_t idx, uint32_t uid, ble_ancs_c_attr_t *attr);
 static void disp_attributes_done(void *ctx, uint8_t idx, uint32_t uid);
+static void disp_request_error(void *ctx, uint8_t idx, uint32_t uid, uint16_t status);
+static void disp_app_name(void *ctx, uint8_t idx, const char *name, uint16_t status);
+static bool disp_send_request(Dispatcher *disp, uint8_t idx, const AttrRequest& r);
+static void disp_start_next(Dispatcher *disp, uint8_t idx);
+static void disp_request_failed(Dispatcher *disp, uint8_t idx, uint32_t uid, bool permanent);
+static void disp_end_replay(Dispatcher *disp, uint8_t idx);
+static void disp_want_app_name(Dispatcher *disp, uint8_t idx, std::string_view appId);
+
+// A replay with no live notification after it is taken as over once this old and idle
+static constexpr int64_t REPLAY_WINDOW_US = 30 * 1000000LL;
+
+// Replays are checked for their end, and changed known UIDs and app names written to NVS this
+// often, whatever the retention TTL. Also bounds the flash writes of a busy phone to one per period.
+static constexpr uint64_t FLUSH_PERIOD_US = 10 * 1000000ULL;
+
+// Apps waiting for their display name per device, more in one burst wait for their next notification
+static constexpr size_t APP_NAME_QUEUE_SIZE = 8;
+
+// Backoff before the first retry of a failed request, doubled on every further one
+static constexpr int64_t RETRY_BACKOFF_US = 250 * 1000LL;
+static constexpr int64_t RETRY_BACKOFF_MAX_US = 4 * 1000000LL;
+
+// Requested lengths match the slots of NotificationBuffer, so what the phone sends fits
+static constexpr AttrSet headerAttrs = AttrSet()
+    .with(BLE_ANCS_NOTIF_ATTR_ID_APP_IDENTIFIER)
+    .with(BLE_ANCS_NOTIF_ATTR_ID_DATE);
 
-static const std::vector<ble_ancs_c_notif_attr_id_val_t> basicAttrList {
-    BLE_ANCS_NOTIF_ATTR_ID_APP_IDENTIFIER,
-    BLE_ANCS_NOTIF_ATTR_ID_DATE,
-    BLE_ANCS_NOTIF_ATTR_ID_TITLE,
-    BLE_ANCS_NOTIF_ATTR_ID_SUBTITLE,
-    BLE_ANCS_NOTIF_ATTR_ID_MESSAGE
-};
+// Message is only a preview here, Message Size tells whether there is more of it
+static constexpr AttrSet auxAttrs = AttrSet()
+    .with(BLE_ANCS_NOTIF_ATTR_ID_TITLE, detail::attrCapacity[BLE_ANCS_NOTIF_ATTR_ID_TITLE])
+    .with(BLE_ANCS_NOTIF_ATTR_ID_SUBTITLE, detail::attrCapacity[BLE_ANCS_NOTIF_ATTR_ID_SUBTITLE])
+    .with(BLE_ANCS_NOTIF_ATTR_ID_MESSAGE, NotificationBuffer::PREVIEW_MAX)
+    .with(BLE_ANCS_NOTIF_ATTR_ID_MESSAGE_SIZE);
 
-/*static const std::vector<ble_ancs_c_notif_attr_id_val_t> auxAttrList {
-    BLE_ANCS_NOTIF_ATTR_ID_TITLE,
-    BLE_ANCS_NOTIF_ATTR_ID_SUBTITLE,
-    BLE_ANCS_NOTIF_ATTR_ID_MESSAGE
-};*/
+static constexpr AttrSet fullAttrs = AttrSet()
+    .with(BLE_ANCS_NOTIF_ATTR_ID_MESSAGE, NotificationBuffer::STREAMED_MAX)
+    .with(BLE_ANCS_NOTIF_ATTR_ID_MESSAGE_SIZE);
+
+static constexpr ancs_attr_frame_t headerFrame = headerAttrs.frame();
+static constexpr ancs_attr_frame_t auxFrame = auxAttrs.frame();
+static constexpr ancs_attr_frame_t fullFrame = fullAttrs.frame();
 
 esp_err_t Dispatcher::initDriver(void) {
     ancs_handlers_t h;
 
-    h.connect = disp_connect;
-    h.disconnect = disp_disconnect;
-    h.device_name = disp_device_name;
-    h.notification = disp_notification;
-    h.attribute = disp_attribute;
-    h.attributes_done = disp_attributes_done;
+    if (m_workerTask == nullptr) {
+        if (xTaskCreate(workerTask, "disp", 4096, this, 5, &m_workerTask) != pdPASS) {
+            ESP_LOGE(TAG, "%s: xTaskCreate failed", __func__);
+            m_workerTask = nullptr;
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    if (m_fetchQueue == nullptr) {
+        m_fetchQueue = xQueueCreate(FETCH_QUEUE_SIZE, sizeof(FetchRequest));
+        if (m_fetchQueue == nullptr) {
+            ESP_LOGE(TAG, "%s: xQueueCreate failed", __func__);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    h.connect = drv_connect;
+    h.disconnect = drv_disconnect;
+    h.device_name = drv_device_name;
+    h.notification = drv_notification;
+    h.attribute = drv_attribute;
+    h.attributes_done = drv_attributes_done;
+    h.attribute_buffer = drv_attribute_buffer;
+    h.attribute_chunk = drv_attribute_chunk;
+    h.request_error = drv_request_error;
+    h.app_name = drv_app_name;
+    h.bond_removed = drv_bond_removed;
+
+    AppNameCache::instance().load();
+
+    esp_err_t ret = startRetentionTimer();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    if (m_retryTimer == nullptr) {
+        esp_timer_create_args_t args = {
+            .callback = retryTimerCb,
+            .arg = this,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "attr_retry",
+            .skip_unhandled_events = true
+        };
+        ret = esp_timer_create(&args, &m_retryTimer);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "%s: esp_timer_create failed (%s)", __func__, esp_err_to_name(ret));
+            m_retryTimer = nullptr;
+            return ret;
+        }
+    }
+
+    if (m_flushTimer == nullptr) {
+        esp_timer_create_args_t args = {
+            .callback = flushTimerCb,
+            .arg = this,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "disp_flush",
+            .skip_unhandled_events = true
+        };
+        ret = esp_timer_create(&args, &m_flushTimer);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "%s: esp_timer_create failed (%s)", __func__, esp_err_to_name(ret));
+            m_flushTimer = nullptr;
+            return ret;
+        }
+        esp_timer_start_periodic(m_flushTimer, FLUSH_PERIOD_US);
+    }
 
     return ancs_init(this, &h); // ANCS driver is a singleton
 }
@@ -42,17 +153,444 @@ esp_err_t Dispatcher::deinitDriver(void) {
     return ancs_deinit(this);
 }
 
+DriverEvent *Dispatcher::prepareEvent(void) {
+    DriverEvent *e;
+    while ((e = m_eventQueue.prepare()) == nullptr) {
+        // Worker task is behind, never drop driver events
+        m_stats.producerStalls ++;
+        vTaskDelay(1);
+    }
+    return e;
+}
+
+void Dispatcher::commitEvent(int64_t startTime) {
+    m_eventQueue.commit();
+    xTaskNotify(m_workerTask, NOTIFY_EVENTS, eSetBits);
+
+    uint32_t depth = m_eventQueue.size();
+    if (depth > m_stats.queueHighWater) {
+        m_stats.queueHighWater = depth;
+    }
+    int64_t dt = esp_timer_get_time() - startTime;
+    m_stats.postTimeTotalUs += dt;
+    if (dt > m_stats.postTimeMaxUs) {
+        m_stats.postTimeMaxUs = dt;
+    }
+}
+
+void Dispatcher::workerTask(void *arg) {
+    Dispatcher *disp = static_cast<Dispatcher *>(arg);
+
+    while (1) {
+        uint32_t bits = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &bits, portMAX_DELAY);
+
+        // Other tasks only read the store in between, see withStore()
+        std::unique_lock<std::mutex> lock(disp->m_storeMutex);
+
+        if (bits & NOTIFY_RETENTION_TICK) {
+            disp->m_retentionTick ++;
+            size_t n = 0;
+            for (auto& p : disp->m_providerList) {
+                n += p.second.expire(disp->m_retentionTick);
+            }
+            if (n != 0) {
+                ESP_LOGD(TAG, "Expired %u notifications", (unsigned)n);
+            }
+        }
+
+        if (bits & NOTIFY_FLUSH) {
+            int64_t now = esp_timer_get_time();
+            for (uint8_t idx = 0; idx < ANCS_PROFILE_NUM; idx ++) {
+                int64_t start = disp->m_replayStart[idx];
+                if (start != 0 && now - start > REPLAY_WINDOW_US && !disp->m_attrScheduler[idx].busy()) {
+                    disp_end_replay(disp, idx);
+                }
+                disp->saveKnownUids(idx); // Only taken when changed
+            }
+            disp->saveAppNames();
+        }
+
+        // Drain everything posted so far in one batch
+        uint32_t n = 0;
+        DriverEvent *e;
+        while ((e = disp->m_eventQueue.front()) != nullptr) {
+            disp->processEvent(*e);
+            disp->m_eventQueue.pop();
+            n ++;
+        }
+
+        // After the batch, so a response that beat its own timeout is already accounted for
+        TimeoutEvent *t;
+        while ((t = disp->m_timeoutQueue.front()) != nullptr) {
+            if (t->app) {
+                disp_app_name(disp, t->idx, nullptr, ANCS_STATUS_TIMEOUT);
+            } else {
+                disp_request_error(disp, t->idx, t->uid, ANCS_STATUS_TIMEOUT);
+            }
+            disp->m_timeoutQueue.pop();
+        }
+        if (bits & NOTIFY_RETRY) {
+            disp->m_retryDue = 0;
+        }
+
+        // Clients last, the notification they opened may have been updated by the batch
+        FetchRequest f;
+        while (xQueueReceive(disp->m_fetchQueue, &f, 0) == pdPASS) {
+            disp->processFetch(f);
+        }
+
+        if (n != 0 || (bits & (NOTIFY_TIMEOUT | NOTIFY_RETRY | NOTIFY_FETCH))) {
+            // Requests queued by the whole batch compete, a replay burst is then served newest first
+            for (uint8_t idx = 0; idx < ANCS_PROFILE_NUM; idx ++) {
+                disp_start_next(disp, idx);
+                ancs_set_backlog(idx, disp->m_attrScheduler[idx].size()); // Connection interval follows it
+            }
+        }
+
+        if (n != 0) {
+            disp->m_stats.events += n;
+            disp->m_stats.batches ++;
+            if (n > disp->m_stats.maxBatch) {
+                disp->m_stats.maxBatch = n;
+            }
+        }
+
+        // Flash writes last and unlocked, nothing waits on the store meanwhile
+        NvsWrites nvs = std::move(disp->m_nvsWrites);
+        disp->m_nvsWrites = {};
+        lock.unlock();
+        writeNvs(nvs);
+    }
+}
+
+void Dispatcher::retentionTimerCb(void *arg) {
+    Dispatcher *disp = static_cast<Dispatcher *>(arg);
+    xTaskNotify(disp->m_workerTask, NOTIFY_RETENTION_TICK, eSetBits);
+}
+
+void Dispatcher::flushTimerCb(void *arg) {
+    Dispatcher *disp = static_cast<Dispatcher *>(arg);
+    xTaskNotify(disp->m_workerTask, NOTIFY_FLUSH, eSetBits);
+}
+
+// The event queue has a single producer, the BT task, so timeouts take a queue of their own
+void Dispatcher::postTimeout(uint8_t idx, uint32_t uid, bool app) {
+    TimeoutEvent *t = m_timeoutQueue.prepare();
+    if (t == nullptr) {
+        // Cannot happen, there are never more requests in flight than slots
+        ESP_LOGE(TAG, "Timeout queue full, UID %" PRIu32 " lost", uid);
+        return;
+    }
+    t->idx = idx;
+    t->app = app;
+    t->uid = uid;
+    m_timeoutQueue.commit();
+    xTaskNotify(m_workerTask, NOTIFY_TIMEOUT, eSetBits);
+}
+
+/**@brief Queue a fetch of the whole message of a notification stored with a preview only.
+ *
+ * @details Safe from any task, typically a console or web client that opened the notification.
+ *          The worker task checks that the device is connected and the message is still cut
+ *          short, then requests it at NOWA_PRIO_ON_DEMAND. False if it could not be posted.
+ */
+bool Dispatcher::fetchFullMessage(const BDA& bda, uint32_t uid) {
+    if (m_fetchQueue == nullptr) {
+        return false;
+    }
+    FetchRequest f { bda, uid };
+    if (xQueueSend(m_fetchQueue, &f, 0) != pdPASS) {
+        ESP_LOGW(TAG, "Fetch queue full, UID %" PRIu32 " not requested", uid);
+        return false;
+    }
+    xTaskNotify(m_workerTask, NOTIFY_FETCH, eSetBits);
+    return true;
+}
+
+void Dispatcher::processFetch(const FetchRequest& f) {
+    uint8_t idx = getId(f.bda);
+    if (idx == INVALID_ID) {
+        ESP_LOGW(TAG, "Full message of UID %" PRIu32 ": device not connected", f.uid);
+        return;
+    }
+    const Notification *n = getNPById(idx)->getNotification(f.uid);
+    if (n == nullptr || !n->messageCut()) {
+        return; // Gone meanwhile, or already whole
+    }
+
+    // A request already queued or in flight for the UID refreshes it from the header, ask again after
+    AttrRequestScheduler& sched = m_attrScheduler[idx];
+    if (sched.holds(f.uid)) {
+        ESP_LOGD(TAG, "UID %" PRIu32 " busy, full message not requested", f.uid);
+        return;
+    }
+    if (sched.push({ f.uid, AttrRequest::FULL, n->category(), n->flags(), true }, esp_timer_get_time())) {
+        ESP_LOGI(TAG, "Requesting full message of UID %" PRIu32, f.uid);
+        m_stats.fullFetchRequests ++;
+    }
+}
+
+void Dispatcher::retryTimerCb(void *arg) {
+    Dispatcher *disp = static_cast<Dispatcher *>(arg);
+    xTaskNotify(disp->m_workerTask, NOTIFY_RETRY, eSetBits);
+}
+
+void Dispatcher::scheduleRetry(int64_t due) {
+    if (m_retryTimer == nullptr || (m_retryDue != 0 && m_retryDue <= due)) {
+        return; // Woken up early enough already
+    }
+    int64_t delay = due - esp_timer_get_time();
+    esp_timer_stop(m_retryTimer);
+    esp_timer_start_once(m_retryTimer, (delay > 0) ? delay : 1);
+    m_retryDue = due;
+}
+
+Dispatcher::FetchSlot *Dispatcher::fetchSlot(uint8_t idx, uint32_t uid) {
+    for (FetchSlot& fs : m_fetchSlots[idx]) {
+        if (fs.used && fs.buf.uid() == uid) {
+            return &fs;
+        }
+    }
+    return nullptr;
+}
+
+/**@brief Slot for the header or full message request of a UID, emptied.
+ *
+ * @details Requests in flight and bodies still to request hold one slot each. A body is always
+ *          served before a new header, so there are never more of them than the pipeline depth.
+ */
+Dispatcher::FetchSlot *Dispatcher::claimFetchSlot(uint8_t idx, uint32_t uid) {
+    FetchSlot *slot = fetchSlot(idx, uid);
+    for (FetchSlot& fs : m_fetchSlots[idx]) {
+        if (slot == nullptr && !fs.used) {
+            slot = &fs;
+        }
+    }
+    if (slot == nullptr) {
+        // A body request dropped from a full queue leaves its slot behind
+        for (FetchSlot& fs : m_fetchSlots[idx]) {
+            if (!m_attrScheduler[idx].holds(fs.buf.uid())) {
+                ESP_LOGW(TAG, "Reclaimed fetch slot of UID %" PRIu32, fs.buf.uid());
+                fs.release();
+                slot = (slot == nullptr) ? &fs : slot;
+            }
+        }
+    }
+    if (slot != nullptr) {
+        slot->used = true;
+        slot->buf.clear(uid);
+    }
+    return slot;
+}
+
+void Dispatcher::releaseFetchSlot(uint8_t idx, uint32_t uid) {
+    if (FetchSlot *fs = fetchSlot(idx, uid)) {
+        fs->release();
+    }
+}
+
+esp_err_t Dispatcher::startRetentionTimer(void) {
+    if (m_retentionTimer == nullptr) {
+        esp_timer_create_args_t args = {
+            .callback = retentionTimerCb,
+            .arg = this,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "retention",
+            .skip_unhandled_events = true
+        };
+        esp_err_t ret = esp_timer_create(&args, &m_retentionTimer);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "%s: esp_timer_create failed (%s)", __func__, esp_err_to_name(ret));
+            m_retentionTimer = nullptr;
+            return ret;
+        }
+    }
+
+    if (esp_timer_is_active(m_retentionTimer)) {
+        esp_timer_stop(m_retentionTimer);
+    }
+    if (m_retention.ttlSeconds == 0) {
+        return ESP_OK;
+    }
+
+    // One wheel revolution spans the TTL
+    uint64_t period = (uint64_t)m_retention.ttlSeconds * 1000000 / NotificationProvider::WHEEL_SIZE;
+    return esp_timer_start_periodic(m_retentionTimer, (period < 1000000) ? 1000000 : period);
+}
+
+void Dispatcher::processEvent(DriverEvent& e) {
+    switch (e.type) {
+        case DriverEvent::CONNECT: disp_connect(this, e.idx, e.bda.data()); break;
+        case DriverEvent::DISCONNECT: disp_disconnect(this, e.idx); break;
+        case DriverEvent::DEVICE_NAME: disp_device_name(this, e.idx, e.name); break;
+        case DriverEvent::NOTIFICATION: disp_notification(this, e.idx, &e.notif); break;
+        case DriverEvent::ATTRIBUTE: disp_attribute(this, e.idx, e.uid, &e.attr); break;
+        case DriverEvent::ATTRIBUTES_DONE: disp_attributes_done(this, e.idx, e.uid); break;
+        case DriverEvent::REQUEST_ERROR: disp_request_error(this, e.idx, e.uid, e.status); break;
+        case DriverEvent::APP_NAME: disp_app_name(this, e.idx, (e.status == ESP_GATT_OK) ? e.name : nullptr, e.status); break;
+        case DriverEvent::BOND_REMOVED: forgetDevice(e.bda); break;
+        default: break;
+    }
+}
+
+static void drv_connect(void *ctx, uint8_t idx, uint8_t bda[6]) {
+    int64_t t = esp_timer_get_time();
+    Dispatcher *disp = static_cast<Dispatcher *>(ctx);
+    DriverEvent *e = disp->prepareEvent();
+    e->type = DriverEvent::CONNECT;
+    e->idx = idx;
+    memcpy(e->bda.data(), bda, e->bda.size());
+    disp->commitEvent(t);
+}
+
+static void drv_disconnect(void *ctx, uint8_t idx) {
+    int64_t t = esp_timer_get_time();
+    Dispatcher *disp = static_cast<Dispatcher *>(ctx);
+    DriverEvent *e = disp->prepareEvent();
+    e->type = DriverEvent::DISCONNECT;
+    e->idx = idx;
+    disp->commitEvent(t);
+}
+
+static void drv_device_name(void *ctx, uint8_t idx, char *name) {
+    int64_t t = esp_timer_get_time();
+    Dispatcher *disp = static_cast<Dispatcher *>(ctx);
+    DriverEvent *e = disp->prepareEvent();
+    e->type = DriverEvent::DEVICE_NAME;
+    e->idx = idx;
+    strlcpy(e->name, name, sizeof(e->name));
+    disp->commitEvent(t);
+}
+
+static void drv_notification(void *ctx, uint8_t idx, ble_ancs_c_evt_notif_t *notif) {
+    int64_t t = esp_timer_get_time();
+    Dispatcher *disp = static_cast<Dispatcher *>(ctx);
+    DriverEvent *e = disp->prepareEvent();
+    e->type = DriverEvent::NOTIFICATION;
+    e->idx = idx;
+    e->uid = notif->notif_uid;
+    e->notif = *notif;
+    disp->commitEvent(t);
+}
+
+static void drv_attribute(void *ctx, uint8_t idx, uint32_t uid, ble_ancs_c_attr_t *attr) {
+    int64_t t = esp_timer_get_time();
+    Dispatcher *disp = static_cast<Dispatcher *>(ctx);
+    DriverEvent *e = disp->prepareEvent();
+    e->type = DriverEvent::ATTRIBUTE;
+    e->idx = idx;
+    e->uid = uid;
+    e->attr = *attr; // Data itself is already in the fetch slot of the UID
+    disp->commitEvent(t);
+}
+
+static void drv_attributes_done(void *ctx, uint8_t idx, uint32_t uid) {
+    int64_t t = esp_timer_get_time();
+    Dispatcher *disp = static_cast<Dispatcher *>(ctx);
+    DriverEvent *e = disp->prepareEvent();
+    e->type = DriverEvent::ATTRIBUTES_DONE;
+    e->idx = idx;
+    e->uid = uid;
+    disp->commitEvent(t);
+}
+
+static void drv_request_error(void *ctx, uint8_t idx, uint32_t uid, uint16_t status) {
+    Dispatcher *disp = static_cast<Dispatcher *>(ctx);
+    if (status == ANCS_STATUS_TIMEOUT) {
+        disp->postTimeout(idx, uid); // Timer task, not the event queue producer
+        return;
+    }
+
+    int64_t t = esp_timer_get_time();
+    DriverEvent *e = disp->prepareEvent();
+    e->type = DriverEvent::REQUEST_ERROR;
+    e->idx = idx;
+    e->uid = uid;
+    e->status = status;
+    disp->commitEvent(t);
+}
+
+static void drv_app_name(void *ctx, uint8_t idx, const char *name, uint16_t status) {
+    Dispatcher *disp = static_cast<Dispatcher *>(ctx);
+    if (status == ANCS_STATUS_TIMEOUT) {
+        disp->postTimeout(idx, 0, true); // Timer task, not the event queue producer
+        return;
+    }
+
+    int64_t t = esp_timer_get_time();
+    DriverEvent *e = disp->prepareEvent();
+    e->type = DriverEvent::APP_NAME;
+    e->idx = idx;
+    strlcpy(e->name, (name != NULL) ? name : "", sizeof(e->name));
+    e->status = status;
+    disp->commitEvent(t);
+}
+
+static void drv_bond_removed(void *ctx, uint8_t bda[6]) {
+    int64_t t = esp_timer_get_time();
+    Dispatcher *disp = static_cast<Dispatcher *>(ctx);
+    DriverEvent *e = disp->prepareEvent();
+    e->type = DriverEvent::BOND_REMOVED;
+    e->idx = Dispatcher::INVALID_ID;
+    memcpy(e->bda.data(), bda, e->bda.size());
+    disp->commitEvent(t);
+}
+
+static uint8_t *drv_attribute_buffer(void *ctx, uint8_t idx, uint32_t uid, uint32_t attr_id, uint16_t *len) {
+    Dispatcher *disp = static_cast<Dispatcher *>(ctx);
+    Dispatcher::FetchSlot *fs = disp->fetchSlot(idx, uid);
+    return (fs != nullptr) ? fs->buf.slot(attr_id, len) : nullptr;
+}
+
+// Straight into the stream of the fetch slot, which drops the chunk unless it is open for the UID
+static void drv_attribute_chunk(void *ctx, uint8_t idx, uint32_t uid, uint32_t attr_id, uint16_t offset, const uint8_t *data, uint16_t len) {
+    Dispatcher *disp = static_cast<Dispatcher *>(ctx);
+    for (Dispatcher::FetchSlot& fs : disp->m_fetchSlots[idx]) {
+        if (fs.buf.append(uid, attr_id, offset, data, len)) {
+            return;
+        }
+    }
+}
+
 static void disp_connect(void *ctx, uint8_t idx, uint8_t bda[6]) {
     Dispatcher *disp = static_cast<Dispatcher *>(ctx);
-    disp->connectNP(idx, { bda[0], bda[1], bda[2], bda[3], bda[4], bda[5] });
+    BDA addr { bda[0], bda[1], bda[2], bda[3], bda[4], bda[5] };
+    disp->connectNP(idx, addr);
     ESP_LOGI(TAG, "Connected as [%d]", idx);
-    Notification *n = disp->getNPById(idx)->getLatestNotification();
-    disp->m_prevLatestNotifications[idx] = n ? n->timeStamp : String();
+
+    // Notifications not newer than what is already stored count as outdated
+    int64_t highWater = DispatcherUtils::INVALID_TIME;
+    NotificationProvider *np = disp->getNPById(idx);
+    np->forEach([&](const Notification& n) {
+        highWater = (n.time() > highWater) ? n.time() : highWater;
+    });
+    disp->m_highWater[idx] = highWater;
+    disp->m_attrScheduler[idx].setDepth(AttrRequestScheduler::MAX_DEPTH); // Undo a fallback of the previous connection
+
+    // Phone replays what it still shows as pre-existing, the ones fetched before are skipped. They
+    // are only known as long as the store is, which does not outlive a reboot or a retired device.
+    KnownUids& known = disp->m_knownUids[idx];
+    disp->loadKnownUids(idx, addr);
+    if (np->size() == 0) {
+        known.clear();
+    }
+    np->reindex([&](uint32_t uid) { return known.contains(uid); });
+    disp->m_replayStart[idx] = esp_timer_get_time();
 }
 
 static void disp_disconnect(void *ctx, uint8_t idx) {
     Dispatcher *disp = static_cast<Dispatcher *>(ctx);
     disp->disconnectNP(idx, false);
+    disp->m_attrScheduler[idx].clear(); // Pending UIDs are meaningless on the next connection
+    for (Dispatcher::FetchSlot& fs : disp->m_fetchSlots[idx]) {
+        fs.release();
+    }
+    disp->m_appNameQueue[idx].clear();
+    disp->m_appNameInFlight[idx].clear();
+    disp->saveKnownUids(idx);
+    disp->saveAppNames();
+    disp->m_replayStart[idx] = 0;
     ESP_LOGI(TAG, "Disconnected [%d]", idx);
 }
 
@@ -64,16 +602,56 @@ static void disp_device_name(void *ctx, uint8_t idx, char *name) {
 
 static void disp_notification(void *ctx, uint8_t idx, ble_ancs_c_evt_notif_t *notif) {
     Dispatcher *disp = static_cast<Dispatcher *>(ctx);
+    KnownUids& known = disp->m_knownUids[idx];
     if (notif->evt_id == BLE_ANCS_EVENT_ID_NOTIFICATION_ADDED || notif->evt_id == BLE_ANCS_EVENT_ID_NOTIFICATION_MODIFIED) {
         DispatcherUtils::printNotif(notif);
 
-        bool empty = disp->m_attrRequestQueue[idx].empty();
-        disp->m_attrRequestQueue[idx].push(std::make_pair(notif->notif_uid, basicAttrList));
-        if (empty) {
-            // Start read process if this is the first request
-            AttrRequest r = disp->m_attrRequestQueue[idx].front();
-            ESP_LOGI(TAG, "Starting immediately for UID %" PRIu32, r.first);
-            ancs_send_attrs_request(idx, r.first, r.second.data(), r.second.size());
+        if (!notif->evt_flags.pre_existing) {
+            // UIDs only grow, a new one at or below the known ones means the phone started over
+            if (notif->evt_id == BLE_ANCS_EVENT_ID_NOTIFICATION_ADDED && !known.empty() && notif->notif_uid <= known.maxUid()) {
+                ESP_LOGW(TAG, "UID %" PRIu32 " reused, known UIDs dropped", notif->notif_uid);
+                known.clear();
+                disp->getNPById(idx)->reindex([](uint32_t) { return false; });
+            }
+            if (disp->m_replayStart[idx] != 0) {
+                disp_end_replay(disp, idx);
+            }
+        }
+
+        if (Notification *stored = disp->getNPById(idx)->getNotification(notif->notif_uid)) {
+            stored->countEvent();
+        }
+
+        if (notif->evt_flags.pre_existing && known.markSeen(notif->notif_uid)) {
+            ESP_LOGD(TAG, "Known UID %" PRIu32 ", skipped", notif->notif_uid);
+            disp->stats().knownSkipped ++;
+            return;
+        }
+
+        // Category and flags alone may already settle it, then nothing is fetched
+        uint8_t flags = NotificationFilter::packFlags(notif->evt_flags);
+        NotificationFilter::Decision d = disp->filter().decide(notif->category_id, flags, nullptr, nullptr);
+        disp->filter().countHit(d);
+        if (d.verdict == NotificationFilter::REJECT) {
+            ESP_LOGD(TAG, "Filtered UID %" PRIu32 " before fetch", notif->notif_uid);
+            disp->stats().filteredEarly ++;
+            return;
+        }
+
+        // Sent once the event batch is processed, see disp_start_next()
+        disp->m_attrScheduler[idx].push({ notif->notif_uid, AttrRequest::HEADER, (uint8_t)notif->category_id, flags,
+            d.verdict == NotificationFilter::ACCEPT }, esp_timer_get_time());
+    } else if (notif->evt_id == BLE_ANCS_EVENT_ID_NOTIFICATION_REMOVED) {
+        known.remove(notif->notif_uid);
+        AttrRequestScheduler& sched = disp->m_attrScheduler[idx];
+        if (sched.cancel(notif->notif_uid)) {
+            ESP_LOGD(TAG, "Cancelled request for removed UID %" PRIu32, notif->notif_uid);
+            if (!sched.holds(notif->notif_uid)) {
+                disp->releaseFetchSlot(idx, notif->notif_uid); // Body request still queued
+            }
+        }
+        if (disp->getNPById(idx)->removeNotification(notif->notif_uid)) {
+            ESP_LOGD(TAG, "Removed UID %" PRIu32, notif->notif_uid);
         }
     }
 }
@@ -82,50 +660,292 @@ static void disp_attribute(void *ctx, uint8_t idx, uint32_t uid, ble_ancs_c_attr
     Dispatcher *disp = static_cast<Dispatcher *>(ctx);
     DispatcherUtils::printNotifAttr(uid, attr);
 
-    // Clean on first attribute
-    AttrRequest r = disp->m_attrRequestQueue[idx].front();
-    if (attr->attr_id == r.second[0]) {
-        disp->m_notifBuffers[idx] = Notification();
+    Dispatcher::FetchSlot *fs = disp->fetchSlot(idx, uid);
+    if (fs == nullptr || disp->m_attrScheduler[idx].inFlight(uid) == nullptr) {
+        return; // Response to a request already given up
     }
 
-    switch (attr->attr_id) {
-        case BLE_ANCS_NOTIF_ATTR_ID_APP_IDENTIFIER: disp->m_notifBuffers[idx].appId = (char *)attr->p_attr_data; break;
-        case BLE_ANCS_NOTIF_ATTR_ID_TITLE: disp->m_notifBuffers[idx].title = (char *)attr->p_attr_data; break;
-        case BLE_ANCS_NOTIF_ATTR_ID_SUBTITLE: disp->m_notifBuffers[idx].subTitle = (char *)attr->p_attr_data; break;
-        case BLE_ANCS_NOTIF_ATTR_ID_MESSAGE: disp->m_notifBuffers[idx].message = (char *)attr->p_attr_data; break;
-        case BLE_ANCS_NOTIF_ATTR_ID_DATE: disp->m_notifBuffers[idx].timeStamp = (char *)attr->p_attr_data; break;
-        default: break;
+    // Bytes are already in place, only record how many of them the parser kept
+    DispatcherStats& st = disp->stats();
+    fs->buf.setLength(attr->attr_id, attr->attr_len);
+    st.fetchBytes += sizeof(uint8_t) + sizeof(uint16_t) + attr->attr_len; // ID, length, data
+
+    if (attr->attr_id == NotificationBuffer::STREAMED_ATTR) {
+        st.streamedLong += (attr->attr_len >= MAX_NOTIF_ATTR_SIZE) ? 1 : 0; // Would not have fit a slot
+        st.streamedMax = (attr->attr_len > st.streamedMax) ? attr->attr_len : st.streamedMax;
+        if (fs->buf.stream().truncated()) {
+            ESP_LOGW(TAG, "Message of UID %" PRIu32 " truncated to %u bytes", uid, (unsigned)fs->buf.length(attr->attr_id));
+            st.streamedTruncated ++;
+        }
     }
 }
 
 static void disp_attributes_done(void *ctx, uint8_t idx, uint32_t uid) {
     Dispatcher *disp = static_cast<Dispatcher *>(ctx);
 
-    if (disp->m_attrRequestQueue[idx].empty()) {
-        return; // Invalid state
+    AttrRequestScheduler& sched = disp->m_attrScheduler[idx];
+    const AttrRequest *r = sched.inFlight(uid);
+    Dispatcher::FetchSlot *fs = disp->fetchSlot(idx, uid);
+    if (r == nullptr || fs == nullptr) {
+        return; // Invalid state, or a request already given up
     }
 
-    disp->m_attrRequestQueue[idx].pop();
+    AttrRequest done = *r;
+    bool cancelled = sched.inFlightCancelled(uid);
+    sched.complete(uid);
 
-    // Notification filtering
-    if (disp->m_notifBuffers[idx].appId.compare("com.apple.shortcuts") == 0) {
-        // Add notification to the queue
-        if (disp->m_notifBuffers[idx].timeStamp.compare(disp->m_prevLatestNotifications[idx]) > 0) {
-            disp->getNPById(idx)->addNotification(disp->m_notifBuffers[idx]);
-            ESP_LOGD(TAG, "Added!");
-            // Request the other attributes
-            //ESP_LOGI(TAG, "Requesting remaining attrs for UID %" PRIu32, uid);
-            //disp->m_attrRequestQueue[idx].push(std::make_pair(uid, auxAttrList));
+    const NotificationBuffer& buf = fs->buf;
+    DispatcherStats& st = disp->stats();
+    st.requestLatency.add(esp_timer_get_time() - fs->requestTime);
+    KnownUids& known = disp->m_knownUids[idx];
+
+    // Notification filtering, with whatever attributes this stage brought in
+    bool rejected = false;
+    bool bodyNext = false;
+    if (cancelled) {
+        ESP_LOGD(TAG, "UID %" PRIu32 " removed while fetching", uid);
+    } else if (!done.decided) {
+        std::string_view appId = buf.get(BLE_ANCS_NOTIF_ATTR_ID_APP_IDENTIFIER);
+        std::string_view title = buf.get(BLE_ANCS_NOTIF_ATTR_ID_TITLE);
+        NotificationFilter::Decision d = disp->filter().decide(done.category, done.flags, &appId,
+            (done.stage == AttrRequest::BODY) ? &title : nullptr);
+        disp->filter().countHit(d);
+        done.decided = (d.verdict == NotificationFilter::ACCEPT);
+        rejected = (d.verdict == NotificationFilter::REJECT);
+    }
+
+    if (cancelled) {
+        // Nothing to keep
+    } else if (rejected) {
+        ESP_LOGD(TAG, "Filtered UID %" PRIu32, uid);
+        st.filteredLate ++;
+        known.add(uid, (done.stage == AttrRequest::BODY) ? fs->headerTime : DispatcherUtils::INVALID_TIME);
+    } else if (done.stage == AttrRequest::FULL) {
+        // Replaces the preview, the notification may have been removed or evicted meanwhile
+        NotificationProvider *np = disp->getNPById(idx);
+        if (const Notification *stored = np->getNotification(uid)) {
+            np->addNotification(Notification(*stored, buf));
+            disp->enforceRetention();
+            st.fullFetchDone ++;
+        }
+    } else if (done.stage == AttrRequest::HEADER) {
+        // A malformed Date cannot be ordered, so it is never outdated
+        int64_t& t = fs->headerTime;
+        bool valid = DispatcherUtils::parseAncsDate(buf.get(BLE_ANCS_NOTIF_ATTR_ID_DATE), &t);
+        if (!valid) {
+            ESP_LOGW(TAG, "Malformed Date for UID %" PRIu32, uid);
+            t = DispatcherUtils::INVALID_TIME;
+            st.badDates ++;
+        }
+        // A stored UID is a Modified one, refreshed whatever its Date
+        if (!valid || t > disp->m_highWater[idx] || disp->getNPById(idx)->getNotification(uid) != nullptr) {
+            // Request the other attributes right away while the buffer still holds the header
+            ESP_LOGI(TAG, "Requesting remaining attrs for UID %" PRIu32, uid);
+            disp_want_app_name(disp, idx, buf.get(BLE_ANCS_NOTIF_ATTR_ID_APP_IDENTIFIER));
+            bodyNext = sched.pushNext({ done.uid, AttrRequest::BODY, done.category, done.flags, done.decided }, esp_timer_get_time());
         } else {
             ESP_LOGD(TAG, "Oudated UID %" PRIu32, uid);
+            known.add(uid, t);
         }
+    } else {
+        // Add notification to the queue, the heap is only touched when the pool grows or a new app ID is interned
+        uint32_t chunks = RecordPool::instance().chunksTaken();
+        size_t appIds = AppIdTable::instance().count();
+        Notification n(buf, done.category, done.flags, fs->headerTime);
+        st.notifsStored ++;
+        st.notifBytesCopied += n.size();
+        if (n.messageCut()) {
+            st.previewsStored ++;
+            st.previewBytesSkipped += n.messageSize() - n.messageLength();
+        }
+        st.notifAllocations += (RecordPool::instance().chunksTaken() - chunks) + ((AppIdTable::instance().count() > appIds) ? 1 : 0);
+        disp->getNPById(idx)->addNotification(std::move(n));
+        disp->enforceRetention();
+        known.add(uid, fs->headerTime);
+        ESP_LOGD(TAG, "Added!");
+
+        int64_t dt = esp_timer_get_time() - fs->fetchStart;
+        st.fetchAccepted ++;
+        st.fetchTimeTotalUs += dt;
+        if (dt > st.fetchTimeMaxUs) {
+            st.fetchTimeMaxUs = dt;
+        }
+    }
+
+    if (!bodyNext) {
+        fs->release();
+    }
+    ESP_LOGI(TAG, "Finished UID %" PRIu32, uid);
+}
+
+static void disp_request_error(void *ctx, uint8_t idx, uint32_t uid, uint16_t status) {
+    Dispatcher *disp = static_cast<Dispatcher *>(ctx);
+
+    AttrRequestScheduler& sched = disp->m_attrScheduler[idx];
+    if (sched.inFlight(uid) == nullptr) {
+        return; // Already answered or given up
+    }
+
+    DispatcherStats& st = disp->stats();
+    if (status == ANCS_STATUS_TIMEOUT) {
+        st.requestTimeouts ++;
+    } else {
+        st.requestNpErrors ++;
+    }
+    ESP_LOGW(TAG, "Request for UID %" PRIu32 " failed, status 0x%x", uid, status);
+
+    // Retrying cannot help when the phone does not know the UID or the command
+    bool permanent = (status == ANCS_STATUS_INVALID_PARAMETER) || (status == ANCS_STATUS_UNKNOWN_COMMAND) || (status == ANCS_STATUS_INVALID_COMMAND);
+
+    // A phone that lost or refused a command queued behind another gets them one at a time from now on
+    bool npError = (status >= ANCS_STATUS_UNKNOWN_COMMAND) && (status <= ANCS_STATUS_ACTION_FAILED);
+    if (!npError && sched.depth() > 1) {
+        ESP_LOGW(TAG, "Pipeline [%d] falls back to one request in flight", idx);
+        sched.setDepth(1);
+        st.pipelineFallbacks ++;
+    }
+    disp_request_failed(disp, idx, uid, permanent);
+}
+
+static bool disp_send_request(Dispatcher *disp, uint8_t idx, const AttrRequest& r) {
+    const ancs_attr_frame_t& frame = (r.stage == AttrRequest::HEADER) ? headerFrame :
+        (r.stage == AttrRequest::BODY) ? auxFrame : fullFrame;
+
+    // Attribute data of this request lands directly in its fetch slot, see drv_attribute_buffer()
+    int64_t now = esp_timer_get_time();
+    Dispatcher::FetchSlot *fs = (r.stage == AttrRequest::BODY) ? disp->fetchSlot(idx, r.uid) : disp->claimFetchSlot(idx, r.uid);
+    if (fs == nullptr) {
+        ESP_LOGE(TAG, "%s: no fetch slot for UID %" PRIu32, __func__, r.uid);
+        return false;
+    }
+    if (r.stage != AttrRequest::BODY) {
+        fs->fetchStart = now;
+    }
+    fs->requestTime = now;
+    fs->buf.setStreamMax((r.stage == AttrRequest::FULL) ? NotificationBuffer::STREAMED_MAX : NotificationBuffer::PREVIEW_MAX);
+
+    // The command, and Command ID and UID back
+    DispatcherStats& st = disp->stats();
+    st.fetchRequests ++;
+    st.replayRequests += (disp->m_replayStart[idx] != 0) ? 1 : 0;
+    st.fetchBytes += frame.len + sizeof(uint8_t) + sizeof(uint32_t);
+
+    return ancs_send_attrs_request(idx, r.uid, &frame);
+}
+
+// Fill the pipeline, so the phone has the next command while it still streams a response
+static void disp_start_next(Dispatcher *disp, uint8_t idx) {
+    AttrRequestScheduler& sched = disp->m_attrScheduler[idx];
+    DispatcherStats& st = disp->stats();
+    int64_t now = esp_timer_get_time();
+
+    while (const AttrRequest *r = sched.next(now)) {
+        ESP_LOGI(TAG, "Performing queued request for UID %" PRIu32, r->uid);
+        uint32_t uid = r->uid;
+        if (!disp_send_request(disp, idx, *r)) {
+            // Likely the link, not this request: back off instead of trying the rest right away
+            st.requestSendFailures ++;
+            disp_request_failed(disp, idx, uid, false);
+            return;
+        }
+        st.maxInFlight = (sched.inFlightCount() > st.maxInFlight) ? sched.inFlightCount() : st.maxInFlight;
+    }
+
+    // Display names only take room the notifications leave, one at a time
+    std::vector<String>& apps = disp->m_appNameQueue[idx];
+    if (!sched.full() && !apps.empty() && disp->m_appNameInFlight[idx].empty()) {
+        String app = std::move(apps.front());
+        apps.erase(apps.begin());
+        st.appNameRequests ++;
+        if (ancs_send_app_attrs_request(idx, app.c_str())) {
+            ESP_LOGI(TAG, "Requesting display name of %s", app.c_str());
+            disp->m_appNameInFlight[idx] = std::move(app);
+            sched.setReserved(1);
+        } else {
+            st.appNameFailures ++;
+        }
+    }
+
+    // A due request left behind waits for the one in flight for its UID, not for the timer
+    int64_t due = sched.nextDue();
+    if (due > now) {
+        disp->scheduleRetry(due);
+    } else if (sched.empty() && disp->m_replayStart[idx] != 0) {
+        // Nothing left to fetch of the replay so far, the last such moment is when it settled
+        disp->stats().replaySettleUs = now - disp->m_replayStart[idx];
+    }
+}
+
+// Request in flight ended without a response: queue it again after a backoff, or give it up
+static void disp_request_failed(Dispatcher *disp, uint8_t idx, uint32_t uid, bool permanent) {
+    AttrRequestScheduler& sched = disp->m_attrScheduler[idx];
+    const AttrRequest *r = sched.inFlight(uid);
+    DispatcherStats& st = disp->stats();
+
+    // Either way the next attempt starts over from the header
+    disp->releaseFetchSlot(idx, uid);
+
+    if (permanent || r->attempts >= CONFIG_NOWA_ATTR_RETRIES) {
+        ESP_LOGW(TAG, "Giving up UID %" PRIu32 " after %u attempts", uid, r->attempts + 1);
+        sched.complete(uid);
+        st.requestsAbandoned ++;
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    int64_t delay = RETRY_BACKOFF_US << r->attempts;
+    delay = (delay < RETRY_BACKOFF_MAX_US) ? delay : RETRY_BACKOFF_MAX_US;
+    if (sched.defer(uid, now, delay)) {
+        st.requestRetries ++;
+        disp->scheduleRetry(now + delay);
+    }
+}
+
+// Pre-existing notifications not replayed by now are gone from the phone
+static void disp_end_replay(Dispatcher *disp, uint8_t idx) {
+    KnownUids& known = disp->m_knownUids[idx];
+    size_t n = known.pruneUnseen();
+    disp->saveKnownUids(idx);
+    disp->m_replayStart[idx] = 0;
+    ESP_LOGI(TAG, "Replay [%d] settled in %" PRId64 " ms, %u known UIDs, %u pruned", idx,
+        disp->stats().replaySettleUs / 1000, (unsigned)known.size(), (unsigned)n);
+}
+
+// Queue a request for the display name of an app, unless it is known or already asked for
+static void disp_want_app_name(Dispatcher *disp, uint8_t idx, std::string_view appId) {
+    if (appId.empty() || appId.size() >= BLE_ANCS_APP_ID_MAX) {
+        return;
+    }
+    if (AppNameCache::instance().lookup(AppIdTable::instance().find(appId)) != nullptr) {
+        return;
+    }
+
+    std::vector<String>& apps = disp->m_appNameQueue[idx];
+    if (disp->m_appNameInFlight[idx] == appId || apps.size() >= APP_NAME_QUEUE_SIZE ||
+        std::find(apps.begin(), apps.end(), appId) != apps.end()) {
+        return;
+    }
+    apps.emplace_back(appId);
+}
+
+static void disp_app_name(void *ctx, uint8_t idx, const char *name, uint16_t status) {
+    Dispatcher *disp = static_cast<Dispatcher *>(ctx);
+    String& app = disp->m_appNameInFlight[idx];
+    if (app.empty()) {
+        return; // Disconnected meanwhile
     }
 
-    if (!disp->m_attrRequestQueue[idx].empty()) {
-        AttrRequest r = disp->m_attrRequestQueue[idx].front();
-        ESP_LOGI(TAG, "Performing queued request for UID %" PRIu32, r.first);
-        ancs_send_attrs_request(idx, r.first, r.second.data(), r.second.size());
+    if (name == nullptr) {
+        // Asked again with the next notification of the app
+        ESP_LOGW(TAG, "Display name of %s failed, status 0x%x", app.c_str(), status);
+        disp->stats().appNameFailures ++;
     } else {
-        ESP_LOGI(TAG, "Finished UID %" PRIu32, uid);
+        // The cache holds its own reference, the ID outlives this one
+        uint16_t id = AppIdTable::instance().intern(app);
+        AppNameCache::instance().put(id, name);
+        AppIdTable::instance().release(id);
+        ESP_LOGI(TAG, "Display name of %s: %s", app.c_str(), name);
     }
+    app.clear();
+    disp->m_attrScheduler[idx].setReserved(0);
 }
@@ -1,5 +1,7 @@
 #include "DispatcherUtils.h"
 
+#include <string.h>
+
 #include "esp_log.h"
 
 #define TAG "DISP"
@@ -92,7 +94,9 @@ int DispatcherUtils::printBDA(FILE *stream, BDA bda) {
  * @param[in] p_attr Pointer to an iOS notification attribute.
  */
 void DispatcherUtils::printNotifAttr(uint32_t uid, ble_ancs_c_attr_t *p_attr) {
-    if (p_attr->attr_len != 0) {
+    if (p_attr->attr_len != 0 && p_attr->p_attr_data == NULL) {
+        ESP_LOGI(TAG, "[%" PRIu32 "] NA %s: <%u bytes streamed>", uid, lit_attrid[p_attr->attr_id], p_attr->attr_len);
+    } else if (p_attr->attr_len != 0) {
         ESP_LOGI(TAG, "[%" PRIu32 "] NA %s: %s", uid, lit_attrid[p_attr->attr_id], p_attr->p_attr_data);
     } else if (p_attr->attr_len == 0) {
         ESP_LOGI(TAG, "NA %s: <No Data>", lit_attrid[p_attr->attr_id]);
@@ -114,3 +118,73 @@ void DispatcherUtils::printNotifAttr(uint32_t uid, ble_ancs_c_attr_t *p_attr) {
         ESP_LOGI(TAG, "AA %s: <No Data>", lit_appid[p_attr->attr_id]);
     }
 }*/
+
+// Days since 1970-01-01 of a proleptic Gregorian date, valid for any year
+static int64_t days_from_civil(int64_t y, unsigned m, unsigned d) {
+    y -= (m <= 2) ? 1 : 0;
+    int64_t era = ((y >= 0) ? y : y - 399) / 400;
+    unsigned yoe = (unsigned)(y - era * 400);
+    unsigned doy = (153 * (m + ((m > 2) ? -3 : 9)) + 2) / 5 + d - 1;
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int64_t)doe - 719468;
+}
+
+/**@brief Parse an ANCS Date attribute.
+ *
+ * @return false, leaving *t untouched, unless s is exactly 15 characters of a valid date and time.
+ */
+bool DispatcherUtils::parseAncsDate(std::string_view s, int64_t *t) {
+    if (s.size() != 15 || s[8] != 'T') {
+        return false;
+    }
+
+    uint32_t v[15];
+    for (size_t i = 0; i < s.size(); i ++) {
+        v[i] = (uint8_t)(s[i] - '0');
+        if (i != 8 && v[i] > 9) {
+            return false;
+        }
+    }
+
+    unsigned year = v[0] * 1000 + v[1] * 100 + v[2] * 10 + v[3];
+    unsigned month = v[4] * 10 + v[5];
+    unsigned day = v[6] * 10 + v[7];
+    unsigned hour = v[9] * 10 + v[10];
+    unsigned min = v[11] * 10 + v[12];
+    unsigned sec = v[13] * 10 + v[14];
+
+    static const uint8_t monthDays[12] = { 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    if (month < 1 || month > 12 || day < 1 || day > monthDays[month - 1] || hour > 23 || min > 59 || sec > 60) {
+        return false;
+    }
+    bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    if (month == 2 && day == 29 && !leap) {
+        return false;
+    }
+
+    *t = days_from_civil(year, month, day) * 86400 + hour * 3600 + min * 60 + sec;
+    return true;
+}
+
+void DispatcherUtils::formatAncsDate(int64_t t, char out[16]) {
+    if (t == INVALID_TIME) {
+        strlcpy(out, "-", 16);
+        return;
+    }
+
+    // Inverse of days_from_civil
+    int64_t days = (t >= 0) ? t / 86400 : (t - 86399) / 86400;
+    int64_t secs = t - days * 86400;
+    int64_t z = days + 719468;
+    int64_t era = ((z >= 0) ? z : z - 146096) / 146097;
+    unsigned doe = (unsigned)(z - era * 146097);
+    unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    unsigned mp = (5 * doy + 2) / 153;
+    unsigned day = doy - (153 * mp + 2) / 5 + 1;
+    unsigned month = (mp < 10) ? mp + 3 : mp - 9;
+    int64_t year = (int64_t)yoe + era * 400 + ((month <= 2) ? 1 : 0);
+
+    snprintf(out, 16, "%04u%02u%02uT%02u%02u%02u", (unsigned)year % 10000, month, day,
+        (unsigned)(secs / 3600), (unsigned)(secs / 60 % 60), (unsigned)(secs % 60));
+}
@@ -0,0 +1,209 @@
+#include "KnownUids.h"
+
+#include <algorithm>
+#include <string.h>
+
+#include "esp_log.h"
+#include "nvs.h"
+#include "ble_handle_cache.h"
+
+#define TAG "KUID"
+
+// Blob layout: count entries of UID (4 bytes) then Date (8 bytes), little endian, sorted by UID
+static constexpr size_t RECORD_SIZE = sizeof(uint32_t) + sizeof(int64_t);
+
+/**@brief Switch to the set of another device, changes to the current one not taken by
+ *        @ref snapshot are lost.
+ *
+ * @details A missing or damaged blob leaves the set empty, which only costs a full fetch.
+ */
+esp_err_t KnownUids::load(const BDA& bda) {
+    m_bda = bda;
+    m_loaded = true;
+    m_dirty = false;
+    m_entries.clear();
+
+    nvs_handle_t h;
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READONLY, &h);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    char k[BLE_BDA_KEY_LEN];
+    ble_bda_key(m_bda.data(), k);
+    size_t len = 0;
+    ret = nvs_get_blob(h, k, NULL, &len);
+    if (ret == ESP_OK && (len % RECORD_SIZE != 0 || len > CAPACITY * RECORD_SIZE)) {
+        ESP_LOGW(TAG, "%s: invalid size %u, ignored", k, (unsigned)len);
+        ret = ESP_ERR_INVALID_SIZE;
+    }
+
+    std::vector<uint8_t> blob;
+    if (ret == ESP_OK) {
+        blob.resize(len);
+        ret = nvs_get_blob(h, k, blob.data(), &len);
+    }
+    nvs_close(h);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    m_entries.reserve(len / RECORD_SIZE);
+    for (size_t off = 0; off < len; off += RECORD_SIZE) {
+        Entry e { 0, false, 0 };
+        memcpy(&e.uid, &blob[off], sizeof(e.uid));
+        memcpy(&e.time, &blob[off + sizeof(e.uid)], sizeof(e.time));
+        if (!m_entries.empty() && e.uid <= m_entries.back().uid) {
+            ESP_LOGW(TAG, "%s: not sorted, ignored", k);
+            m_entries.clear();
+            return ESP_ERR_INVALID_STATE;
+        }
+        m_entries.push_back(e);
+    }
+
+    ESP_LOGI(TAG, "%s: %u known UIDs", k, (unsigned)m_entries.size());
+    return ESP_OK;
+}
+
+// Switch to a set not written yet, newer than the one saved
+void KnownUids::load(const Snapshot& s) {
+    m_bda = s.bda;
+    m_loaded = true;
+    m_dirty = false;
+    m_entries.clear();
+    for (size_t off = 0; off + RECORD_SIZE <= s.blob.size(); off += RECORD_SIZE) {
+        Entry e { 0, false, 0 };
+        memcpy(&e.uid, &s.blob[off], sizeof(e.uid));
+        memcpy(&e.time, &s.blob[off + sizeof(e.uid)], sizeof(e.time));
+        m_entries.push_back(e);
+    }
+}
+
+// The set as it is to be saved, false if unchanged since the last snapshot
+bool KnownUids::snapshot(Snapshot& out) {
+    if (!m_loaded || !m_dirty) {
+        return false;
+    }
+
+    out.bda = m_bda;
+    out.blob.resize(m_entries.size() * RECORD_SIZE);
+    size_t off = 0;
+    for (const Entry& e : m_entries) {
+        memcpy(&out.blob[off], &e.uid, sizeof(e.uid));
+        memcpy(&out.blob[off + sizeof(e.uid)], &e.time, sizeof(e.time));
+        off += RECORD_SIZE;
+    }
+    m_dirty = false;
+    return true;
+}
+
+esp_err_t KnownUids::write(const Snapshot& s) {
+    nvs_handle_t h;
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &h);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "%s: nvs_open failed (%s)", __func__, esp_err_to_name(ret));
+        return ret;
+    }
+
+    char k[BLE_BDA_KEY_LEN];
+    ble_bda_key(s.bda.data(), k);
+    ret = s.blob.empty() ? nvs_erase_key(h, k) : nvs_set_blob(h, k, s.blob.data(), s.blob.size());
+    if (ret == ESP_ERR_NVS_NOT_FOUND) {
+        ret = ESP_OK;
+    }
+    if (ret == ESP_OK) {
+        ret = nvs_commit(h);
+    }
+    nvs_close(h);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "%s: %s failed (%s)", __func__, k, esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+void KnownUids::clear(void) {
+    m_dirty |= !m_entries.empty();
+    m_entries.clear();
+}
+
+// Drop the set if it is the device's, nothing is saved until the next load
+void KnownUids::unload(const BDA& bda) {
+    if (m_loaded && m_bda == bda) {
+        m_loaded = false;
+        m_dirty = false;
+        m_entries.clear();
+    }
+}
+
+bool KnownUids::contains(uint32_t uid) const {
+    auto it = lowerBound(uid);
+    return it != m_entries.end() && it->uid == uid;
+}
+
+bool KnownUids::markSeen(uint32_t uid) {
+    auto it = lowerBound(uid);
+    if (it == m_entries.end() || it->uid != uid) {
+        return false;
+    }
+    it->seen = true;
+    return true;
+}
+
+void KnownUids::add(uint32_t uid, int64_t time) {
+    auto it = lowerBound(uid);
+    if (it != m_entries.end() && it->uid == uid) {
+        m_dirty |= (it->time != time);
+        it->time = time;
+        it->seen = true;
+        return;
+    }
+
+    if (m_entries.size() >= CAPACITY) {
+        // INVALID_TIME is the smallest value, so entries without a Date go first
+        auto oldest = std::min_element(m_entries.begin(), m_entries.end(),
+            [](const Entry& a, const Entry& b) { return a.time < b.time; });
+        if (oldest->time > time) {
+            return; // Older than everything kept
+        }
+        size_t pos = it - m_entries.begin();
+        pos -= (oldest < it) ? 1 : 0;
+        m_entries.erase(oldest);
+        it = m_entries.begin() + pos;
+    }
+
+    m_entries.insert(it, { uid, true, time });
+    m_dirty = true;
+}
+
+bool KnownUids::remove(uint32_t uid) {
+    auto it = lowerBound(uid);
+    if (it == m_entries.end() || it->uid != uid) {
+        return false;
+    }
+    m_entries.erase(it);
+    m_dirty = true;
+    return true;
+}
+
+/**@brief Forget UIDs neither replayed nor added since the device connected, the phone no longer
+ *        has them. Call only once the replay of pre-existing notifications is over.
+ */
+size_t KnownUids::pruneUnseen(void) {
+    size_t n = m_entries.size();
+    m_entries.erase(std::remove_if(m_entries.begin(), m_entries.end(), [](const Entry& e) { return !e.seen; }),
+        m_entries.end());
+    n -= m_entries.size();
+    m_dirty |= (n != 0);
+    return n;
+}
+
+std::vector<KnownUids::Entry>::iterator KnownUids::lowerBound(uint32_t uid) {
+    return std::lower_bound(m_entries.begin(), m_entries.end(), uid,
+        [](const Entry& e, uint32_t u) { return e.uid < u; });
+}
+
+std::vector<KnownUids::Entry>::const_iterator KnownUids::lowerBound(uint32_t uid) const {
+    return std::lower_bound(m_entries.begin(), m_entries.end(), uid,
+        [](const Entry& e, uint32_t u) { return e.uid < u; });
+}
@@ -0,0 +1,214 @@
+#include "Notification.h"
+
+#include <charconv>
+#include <string.h>
+
+#include "AppIdTable.h"
+#include "AppNameCache.h"
+#include "RecordPool.h"
+
+// Longest record: Title and Subtitle at their slot size and the longest Message, each null-terminated
+static_assert(RecordPool::MAX_BLOCK_SIZE >= 2 * (MAX_NOTIF_ATTR_SIZE - 1) + NotificationBuffer::STREAMED_MAX + 3,
+    "Longest notification record must fit a pool block");
+
+// Streamed attribute: no slot, the length to request from the phone
+uint8_t *NotificationBuffer::slot(uint32_t attrId, uint16_t *len) {
+    if (attrId >= BLE_ANCS_NB_OF_NOTIF_ATTR) {
+        return nullptr;
+    }
+    if (attrId == STREAMED_ATTR) {
+        *len = m_streamMax;
+        return nullptr;
+    }
+    *len = detail::attrCapacity[attrId];
+    return &m_data[detail::attrOffset(attrId)];
+}
+
+void NotificationBuffer::setLength(uint32_t attrId, uint16_t wireLen) {
+    if (attrId >= BLE_ANCS_NB_OF_NOTIF_ATTR || attrId == STREAMED_ATTR) {
+        return; // The stream counts what it kept
+    }
+    // Parser keeps one byte of the slot for the null terminator and drops the rest
+    uint16_t maxLen = detail::attrCapacity[attrId] - 1;
+    m_lengths[attrId] = (wireLen < maxLen) ? wireLen : maxLen;
+}
+
+// BT task, chunk of the streamed attribute as it arrives
+bool NotificationBuffer::append(uint32_t uid, uint32_t attrId, uint16_t offset, const uint8_t *data, size_t len) {
+    return attrId == STREAMED_ATTR && m_stream.append(uid, offset, data, len);
+}
+
+std::string_view NotificationBuffer::get(uint32_t attrId) const {
+    if (attrId >= BLE_ANCS_NB_OF_NOTIF_ATTR || attrId == STREAMED_ATTR) {
+        return std::string_view();
+    }
+    return std::string_view((const char *)&m_data[detail::attrOffset(attrId)], m_lengths[attrId]);
+}
+
+size_t NotificationBuffer::length(uint32_t attrId) const {
+    return (attrId == STREAMED_ATTR) ? m_stream.length() : get(attrId).size();
+}
+
+// Attribute data without terminator, at most max bytes
+size_t NotificationBuffer::copy(uint32_t attrId, uint8_t *out, size_t max) const {
+    if (attrId == STREAMED_ATTR) {
+        return m_stream.copy(out, max);
+    }
+    std::string_view v = get(attrId);
+    size_t n = (v.size() < max) ? v.size() : max;
+    memcpy(out, v.data(), n);
+    return n;
+}
+
+Notification::Notification(const NotificationBuffer& buf, uint8_t category, uint8_t flags, int64_t time)
+    : m_category(category), m_flags(flags), m_uid(buf.uid()), m_time(time) {
+    m_messageSize = parseMessageSize(buf.get(BLE_ANCS_NOTIF_ATTR_ID_MESSAGE_SIZE));
+
+    std::array<size_t, FIELD_NUM> lengths;
+    size_t total = 0;
+    for (size_t f = 0; f < FIELD_NUM; f ++) {
+        lengths[f] = buf.length(FIELD_ATTRS[f]);
+        total += lengths[f] + 1;
+    }
+
+    m_appId = AppIdTable::instance().intern(buf.get(BLE_ANCS_NOTIF_ATTR_ID_APP_IDENTIFIER));
+    m_record = RecordPool::instance().alloc(total, &m_class);
+    if (m_record == nullptr) {
+        return; // Stored without text rather than not at all
+    }
+
+    size_t pos = 0;
+    for (size_t f = 0; f < FIELD_NUM; f ++) {
+        m_offsets[f] = pos;
+        pos += buf.copy(FIELD_ATTRS[f], m_record + pos, lengths[f]); // A late chunk cannot overrun the block
+        m_record[pos ++] = '\0';
+    }
+    m_size = pos;
+}
+
+// Copy of base with the whole message fetched on demand in place of its preview
+Notification::Notification(const Notification& base, const NotificationBuffer& message)
+    : m_appId(base.m_appId), m_category(base.m_category), m_flags(base.m_flags), m_events(base.m_events),
+      m_uid(base.m_uid), m_time(base.m_time) {
+    AppIdTable::instance().addRef(m_appId);
+    m_messageSize = parseMessageSize(message.get(BLE_ANCS_NOTIF_ATTR_ID_MESSAGE_SIZE));
+
+    std::array<std::string_view, MESSAGE> kept { base.title(), base.subTitle() };
+    size_t msgLen = message.length(BLE_ANCS_NOTIF_ATTR_ID_MESSAGE);
+    size_t total = kept[TITLE].size() + kept[SUB_TITLE].size() + msgLen + FIELD_NUM;
+    m_record = RecordPool::instance().alloc(total, &m_class);
+    if (m_record == nullptr) {
+        return;
+    }
+
+    size_t pos = 0;
+    for (size_t f = 0; f < MESSAGE; f ++) {
+        m_offsets[f] = pos;
+        memcpy(m_record + pos, kept[f].data(), kept[f].size());
+        pos += kept[f].size();
+        m_record[pos ++] = '\0';
+    }
+    m_offsets[MESSAGE] = pos;
+    pos += message.copy(BLE_ANCS_NOTIF_ATTR_ID_MESSAGE, m_record + pos, msgLen);
+    m_record[pos ++] = '\0';
+    m_size = pos;
+}
+
+Notification::Notification(const Notification& other) {
+    copyFrom(other);
+}
+
+Notification::Notification(Notification&& other) noexcept {
+    *this = std::move(other);
+}
+
+Notification& Notification::operator=(const Notification& other) {
+    if (this != &other) {
+        reset();
+        copyFrom(other);
+    }
+    return *this;
+}
+
+Notification& Notification::operator=(Notification&& other) noexcept {
+    if (this != &other) {
+        reset();
+        m_record = other.m_record;
+        m_offsets = other.m_offsets;
+        m_size = other.m_size;
+        m_appId = other.m_appId;
+        m_class = other.m_class;
+        m_category = other.m_category;
+        m_flags = other.m_flags;
+        m_events = other.m_events;
+        m_messageSize = other.m_messageSize;
+        m_uid = other.m_uid;
+        m_time = other.m_time;
+        other.m_record = nullptr;
+        other.m_size = 0;
+        other.m_appId = AppIdTable::EMPTY;
+    }
+    return *this;
+}
+
+const char *Notification::appId(void) const {
+    return AppIdTable::instance().get(m_appId);
+}
+
+const char *Notification::appName(void) const {
+    const char *name = AppNameCache::instance().get(m_appId);
+    return (name != nullptr && name[0] != '\0') ? name : appId();
+}
+
+size_t Notification::messageLength(void) const {
+    return (m_record == nullptr) ? 0 : m_size - m_offsets[MESSAGE] - 1;
+}
+
+// Only a preview is stored, the rest can still be fetched. Longer than requested is never whole.
+bool Notification::messageCut(void) const {
+    size_t whole = (m_messageSize < NotificationBuffer::STREAMED_MAX) ? m_messageSize : NotificationBuffer::STREAMED_MAX;
+    return messageLength() < whole;
+}
+
+size_t Notification::footprint(void) const {
+    return sizeof(Notification) + ((m_record != nullptr) ? RecordPool::blockSize(m_class) : 0);
+}
+
+// Decimal Message Size attribute, 0 if missing or malformed
+uint16_t Notification::parseMessageSize(std::string_view s) {
+    uint32_t v = 0;
+    auto res = std::from_chars(s.data(), s.data() + s.size(), v);
+    if (res.ec != std::errc() || res.ptr != s.data() + s.size()) {
+        return 0;
+    }
+    return (v < UINT16_MAX) ? v : UINT16_MAX;
+}
+
+void Notification::copyFrom(const Notification& other) {
+    m_offsets = other.m_offsets;
+    m_category = other.m_category;
+    m_flags = other.m_flags;
+    m_events = other.m_events;
+    m_messageSize = other.m_messageSize;
+    m_uid = other.m_uid;
+    m_time = other.m_time;
+    m_appId = other.m_appId;
+    AppIdTable::instance().addRef(m_appId);
+    if (other.m_record != nullptr) {
+        m_record = RecordPool::instance().alloc(other.m_size, &m_class);
+        if (m_record != nullptr) {
+            memcpy(m_record, other.m_record, other.m_size);
+            m_size = other.m_size;
+        }
+    }
+}
+
+void Notification::reset(void) {
+    if (m_record != nullptr) {
+        RecordPool::instance().free(m_record, m_class);
+        m_record = nullptr;
+    }
+    m_size = 0;
+    AppIdTable::instance().release(m_appId);
+    m_appId = AppIdTable::EMPTY;
+}
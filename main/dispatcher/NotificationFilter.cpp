@@ -0,0 +1,313 @@
+#include "NotificationFilter.h"
+
+#include <stdio.h>
+
+#include "esp_log.h"
+#include "cJSON.h"
+
+#define TAG "FILT"
+
+static const char *flagNames[] = { "silent", "important", "pre_existing", "positive_action", "negative_action" };
+
+static bool parseAction(const cJSON *item, bool& accept);
+static uint8_t parseFlags(const cJSON *array);
+
+NotificationFilter::NotificationFilter() {
+    // Built-in rule set, used until a rule file is loaded
+    std::vector<Rule> rules(1);
+    rules[0].name = "shortcuts";
+    rules[0].accept = true;
+    rules[0].appId = "com.apple.shortcuts";
+    setRules(std::move(rules), false);
+}
+
+/**@brief Load rules from a JSON file, keeps the current rules on failure.
+ *
+ * @details Format: { "default": "reject", "rules": [ { "name": "...", "action": "accept",
+ *          "app": "com.apple.shortcuts" | "app_prefix": "com.apple.", "categories": [ 1, 2 ],
+ *          "flags_set": [ "important" ], "flags_clear": [ "silent" ], "title": "..." } ] }
+ *          Every condition is optional, a rule without conditions matches everything.
+ */
+esp_err_t NotificationFilter::load(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        ESP_LOGI(TAG, "%s not found, using built-in rules", path);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    String text(size > 0 ? size : 0, '\0');
+    size_t n = fread(text.data(), 1, text.size(), f);
+    fclose(f);
+    text.resize(n);
+
+    cJSON *root = cJSON_Parse(text.c_str());
+    if (root == NULL) {
+        ESP_LOGE(TAG, "%s: invalid JSON", path);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret = ESP_OK;
+    bool defaultAccept = false;
+    std::vector<Rule> rules;
+
+    const cJSON *item = cJSON_GetObjectItem(root, "default");
+    if (item != NULL && !parseAction(item, defaultAccept)) {
+        ESP_LOGE(TAG, "Invalid default action");
+        ret = ESP_ERR_INVALID_ARG;
+    }
+
+    const cJSON *jrules = cJSON_GetObjectItem(root, "rules");
+    const cJSON *jrule;
+    cJSON_ArrayForEach(jrule, jrules) {
+        if (ret != ESP_OK) {
+            break;
+        }
+        if (rules.size() == MAX_RULES) {
+            ESP_LOGW(TAG, "More than %u rules, rest ignored", (unsigned)MAX_RULES);
+            break;
+        }
+
+        Rule r;
+        if ((item = cJSON_GetObjectItem(jrule, "name")) != NULL && cJSON_IsString(item)) {
+            r.name = item->valuestring;
+        }
+        if ((item = cJSON_GetObjectItem(jrule, "action")) != NULL && !parseAction(item, r.accept)) {
+            ESP_LOGE(TAG, "Rule %u: invalid action", (unsigned)rules.size());
+            ret = ESP_ERR_INVALID_ARG;
+            break;
+        }
+        if ((item = cJSON_GetObjectItem(jrule, "app")) != NULL && cJSON_IsString(item)) {
+            r.appId = item->valuestring;
+        } else if ((item = cJSON_GetObjectItem(jrule, "app_prefix")) != NULL && cJSON_IsString(item)) {
+            r.appId = item->valuestring;
+            r.appIdPrefix = true;
+        }
+        const cJSON *c;
+        cJSON_ArrayForEach(c, cJSON_GetObjectItem(jrule, "categories")) {
+            if (cJSON_IsNumber(c) && c->valueint >= 0 && c->valueint < BLE_ANCS_NB_OF_CATEGORY_ID) {
+                r.categoryMask |= 1 << c->valueint;
+            }
+        }
+        r.flagsSet = parseFlags(cJSON_GetObjectItem(jrule, "flags_set"));
+        r.flagsClear = parseFlags(cJSON_GetObjectItem(jrule, "flags_clear"));
+        if ((item = cJSON_GetObjectItem(jrule, "title")) != NULL && cJSON_IsString(item)) {
+            r.title = item->valuestring;
+        }
+        rules.push_back(std::move(r));
+    }
+    cJSON_Delete(root);
+
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    ESP_LOGI(TAG, "Loaded %u rules from %s", (unsigned)rules.size(), path);
+    setRules(std::move(rules), defaultAccept);
+    return ESP_OK;
+}
+
+void NotificationFilter::setRules(std::vector<Rule>&& rules, bool defaultAccept) {
+    if (rules.size() > MAX_RULES) {
+        rules.resize(MAX_RULES);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_rules = std::move(rules);
+    m_defaultAccept = defaultAccept;
+    m_defaultHits = 0;
+    compile();
+}
+
+/**@brief First matching rule for what is known so far, appId and title are nullptr while not fetched.
+ *
+ * @details Candidates are the rules whose known conditions all pass. If the first of them still
+ *          has an unknown condition the result is NEED_*, otherwise it is that rule's action.
+ *          Category and flags never change, so an ACCEPT or REJECT stays the same once more
+ *          attributes are known.
+ */
+NotificationFilter::Decision NotificationFilter::decide(uint8_t category, uint8_t flags, const std::string_view *appId, const std::string_view *title) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    uint32_t cand = m_categoryRules[(category < m_categoryRules.size()) ? category : m_categoryRules.size() - 1];
+    cand &= m_flagRules[flags & (m_flagRules.size() - 1)];
+
+    uint32_t needApp = 0, needTitle = 0;
+    if (appId != nullptr) {
+        cand &= matchAppId(*appId) | ~m_appRules;
+    } else {
+        needApp = m_appRules;
+    }
+    if (title != nullptr) {
+        cand &= matchTitle(*title) | ~m_titleRules;
+    } else {
+        needTitle = m_titleRules;
+    }
+
+    if (cand == 0) {
+        return { m_defaultAccept ? ACCEPT : REJECT, NO_RULE };
+    }
+
+    uint8_t rule = __builtin_ctz(cand);
+    uint32_t bit = 1u << rule;
+    if (bit & needApp) {
+        return { NEED_APP_ID, rule };
+    }
+    if (bit & needTitle) {
+        return { NEED_TITLE, rule };
+    }
+    return { (bit & m_acceptRules) ? ACCEPT : REJECT, rule };
+}
+
+void NotificationFilter::countHit(const Decision& d) {
+    if (d.verdict != ACCEPT && d.verdict != REJECT) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (d.rule == NO_RULE) {
+        m_defaultHits ++;
+    } else if (d.rule < m_rules.size()) {
+        m_rules[d.rule].hits ++;
+    }
+}
+
+void NotificationFilter::getRules(std::vector<Rule>& rules, bool& defaultAccept, uint32_t& defaultHits) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    rules = m_rules;
+    defaultAccept = m_defaultAccept;
+    defaultHits = m_defaultHits;
+}
+
+uint8_t NotificationFilter::packFlags(const ble_ancs_c_notif_flags_t& flags) {
+    return (flags.silent << BLE_ANCS_EVENT_FLAG_SILENT)
+        | (flags.important << BLE_ANCS_EVENT_FLAG_IMPORTANT)
+        | (flags.pre_existing << BLE_ANCS_EVENT_FLAG_PREEXISTING)
+        | (flags.positive_action << BLE_ANCS_EVENT_FLAG_POSITIVE_ACTION)
+        | (flags.negative_action << BLE_ANCS_EVENT_FLAG_NEGATIVE_ACTION);
+}
+
+void NotificationFilter::compile(void) {
+    m_categoryRules.fill(0);
+    m_flagRules.fill(0);
+    m_trie.assign(1, TrieNode {});
+    m_appRules = 0;
+    m_titleRules = 0;
+    m_acceptRules = 0;
+
+    for (size_t i = 0; i < m_rules.size(); i ++) {
+        const Rule& r = m_rules[i];
+        uint32_t bit = 1u << i;
+
+        uint16_t categories = r.categoryMask ? r.categoryMask : 0xFFFF;
+        for (size_t c = 0; c < m_categoryRules.size(); c ++) {
+            if (categories & (1 << c)) {
+                m_categoryRules[c] |= bit;
+            }
+        }
+
+        // Every combination of the five event flags
+        for (size_t f = 0; f < m_flagRules.size(); f ++) {
+            if ((f & r.flagsSet) == r.flagsSet && (f & r.flagsClear) == 0) {
+                m_flagRules[f] |= bit;
+            }
+        }
+
+        if (!r.appId.empty()) {
+            uint16_t node = 0;
+            for (char c : r.appId) {
+                uint16_t child = m_trie[node].child, prev = 0;
+                while (child != 0 && m_trie[child].c != c) {
+                    prev = child;
+                    child = m_trie[child].next;
+                }
+                if (child == 0) {
+                    child = m_trie.size();
+                    m_trie.push_back({ c, 0, 0, 0, 0 });
+                    if (prev != 0) {
+                        m_trie[prev].next = child;
+                    } else {
+                        m_trie[node].child = child;
+                    }
+                }
+                node = child;
+            }
+            if (r.appIdPrefix) {
+                m_trie[node].prefixRules |= bit;
+            } else {
+                m_trie[node].exactRules |= bit;
+            }
+            m_appRules |= bit;
+        }
+
+        if (!r.title.empty()) {
+            m_titleRules |= bit;
+        }
+        if (r.accept) {
+            m_acceptRules |= bit;
+        }
+    }
+
+    ESP_LOGD(TAG, "Compiled %u rules, %u trie nodes", (unsigned)m_rules.size(), (unsigned)m_trie.size());
+}
+
+uint32_t NotificationFilter::matchAppId(std::string_view appId) const {
+    uint16_t node = 0;
+    uint32_t match = m_trie[0].prefixRules;
+
+    for (char c : appId) {
+        uint16_t child = m_trie[node].child;
+        while (child != 0 && m_trie[child].c != c) {
+            child = m_trie[child].next;
+        }
+        if (child == 0) {
+            return match;
+        }
+        node = child;
+        match |= m_trie[node].prefixRules;
+    }
+
+    return match | m_trie[node].exactRules;
+}
+
+uint32_t NotificationFilter::matchTitle(std::string_view title) const {
+    uint32_t match = 0;
+    for (uint32_t rules = m_titleRules; rules != 0; rules &= rules - 1) {
+        uint8_t i = __builtin_ctz(rules);
+        if (title.find(m_rules[i].title) != std::string_view::npos) {
+            match |= 1u << i;
+        }
+    }
+    return match;
+}
+
+static bool parseAction(const cJSON *item, bool& accept) {
+    if (!cJSON_IsString(item)) {
+        return false;
+    }
+    String s = item->valuestring;
+    if (s == "accept") {
+        accept = true;
+    } else if (s == "reject") {
+        accept = false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static uint8_t parseFlags(const cJSON *array) {
+    uint8_t flags = 0;
+    const cJSON *e;
+    cJSON_ArrayForEach(e, array) {
+        for (size_t i = 0; i < sizeof(flagNames) / sizeof(flagNames[0]); i ++) {
+            if (cJSON_IsString(e) && String(e->valuestring) == flagNames[i]) {
+                flags |= 1 << i;
+            }
+        }
+    }
+    return flags;
+}
@@ -3,12 +3,169 @@
 
 #define TAG "DISP"
 
-bool NotificationProvider::addNotification(const Notification &notif) {
+void NotificationProvider::setIsActive(bool isActive, int64_t now) {
+	if (!isActive) {
+		m_index.clear(); // Next connection hands out UIDs afresh
+	}
+	m_isActive = isActive;
+	m_lastActive = now;
+}
+
+bool NotificationProvider::addNotification(Notification &&notif) {
 	if (!m_isActive) {
 		ESP_LOGD(TAG, "Device not active");
 		return false;
 	}
 
-	m_notifQueue.push_back(notif);
+	int i = m_index.find(notif.uid());
+	if (i >= 0) {
+		// Modified: same record, new content, TTL starts over
+		notif.setEvents(m_slots[i].notif.events());
+		m_bytes -= m_slots[i].notif.footprint();
+		m_slots[i].notif = std::move(notif);
+		m_bytes += m_slots[i].notif.footprint();
+		wheelRemove(i);
+		wheelInsert(i);
+		return true;
+	}
+
+	while (m_count >= m_capacity && m_head != NIL) {
+		ESP_LOGD(TAG, "Store full, evicting UID %" PRIu32, m_slots[m_head].notif.uid());
+		evict(m_head);
+		m_evictedCapacity ++;
+	}
+
+	uint16_t s = allocSlot();
+	m_slots[s].notif = std::move(notif);
+	m_bytes += m_slots[s].notif.footprint();
+	linkTail(s);
+	wheelInsert(s);
+	m_index.insert(m_slots[s].notif.uid(), s);
+	return true;
+}
+
+bool NotificationProvider::removeNotification(uint32_t uid) {
+	int i = m_index.find(uid);
+	if (i < 0) {
+		return false;
+	}
+
+	evict(i);
+	m_removed ++;
+	return true;
+}
+
+Notification *NotificationProvider::getNotification(uint32_t uid) {
+	int i = m_index.find(uid);
+	return (i < 0) ? nullptr : &m_slots[i].notif;
+}
+
+bool NotificationProvider::evictOldest(void) {
+	if (m_head == NIL) {
+		return false;
+	}
+	evict(m_head);
+	m_evictedBudget ++;
 	return true;
 }
+
+size_t NotificationProvider::expire(uint32_t tick) {
+	m_tick = tick;
+
+	size_t n = 0;
+	uint16_t& bucket = m_wheel[tick % WHEEL_SIZE];
+	while (bucket != NIL) {
+		evict(bucket);
+		n ++;
+	}
+	m_evictedTtl += n;
+	return n;
+}
+
+void NotificationProvider::addUsage(RetentionUsage& u) const {
+	u.providers ++;
+	u.inactiveProviders += m_isActive ? 0 : 1;
+	u.notifications += m_count;
+	u.bytes += m_bytes;
+	u.evictedCapacity += m_evictedCapacity;
+	u.evictedBudget += m_evictedBudget;
+	u.evictedTtl += m_evictedTtl;
+	u.removed += m_removed;
+}
+
+uint16_t NotificationProvider::allocSlot(void) {
+	if (m_free != NIL) {
+		uint16_t i = m_free;
+		m_free = m_slots[i].next;
+		return i;
+	}
+	if (m_slots.capacity() < CAPACITY) {
+		m_slots.reserve(CAPACITY); // Slab is allocated once, on first use
+	}
+	m_slots.emplace_back();
+	return m_slots.size() - 1;
+}
+
+void NotificationProvider::freeSlot(uint16_t i) {
+	m_slots[i].notif = Notification(); // Release the record data now
+	m_slots[i].next = m_free;
+	m_free = i;
+}
+
+void NotificationProvider::evict(uint16_t i) {
+	m_index.erase(m_slots[i].notif.uid(), i); // No-op for records of a past connection
+	m_bytes -= m_slots[i].notif.footprint();
+	wheelRemove(i);
+	unlink(i);
+	freeSlot(i);
+}
+
+void NotificationProvider::unlink(uint16_t i) {
+	Slot& s = m_slots[i];
+	if (s.prev != NIL) {
+		m_slots[s.prev].next = s.next;
+	} else {
+		m_head = s.next;
+	}
+	if (s.next != NIL) {
+		m_slots[s.next].prev = s.prev;
+	} else {
+		m_tail = s.prev;
+	}
+	m_count --;
+}
+
+void NotificationProvider::linkTail(uint16_t i) {
+	m_slots[i].prev = m_tail;
+	m_slots[i].next = NIL;
+	if (m_tail != NIL) {
+		m_slots[m_tail].next = i;
+	} else {
+		m_head = i;
+	}
+	m_tail = i;
+	m_count ++;
+}
+
+void NotificationProvider::wheelInsert(uint16_t i) {
+	Slot& s = m_slots[i];
+	s.bucket = m_tick % WHEEL_SIZE;
+	s.wheelPrev = NIL;
+	s.wheelNext = m_wheel[s.bucket];
+	if (s.wheelNext != NIL) {
+		m_slots[s.wheelNext].wheelPrev = i;
+	}
+	m_wheel[s.bucket] = i;
+}
+
+void NotificationProvider::wheelRemove(uint16_t i) {
+	Slot& s = m_slots[i];
+	if (s.wheelPrev != NIL) {
+		m_slots[s.wheelPrev].wheelNext = s.wheelNext;
+	} else {
+		m_wheel[s.bucket] = s.wheelNext;
+	}
+	if (s.wheelNext != NIL) {
+		m_slots[s.wheelNext].wheelPrev = s.wheelPrev;
+	}
+}
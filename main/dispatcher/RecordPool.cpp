@@ -0,0 +1,137 @@
+#include "RecordPool.h"
+
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+#define TAG "POOL"
+
+RecordPool& RecordPool::instance(void) {
+    static RecordPool pool;
+    return pool;
+}
+
+uint8_t *RecordPool::alloc(size_t size, uint8_t *cls) {
+    uint8_t c = 0;
+    while (c < CLASS_SIZES.size() && CLASS_SIZES[c] < size) {
+        c ++;
+    }
+    if (c == CLASS_SIZES.size()) {
+        ESP_LOGE(TAG, "No class for %u bytes", (unsigned)size);
+        return nullptr;
+    }
+
+    if (m_free[c] == nullptr && !grow(c)) {
+        return nullptr;
+    }
+
+    uint8_t *p = m_free[c];
+    memcpy(&m_free[c], p, sizeof(uint8_t *));
+    m_freeBlocks[c] --;
+    Chunk *chunk = findChunk(p);
+    if (chunk->used ++ == 0 && chunk->base == m_spare) {
+        m_spare = nullptr;
+    }
+    m_used += CLASS_SIZES[c];
+    m_blocks ++;
+    *cls = c;
+    return p;
+}
+
+void RecordPool::free(uint8_t *p, uint8_t cls) {
+    if (p == nullptr || cls >= CLASS_SIZES.size()) {
+        return;
+    }
+    memcpy(p, &m_free[cls], sizeof(uint8_t *));
+    m_free[cls] = p;
+    m_freeBlocks[cls] ++;
+    m_used -= CLASS_SIZES[cls];
+    m_blocks --;
+
+    // Free blocks beyond those of one chunk: the empty chunk, or the spare of the class, can go
+    Chunk *chunk = findChunk(p);
+    bool others = m_freeBlocks[cls] > chunkBlocks(cls);
+    if (-- chunk->used == 0) {
+        if (others) {
+            release(chunk);
+            return;
+        }
+        uint8_t *base = chunk->base;
+        if (m_spare != nullptr) {
+            release(findChunk(m_spare));
+        }
+        m_spare = base;
+    } else if (others && m_spare != nullptr && findChunk(m_spare)->cls == cls) {
+        release(findChunk(m_spare));
+    }
+}
+
+// Up to CHUNK_BLOCKS blocks within CHUNK_SIZE, a single one for the classes of long messages
+size_t RecordPool::chunkBlocks(uint8_t cls) {
+    size_t count = CHUNK_SIZE / CLASS_SIZES[cls];
+    return (count < 1) ? 1 : (count > CHUNK_BLOCKS) ? CHUNK_BLOCKS : count;
+}
+
+bool RecordPool::grow(uint8_t cls) {
+    size_t size = CLASS_SIZES[cls];
+    size_t count = chunkBlocks(cls);
+
+    uint8_t *base = (uint8_t *)malloc(size * count);
+    if (base == nullptr) {
+        ESP_LOGE(TAG, "%s: out of memory", __func__);
+        return false;
+    }
+    auto it = std::lower_bound(m_chunks.begin(), m_chunks.end(), base,
+        [](const Chunk& c, const uint8_t *p) { return c.base < p; });
+    m_chunks.insert(it, Chunk { base, 0, cls });
+    m_taken ++;
+    m_reserved += size * count;
+
+    for (size_t i = 0; i < count; i ++) {
+        uint8_t *p = base + i * size;
+        memcpy(p, &m_free[cls], sizeof(uint8_t *));
+        m_free[cls] = p;
+    }
+    m_freeBlocks[cls] += count;
+    return true;
+}
+
+// Chunk a block belongs to, by binary search on the base addresses
+RecordPool::Chunk *RecordPool::findChunk(const uint8_t *p) {
+    auto it = std::upper_bound(m_chunks.begin(), m_chunks.end(), p,
+        [](const uint8_t *q, const Chunk& c) { return q < c.base; });
+    return &*(it - 1);
+}
+
+// Empty chunk back to the heap, its blocks unlinked from the free list of its class first
+void RecordPool::release(Chunk *chunk) {
+    uint8_t cls = chunk->cls;
+    size_t count = chunkBlocks(cls);
+    uint8_t *base = chunk->base;
+    uint8_t *end = base + CLASS_SIZES[cls] * count;
+
+    uint8_t *prev = nullptr;
+    for (uint8_t *p = m_free[cls]; p != nullptr;) {
+        uint8_t *next;
+        memcpy(&next, p, sizeof(uint8_t *));
+        if (p >= base && p < end) {
+            if (prev == nullptr) {
+                m_free[cls] = next;
+            } else {
+                memcpy(prev, &next, sizeof(uint8_t *));
+            }
+        } else {
+            prev = p;
+        }
+        p = next;
+    }
+    m_freeBlocks[cls] -= count;
+    m_reserved -= CLASS_SIZES[cls] * count;
+    if (m_spare == base) {
+        m_spare = nullptr;
+    }
+    m_chunks.erase(m_chunks.begin() + (chunk - m_chunks.data()));
+    ::free(base);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <deque>
+#include <string_view>
+#include <vector>
+
+#include "DispatcherTypes.h"
+
+/**@brief Interned app identifiers, shared by all stored notifications.
+ *
+ * @details A record keeps a 16-bit ID instead of its own copy of strings like
+ *          "com.apple.MobileSMS". Entries are reference counted and their IDs reused once
+ *          released. ID 0 is the empty string. Owned by the Dispatcher worker task.
+ */
+class AppIdTable {
+
+public:
+    static constexpr uint16_t EMPTY = 0;
+
+    static AppIdTable& instance(void);
+
+    uint16_t intern(std::string_view appId);
+    uint16_t find(std::string_view appId) const;
+    void addRef(uint16_t id);
+    void release(uint16_t id);
+    const char *get(uint16_t id) const { return (id < m_entries.size()) ? m_entries[id].str.c_str() : ""; }
+
+    size_t count(void) const { return m_entries.size() - m_freeIds.size() - 1; }
+    size_t bytes(void) const { return m_bytes; }
+
+private:
+    struct Entry {
+        String str;
+        uint32_t hash;
+        uint16_t refs;
+    };
+
+    AppIdTable();
+    static uint32_t hash(std::string_view s);
+
+    std::deque<Entry> m_entries;    // Deque keeps c_str() pointers stable as it grows
+    std::vector<uint16_t> m_freeIds;
+    size_t m_bytes = 0;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+#include "esp_system.h"
+#include "sdkconfig.h"
+#include "DispatcherTypes.h"
+
+/**@brief Display names of apps, fetched with Get App Attributes and persisted in NVS.
+ *
+ * @details Keyed by AppIdTable ID, every entry holds a reference so that its ID stays put.
+ *          Shared by all devices, a name fetched once serves every later notification of the
+ *          app. Least recently used entries give way once full. Owned by the Dispatcher worker
+ *          task.
+ */
+class AppNameCache {
+
+public:
+    static constexpr size_t CAPACITY = CONFIG_NOWA_APP_NAMES;
+    static constexpr size_t NAME_SIZE = 64;      // Including the terminator, as requested from the phone
+    static constexpr const char *NVS_NAMESPACE = "nowa_apps";
+
+    static AppNameCache& instance(void);
+
+    esp_err_t load(void);
+    // Blob to save, taken under the store lock and written once it is released. Empty erases it.
+    bool snapshot(std::vector<uint8_t>& out);
+    static esp_err_t write(const std::vector<uint8_t>& blob);
+
+    const char *lookup(uint16_t appId);
+    const char *get(uint16_t appId) const;
+    void put(uint16_t appId, std::string_view name);
+
+    size_t size(void) const { return m_entries.size(); }
+    bool dirty(void) const { return m_dirty; }
+
+    uint32_t hits = 0;              // Lookups answered, each one a Get App Attributes command saved
+    uint32_t misses = 0;
+
+private:
+    struct Entry {
+        uint16_t appId;
+        String name;
+    };
+
+    AppNameCache() = default;
+    int find(uint16_t appId) const;
+
+    std::vector<Entry> m_entries;   // Most recently used first
+    bool m_loaded = false;
+    bool m_dirty = false;
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <array>
+
+#include "esp_system.h"
+#include "sdkconfig.h"
+#include "DispatcherTypes.h"
+#include "UidIndex.h"
+
+/**@brief Bounded per-device queue of attribute requests, served by priority instead of arrival.
+ *
+ * @details Priority level comes from category and the Important flag (Kconfig NOWA_PRIO_*), a
+ *          full message a client asked for has a level of its own. Ties go to the newest
+ *          notification, so a replay of pre-existing ones is served newest first. Up to @ref depth
+ *          requests are in flight on the Control Point, never two for the same UID, each stays
+ *          put until completed even if something more urgent arrives. When full, the lowest
+ *          ranked pending request gives way to a higher ranked newcomer. A request that failed
+ *          can be deferred, it is not served again before its backoff ends. A UID hash index lets
+ *          a repeated event for a pending UID merge into its request.
+ */
+class AttrRequestScheduler {
+
+public:
+    static constexpr size_t CAPACITY = CONFIG_NOWA_ATTR_QUEUE_SIZE;
+    static constexpr size_t MAX_DEPTH = ANCS_PIPELINE_DEPTH;
+    static_assert(MAX_DEPTH < CAPACITY, "Pipeline deeper than the queue");
+
+    bool push(const AttrRequest& r, int64_t now);
+    bool pushNext(const AttrRequest& r, int64_t now);
+    AttrRequest *next(int64_t now);
+    bool defer(uint32_t uid, int64_t now, int64_t delayUs);
+    int64_t nextDue(void) const;
+    AttrRequest *inFlight(uint32_t uid);
+    bool inFlightCancelled(uint32_t uid) const;
+    bool complete(uint32_t uid);
+    bool cancel(uint32_t uid);
+    bool holds(uint32_t uid) const { return m_index.find(uid) >= 0; }
+    void clear(void);
+
+    void setDepth(size_t depth) { m_depth = (depth < 1) ? 1 : (depth > MAX_DEPTH) ? MAX_DEPTH : depth; }
+    size_t depth(void) const { return m_depth; }
+    // Control Point requests in flight that are not from this queue, they count against the depth
+    void setReserved(size_t n) { m_reserved = n; }
+    size_t inFlightCount(void) const { return m_inFlight; }
+    bool busy(void) const { return m_inFlight != 0; }
+    bool full(void) const { return m_inFlight + m_reserved >= m_depth; }
+    bool empty(void) const { return m_count == 0; }
+    size_t size(void) const { return m_count; }
+
+    static uint8_t level(const AttrRequest& r);
+    static bool urgent(const AttrRequest& r) { return level(r) > CONFIG_NOWA_PRIO_DEFAULT; }
+
+    // Owned by the Dispatcher worker task
+    uint32_t dropped = 0;           // Requests lost to a full queue
+    uint32_t coalesced = 0;         // Requests merged into one already queued or in flight for the same UID
+    uint32_t cancelled = 0;         // Requests cancelled by a Notification Removed event
+    uint32_t urgentStarted = 0;     // Requests above default priority sent
+    int64_t urgentWaitTotalUs = 0;  // Queued to sent, urgent requests only
+    int64_t urgentWaitMaxUs = 0;
+
+private:
+    struct Entry {
+        AttrRequest req;
+        uint8_t level;
+        int64_t queuedAt;
+        int64_t notBefore;          // Backoff of a deferred request, 0: due now
+        bool cancelled;             // In flight only, its response gets discarded
+    };
+
+    bool ranksAbove(const Entry& a, const Entry& b) const;
+    bool insert(const AttrRequest& r, uint8_t lvl, int64_t now);
+    void remove(size_t slot);
+    void removeInFlight(size_t slot);
+    void swapSlots(size_t a, size_t b);
+
+    int findPending(uint32_t uid) const;
+    int findInFlight(uint32_t uid) const;
+
+    // Slots [0, m_inFlight) hold the requests in flight, the rest is unordered
+    std::array<Entry, CAPACITY> m_entries;
+    UidIndex<CAPACITY> m_index;
+    size_t m_count = 0;
+    size_t m_inFlight = 0;
+    size_t m_depth = 1;
+    size_t m_reserved = 0;
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ble_ancs.h"
+
+/**@brief Attributes of one Get Notification Attributes command, a compile-time constant.
+ *
+ * @details A bit per attribute and the length requested for Title, Subtitle and Message. @ref frame
+ *          encodes the command with the UID left 0, so sending a request only patches the UID into
+ *          a frame built by the compiler. The parser learns which attributes and how many to
+ *          expect from the same frame.
+ */
+struct AttrSet {
+    uint8_t mask = 0;
+    uint16_t maxLen[BLE_ANCS_NB_OF_NOTIF_ATTR] {};
+
+    static constexpr bool hasLength(uint32_t id) {
+        return id == BLE_ANCS_NOTIF_ATTR_ID_TITLE || id == BLE_ANCS_NOTIF_ATTR_ID_SUBTITLE || id == BLE_ANCS_NOTIF_ATTR_ID_MESSAGE;
+    }
+
+    constexpr AttrSet with(ble_ancs_c_notif_attr_id_val_t id, uint16_t len = 0) const {
+        AttrSet s = *this;
+        s.mask |= 1u << id;
+        s.maxLen[id] = len;
+        return s;
+    }
+
+    constexpr bool has(uint32_t id) const { return (mask & (1u << id)) != 0; }
+
+    constexpr size_t count(void) const {
+        size_t n = 0;
+        for (uint32_t id = 0; id < BLE_ANCS_NB_OF_NOTIF_ATTR; id ++) {
+            n += has(id) ? 1 : 0;
+        }
+        return n;
+    }
+
+    // Command ID, UID, then attribute IDs in ascending order, with a length for text attributes
+    constexpr ancs_attr_frame_t frame(void) const {
+        ancs_attr_frame_t f {};
+        size_t len = 0;
+        f.data[len ++] = BLE_ANCS_COMMAND_ID_GET_NOTIF_ATTRIBUTES;
+        len += sizeof(uint32_t);
+        for (uint32_t id = 0; id < BLE_ANCS_NB_OF_NOTIF_ATTR; id ++) {
+            if (!has(id)) {
+                continue;
+            }
+            f.data[len ++] = (uint8_t)id;
+            if (hasLength(id)) {
+                f.data[len ++] = (uint8_t)maxLen[id];
+                f.data[len ++] = (uint8_t)(maxLen[id] >> 8);
+            }
+        }
+        f.mask = mask;
+        f.count = (uint8_t)count();
+        f.len = (uint8_t)len;
+        return f;
+    }
+};
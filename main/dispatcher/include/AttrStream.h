@@ -0,0 +1,81 @@
+#pragma once
+
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+
+/**@brief Fixed-size blocks for attributes streamed in by the ANCS parser, see AttrStream.
+ *
+ * @details One pool for all devices, carved out of a single static array, so a long message only
+ *          takes memory while it is being received. The BT task takes blocks as a response
+ *          arrives, the Dispatcher worker gives them back once it has copied the attribute. The
+ *          lock is held for list updates and copies of at most one GATT packet or one attribute.
+ */
+class StreamPool {
+
+public:
+    static constexpr size_t BLOCK_SIZE = 128;
+    static constexpr size_t BLOCKS = CONFIG_NOWA_STREAM_POOL_SIZE / BLOCK_SIZE;
+    static constexpr uint16_t NONE = UINT16_MAX;
+    static_assert(BLOCKS < NONE, "Block index must fit");
+
+    static StreamPool& instance(void);
+
+    size_t freeBlocks(void) const { return m_freeCount; }
+    size_t highWater(void) const { return m_highWater; }   // Most blocks in use at once
+
+    uint32_t exhausted = 0;     // Attributes cut short for lack of blocks
+
+private:
+    friend class AttrStream;
+
+    StreamPool();
+    uint16_t take(void);
+    void give(uint16_t first);
+    uint8_t *block(uint16_t b) { return &m_data[b * BLOCK_SIZE]; }
+
+    portMUX_TYPE m_lock = portMUX_INITIALIZER_UNLOCKED;
+    std::array<uint8_t, BLOCKS * BLOCK_SIZE> m_data;
+    std::array<uint16_t, BLOCKS> m_next;    // Next block of a stream or of the free list
+    uint16_t m_free = NONE;
+    size_t m_freeCount = 0;
+    size_t m_highWater = 0;
+};
+
+/**@brief One attribute streamed in by the ANCS parser, held as a chain of StreamPool blocks.
+ *
+ * @details Opened by the Dispatcher worker for the UID of a request, appended to by the BT task
+ *          as the response arrives, read and closed by the worker once it is complete. Chunks for
+ *          another UID or out of sequence are dropped, so a late response to a request already
+ *          given up cannot mix into the next one. When the pool runs out, the rest of the
+ *          attribute is dropped and the stream is marked truncated.
+ */
+class AttrStream {
+
+public:
+    AttrStream() = default;
+    AttrStream(const AttrStream&) = delete;
+    AttrStream& operator=(const AttrStream&) = delete;
+    ~AttrStream() { close(); }
+
+    void open(uint32_t uid);
+    void close(void);
+    bool append(uint32_t uid, uint16_t offset, const uint8_t *data, size_t len);
+
+    size_t length(void) const;
+    bool truncated(void) const;
+    size_t copy(uint8_t *out, size_t max) const;
+
+private:
+    void reset(void);
+
+    uint32_t m_uid = 0;
+    bool m_open = false;
+    bool m_truncated = false;
+    uint16_t m_head = StreamPool::NONE;
+    uint16_t m_tail = StreamPool::NONE;
+    uint32_t m_length = 0;
+};
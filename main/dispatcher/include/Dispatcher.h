@@ -1,11 +1,21 @@
 #pragma once
 
-#include <queue>
 #include <map>
+#include <mutex>
 
 #include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "AttrRequestScheduler.h"
 #include "DispatcherTypes.h"
+#include "KnownUids.h"
+#include "Notification.h"
+#include "NotificationFilter.h"
 #include "NotificationProvider.h"
+#include "SpscQueue.h"
 
 class Dispatcher {
 
@@ -18,15 +28,119 @@ public:
     uint8_t getId(const BDA& bda);
     NotificationProvider *getNPById(uint8_t idx);
     NotificationProvider *getNPByBDA(const BDA& bda);
-    std::map<BDA, NotificationProvider>& providers() { return m_providerList; }
+    std::map<BDA, NotificationProvider>& providers() { return m_providerList; } // Worker task or withStore()
+
+    // Any task: run f while the worker task leaves the providers and their notifications alone.
+    // Keep f short, copy out what is to be printed and print it after.
+    template <typename F>
+    auto withStore(F f) {
+        std::lock_guard<std::mutex> lock(m_storeMutex);
+        return f();
+    }
+
+    // Driver (BT task) side of the event queue
+    DriverEvent *prepareEvent(void);
+    void commitEvent(int64_t startTime);
+    // Driver esp_timer task side, bypasses the event queue
+    void postTimeout(uint8_t idx, uint32_t uid, bool app = false);
+    const DispatcherStats& stats() const { return m_stats; }
+    DispatcherStats& stats() { return m_stats; }
+    NotificationFilter& filter() { return m_filter; }
+
+    // Any task: fetch the whole message of a stored notification of a connected device
+    bool fetchFullMessage(const BDA& bda, uint32_t uid);
+
+    // Retention, configure before initDriver() or from the worker task
+    void setRetention(const RetentionConfig& cfg);
+    const RetentionConfig& retention() const { return m_retention; }
+    void enforceRetention(void);
+    RetentionUsage retentionUsage(void);    // Worker task or withStore()
+    // Erase what NVS keeps for a device, its known UIDs and cached handles. Worker task or withStore()
+    void forgetDevice(const BDA& bda);
+
+    // NVS writes are taken under the store lock and done by the worker task once it is released, a
+    // flash write or erase would hold up every task waiting on the store and the BT task behind them
+    void loadKnownUids(uint8_t idx, const BDA& bda);
+    void saveKnownUids(uint8_t idx);
+    void saveAppNames(void);
+
+    // Wake the worker task at this time to serve requests whose backoff is over
+    void scheduleRetry(int64_t due);
 
     static constexpr uint8_t INVALID_ID = (uint8_t)(-1);
+    static constexpr size_t EVENT_QUEUE_SIZE = 16;
+    static constexpr size_t TIMEOUT_QUEUE_SIZE = (ANCS_PROFILE_NUM * (ANCS_PIPELINE_DEPTH + 1) <= 32) ? 32 : 64;
+    static constexpr size_t FETCH_QUEUE_SIZE = 8;
+    static_assert(ANCS_PROFILE_NUM * (ANCS_PIPELINE_DEPTH + 1) <= TIMEOUT_QUEUE_SIZE, "Every request in flight may time out at once");
+
+    // Attributes of a notification being fetched, from header request to body done
+    struct FetchSlot {
+        NotificationBuffer buf;
+        bool used = false;
+        int64_t fetchStart = 0;     // Header requested
+        int64_t requestTime = 0;    // Request in flight sent
+        int64_t headerTime = 0;     // Date of the header fetched
 
-    std::array<std::queue<AttrRequest>, ANCS_PROFILE_NUM> m_attrRequestQueue;
-    std::array<Notification, ANCS_PROFILE_NUM> m_notifBuffers;
-    std::array<String, ANCS_PROFILE_NUM> m_prevLatestNotifications;
+        void release(void) { used = false; buf.release(); }
+    };
+    FetchSlot *fetchSlot(uint8_t idx, uint32_t uid);
+    FetchSlot *claimFetchSlot(uint8_t idx, uint32_t uid);
+    void releaseFetchSlot(uint8_t idx, uint32_t uid);
+
+    std::array<AttrRequestScheduler, ANCS_PROFILE_NUM> m_attrScheduler;
+    std::array<std::array<FetchSlot, AttrRequestScheduler::MAX_DEPTH>, ANCS_PROFILE_NUM> m_fetchSlots;
+    std::array<int64_t, ANCS_PROFILE_NUM> m_highWater;     // Newest stored Date when the device connected
+    std::array<KnownUids, ANCS_PROFILE_NUM> m_knownUids;   // Of the connected device
+    std::array<int64_t, ANCS_PROFILE_NUM> m_replayStart {}; // Connect time while pre-existing ones replay, 0 after
+    std::array<std::vector<String>, ANCS_PROFILE_NUM> m_appNameQueue; // Apps whose display name is to be requested
+    std::array<String, ANCS_PROFILE_NUM> m_appNameInFlight;          // Empty while none is requested
 
 private:
+    static void workerTask(void *arg);
+    static void retentionTimerCb(void *arg);
+    static void retryTimerCb(void *arg);
+    static void flushTimerCb(void *arg);
+    void processEvent(DriverEvent& e);
+    void processFetch(const FetchRequest& f);
+    esp_err_t startRetentionTimer(void);
+    void retire(std::map<BDA, NotificationProvider>::iterator it);
+
+    struct NvsWrites {
+        std::vector<KnownUids::Snapshot> knownUids;
+        std::vector<BDA> handleCaches;      // Erased
+        std::vector<uint8_t> appNames;
+        bool appNamesChanged = false;
+    };
+    static void writeNvs(const NvsWrites& w);
+    void wakeForNvs(void);
+
+    // Worker task notification bits
+    static constexpr uint32_t NOTIFY_EVENTS = 1 << 0;
+    static constexpr uint32_t NOTIFY_RETENTION_TICK = 1 << 1;
+    static constexpr uint32_t NOTIFY_RETRY = 1 << 2;
+    static constexpr uint32_t NOTIFY_TIMEOUT = 1 << 3;
+    static constexpr uint32_t NOTIFY_FETCH = 1 << 4;
+    static constexpr uint32_t NOTIFY_FLUSH = 1 << 5;
+    static constexpr uint32_t NOTIFY_NVS = 1 << 6;      // NVS writes queued from withStore()
+
     std::array<BDA, ANCS_PROFILE_NUM> m_activeBDAs;
     std::map<BDA, NotificationProvider> m_providerList;
+    std::mutex m_storeMutex;        // Held by the worker task while it handles anything, see withStore()
+    NvsWrites m_nvsWrites;          // Queued under the store lock
+
+    SpscQueue<DriverEvent, EVENT_QUEUE_SIZE> m_eventQueue;
+    TaskHandle_t m_workerTask = nullptr;
+    DispatcherStats m_stats {};
+    NotificationFilter m_filter;
+
+    RetentionConfig m_retention { CONFIG_NOWA_PROVIDER_CAPACITY, CONFIG_NOWA_MAX_PROVIDERS,
+        CONFIG_NOWA_STORE_BYTE_BUDGET, CONFIG_NOWA_STORE_TTL };
+    esp_timer_handle_t m_retentionTimer = nullptr;
+    uint32_t m_retentionTick = 0;
+    esp_timer_handle_t m_retryTimer = nullptr;
+    int64_t m_retryDue = 0;        // Retry timer armed for this time, 0: not armed
+    esp_timer_handle_t m_flushTimer = nullptr; // Ends replays, writes known UIDs and app names to NVS
+    SpscQueue<TimeoutEvent, TIMEOUT_QUEUE_SIZE> m_timeoutQueue; // The esp_timer task is its only producer
+    QueueHandle_t m_fetchQueue = nullptr;   // Client tasks, many producers
+    RetentionUsage m_retired {};    // Eviction counters of providers no longer in the list
 };
@@ -8,12 +8,144 @@
 
 using BDA = std::array<uint8_t, 6>;
 using String = std::string;
-using AttrRequest = std::pair<uint32_t, std::vector<ble_ancs_c_notif_attr_id_val_t>>;
-
-struct Notification {
-    String timeStamp;
-    String appId;
-    String title;
-    String subTitle;
-    String message;
+
+struct AttrRequest {
+    enum Stage : uint8_t {
+        HEADER, // App Identifier and Date, enough to accept or drop the notification
+        BODY,   // Title, Subtitle and a preview of Message, fetched for accepted notifications only
+        FULL    // Whole Message of a stored notification, fetched when a client opens it
+    };
+
+    uint32_t uid;
+    Stage stage;
+    uint8_t category;   // From the Notification Source event, needed by the filter at every stage
+    uint8_t flags;      // Event flags packed as BLE_ANCS_EVENT_FLAG_* bits
+    bool decided;       // Filter already accepted it, remaining stages only fetch
+    uint8_t attempts = 0; // Sends that timed out or failed so far
+};
+
+// Driver callback copied from the BT task to the Dispatcher worker task
+struct DriverEvent {
+    enum Type : uint8_t {
+        CONNECT,
+        DISCONNECT,
+        DEVICE_NAME,
+        NOTIFICATION,
+        ATTRIBUTE,
+        ATTRIBUTES_DONE,
+        REQUEST_ERROR,
+        APP_NAME,
+        BOND_REMOVED
+    };
+
+    Type type;
+    uint8_t idx;
+    uint32_t uid;
+    BDA bda;
+    ble_ancs_c_evt_notif_t notif;
+    ble_ancs_c_attr_t attr;     // attr.p_attr_data points into a Dispatcher fetch slot
+    char name[64];              // Device or app display name, null-terminated
+    uint16_t status;            // Request error, ANCS_STATUS_*
+};
+
+// Attribute request timeout, posted by the esp_timer task
+struct TimeoutEvent {
+    uint8_t idx;
+    bool app;                   // Get App Attributes, no UID
+    uint32_t uid;
+};
+
+// Whole message of a stored notification requested by a client, posted by any task
+struct FetchRequest {
+    BDA bda;
+    uint32_t uid;
+};
+
+// Durations in log2 buckets of milliseconds: [0, 1), [1, 2), [2, 4) ... the last one open ended
+struct LatencyHistogram {
+    static constexpr size_t BUCKETS = 14;
+
+    std::array<uint32_t, BUCKETS> counts;
+    uint32_t total;
+    int64_t maxUs;
+
+    void add(int64_t us) {
+        uint32_t ms = (us > 0) ? (uint32_t)(us / 1000) : 0;
+        size_t b = (ms == 0) ? 0 : 32 - __builtin_clz(ms);
+        counts[(b < BUCKETS) ? b : BUCKETS - 1] ++;
+        total ++;
+        maxUs = (us > maxUs) ? us : maxUs;
+    }
+
+    // Upper bound of the bucket holding the given percentile, in ms
+    uint32_t percentileMs(uint32_t pct) const {
+        uint32_t rank = (total * pct + 99) / 100, n = 0;
+        for (size_t b = 0; b < BUCKETS - 1; b ++) {
+            n += counts[b];
+            if (n >= rank) {
+                return 1u << b;
+            }
+        }
+        return (uint32_t)(maxUs / 1000);
+    }
+};
+
+struct DispatcherStats {
+    uint32_t events;            // Events processed by the worker task
+    uint32_t batches;           // Worker wake-ups that processed at least one event
+    uint32_t maxBatch;          // Largest number of events drained in one wake-up
+    uint32_t queueHighWater;    // Largest observed event queue depth
+    uint32_t producerStalls;    // Times the BT task had to wait for a free queue slot
+    int64_t postTimeTotalUs;    // Total time spent in driver callbacks on the BT task
+    int64_t postTimeMaxUs;      // Longest single driver callback on the BT task
+    uint32_t notifsStored;      // Notifications moved into provider storage
+    uint32_t notifAllocations;  // Heap allocations made while storing them
+    uint32_t notifBytesCopied;  // Attribute bytes copied while storing them
+    uint32_t fetchRequests;     // Get Notification Attributes commands sent
+    uint32_t fetchBytes;        // ANCS bytes exchanged for them (commands and responses)
+    uint32_t fetchAccepted;     // Notifications whose body was fetched
+    int64_t fetchTimeTotalUs;   // Header request to body done, accepted notifications only
+    int64_t fetchTimeMaxUs;
+    uint32_t filteredEarly;     // Notifications rejected before any attribute was requested
+    uint32_t filteredLate;      // Notifications rejected after fetching App Identifier or Title
+    uint32_t badDates;          // Date attributes that failed to parse, fetched regardless
+    uint32_t knownSkipped;      // Pre-existing notifications already fetched on an earlier connection
+    uint32_t replayRequests;    // Attribute requests sent while pre-existing notifications replayed
+    int64_t replaySettleUs;     // Connect to last idle attribute queue of the replay, latest connection
+    uint32_t requestTimeouts;   // Attribute requests without a complete response in time
+    uint32_t requestNpErrors;   // Attribute requests the phone answered with an error
+    uint32_t requestSendFailures; // Attribute requests that could not be written
+    uint32_t requestRetries;    // Failed requests queued again after a backoff
+    uint32_t requestsAbandoned; // Failed requests given up: out of retries, or the UID is gone
+    LatencyHistogram requestLatency; // Attribute request sent to its response complete
+    uint32_t maxInFlight;       // Most attribute requests in flight at once on one device
+    uint32_t pipelineFallbacks; // Devices dropped to one request in flight after a failure
+    uint32_t appNameRequests;   // Get App Attributes commands sent
+    uint32_t appNameFailures;   // Of them, not answered or not sent
+    uint32_t streamedLong;      // Messages longer than a fixed attribute slot
+    uint32_t streamedMax;       // Longest message received, bytes
+    uint32_t streamedTruncated; // Messages cut short, the stream pool was exhausted
+    uint32_t previewsStored;    // Messages stored as a preview, longer than the preview length
+    uint32_t previewBytesSkipped; // Message bytes of them not fetched
+    uint32_t fullFetchRequests; // Whole messages requested by a client and queued
+    uint32_t fullFetchDone;     // Of them, fetched and stored
+};
+
+struct RetentionConfig {
+    uint16_t maxPerProvider;    // Records per device, at most NotificationProvider::CAPACITY
+    uint16_t maxProviders;      // Devices remembered, inactive ones beyond it are forgotten LRU first
+    uint32_t byteBudget;        // All stored records together
+    uint32_t ttlSeconds;        // Since stored or last modified, 0: records never expire
+};
+
+struct RetentionUsage {
+    uint32_t providers;
+    uint32_t inactiveProviders;
+    uint32_t notifications;
+    uint32_t bytes;
+    uint32_t evictedCapacity;   // Oldest record of a full device
+    uint32_t evictedBudget;     // Oldest records while over the byte budget
+    uint32_t evictedTtl;        // Expired records
+    uint32_t removed;           // Records dismissed on the phone
+    uint32_t evictedProviders;  // Inactive devices forgotten
 };
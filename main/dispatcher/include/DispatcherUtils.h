@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdio.h>
+#include <string_view>
 #include "Dispatcher.h"
 
 class DispatcherUtils {
@@ -9,4 +10,9 @@ public:
     static void printNotif(ble_ancs_c_evt_notif_t *p_notif);
     static int printBDA(FILE *stream, BDA bda);
     static void printNotifAttr(uint32_t uid, ble_ancs_c_attr_t *p_attr);
+
+    // ANCS Date attribute, yyyyMMdd'T'HHmmSS in the phone's local time, as seconds since 1970-01-01T000000
+    static constexpr int64_t INVALID_TIME = INT64_MIN;
+    static bool parseAncsDate(std::string_view s, int64_t *t);
+    static void formatAncsDate(int64_t t, char out[16]);
 };
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+
+#include "esp_system.h"
+#include "sdkconfig.h"
+#include "DispatcherTypes.h"
+
+/**@brief UIDs of one device that were already fetched, with their Date, persisted in NVS.
+ *
+ * @details The phone replays every notification it still shows as pre-existing on each
+ *          connection. A pre-existing UID found here has been handled before and needs no
+ *          attribute request. Entries are kept sorted by UID. Once full, the oldest Date gives
+ *          way, entries without a Date first. Owned by the Dispatcher worker task.
+ */
+class KnownUids {
+
+public:
+    static constexpr size_t CAPACITY = CONFIG_NOWA_KNOWN_UIDS;
+    static constexpr const char *NVS_NAMESPACE = "nowa_uids";
+
+    // Set of a device as saved to NVS, taken under the store lock and written once it is released
+    struct Snapshot {
+        BDA bda;
+        std::vector<uint8_t> blob;  // Empty erases the saved set
+    };
+
+    esp_err_t load(const BDA& bda);
+    void load(const Snapshot& s);
+    bool snapshot(Snapshot& out);
+    static esp_err_t write(const Snapshot& s);
+    void clear(void);
+    void unload(const BDA& bda);
+
+    bool contains(uint32_t uid) const;
+    bool markSeen(uint32_t uid);
+    void add(uint32_t uid, int64_t time);
+    bool remove(uint32_t uid);
+    size_t pruneUnseen(void);
+
+    size_t size(void) const { return m_entries.size(); }
+    bool empty(void) const { return m_entries.empty(); }
+    uint32_t maxUid(void) const { return m_entries.empty() ? 0 : m_entries.back().uid; }
+    bool dirty(void) const { return m_dirty; }
+
+private:
+    struct Entry {
+        uint32_t uid;
+        bool seen;      // Replayed or added during the current connection, not persisted
+        int64_t time;   // Date, DispatcherUtils::INVALID_TIME if unknown
+    };
+
+    std::vector<Entry>::iterator lowerBound(uint32_t uid);
+    std::vector<Entry>::const_iterator lowerBound(uint32_t uid) const;
+
+    BDA m_bda {};
+    bool m_loaded = false;
+    bool m_dirty = false;
+    std::vector<Entry> m_entries;
+};
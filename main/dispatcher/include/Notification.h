@@ -0,0 +1,128 @@
+#pragma once
+
+#include <array>
+#include <string_view>
+
+#include "AttrStream.h"
+#include "DispatcherTypes.h"
+
+namespace detail {
+constexpr std::array<uint16_t, BLE_ANCS_NB_OF_NOTIF_ATTR> attrCapacity {
+    128,                    // App Identifier
+    MAX_NOTIF_ATTR_SIZE,    // Title
+    MAX_NOTIF_ATTR_SIZE,    // Subtitle
+    0,                      // Message, streamed
+    8,                      // Message Size
+    16,                     // Date
+    32,                     // Positive Action Label
+    32                      // Negative Action Label
+};
+
+constexpr size_t attrOffset(uint32_t attrId) {
+    size_t offset = 0;
+    for (uint32_t i = 0; i < attrId; i ++) {
+        offset += attrCapacity[i];
+    }
+    return offset;
+}
+}
+
+/**@brief Attribute storage of a notification being fetched, the ANCS parser writes into it directly.
+ *
+ * @details Short attributes have a fixed slot each. Message can be far longer and is streamed into
+ *          pooled blocks instead, see AttrStream. @ref get only serves the fixed ones. Only a
+ *          preview of Message is requested with every notification, the whole of it on demand.
+ */
+class NotificationBuffer {
+
+public:
+    static constexpr uint32_t STREAMED_ATTR = BLE_ANCS_NOTIF_ATTR_ID_MESSAGE;
+    static constexpr uint16_t STREAMED_MAX = CONFIG_NOWA_MAX_MESSAGE_LEN;
+    static constexpr uint16_t PREVIEW_MAX = CONFIG_NOWA_MESSAGE_PREVIEW_LEN;
+    static_assert(PREVIEW_MAX <= STREAMED_MAX, "Message preview longer than the message");
+
+    void clear(uint32_t uid) { m_uid = uid; m_lengths.fill(0); m_streamMax = PREVIEW_MAX; m_stream.open(uid); }
+    void release(void) { m_stream.close(); }
+    uint32_t uid(void) const { return m_uid; }
+    void setStreamMax(uint16_t len) { m_streamMax = len; }     // Message length to request
+    uint8_t *slot(uint32_t attrId, uint16_t *len);
+    void setLength(uint32_t attrId, uint16_t wireLen);
+    bool append(uint32_t uid, uint32_t attrId, uint16_t offset, const uint8_t *data, size_t len);
+
+    std::string_view get(uint32_t attrId) const;
+    size_t length(uint32_t attrId) const;
+    size_t copy(uint32_t attrId, uint8_t *out, size_t max) const;
+    const AttrStream& stream(void) const { return m_stream; }
+
+private:
+    uint32_t m_uid = 0;
+    uint16_t m_streamMax = PREVIEW_MAX;
+    std::array<uint16_t, BLE_ANCS_NB_OF_NOTIF_ATTR> m_lengths {};
+    std::array<uint8_t, detail::attrOffset(BLE_ANCS_NB_OF_NOTIF_ATTR)> m_data;
+    AttrStream m_stream;
+};
+
+/**@brief Stored notification: one packed record from the RecordPool plus an interned app ID.
+ *
+ * @details The record holds Title, Subtitle and Message back to back, each null-terminated,
+ *          located by the offset table in the header. App Identifier is an AppIdTable ID and
+ *          Date is kept parsed, see DispatcherUtils::parseAncsDate(). Message may only be a
+ *          preview, Message Size tells how long the whole of it is.
+ */
+class Notification {
+
+public:
+    Notification() = default;
+    Notification(const NotificationBuffer& buf, uint8_t category, uint8_t flags, int64_t time);
+    Notification(const Notification& base, const NotificationBuffer& message);
+    Notification(const Notification& other);
+    Notification(Notification&& other) noexcept;
+    Notification& operator=(const Notification& other);
+    Notification& operator=(Notification&& other) noexcept;
+    ~Notification() { reset(); }
+
+    uint32_t uid(void) const { return m_uid; }
+    uint8_t category(void) const { return m_category; }
+    uint8_t flags(void) const { return m_flags; }                 // BLE_ANCS_EVENT_FLAG_* bits
+    uint16_t events(void) const { return m_events; }              // Added and Modified events seen
+    void countEvent(void) { m_events ++; }
+    void setEvents(uint16_t events) { m_events = events; }
+
+    int64_t time(void) const { return m_time; }                   // DispatcherUtils::INVALID_TIME if malformed
+    const char *appId(void) const;
+    const char *appName(void) const;                             // Display name, the app ID until it is known
+    const char *title(void) const { return field(TITLE); }
+    const char *subTitle(void) const { return field(SUB_TITLE); }
+    const char *message(void) const { return field(MESSAGE); }
+    size_t messageLength(void) const;
+    uint16_t messageSize(void) const { return m_messageSize; }   // Whole message on the phone, 0 if unknown
+    bool messageCut(void) const;
+    size_t size(void) const { return m_size; }                    // Record bytes in use
+    size_t footprint(void) const;                                 // Object plus pool block
+
+private:
+    enum Field : uint8_t { TITLE, SUB_TITLE, MESSAGE, FIELD_NUM };
+    static constexpr std::array<ble_ancs_c_notif_attr_id_val_t, FIELD_NUM> FIELD_ATTRS {
+        BLE_ANCS_NOTIF_ATTR_ID_TITLE,
+        BLE_ANCS_NOTIF_ATTR_ID_SUBTITLE,
+        BLE_ANCS_NOTIF_ATTR_ID_MESSAGE
+    };
+
+    const char *field(Field f) const { return (m_record == nullptr) ? "" : (const char *)m_record + m_offsets[f]; }
+    static uint16_t parseMessageSize(std::string_view s);
+    void copyFrom(const Notification& other);
+    void reset(void);
+
+    // Header
+    uint8_t *m_record = nullptr;
+    std::array<uint16_t, FIELD_NUM> m_offsets {};
+    uint16_t m_size = 0;
+    uint16_t m_appId = 0;
+    uint8_t m_class = 0;            // RecordPool size class of m_record
+    uint8_t m_category = 0;
+    uint8_t m_flags = 0;
+    uint16_t m_events = 1;
+    uint16_t m_messageSize = 0;
+    uint32_t m_uid = 0;
+    int64_t m_time = 0;
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <array>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include "esp_system.h"
+#include "DispatcherTypes.h"
+
+/**@brief Ordered accept/reject rules compiled into bitmask tables and an app ID prefix trie.
+ *
+ * @details Rules are evaluated first match wins, the default action applies when nothing matches.
+ *          Category and flag conditions come with the notification itself, app ID and title
+ *          conditions need attributes. @ref decide reports which attribute is still missing
+ *          when a rule that could win depends on it, so callers fetch only what is needed.
+ */
+class NotificationFilter {
+
+public:
+    static constexpr size_t MAX_RULES = 32;
+    static constexpr const char *RULES_PATH = "/spiffs/filter.json";
+
+    enum Verdict : uint8_t {
+        ACCEPT,
+        REJECT,
+        NEED_APP_ID,    // Undecided until App Identifier is known
+        NEED_TITLE      // Undecided until Title is known
+    };
+
+    struct Rule {
+        String name;
+        bool accept = true;
+        String appId;               // Empty: any app
+        bool appIdPrefix = false;   // Match appId as a prefix instead of exactly
+        uint16_t categoryMask = 0;  // Bit per BLE_ANCS_CATEGORY_ID_*, 0: any category
+        uint8_t flagsSet = 0;       // BLE_ANCS_EVENT_FLAG_* bits that must be set
+        uint8_t flagsClear = 0;     // BLE_ANCS_EVENT_FLAG_* bits that must be clear
+        String title;               // Empty: any title, otherwise required substring
+        uint32_t hits = 0;
+    };
+
+    struct Decision {
+        Verdict verdict;
+        uint8_t rule;               // Index of the deciding rule, NO_RULE for the default action
+    };
+
+    static constexpr uint8_t NO_RULE = 0xFF;
+
+    NotificationFilter();
+
+    esp_err_t load(const char *path);
+    void setRules(std::vector<Rule>&& rules, bool defaultAccept);
+    Decision decide(uint8_t category, uint8_t flags, const std::string_view *appId, const std::string_view *title);
+    void countHit(const Decision& d);
+
+    // Snapshot for printing, rules come with their hit counters
+    void getRules(std::vector<Rule>& rules, bool& defaultAccept, uint32_t& defaultHits);
+
+    static uint8_t packFlags(const ble_ancs_c_notif_flags_t& flags);
+
+private:
+    struct TrieNode {
+        char c;
+        uint16_t child;             // First child, 0: none (root is never a child)
+        uint16_t next;              // Next sibling, 0: none
+        uint32_t exactRules;        // Rules whose appId ends here
+        uint32_t prefixRules;       // Rules whose appId prefix ends here
+    };
+
+    void compile(void);
+    uint32_t matchAppId(std::string_view appId) const;
+    uint32_t matchTitle(std::string_view title) const;
+
+    std::mutex m_mutex;
+    std::vector<Rule> m_rules;
+    bool m_defaultAccept = false;
+    uint32_t m_defaultHits = 0;
+
+    // Compiled form, bit N stands for m_rules[N]
+    std::array<uint32_t, 16> m_categoryRules {};  // Unknown category IDs share the last entry
+    std::array<uint32_t, 1 << 5> m_flagRules {};
+    std::vector<TrieNode> m_trie;
+    uint32_t m_appRules = 0;        // Rules with an app ID condition
+    uint32_t m_titleRules = 0;      // Rules with a title condition
+    uint32_t m_acceptRules = 0;
+};
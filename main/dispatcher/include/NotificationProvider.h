@@ -1,25 +1,121 @@
 #pragma once
 
-#include <deque>
+#include <vector>
 
+#include "sdkconfig.h"
 #include "DispatcherTypes.h"
+#include "Notification.h"
+#include "UidIndex.h"
 
+/**@brief Notifications of one device, kept in arrival order and addressable by UID.
+ *
+ * @details Records live in a slab of at most CAPACITY slots, linked oldest to newest, with a
+ *          UID hash index on top. A Modified notification replaces its record in place, a
+ *          Removed one is evicted at once, and the oldest gives way when the slab is full.
+ *          The index is dropped when the device goes inactive, as the phone may hand out its
+ *          UIDs afresh. On the next connection the Dispatcher indexes again the records of the
+ *          UIDs it knows to be still valid, see @ref reindex, the others are no longer reachable
+ *          by UID.
+ *
+ *          Records also sit on a timer wheel of WHEEL_SIZE buckets spanning the TTL. Each
+ *          @ref expire tick evicts the whole bucket it lands on, then new and modified records
+ *          go into that bucket, so they expire when the wheel comes round to it again.
+ */
 class NotificationProvider {
 
 public:
+	static constexpr size_t CAPACITY = CONFIG_NOWA_PROVIDER_CAPACITY;
+	static constexpr size_t WHEEL_SIZE = 32;
+
 	NotificationProvider() = default; // for std::map
 	NotificationProvider(BDA bda) : m_bda(bda) { }
 
-	void setIsActive(bool isActive) { m_isActive = isActive; }
-    String name(void) { return m_name; }
+	void setIsActive(bool isActive, int64_t now = 0);
+	bool isActive(void) const { return m_isActive; }
+	int64_t lastActive(void) const { return m_lastActive; }
+	String name(void) const { return m_name; }
 	void setName(String name) { m_name = name; }
-	bool addNotification(const Notification &notif);
-	Notification *getLatestNotification(void) { return m_notifQueue.empty() ? nullptr : &m_notifQueue.back(); }
-    const std::deque<Notification>& notifications(void) const { return m_notifQueue; }
+	bool addNotification(Notification &&notif);
+	bool removeNotification(uint32_t uid);
+	Notification *getNotification(uint32_t uid);
+	Notification *getLatestNotification(void) { return (m_tail == NIL) ? nullptr : &m_slots[m_tail].notif; }
+	size_t size(void) const { return m_count; }
+
+	// Retention, driven by the Dispatcher
+	void setCapacity(size_t cap) { m_capacity = (cap < CAPACITY) ? cap : CAPACITY; }
+	bool evictOldest(void);
+	size_t expire(uint32_t tick);
+	size_t bytes(void) const { return m_bytes; }
+	void addUsage(RetentionUsage& u) const;
+
+	// Index the records whose UID keep() accepts, newest first so a UID held twice finds its latest
+	template <typename F>
+	void reindex(F keep) {
+		m_index.clear();
+		for (uint16_t i = m_tail; i != NIL; i = m_slots[i].prev) {
+			uint32_t uid = m_slots[i].notif.uid();
+			if (keep(uid) && m_index.find(uid) < 0) {
+				m_index.insert(uid, i);
+			}
+		}
+	}
+
+	// Oldest to newest
+	template <typename F>
+	void forEach(F f) const {
+		for (uint16_t i = m_head; i != NIL; i = m_slots[i].next) {
+			f(m_slots[i].notif);
+		}
+	}
 
 private:
-	bool m_isActive;
+	static constexpr uint16_t NIL = UINT16_MAX;
+	static_assert(CAPACITY < NIL, "Slot links are 16-bit");
+
+	struct Slot {
+		Notification notif;
+		uint16_t prev;
+		uint16_t next;		// Also links the free list
+		uint16_t wheelPrev;
+		uint16_t wheelNext;
+		uint8_t bucket;
+	};
+
+	uint16_t allocSlot(void);
+	void freeSlot(uint16_t i);
+	void evict(uint16_t i);
+	void unlink(uint16_t i);
+	void linkTail(uint16_t i);
+	void wheelInsert(uint16_t i);
+	void wheelRemove(uint16_t i);
+
+	bool m_isActive = false;
+	int64_t m_lastActive = 0;
 	String m_name;
 	BDA m_bda;
-	std::deque<Notification> m_notifQueue;
+
+	std::vector<Slot> m_slots;		// Grows up to CAPACITY, freed slots are reused
+	UidIndex<CAPACITY> m_index;
+	uint16_t m_head = NIL;
+	uint16_t m_tail = NIL;
+	uint16_t m_free = NIL;
+	size_t m_count = 0;
+	size_t m_capacity = CAPACITY;
+	size_t m_bytes = 0;
+
+	std::array<uint16_t, WHEEL_SIZE> m_wheel = make_wheel();
+	uint32_t m_tick = 0;
+
+	uint32_t m_evictedCapacity = 0;
+	uint32_t m_evictedBudget = 0;
+	uint32_t m_evictedTtl = 0;
+	uint32_t m_removed = 0;
+
+	static constexpr std::array<uint16_t, WHEEL_SIZE> make_wheel(void) {
+		std::array<uint16_t, WHEEL_SIZE> w {};
+		for (auto& b : w) {
+			b = NIL;
+		}
+		return w;
+	}
 };
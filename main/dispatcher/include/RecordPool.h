@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**@brief Size-class block pool for packed notification records.
+ *
+ * @details Blocks are carved out of chunks taken from the heap and recycled through per-class
+ *          free lists, so storing a notification costs no heap allocation in the steady state and
+ *          the heap does not fragment under notification churn. A chunk whose blocks are all free
+ *          goes back to the heap, so a burst of long messages does not hold memory once evicted.
+ *          Chunks hold a few blocks only, so they empty soon after their records are evicted and a
+ *          class holds little unused memory. One empty chunk is kept when its class has no other
+ *          free block, so a count going back and forth over a chunk boundary does not take and
+ *          return it each time. Classes grow by about 1.25x, which bounds the unused tail of a
+ *          block to a fifth of its size. Owned by the Dispatcher worker task.
+ */
+class RecordPool {
+
+public:
+    static constexpr uint8_t NO_CLASS = UINT8_MAX;
+    static constexpr size_t MAX_BLOCK_SIZE = 5120;
+
+    static RecordPool& instance(void);
+
+    uint8_t *alloc(size_t size, uint8_t *cls);
+    void free(uint8_t *p, uint8_t cls);
+    static size_t blockSize(uint8_t cls) { return (cls < CLASS_SIZES.size()) ? CLASS_SIZES[cls] : 0; }
+
+    size_t chunks(void) const { return m_chunks.size(); }
+    uint32_t chunksTaken(void) const { return m_taken; }       // From the heap, ever
+    size_t reservedBytes(void) const { return m_reserved; }
+    size_t usedBytes(void) const { return m_used; }
+    size_t blocks(void) const { return m_blocks; }
+
+private:
+    static constexpr std::array<uint16_t, 28> CLASS_SIZES {
+        32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 448, 512, 640, 768, 896,
+        1024, 1280, 1536, 2048, 2560, 3072, 4096, MAX_BLOCK_SIZE
+    };
+    static constexpr size_t CHUNK_SIZE = 4096;
+    static constexpr size_t CHUNK_BLOCKS = 4;
+
+    struct Chunk {
+        uint8_t *base;
+        uint16_t used;              // Blocks allocated
+        uint8_t cls;
+    };
+
+    RecordPool() { m_free.fill(nullptr); m_freeBlocks.fill(0); }
+    static size_t chunkBlocks(uint8_t cls);
+    bool grow(uint8_t cls);
+    Chunk *findChunk(const uint8_t *p);
+    void release(Chunk *c);
+
+    std::array<uint8_t *, CLASS_SIZES.size()> m_free;  // Next pointer stored in each free block
+    std::array<size_t, CLASS_SIZES.size()> m_freeBlocks;
+    std::vector<Chunk> m_chunks;    // Sorted by base address
+    uint8_t *m_spare = nullptr;     // Empty chunk kept, the only free blocks of its class
+    uint32_t m_taken = 0;
+    size_t m_reserved = 0;
+    size_t m_used = 0;
+    size_t m_blocks = 0;
+};
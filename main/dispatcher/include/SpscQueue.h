@@ -0,0 +1,45 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <stddef.h>
+
+/**@brief Lock-free single-producer/single-consumer ring buffer.
+ *
+ * @details The producer fills a slot in place (@ref prepare) and publishes it with @ref commit,
+ *          the consumer reads the oldest slot in place (@ref front) and releases it with @ref pop.
+ *          No element is ever copied by the queue itself. Capacity must be a power of two.
+ */
+template <typename T, size_t N>
+class SpscQueue {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    // Producer side
+    T *prepare(void) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) == N) {
+            return nullptr; // Full
+        }
+        return &m_slots[tail & (N - 1)];
+    }
+    void commit(void) { m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    // Consumer side
+    T *front(void) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire)) {
+            return nullptr; // Empty
+        }
+        return &m_slots[head & (N - 1)];
+    }
+    void pop(void) { m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    size_t size(void) const { return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire); }
+    static constexpr size_t capacity(void) { return N; }
+
+private:
+    std::array<T, N> m_slots;
+    std::atomic<size_t> m_head { 0 }; // Written by consumer only
+    std::atomic<size_t> m_tail { 0 }; // Written by producer only
+};
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+
+/**@brief Fixed-size hash from notification UID to a slot of an external array of at most N entries.
+ *
+ * @details Open addressing with linear probing, at least twice as many buckets as entries.
+ *          Deletion shifts the rest of the probe chain back, so there are no tombstones and
+ *          lookups stay short however long the index has been in use. The same UID may be
+ *          present more than once, @ref find takes a predicate to pick the wanted slot.
+ */
+template <size_t N>
+class UidIndex {
+    using Slot = std::conditional_t<(N < UINT8_MAX), uint8_t, uint16_t>;
+    static_assert(N < UINT16_MAX, "Slot + 1 must fit");
+
+    static constexpr size_t bucketBits(void) {
+        size_t bits = 1;
+        while (((size_t)1 << bits) < 2 * N) {
+            bits ++;
+        }
+        return bits;
+    }
+
+public:
+    static constexpr size_t BITS = bucketBits();
+    static constexpr size_t SIZE = (size_t)1 << BITS;
+
+    UidIndex() { clear(); }
+
+    void clear(void) { m_buckets.fill({ 0, 0 }); }
+
+    void insert(uint32_t uid, size_t slot) {
+        size_t i = home(uid);
+        while (m_buckets[i].slot != 0) {
+            i = (i + 1) & (SIZE - 1);
+        }
+        m_buckets[i] = { uid, (Slot)(slot + 1) };
+    }
+
+    void erase(uint32_t uid, size_t slot) {
+        size_t i = locate(uid, slot);
+        if (i == SIZE) {
+            return;
+        }
+        size_t j = i;
+        while (1) {
+            j = (j + 1) & (SIZE - 1);
+            if (m_buckets[j].slot == 0) {
+                break;
+            }
+            // Entry at j stays if its home bucket lies cyclically in (i, j]
+            size_t k = home(m_buckets[j].uid);
+            bool stays = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+            if (!stays) {
+                m_buckets[i] = m_buckets[j];
+                i = j;
+            }
+        }
+        m_buckets[i] = { 0, 0 };
+    }
+
+    void move(uint32_t uid, size_t from, size_t to) {
+        size_t i = locate(uid, from);
+        if (i != SIZE) {
+            m_buckets[i].slot = to + 1;
+        }
+    }
+
+    template <typename Pred>
+    int find(uint32_t uid, Pred pred) const {
+        for (size_t i = home(uid); m_buckets[i].slot != 0; i = (i + 1) & (SIZE - 1)) {
+            if (m_buckets[i].uid == uid && pred((size_t)m_buckets[i].slot - 1)) {
+                return m_buckets[i].slot - 1;
+            }
+        }
+        return -1;
+    }
+
+    int find(uint32_t uid) const { return find(uid, [](size_t) { return true; }); }
+
+private:
+    struct Bucket {
+        uint32_t uid;
+        Slot slot;      // Slot + 1, 0: empty bucket
+    };
+
+    static size_t home(uint32_t uid) { return (uint32_t)(uid * 2654435761u) >> (32 - BITS); }
+
+    size_t locate(uint32_t uid, size_t slot) const {
+        for (size_t i = home(uid); m_buckets[i].slot != 0; i = (i + 1) & (SIZE - 1)) {
+            if (m_buckets[i].uid == uid && m_buckets[i].slot == slot + 1) {
+                return i;
+            }
+        }
+        return SIZE;
+    }
+
+    std::array<Bucket, SIZE> m_buckets;
+};
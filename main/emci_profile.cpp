@@ -1,11 +1,19 @@
 #include <stdio.h>
 #include <inttypes.h>
+#include <string.h>
+#include <iterator>
+#include <optional>
+#include <vector>
 
 #include "emci_profile.h"
 #include "emci_std_handlers.h"
 #include "esp_system.h"
 #include "Dispatcher.h"
 #include "DispatcherUtils.h"
+#include "AppIdTable.h"
+#include "AppNameCache.h"
+#include "AttrStream.h"
+#include "RecordPool.h"
 
 const emci_command_t cmd_array[] =
 {
@@ -21,6 +29,26 @@ const emci_command_t cmd_array[] =
     NULL,
     "Print specified device notifications", "DeviceNum"},
 
+    {"nm", notification_message_handler, "uu", 0,
+    NULL,
+    "Print one notification, fetching its whole message if only a preview is stored", "DeviceNum\0UID"},
+
+    {"ds", dispatcher_stats_handler, "", 0,
+    NULL,
+    "Print dispatcher statistics", NULL},
+
+    {"bl", link_telemetry_handler, "", 0,
+    NULL,
+    "Print BLE link telemetry: RSSI, connection parameters, sizes, traffic, attribute round trips, advertising, reconnections", NULL},
+
+    {"rt", retention_handler, "", 0,
+    NULL,
+    "Print notification storage usage and evictions", NULL},
+
+    {"fl", filter_list_handler, "s", 1,
+    NULL,
+    "Print notification filter rules, reload them first if asked", "reload"},
+
     {"reset", reset_handler, "", 0,
     NULL,
     "Reset MCU", NULL},
@@ -61,26 +89,40 @@ emci_status_t device_list_handler(uint8_t argc, emci_arg_t *argv, emci_env_t *en
 {
     FILE *f = (FILE *)env->extra;
 
+    struct Row {
+        BDA bda;
+        uint8_t id;
+        String name;
+        size_t notifs;
+        int64_t latest;
+    };
+    std::vector<Row> rows = disp.withStore([] {
+        std::vector<Row> list;
+        for (auto& p : disp.providers()) {
+            Notification *latest = p.second.getLatestNotification();
+            list.push_back({ p.first, disp.getId(p.first), p.second.name(), p.second.size(),
+                (latest != nullptr) ? latest->time() : DispatcherUtils::INVALID_TIME });
+        }
+        return list;
+    });
+
     fprintf(f, " Num | Stat |       BDA       |  Device Name | Ntfs | Latest Timestamp " EMCI_ENDL);
     fprintf(f, "-----+------+-----------------+--------------+------+------------------" EMCI_ENDL);
     int i = 0;
-    for (auto p : disp.providers()) {
+    for (const Row& r : rows) {
         i ++;
-        BDA bda = p.first;
-        String name = p.second.name();
-        size_t notifs = p.second.notifications().size();
-        uint8_t id = disp.getId(bda);
         fprintf(f, " %03d |", i);
-        if (id != Dispatcher::INVALID_ID) {
-            fprintf(f, " On/%d |", id);
+        if (r.id != Dispatcher::INVALID_ID) {
+            fprintf(f, " On/%d |", r.id);
         } else {
             fprintf(f, "  Off |");
         }
-        DispatcherUtils::printBDA(f, bda);
-        fprintf(f, "| %12s | %4d |", p.second.name().c_str(), notifs);
-        Notification *latest = p.second.getLatestNotification();
-        if (latest) {
-            fprintf(f, " %s", latest->timeStamp.c_str());
+        DispatcherUtils::printBDA(f, r.bda);
+        fprintf(f, "| %12s | %4d |", r.name.c_str(), r.notifs);
+        if (r.latest != DispatcherUtils::INVALID_TIME) {
+            char date[16];
+            DispatcherUtils::formatAncsDate(r.latest, date);
+            fprintf(f, " %s", date);
         }
         fprintf(f, EMCI_ENDL);
     }
@@ -92,40 +134,89 @@ emci_status_t device_list_handler(uint8_t argc, emci_arg_t *argv, emci_env_t *en
     return EMCI_STATUS_OK;
 }
 
-emci_status_t notification_list_handler(uint8_t argc, emci_arg_t *argv, emci_env_t *env)
+// Device numbers are 1 based, in the order of dl. Worker task or withStore().
+static emci_status_t check_device_num(uint32_t devNum, emci_env_t *env)
 {
-    FILE *f = (FILE *)env->extra;
-    int devNum = argv[1].u;
-
-    if (devNum <= 0) {
+    if (devNum == 0) {
         env->resp.param = 1;
         return EMCI_STATUS_ARG_TOO_LOW;
     } else if (devNum > disp.providers().size()) {
         env->resp.param = 1;
         return EMCI_STATUS_ARG_TOO_HIGH;
     }
+    return EMCI_STATUS_OK;
+}
 
-    int i = 0;
-    const NotificationProvider *np = nullptr;
-    for (const auto& p : disp.providers()) {
-        i ++;
-        if (i == devNum) {
-            np = &p.second;
-            break;
+static std::map<BDA, NotificationProvider>::iterator provider_by_num(uint32_t devNum)
+{
+    auto it = disp.providers().begin();
+    std::advance(it, devNum - 1);
+    return it;
+}
+
+// A stored notification copied out of the store, so it can be printed once the worker task runs again
+struct NotificationCopy {
+    uint32_t uid;
+    uint8_t category;
+    uint8_t flags;
+    uint16_t events;
+    int64_t time;
+    String appId;
+    String appName;
+    String title;
+    String subTitle;
+    String message;
+    uint16_t messageSize;
+    bool messageCut;
+
+    explicit NotificationCopy(const Notification& n)
+        : uid(n.uid()), category(n.category()), flags(n.flags()), events(n.events()), time(n.time()),
+          appId(n.appId()), appName(n.appName()), title(n.title()), subTitle(n.subTitle()),
+          message(n.message()), messageSize(n.messageSize()), messageCut(n.messageCut()) { }
+};
+
+static void print_notification(FILE *f, const NotificationCopy& n)
+{
+    fprintf(f, "UID       : %" PRIu32 " (category %u, flags %02X, %u events)" EMCI_ENDL,
+        n.uid, n.category, n.flags, n.events);
+    char date[16];
+    DispatcherUtils::formatAncsDate(n.time, date);
+    fprintf(f, "Date/Time : %s" EMCI_ENDL, date);
+    fprintf(f, "AppId     : %s" EMCI_ENDL, n.appId.c_str());
+    fprintf(f, "App       : %s" EMCI_ENDL, n.appName.c_str());
+    fprintf(f, "Title     : %s" EMCI_ENDL, n.title.c_str());
+    if (!n.subTitle.empty()) {
+        fprintf(f, "Subtitle  : %s" EMCI_ENDL, n.subTitle.c_str());
+    }
+    fprintf(f, "Message   : %s", n.message.c_str());
+    if (n.messageCut) {
+        fprintf(f, "... [%u/%u bytes]", (unsigned)n.message.size(), n.messageSize);
+    }
+    fprintf(f, EMCI_ENDL EMCI_ENDL);
+}
+
+emci_status_t notification_list_handler(uint8_t argc, emci_arg_t *argv, emci_env_t *env)
+{
+    FILE *f = (FILE *)env->extra;
+    std::vector<NotificationCopy> notifs;
+    emci_status_t status = disp.withStore([&] {
+        emci_status_t status = check_device_num(argv[1].u, env);
+        if (status == EMCI_STATUS_OK) {
+            provider_by_num(argv[1].u)->second.forEach([&](const Notification& n) {
+                notifs.emplace_back(n);
+            });
         }
+        return status;
+    });
+    if (status != EMCI_STATUS_OK) {
+        return status;
     }
 
-    i = 0;
-    for (const auto& n : np->notifications()) {
+    int i = 0;
+    for (const NotificationCopy& n : notifs) {
         i ++;
         fprintf(f, "---------------- Notification %d ----------------" EMCI_ENDL, i);
-        fprintf(f, "Date/Time : %s" EMCI_ENDL, n.timeStamp.c_str());
-        fprintf(f, "AppId     : %s" EMCI_ENDL, n.appId.c_str());
-        fprintf(f, "Title     : %s" EMCI_ENDL, n.title.c_str());
-        if (!n.subTitle.empty()) {
-            fprintf(f, "Subtitle  : %s" EMCI_ENDL, n.subTitle.c_str());
-        }
-        fprintf(f, "Message   : %s" EMCI_ENDL EMCI_ENDL, n.message.c_str());
+        print_notification(f, n);
     }
 
     if (i == 0) {
@@ -135,6 +226,296 @@ emci_status_t notification_list_handler(uint8_t argc, emci_arg_t *argv, emci_env
     return EMCI_STATUS_OK;
 }
 
+emci_status_t notification_message_handler(uint8_t argc, emci_arg_t *argv, emci_env_t *env)
+{
+    FILE *f = (FILE *)env->extra;
+    std::optional<NotificationCopy> n;
+    BDA bda;
+    bool connected = false;
+    emci_status_t status = disp.withStore([&] {
+        emci_status_t status = check_device_num(argv[1].u, env);
+        if (status == EMCI_STATUS_OK) {
+            auto it = provider_by_num(argv[1].u);
+            const Notification *stored = it->second.getNotification(argv[2].u);
+            if (stored != nullptr) {
+                n.emplace(*stored);
+            }
+            bda = it->first;
+            connected = disp.getId(bda) != Dispatcher::INVALID_ID;
+        }
+        return status;
+    });
+    if (status != EMCI_STATUS_OK) {
+        return status;
+    }
+    if (!n) {
+        fprintf(f, "<No notification %" PRIu32 ">" EMCI_ENDL, argv[2].u);
+        return EMCI_STATUS_OK;
+    }
+    print_notification(f, *n);
+
+    // Only the preview came with the notification, the rest is fetched now that someone reads it
+    if (!n->messageCut) {
+        return EMCI_STATUS_OK;
+    }
+    if (!connected) {
+        fprintf(f, "Device not connected, only the preview is stored" EMCI_ENDL);
+    } else if (disp.fetchFullMessage(bda, n->uid)) {
+        fprintf(f, "Fetching the whole message, print it again shortly" EMCI_ENDL);
+    } else {
+        fprintf(f, "Whole message cannot be requested now" EMCI_ENDL);
+    }
+    return EMCI_STATUS_OK;
+}
+
+emci_status_t dispatcher_stats_handler(uint8_t argc, emci_arg_t *argv, emci_env_t *env)
+{
+    FILE *f = (FILE *)env->extra;
+    const DispatcherStats& st = disp.stats();
+
+    fprintf(f, "Events processed  : %" PRIu32 EMCI_ENDL, st.events);
+    fprintf(f, "Worker batches    : %" PRIu32 " (max %" PRIu32 " events)" EMCI_ENDL, st.batches, st.maxBatch);
+    fprintf(f, "Queue high water  : %" PRIu32 "/%u" EMCI_ENDL, st.queueHighWater, (unsigned)Dispatcher::EVENT_QUEUE_SIZE);
+    fprintf(f, "Producer stalls   : %" PRIu32 EMCI_ENDL, st.producerStalls);
+    fprintf(f, "BT callback time  : avg %" PRId64 " us, max %" PRId64 " us" EMCI_ENDL,
+        st.events ? st.postTimeTotalUs / st.events : 0, st.postTimeMaxUs);
+    fprintf(f, "Stored notifs     : %" PRIu32 EMCI_ENDL, st.notifsStored);
+    fprintf(f, "Allocs per notif  : %.2f" EMCI_ENDL, st.notifsStored ? (float)st.notifAllocations / st.notifsStored : 0.0f);
+    fprintf(f, "Bytes copied/notif: %" PRIu32 EMCI_ENDL, st.notifsStored ? st.notifBytesCopied / st.notifsStored : 0);
+    fprintf(f, "Attr requests     : %" PRIu32 " (%" PRIu32 " bytes)" EMCI_ENDL, st.fetchRequests, st.fetchBytes);
+    fprintf(f, "Accepted notifs   : %" PRIu32 EMCI_ENDL, st.fetchAccepted);
+    fprintf(f, "Filtered notifs   : %" PRIu32 " before fetch, %" PRIu32 " after" EMCI_ENDL, st.filteredEarly, st.filteredLate);
+    fprintf(f, "Malformed dates   : %" PRIu32 EMCI_ENDL, st.badDates);
+    fprintf(f, "Reconnect replay  : %" PRIu32 " known skipped, %" PRIu32 " requests, idle after %" PRId64 " ms" EMCI_ENDL,
+        st.knownSkipped, st.replayRequests, st.replaySettleUs / 1000);
+
+    uint32_t dropped = 0, coalesced = 0, cancelled = 0, urgent = 0;
+    int64_t urgentTotal = 0, urgentMax = 0;
+    for (const auto& sched : disp.m_attrScheduler) {
+        dropped += sched.dropped;
+        coalesced += sched.coalesced;
+        cancelled += sched.cancelled;
+        urgent += sched.urgentStarted;
+        urgentTotal += sched.urgentWaitTotalUs;
+        urgentMax = (sched.urgentWaitMaxUs > urgentMax) ? sched.urgentWaitMaxUs : urgentMax;
+    }
+    fprintf(f, "Requests dropped  : %" PRIu32 " (queue full)" EMCI_ENDL, dropped);
+    fprintf(f, "Requests merged   : %" PRIu32 " coalesced, %" PRIu32 " cancelled" EMCI_ENDL, coalesced, cancelled);
+    if (urgent != 0) {
+        fprintf(f, "Urgent queue wait : avg %" PRId64 " us, max %" PRId64 " us (%" PRIu32 " requests)" EMCI_ENDL,
+            urgentTotal / urgent, urgentMax, urgent);
+    }
+    if (st.fetchAccepted != 0) {
+        fprintf(f, "Bytes/accepted    : %" PRIu32 EMCI_ENDL, st.fetchBytes / st.fetchAccepted);
+        fprintf(f, "Fetch latency     : avg %" PRId64 " us, max %" PRId64 " us" EMCI_ENDL,
+            st.fetchTimeTotalUs / st.fetchAccepted, st.fetchTimeMaxUs);
+    }
+    fprintf(f, "Request failures  : %" PRIu32 " timeouts, %" PRIu32 " NP errors, %" PRIu32 " not sent" EMCI_ENDL,
+        st.requestTimeouts, st.requestNpErrors, st.requestSendFailures);
+    fprintf(f, "Failure recovery  : %" PRIu32 " retried, %" PRIu32 " abandoned" EMCI_ENDL, st.requestRetries, st.requestsAbandoned);
+    fprintf(f, "Request pipeline  : depth %u, max %" PRIu32 " in flight, %" PRIu32 " fallbacks" EMCI_ENDL,
+        (unsigned)AttrRequestScheduler::MAX_DEPTH, st.maxInFlight, st.pipelineFallbacks);
+
+    const StreamPool& pool = StreamPool::instance();
+    fprintf(f, "Long messages     : %" PRIu32 " streamed, max %" PRIu32 " bytes, %" PRIu32 " truncated, pool peak %u/%u blocks" EMCI_ENDL,
+        st.streamedLong, st.streamedMax, st.streamedTruncated, (unsigned)pool.highWater(), (unsigned)StreamPool::BLOCKS);
+
+    fprintf(f, "Message previews  : %" PRIu32 " stored cut short, %" PRIu32 " bytes not fetched, %" PRIu32 "/%" PRIu32 " full messages fetched" EMCI_ENDL,
+        st.previewsStored, st.previewBytesSkipped, st.fullFetchDone, st.fullFetchRequests);
+
+    // Connect to notifications enabled, with handles from the cache or from service discovery
+    ancs_setup_stats_t setup;
+    ancs_get_setup_stats(&setup);
+    const ancs_setup_path_t *paths[] = { &setup.cached, &setup.discovered };
+    for (const ancs_setup_path_t *path : paths) {
+        fprintf(f, "Link setup %-7s: %" PRIu32 " setups", (path == &setup.cached) ? "cached" : "discov.", path->setups);
+        if (path->setups != 0) {
+            fprintf(f, ", subscribed avg %" PRId64 " ms", path->subscribed_total_us / path->setups / 1000);
+        }
+        if (path->first_notifs != 0) {
+            fprintf(f, ", first notif avg %" PRId64 " ms", path->first_notif_total_us / path->first_notifs / 1000);
+        }
+        fprintf(f, EMCI_ENDL);
+    }
+    fprintf(f, "Handle cache      : %" PRIu32 " invalidated" EMCI_ENDL, setup.invalidations);
+    fprintf(f, "GATT setup ops    : %" PRIu32 " issued, %" PRIu32 " busy retries, %" PRIu32 " failed, %" PRIu32 " dropped, max %u in flight" EMCI_ENDL,
+        setup.gatt_ops, setup.gatt_retries, setup.gatt_failures, setup.gatt_dropped, (unsigned)setup.gatt_max_in_flight);
+    fprintf(f, "Link negotiation  : %" PRIu32 " MTU exchanges refused, %" PRIu32 " data lengths refused" EMCI_ENDL,
+        setup.mtu_refused, setup.dle_refused);
+    fprintf(f, "Conn. parameters  : %" PRIu32 " fast, %" PRIu32 " idle asked for, %" PRIu32 " refused" EMCI_ENDL,
+        setup.conn_fast_requests, setup.conn_idle_requests, setup.conn_rejected);
+    for (uint8_t i = 0; i < ANCS_PROFILE_NUM; i ++) {
+        ancs_setup_times_t t;
+        if (!ancs_get_setup_times(i, &t)) {
+            continue;
+        }
+        // ms after connect, -1 until reached
+        auto ms = [&t](int64_t at) { return at ? (at - t.connect) / 1000 : (int64_t)-1; };
+        fprintf(f, "  [%u] %-10s: open %" PRId64 ", MTU %" PRId64 ", encrypted %" PRId64 ", handles %" PRId64
+            ", subscribed %" PRId64 ", name %" PRId64 ", first notif %" PRId64 " ms" EMCI_ENDL,
+            i, t.cached ? "cached" : "discovered", ms(t.open), ms(t.mtu), ms(t.encrypted), ms(t.discovered),
+            ms(t.subscribed), ms(t.gap_read), ms(t.first_notif));
+    }
+
+    // Every hit is a Get App Attributes command the phone did not have to answer
+    const AppNameCache& names = AppNameCache::instance();
+    uint32_t lookups = names.hits + names.misses;
+    fprintf(f, "App name cache    : %u/%u names, %.1f%% hits (%" PRIu32 " commands saved), %" PRIu32 " requests, %" PRIu32 " failed" EMCI_ENDL,
+        (unsigned)names.size(), (unsigned)AppNameCache::CAPACITY, lookups ? 100.0f * names.hits / lookups : 0.0f,
+        names.hits, st.appNameRequests, st.appNameFailures);
+
+    const LatencyHistogram& h = st.requestLatency;
+    if (h.total != 0) {
+        fprintf(f, "Request latency   : p50 <%" PRIu32 " ms, p90 <%" PRIu32 " ms, p99 <%" PRIu32 " ms, max %" PRId64 " ms" EMCI_ENDL,
+            h.percentileMs(50), h.percentileMs(90), h.percentileMs(99), h.maxUs / 1000);
+        fprintf(f, "  ms  <1 <2 <4 <8 ... :");
+        for (uint32_t c : h.counts) {
+            fprintf(f, " %" PRIu32, c);
+        }
+        fprintf(f, EMCI_ENDL);
+    }
+
+    return EMCI_STATUS_OK;
+}
+
+emci_status_t link_telemetry_handler(uint8_t argc, emci_arg_t *argv, emci_env_t *env)
+{
+    FILE *f = (FILE *)env->extra;
+    static const char *const states[] = { " pending", "", " refused" };
+    static const char *const modes[] = { "peer", "fast", "idle" };
+    int64_t now = esp_timer_get_time();
+
+    for (uint8_t i = 0; i < ANCS_PROFILE_NUM; i ++) {
+        ancs_setup_times_t t;
+        ancs_link_info_t link;
+        if (!ancs_get_setup_times(i, &t) || !ancs_get_link_info(i, &link)) {
+            continue;
+        }
+        fprintf(f, "[%u] connected %" PRId64 " s" EMCI_ENDL, i, (now - t.connect) / 1000000);
+        if (link.rssi_at != 0) {
+            fprintf(f, "  RSSI         : %d dBm, %" PRId64 " ms ago" EMCI_ENDL, link.rssi, (now - link.rssi_at) / 1000);
+        }
+        fprintf(f, "  Connection   : interval %u.%02u ms, latency %u, timeout %u ms, %s" EMCI_ENDL,
+            link.conn_interval * 125 / 100, link.conn_interval * 125 % 100, link.conn_latency, link.conn_timeout * 10,
+            modes[link.conn_mode]);
+        fprintf(f, "  Sizes        : MTU %u%s, data length tx %u rx %u%s" EMCI_ENDL,
+            link.mtu, states[link.mtu_state], link.tx_octets, link.rx_octets, states[link.dle_state]);
+        fprintf(f, "  Notif. Source: %" PRIu32 " notifs, %" PRIu32 " bytes, %" PRIu32 "/s" EMCI_ENDL,
+            link.ns_notifs, link.ns_bytes, link.ns_per_s);
+        fprintf(f, "  Data Source  : %" PRIu32 " notifs, %" PRIu32 " bytes, %" PRIu32 " bytes/notif, %" PRIu32 "/s, %" PRIu32 " bytes/s" EMCI_ENDL,
+            link.ds_notifs, link.ds_bytes, link.ds_notifs ? link.ds_bytes / link.ds_notifs : 0, link.ds_per_s, link.ds_bytes_per_s);
+        if (link.rtt_count != 0) {
+            fprintf(f, "  Attr. RTT    : avg %" PRId64 " ms, max %" PRId64 " ms, last %" PRId64 " ms, %" PRIu32 " done, %" PRIu32 " timed out" EMCI_ENDL,
+                link.rtt_total_us / link.rtt_count / 1000, link.rtt_max_us / 1000, link.rtt_last_us / 1000, link.rtt_count, link.rtt_timeouts);
+        }
+
+        // Parameters in effect from ms after connect, the first ones are those of the connection
+        ble_conn_sample_t history[BLE_CONN_CTRL_HISTORY];
+        size_t n = ancs_get_conn_history(i, history, BLE_CONN_CTRL_HISTORY);
+        for (size_t k = 0; k < n; k ++) {
+            const ble_conn_sample_t& c = history[k];
+            fprintf(f, "    %6" PRId64 " ms: interval %u.%02u ms, latency %u, timeout %u ms, %s, backlog %u" EMCI_ENDL,
+                (c.at - t.connect) / 1000, c.interval * 125 / 100, c.interval * 125 % 100,
+                c.latency, c.timeout * 10, modes[c.mode], c.backlog);
+        }
+    }
+
+    static const char *const phases[] = { "off", "fast", "slow" };
+    ble_adv_state_t adv;
+    ancs_get_adv_state(&adv);
+    fprintf(f, "Advertising  : %s, interval %u.%03u ms, %u bonds on the accept list%s, %" PRIu32 " fast windows, %" PRIu32 " restarts" EMCI_ENDL,
+        phases[adv.phase], adv.interval * 625 / 1000, adv.interval * 625 % 1000, adv.accept_list,
+        adv.filtered ? " (bonded only)" : "", adv.fast_windows, adv.restarts);
+    if (adv.fast_until != 0) {
+        fprintf(f, "  Fast for   : %" PRId64 " s" EMCI_ENDL, (adv.fast_until - now) / 1000000);
+    }
+
+    // Bonded phones, from a disconnection or boot to the next connection
+    ble_adv_peer_t peers[BLE_ADV_POLICY_PEERS];
+    size_t n = ancs_get_reconnect_stats(peers, BLE_ADV_POLICY_PEERS);
+    for (size_t k = 0; k < n; k ++) {
+        const ble_adv_peer_t& p = peers[k];
+        fprintf(f, "  %02x:%02x:%02x:%02x:%02x:%02x: %" PRIu32 " reconnects (%" PRIu32 " fast)",
+            p.bda[0], p.bda[1], p.bda[2], p.bda[3], p.bda[4], p.bda[5], p.reconnects, p.in_fast);
+        if (p.reconnects != 0) {
+            fprintf(f, ", avg %" PRId64 " ms, min %" PRId64 " ms, max %" PRId64 " ms, last %" PRId64 " ms",
+                p.total_us / p.reconnects / 1000, p.min_us / 1000, p.max_us / 1000, p.last_us / 1000);
+        }
+        if (p.disconnected_at != 0) {
+            fprintf(f, ", away %" PRId64 " s", (now - p.disconnected_at) / 1000000);
+        }
+        fprintf(f, EMCI_ENDL);
+    }
+
+    return EMCI_STATUS_OK;
+}
+
+emci_status_t retention_handler(uint8_t argc, emci_arg_t *argv, emci_env_t *env)
+{
+    FILE *f = (FILE *)env->extra;
+    const RetentionConfig& cfg = disp.retention();
+    struct {
+        size_t blocks, used, reserved, chunks, apps, appBytes;
+    } mem;
+    RetentionUsage u = disp.withStore([&] {
+        const RecordPool& pool = RecordPool::instance();
+        const AppIdTable& apps = AppIdTable::instance();
+        mem = { pool.blocks(), pool.usedBytes(), pool.reservedBytes(), pool.chunks(), apps.count(), apps.bytes() };
+        return disp.retentionUsage();
+    });
+
+    fprintf(f, "Devices           : %" PRIu32 " (%" PRIu32 " inactive, max %u)" EMCI_ENDL,
+        u.providers, u.inactiveProviders, cfg.maxProviders);
+    fprintf(f, "Notifications     : %" PRIu32 " (max %u per device)" EMCI_ENDL, u.notifications, cfg.maxPerProvider);
+    fprintf(f, "Bytes             : %" PRIu32 "/%" PRIu32 EMCI_ENDL, u.bytes, cfg.byteBudget);
+    fprintf(f, "TTL               : %" PRIu32 " s" EMCI_ENDL, cfg.ttlSeconds);
+    fprintf(f, "Evicted           : %" PRIu32 " capacity, %" PRIu32 " budget, %" PRIu32 " expired" EMCI_ENDL,
+        u.evictedCapacity, u.evictedBudget, u.evictedTtl);
+    fprintf(f, "Removed on phone  : %" PRIu32 EMCI_ENDL, u.removed);
+    fprintf(f, "Devices forgotten : %" PRIu32 EMCI_ENDL, u.evictedProviders);
+
+    fprintf(f, "Record pool       : %u blocks, %u/%u bytes, %u chunks" EMCI_ENDL,
+        (unsigned)mem.blocks, (unsigned)mem.used, (unsigned)mem.reserved, (unsigned)mem.chunks);
+    fprintf(f, "App IDs           : %u (%u bytes)" EMCI_ENDL, (unsigned)mem.apps, (unsigned)mem.appBytes);
+    if (u.notifications != 0) {
+        fprintf(f, "Bytes/notification: %" PRIu32 EMCI_ENDL, (uint32_t)((u.bytes + mem.appBytes) / u.notifications));
+    }
+
+    return EMCI_STATUS_OK;
+}
+
+emci_status_t filter_list_handler(uint8_t argc, emci_arg_t *argv, emci_env_t *env)
+{
+    FILE *f = (FILE *)env->extra;
+
+    if (argc > 1 && strcmp(argv[1].s, "reload") == 0) {
+        esp_err_t ret = disp.filter().load(NotificationFilter::RULES_PATH);
+        fprintf(f, "Reload: %s" EMCI_ENDL, esp_err_to_name(ret));
+    }
+
+    std::vector<NotificationFilter::Rule> rules;
+    bool defaultAccept;
+    uint32_t defaultHits;
+    disp.filter().getRules(rules, defaultAccept, defaultHits);
+
+    fprintf(f, " Num |  Action |       Name       | Cat  | Set/Clr | App ID / Title                   | Hits " EMCI_ENDL);
+    fprintf(f, "-----+---------+------------------+------+---------+----------------------------------+------" EMCI_ENDL);
+    int i = 0;
+    for (const auto& r : rules) {
+        i ++;
+        fprintf(f, " %03d | %-7s | %-16.16s | %04X |  %02X/%02X  | %s%-32.32s | %" PRIu32 EMCI_ENDL,
+            i, r.accept ? "accept" : "reject", r.name.c_str(), r.categoryMask, r.flagsSet, r.flagsClear,
+            r.appIdPrefix ? "*" : " ", r.appId.empty() ? "<any>" : r.appId.c_str(), r.hits);
+        if (!r.title.empty()) {
+            fprintf(f, "     |         |                  |      |         |  title: %-25.25s |" EMCI_ENDL, r.title.c_str());
+        }
+    }
+    fprintf(f, " --- | %-7s | <default>        |      |         |                                  | %" PRIu32 EMCI_ENDL,
+        defaultAccept ? "accept" : "reject", defaultHits);
+
+    return EMCI_STATUS_OK;
+}
+
 emci_status_t reset_handler(uint8_t argc, emci_arg_t *argv, emci_env_t *env)
 {
     esp_restart();
@@ -11,7 +11,7 @@
 #define EMCI_ENDL               "\r\n"
 #define EMCI_ECHO_INPUT         1
 #define EMCI_MAX_LINE_LENGTH    32
-#define EMCI_MAX_COMMANDS       8
+#define EMCI_MAX_COMMANDS       16
 #define EMCI_MAX_ARGS           10    // see "if (!adp)" line inside cmd_help_handler()
 #define EMCI_MAX_NAME_LENGTH    12
 #define EMCI_PRINTF(...)        { fprintf((FILE *)env->extra, __VA_ARGS__); }
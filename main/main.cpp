@@ -71,6 +71,8 @@ extern "C" void app_main(void)
 
     ESP_ERROR_CHECK(spiffs_init());
 
+    disp.filter().load(NotificationFilter::RULES_PATH); // Built-in rules stay on failure
+
     //con_loop();
 
     ESP_ERROR_CHECK(esp_netif_init());
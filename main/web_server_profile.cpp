@@ -25,6 +25,7 @@ extern Dispatcher disp;
 
 static esp_err_t dispatcher_control_get_handler(httpd_req_t *req);
 static esp_err_t system_info_get_handler(httpd_req_t *req);
+static esp_err_t ble_links_get_handler(httpd_req_t *req);
 static esp_err_t mcu_restart_handler(httpd_req_t *req);
 static esp_err_t firmware_update_post_handler(httpd_req_t *req);
 static esp_err_t spiffs_update_post_handler(httpd_req_t *req);
@@ -99,6 +100,19 @@ esp_err_t web_profile_start()
         return ret;
     }
 
+    /* URI handler for fetching BLE link telemetry */
+    httpd_uri_t ble_links_get_uri = {
+        .uri = "/api/ble_links",
+        .method = HTTP_GET,
+        .handler = ble_links_get_handler,
+        .user_ctx = &context
+    };
+    ret = httpd_register_uri_handler(server, &ble_links_get_uri);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "httpd_register_uri_handler failed with %d (%s)", ret, esp_err_to_name(ret));
+        return ret;
+    }
+
     /* URI handler for MCU restart */
     httpd_uri_t mcu_restart_uri = {
         .uri = "/api/mcu_restart",
@@ -276,6 +290,112 @@ static esp_err_t system_info_get_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
+/* Getting BLE link telemetry handler, with the request latency of the Dispatcher to correlate it with */
+static esp_err_t ble_links_get_handler(httpd_req_t *req)
+{
+    static const char *const states[] = { "pending", "done", "refused" };
+    static const char *const modes[] = { "peer", "fast", "idle" };
+
+    httpd_resp_set_type(req, "application/json");
+    cJSON *root = cJSON_CreateObject();
+    cJSON *links = cJSON_AddArrayToObject(root, "links");
+    int64_t now = esp_timer_get_time();
+
+    for (uint8_t i = 0; i < ANCS_PROFILE_NUM; i ++) {
+        ancs_setup_times_t t;
+        ancs_link_info_t link;
+        if (!ancs_get_setup_times(i, &t) || !ancs_get_link_info(i, &link)) {
+            continue;
+        }
+        cJSON *l = cJSON_CreateObject();
+        cJSON_AddNumberToObject(l, "device", i);
+        cJSON_AddNumberToObject(l, "connected_ms", (now - t.connect) / 1000);
+        if (link.rssi_at != 0) {
+            cJSON_AddNumberToObject(l, "rssi", link.rssi);
+            cJSON_AddNumberToObject(l, "rssi_age_ms", (now - link.rssi_at) / 1000);
+        }
+        cJSON_AddNumberToObject(l, "interval_ms", link.conn_interval * 1.25);
+        cJSON_AddNumberToObject(l, "latency", link.conn_latency);
+        cJSON_AddNumberToObject(l, "timeout_ms", link.conn_timeout * 10);
+        cJSON_AddStringToObject(l, "conn_mode", modes[link.conn_mode]);
+        cJSON_AddNumberToObject(l, "mtu", link.mtu);
+        cJSON_AddStringToObject(l, "mtu_state", states[link.mtu_state]);
+        cJSON_AddNumberToObject(l, "tx_octets", link.tx_octets);
+        cJSON_AddNumberToObject(l, "rx_octets", link.rx_octets);
+        cJSON_AddStringToObject(l, "dle_state", states[link.dle_state]);
+        cJSON_AddNumberToObject(l, "ns_notifs", link.ns_notifs);
+        cJSON_AddNumberToObject(l, "ns_bytes", link.ns_bytes);
+        cJSON_AddNumberToObject(l, "ns_per_s", link.ns_per_s);
+        cJSON_AddNumberToObject(l, "ds_notifs", link.ds_notifs);
+        cJSON_AddNumberToObject(l, "ds_bytes", link.ds_bytes);
+        cJSON_AddNumberToObject(l, "ds_per_s", link.ds_per_s);
+        cJSON_AddNumberToObject(l, "ds_bytes_per_s", link.ds_bytes_per_s);
+        cJSON_AddNumberToObject(l, "rtt_count", link.rtt_count);
+        cJSON_AddNumberToObject(l, "rtt_timeouts", link.rtt_timeouts);
+        if (link.rtt_count != 0) {
+            cJSON_AddNumberToObject(l, "rtt_avg_ms", link.rtt_total_us / link.rtt_count / 1000.0);
+            cJSON_AddNumberToObject(l, "rtt_max_ms", link.rtt_max_us / 1000.0);
+            cJSON_AddNumberToObject(l, "rtt_last_ms", link.rtt_last_us / 1000.0);
+        }
+        cJSON_AddItemToArray(links, l);
+    }
+
+    static const char *const phases[] = { "off", "fast", "slow" };
+    ble_adv_state_t adv;
+    ancs_get_adv_state(&adv);
+    cJSON *a = cJSON_AddObjectToObject(root, "advertising");
+    cJSON_AddStringToObject(a, "phase", phases[adv.phase]);
+    cJSON_AddNumberToObject(a, "interval_ms", adv.interval * 0.625);
+    cJSON_AddNumberToObject(a, "accept_list", adv.accept_list);
+    cJSON_AddBoolToObject(a, "bonded_only", adv.filtered);
+    if (adv.fast_until != 0) {
+        cJSON_AddNumberToObject(a, "fast_left_ms", (adv.fast_until - now) / 1000);
+    }
+    cJSON_AddNumberToObject(a, "fast_windows", adv.fast_windows);
+    cJSON_AddNumberToObject(a, "restarts", adv.restarts);
+
+    // Bonded phones, from a disconnection or boot to the next connection
+    ble_adv_peer_t peers[BLE_ADV_POLICY_PEERS];
+    size_t n = ancs_get_reconnect_stats(peers, BLE_ADV_POLICY_PEERS);
+    cJSON *reconnects = cJSON_AddArrayToObject(root, "reconnects");
+    for (size_t k = 0; k < n; k ++) {
+        const ble_adv_peer_t& p = peers[k];
+        char bda[18];
+        snprintf(bda, sizeof(bda), "%02x:%02x:%02x:%02x:%02x:%02x", p.bda[0], p.bda[1], p.bda[2], p.bda[3], p.bda[4], p.bda[5]);
+        cJSON *r = cJSON_CreateObject();
+        cJSON_AddStringToObject(r, "bda", bda);
+        cJSON_AddNumberToObject(r, "count", p.reconnects);
+        cJSON_AddNumberToObject(r, "in_fast_window", p.in_fast);
+        if (p.reconnects != 0) {
+            cJSON_AddNumberToObject(r, "avg_ms", p.total_us / p.reconnects / 1000.0);
+            cJSON_AddNumberToObject(r, "min_ms", p.min_us / 1000.0);
+            cJSON_AddNumberToObject(r, "max_ms", p.max_us / 1000.0);
+            cJSON_AddNumberToObject(r, "last_ms", p.last_us / 1000.0);
+        }
+        if (p.disconnected_at != 0) {
+            cJSON_AddNumberToObject(r, "away_ms", (now - p.disconnected_at) / 1000);
+        }
+        cJSON_AddItemToArray(reconnects, r);
+    }
+
+    // Attribute request sent to its response complete, all devices
+    const LatencyHistogram& h = disp.stats().requestLatency;
+    cJSON *lat = cJSON_AddObjectToObject(root, "request_latency");
+    cJSON_AddNumberToObject(lat, "count", h.total);
+    if (h.total != 0) {
+        cJSON_AddNumberToObject(lat, "p50_ms", h.percentileMs(50));
+        cJSON_AddNumberToObject(lat, "p90_ms", h.percentileMs(90));
+        cJSON_AddNumberToObject(lat, "p99_ms", h.percentileMs(99));
+        cJSON_AddNumberToObject(lat, "max_ms", h.maxUs / 1000);
+    }
+
+    const char *info = cJSON_Print(root);
+    httpd_resp_sendstr(req, info);
+    free((void *)info);
+    cJSON_Delete(root);
+    return ESP_OK;
+}
+
 static esp_err_t mcu_restart_handler(httpd_req_t *req) {
     ESP_LOGI(TAG, "Requesting MCU restart");
     mcu_restart_request = true;
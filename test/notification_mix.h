@@ -0,0 +1,51 @@
+#pragma once
+
+// Notification mix shared by the record and ingest tests: eight apps, mostly short chat messages,
+// some mails and calendar entries with long bodies. Drawn from a fixed seed, so runs repeat.
+
+#include <stdint.h>
+#include <string>
+#include "DispatcherUtils.h"
+
+struct Sample {
+    std::string appId;
+    std::string title;
+    std::string subTitle;
+    std::string message;
+    std::string date;
+};
+
+static uint32_t rng_state = 0x9E3779B9;
+
+static uint32_t rng(uint32_t lo, uint32_t hi) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return lo + rng_state % (hi - lo + 1);
+}
+
+static std::string text(size_t len) {
+    std::string s;
+    for (size_t i = 0; i < len; i ++) {
+        s.push_back((i % 6 == 5) ? ' ' : (char)rng('a', 'z'));
+    }
+    return s;
+}
+
+// longMessages draws every message from the longest kind
+static Sample makeSample(uint32_t i, bool longMessages = false) {
+    static const char *apps[] = {
+        "com.apple.MobileSMS", "net.whatsapp.WhatsApp", "com.apple.mobilemail", "com.google.Gmail",
+        "com.apple.mobilecal", "com.facebook.Messenger", "ph.telegra.Telegraph", "com.apple.reminders"
+    };
+    Sample s;
+    s.appId = apps[rng(0, 7)];
+    s.title = text(rng(4, 24));
+    s.subTitle = (rng(0, 9) < 3) ? text(rng(8, 40)) : "";
+    uint32_t kind = longMessages ? 9 : rng(0, 9);
+    s.message = text(kind < 6 ? rng(5, 60) : kind < 9 ? rng(60, 200) : rng(200, 480));
+    char date[16];
+    DispatcherUtils::formatAncsDate(1790000000 + i * 37, date);
+    s.date = date;
+    return s;
+}
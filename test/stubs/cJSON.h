@@ -0,0 +1,29 @@
+#pragma once
+
+// Declarations only, parsing always fails on the host: rule files are not under test
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct cJSON {
+    struct cJSON *next;
+    struct cJSON *prev;
+    struct cJSON *child;
+    int type;
+    char *valuestring;
+    int valueint;
+    double valuedouble;
+    char *string;
+} cJSON;
+
+cJSON *cJSON_Parse(const char *value);
+void cJSON_Delete(cJSON *item);
+cJSON *cJSON_GetObjectItem(const cJSON *object, const char *string);
+int cJSON_IsString(const cJSON *item);
+int cJSON_IsNumber(const cJSON *item);
+
+#define cJSON_ArrayForEach(element, array) for (element = (array != NULL) ? (array)->child : NULL; element != NULL; element = element->next)
+
+#ifdef __cplusplus
+}
+#endif
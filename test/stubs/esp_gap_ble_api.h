@@ -0,0 +1,77 @@
+#pragma once
+
+#include "esp_bt_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum { ADV_TYPE_IND = 0, ADV_TYPE_DIRECT_IND_HIGH, ADV_TYPE_SCAN_IND, ADV_TYPE_NONCONN_IND, ADV_TYPE_DIRECT_IND_LOW } esp_ble_adv_type_t;
+typedef enum { BLE_ADDR_TYPE_PUBLIC = 0, BLE_ADDR_TYPE_RANDOM, BLE_ADDR_TYPE_RPA_PUBLIC, BLE_ADDR_TYPE_RPA_RANDOM } esp_ble_addr_type_t;
+typedef enum { ADV_CHNL_37 = 1, ADV_CHNL_38 = 2, ADV_CHNL_39 = 4, ADV_CHNL_ALL = 7 } esp_ble_adv_channel_t;
+typedef enum { ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY = 0, ADV_FILTER_ALLOW_SCAN_WLST_CON_ANY, ADV_FILTER_ALLOW_SCAN_ANY_CON_WLST, ADV_FILTER_ALLOW_SCAN_WLST_CON_WLST } esp_ble_adv_filter_t;
+typedef struct { uint16_t adv_int_min; uint16_t adv_int_max; esp_ble_adv_type_t adv_type; esp_ble_addr_type_t own_addr_type; esp_bd_addr_t peer_addr; esp_ble_addr_type_t peer_addr_type; esp_ble_adv_channel_t channel_map; esp_ble_adv_filter_t adv_filter_policy; } esp_ble_adv_params_t;
+typedef struct { bool set_scan_rsp; bool include_name; bool include_txpower; int min_interval; int max_interval; int appearance; uint16_t manufacturer_len; uint8_t *p_manufacturer_data; uint16_t service_data_len; uint8_t *p_service_data; uint16_t service_uuid_len; uint8_t *p_service_uuid; uint8_t flag; } esp_ble_adv_data_t;
+#define ESP_BLE_APPEARANCE_GENERIC_HID 0x03C0
+#define ESP_BLE_APPEARANCE_GENERIC_WATCH 0x00C0
+#define ESP_BLE_ADV_FLAG_GEN_DISC (1<<1)
+#define ESP_BLE_ADV_FLAG_BREDR_NOT_SPT (1<<2)
+typedef enum {
+ ESP_GAP_BLE_ADV_DATA_SET_COMPLETE_EVT = 0, ESP_GAP_BLE_SCAN_RSP_DATA_SET_COMPLETE_EVT, ESP_GAP_BLE_ADV_START_COMPLETE_EVT, ESP_GAP_BLE_ADV_STOP_COMPLETE_EVT,
+ ESP_GAP_BLE_PASSKEY_REQ_EVT, ESP_GAP_BLE_OOB_REQ_EVT, ESP_GAP_BLE_NC_REQ_EVT, ESP_GAP_BLE_SEC_REQ_EVT, ESP_GAP_BLE_PASSKEY_NOTIF_EVT,
+ ESP_GAP_BLE_AUTH_CMPL_EVT, ESP_GAP_BLE_SET_LOCAL_PRIVACY_COMPLETE_EVT, ESP_GAP_BLE_READ_RSSI_COMPLETE_EVT, ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT,
+ ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT, ESP_GAP_BLE_UPDATE_WHITELIST_COMPLETE_EVT, ESP_GAP_BLE_REMOVE_BOND_DEV_COMPLETE_EVT
+} esp_gap_ble_cb_event_t;
+typedef struct { uint16_t rx_len; uint16_t tx_len; } esp_ble_pkt_data_length_params_t;
+typedef union {
+ struct { esp_bt_status_t status; } adv_start_cmpl;
+ struct { esp_bt_status_t status; } adv_stop_cmpl;
+ union { struct { esp_bd_addr_t bd_addr; } ble_req; struct { esp_bd_addr_t bd_addr; uint32_t passkey; } key_notif; struct { esp_bd_addr_t bd_addr; bool success; uint8_t fail_reason; } auth_cmpl; } ble_security;
+ struct { esp_bt_status_t status; } local_privacy_cmpl;
+ struct { esp_bt_status_t status; int8_t rssi; esp_bd_addr_t remote_addr; } read_rssi_cmpl;
+ struct { esp_bt_status_t status; esp_bd_addr_t bda; uint16_t min_int; uint16_t max_int; uint16_t latency; uint16_t conn_int; uint16_t timeout; } update_conn_params;
+ struct { esp_bt_status_t status; esp_ble_pkt_data_length_params_t params; } pkt_data_length_cmpl;
+ struct { esp_bt_status_t status; int wl_operation; } update_whitelist_cmpl;
+ struct { esp_bt_status_t status; esp_bd_addr_t bd_addr; } remove_bond_dev_cmpl;
+} esp_ble_gap_cb_param_t;
+typedef void (*esp_gap_ble_cb_t)(esp_gap_ble_cb_event_t, esp_ble_gap_cb_param_t*);
+esp_err_t esp_ble_gap_register_callback(esp_gap_ble_cb_t);
+esp_err_t esp_ble_gap_start_advertising(esp_ble_adv_params_t*);
+esp_err_t esp_ble_gap_stop_advertising(void);
+esp_err_t esp_ble_gap_config_adv_data(esp_ble_adv_data_t*);
+esp_err_t esp_ble_gap_set_device_name(const char*);
+esp_err_t esp_ble_gap_config_local_icon(uint16_t);
+esp_err_t esp_ble_gap_config_local_privacy(bool);
+esp_err_t esp_ble_gap_read_rssi(esp_bd_addr_t);
+esp_err_t esp_ble_oob_req_reply(esp_bd_addr_t, uint8_t*, uint8_t);
+esp_err_t esp_ble_confirm_reply(esp_bd_addr_t, bool);
+esp_err_t esp_ble_gap_security_rsp(esp_bd_addr_t, bool);
+typedef enum { ESP_BLE_SEC_ENCRYPT = 1, ESP_BLE_SEC_ENCRYPT_NO_MITM, ESP_BLE_SEC_ENCRYPT_MITM } esp_ble_sec_act_t;
+esp_err_t esp_ble_set_encryption(esp_bd_addr_t, esp_ble_sec_act_t);
+typedef struct { esp_bd_addr_t bda; uint16_t min_int; uint16_t max_int; uint16_t latency; uint16_t timeout; } esp_ble_conn_update_params_t;
+esp_err_t esp_ble_gap_update_conn_params(esp_ble_conn_update_params_t*);
+esp_err_t esp_ble_gap_set_pkt_data_len(esp_bd_addr_t, uint16_t);
+esp_err_t esp_ble_gap_disconnect(esp_bd_addr_t);
+typedef enum { ESP_BLE_WHITELIST_REMOVE = 0, ESP_BLE_WHITELIST_ADD, ESP_BLE_WHITELIST_CLEAR } esp_ble_wl_operation_t;
+typedef enum { BLE_WL_ADDR_TYPE_PUBLIC = 0, BLE_WL_ADDR_TYPE_RANDOM } esp_ble_wl_addr_type_t;
+esp_err_t esp_ble_gap_update_whitelist(bool, esp_bd_addr_t, esp_ble_wl_addr_type_t);
+esp_err_t esp_ble_gap_clear_whitelist(void);
+typedef struct { uint8_t irk[16]; esp_ble_addr_type_t addr_type; esp_bd_addr_t static_addr; } esp_ble_pid_keys_t;
+typedef struct { esp_ble_pid_keys_t pid_key; } esp_ble_bond_key_info_t;
+typedef struct { esp_bd_addr_t bd_addr; esp_ble_bond_key_info_t bond_key; } esp_ble_bond_dev_t;
+int esp_ble_get_bond_device_num(void);
+esp_err_t esp_ble_get_bond_device_list(int*, esp_ble_bond_dev_t*);
+typedef enum { ESP_BLE_SM_PASSKEY = 0, ESP_BLE_SM_AUTHEN_REQ_MODE, ESP_BLE_SM_IOCAP_MODE, ESP_BLE_SM_SET_INIT_KEY, ESP_BLE_SM_SET_RSP_KEY, ESP_BLE_SM_MAX_KEY_SIZE, ESP_BLE_SM_SET_STATIC_PASSKEY, ESP_BLE_SM_ONLY_ACCEPT_SPECIFIED_SEC_AUTH, ESP_BLE_SM_OOB_SUPPORT } esp_ble_sm_param_t;
+typedef uint8_t esp_ble_auth_req_t;
+typedef uint8_t esp_ble_io_cap_t;
+#define ESP_LE_AUTH_REQ_SC_MITM_BOND 0x0d
+#define ESP_IO_CAP_NONE 3
+#define ESP_BLE_ENC_KEY_MASK 1
+#define ESP_BLE_ID_KEY_MASK 2
+#define ESP_BLE_ONLY_ACCEPT_SPECIFIED_AUTH_DISABLE 0
+#define ESP_BLE_OOB_DISABLE 0
+esp_err_t esp_ble_gap_set_security_param(esp_ble_sm_param_t, void*, uint8_t);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "esp_gatt_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t esp_ble_gatt_set_local_mtu(uint16_t);
+
+#ifdef __cplusplus
+}
+#endif
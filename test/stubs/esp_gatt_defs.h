@@ -0,0 +1,29 @@
+#pragma once
+
+#include "esp_bt_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint8_t esp_gatt_if_t;
+#define ESP_GATT_IF_NONE 0xff
+typedef enum { ESP_GATT_OK = 0, ESP_GATT_INVALID_HANDLE = 1, ESP_GATT_INSUF_AUTHENTICATION = 5, ESP_GATT_INSUF_ENCRYPTION = 0x0f, ESP_GATT_NO_RESOURCES = 0x80, ESP_GATT_BUSY = 0x84, ESP_GATT_ERROR = 0x85, ESP_GATT_NOT_FOUND = 0x8a, ESP_GATT_CONGESTED = 0x8f } esp_gatt_status_t;
+typedef uint8_t esp_gatt_char_prop_t;
+#define ESP_GATT_CHAR_PROP_BIT_READ (1<<1)
+#define ESP_GATT_CHAR_PROP_BIT_WRITE (1<<3)
+#define ESP_GATT_CHAR_PROP_BIT_NOTIFY (1<<4)
+#define ESP_GATT_CHAR_PROP_BIT_INDICATE (1<<5)
+#define ESP_GATT_UUID_CHAR_CLIENT_CONFIG 0x2902
+typedef enum { ESP_GATT_AUTH_REQ_NONE = 0 } esp_gatt_auth_req_t;
+typedef enum { ESP_GATT_WRITE_TYPE_NO_RSP = 1, ESP_GATT_WRITE_TYPE_RSP } esp_gatt_write_type_t;
+typedef enum { ESP_GATT_DB_PRIMARY_SERVICE, ESP_GATT_DB_SECONDARY_SERVICE, ESP_GATT_DB_CHARACTERISTIC, ESP_GATT_DB_DESCRIPTOR, ESP_GATT_DB_INCLUDED_SERVICE, ESP_GATT_DB_ALL } esp_gatt_db_attr_type_t;
+typedef struct { uint16_t char_handle; esp_gatt_char_prop_t properties; esp_bt_uuid_t uuid; } esp_gattc_char_elem_t;
+typedef struct { uint16_t handle; esp_bt_uuid_t uuid; } esp_gattc_descr_elem_t;
+typedef struct { esp_bt_uuid_t uuid; uint8_t inst_id; } esp_gatt_id_t;
+typedef uint16_t esp_gatt_conn_reason_t;
+typedef struct { uint16_t interval; uint16_t latency; uint16_t timeout; } esp_gatt_conn_params_t;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "esp_gatt_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+ ESP_GATTC_REG_EVT = 0, ESP_GATTC_UNREG_EVT, ESP_GATTC_OPEN_EVT, ESP_GATTC_READ_CHAR_EVT, ESP_GATTC_WRITE_CHAR_EVT, ESP_GATTC_CLOSE_EVT,
+ ESP_GATTC_SEARCH_CMPL_EVT, ESP_GATTC_SEARCH_RES_EVT, ESP_GATTC_READ_DESCR_EVT, ESP_GATTC_WRITE_DESCR_EVT, ESP_GATTC_NOTIFY_EVT,
+ ESP_GATTC_PREP_WRITE_EVT, ESP_GATTC_EXEC_EVT, ESP_GATTC_ACL_EVT, ESP_GATTC_CANCEL_OPEN_EVT, ESP_GATTC_SRVC_CHG_EVT,
+ ESP_GATTC_ENC_CMPL_CB_EVT, ESP_GATTC_CFG_MTU_EVT, ESP_GATTC_ADV_DATA_EVT, ESP_GATTC_MULT_ADV_ENB_EVT, ESP_GATTC_MULT_ADV_UPD_EVT,
+ ESP_GATTC_MULT_ADV_DATA_EVT, ESP_GATTC_MULT_ADV_DIS_EVT, ESP_GATTC_CONGEST_EVT, ESP_GATTC_BTH_SCAN_ENB_EVT, ESP_GATTC_BTH_SCAN_CFG_EVT,
+ ESP_GATTC_BTH_SCAN_RD_EVT, ESP_GATTC_BTH_SCAN_THR_EVT, ESP_GATTC_BTH_SCAN_PARAM_EVT, ESP_GATTC_BTH_SCAN_DIS_EVT, ESP_GATTC_SCAN_FLT_CFG_EVT,
+ ESP_GATTC_SCAN_FLT_PARAM_EVT, ESP_GATTC_SCAN_FLT_STATUS_EVT, ESP_GATTC_ADV_VSC_EVT, ESP_GATTC_REG_FOR_NOTIFY_EVT, ESP_GATTC_UNREG_FOR_NOTIFY_EVT,
+ ESP_GATTC_CONNECT_EVT, ESP_GATTC_DISCONNECT_EVT, ESP_GATTC_READ_MULTIPLE_EVT, ESP_GATTC_QUEUE_FULL_EVT, ESP_GATTC_SET_ASSOC_EVT,
+ ESP_GATTC_GET_ADDR_LIST_EVT, ESP_GATTC_DIS_SRVC_CMPL_EVT
+} esp_gattc_cb_event_t;
+typedef union {
+ struct { esp_gatt_status_t status; uint16_t app_id; } reg;
+ struct { esp_gatt_status_t status; uint16_t conn_id; esp_bd_addr_t remote_bda; uint16_t mtu; } open;
+ struct { esp_gatt_status_t status; uint16_t conn_id; uint16_t mtu; } cfg_mtu;
+ struct { uint16_t conn_id; uint16_t start_handle; uint16_t end_handle; esp_gatt_id_t srvc_id; bool is_primary; } search_res;
+ struct { esp_gatt_status_t status; uint16_t conn_id; int searched_service_source; } search_cmpl;
+ struct { esp_gatt_status_t status; uint16_t conn_id; uint16_t handle; uint8_t *value; uint16_t value_len; } read;
+ struct { esp_gatt_status_t status; uint16_t conn_id; uint16_t handle; uint16_t offset; } write;
+ struct { esp_gatt_status_t status; uint16_t handle; } reg_for_notify;
+ struct { uint16_t conn_id; esp_bd_addr_t remote_bda; uint16_t handle; uint16_t value_len; uint8_t *value; bool is_notify; } notify;
+ struct { esp_bd_addr_t remote_bda; } srvc_chg;
+ struct { uint16_t conn_id; uint8_t link_role; esp_bd_addr_t remote_bda; esp_gatt_conn_params_t conn_params; } connect;
+ struct { esp_gatt_conn_reason_t reason; uint16_t conn_id; esp_bd_addr_t remote_bda; } disconnect;
+ struct { uint16_t conn_id; bool congested; } congest;
+ struct { esp_gatt_status_t status; uint16_t conn_id; } dis_srvc_cmpl;
+} esp_ble_gattc_cb_param_t;
+typedef void (*esp_gattc_cb_t)(esp_gattc_cb_event_t, esp_gatt_if_t, esp_ble_gattc_cb_param_t*);
+esp_err_t esp_ble_gattc_register_callback(esp_gattc_cb_t);
+esp_err_t esp_ble_gattc_app_register(uint16_t);
+esp_err_t esp_ble_gattc_app_unregister(esp_gatt_if_t);
+esp_err_t esp_ble_gattc_open(esp_gatt_if_t, esp_bd_addr_t, int, bool);
+esp_err_t esp_ble_gattc_send_mtu_req(esp_gatt_if_t, uint16_t);
+esp_err_t esp_ble_gattc_search_service(esp_gatt_if_t, uint16_t, esp_bt_uuid_t*);
+esp_gatt_status_t esp_ble_gattc_get_attr_count(esp_gatt_if_t, uint16_t, esp_gatt_db_attr_type_t, uint16_t, uint16_t, uint16_t, uint16_t*);
+esp_gatt_status_t esp_ble_gattc_get_all_char(esp_gatt_if_t, uint16_t, uint16_t, uint16_t, esp_gattc_char_elem_t*, uint16_t*, uint16_t);
+esp_gatt_status_t esp_ble_gattc_get_all_descr(esp_gatt_if_t, uint16_t, uint16_t, esp_gattc_descr_elem_t*, uint16_t*, uint16_t);
+esp_err_t esp_ble_gattc_read_char(esp_gatt_if_t, uint16_t, uint16_t, esp_gatt_auth_req_t);
+esp_err_t esp_ble_gattc_write_char(esp_gatt_if_t, uint16_t, uint16_t, uint16_t, uint8_t*, esp_gatt_write_type_t, esp_gatt_auth_req_t);
+esp_err_t esp_ble_gattc_write_char_descr(esp_gatt_if_t, uint16_t, uint16_t, uint16_t, uint8_t*, esp_gatt_write_type_t, esp_gatt_auth_req_t);
+esp_err_t esp_ble_gattc_register_for_notify(esp_gatt_if_t, esp_bd_addr_t, uint16_t);
+esp_err_t esp_ble_gattc_cache_refresh(esp_bd_addr_t);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,4 @@
+#pragma once
+
+#define ESP_TASK_BT_CONTROLLER_PRIO     23
+#define ESP_TASK_BT_CONTROLLER_STACK    4096
@@ -0,0 +1,36 @@
+#pragma once
+
+// Controls of the host stand-ins for tests, and a minimal check macro
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Virtual esp_timer clock. Advancing runs every timer callback due on the way, on the calling
+// thread as the esp_timer task, and lets the tasks go idle after each one.
+void host_time_set(int64_t us);
+void host_time_advance(int64_t us);
+
+// Wait until every task blocks in xTaskNotifyWait() with nothing pending
+void host_idle(void);
+
+void host_nvs_clear(void);
+uint32_t host_nvs_commits(void);
+
+// Wall clock for benchmarks, in ns
+uint64_t host_wall_ns(void);
+
+bool host_check(bool ok, const char *expr, const char *file, int line);
+int host_test_failures(void);
+// Reports the result and ends the process without running destructors, tasks never return
+void host_test_exit(void);
+
+#define CHECK(cond) host_check((cond), #cond, __FILE__, __LINE__)
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,310 @@
+// Host implementation of the ANCS driver stand-in, see host_ancs.h
+//
+// A command registers the destination of each requested attribute through attribute_buffer, as
+// ble_ancs.c does, on the task that sends it. The response fills them in, or streams to
+// attribute_chunk, then ends with attributes_done. The phone cuts text attributes to the length
+// requested, the parser keeps what fits the buffer and reports the length sent.
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "host.h"
+#include "host_ancs.h"
+#include "esp_gatt_defs.h"
+#include "esp_timer.h"
+
+namespace {
+
+struct Notif {
+    std::string appId;
+    std::string title;
+    std::string message;
+    std::string date;
+};
+
+struct Request {
+    uint8_t idx;
+    uint32_t uid;
+    bool app;
+    std::string appId;
+    int64_t due;
+    uint8_t attrIds[BLE_ANCS_NB_OF_NOTIF_ATTR];
+    uint16_t maxLen[BLE_ANCS_NB_OF_NOTIF_ATTR];
+    uint8_t *data[BLE_ANCS_NB_OF_NOTIF_ATTR];
+    uint16_t cap[BLE_ANCS_NB_OF_NOTIF_ATTR];
+    uint8_t count;
+};
+
+}
+
+static std::recursive_mutex ancs_lock;
+static void *context;
+static ancs_handlers_t handlers;
+static bool initialized;
+static std::map<uint32_t, Notif> notifs;
+static std::vector<Request> in_flight;
+static int64_t rtt_us = 60 * 1000;
+static uint32_t requests, app_requests, max_in_flight;
+static uint8_t driver_buffer[MAX_NOTIF_ATTR_SIZE + 1];   // Attributes without a buffer of their own
+static void (*handler_tail)(bool attribute);
+static host_ancs_dwell_t dwell;
+
+// A handler call on the BT task, timed with the tail
+template <typename F>
+static void bt_call(bool attribute, F f) {
+    uint64_t start = host_wall_ns();
+    f();
+    if (handler_tail != nullptr) {
+        handler_tail(attribute);
+    }
+    uint64_t dt = host_wall_ns() - start;
+    dwell.calls ++;
+    dwell.total_ns += dt;
+    dwell.max_ns = std::max(dwell.max_ns, dt);
+}
+
+static std::string value(const Notif& n, uint32_t id) {
+    switch (id) {
+    case BLE_ANCS_NOTIF_ATTR_ID_APP_IDENTIFIER: return n.appId;
+    case BLE_ANCS_NOTIF_ATTR_ID_TITLE: return n.title;
+    case BLE_ANCS_NOTIF_ATTR_ID_MESSAGE: return n.message;
+    case BLE_ANCS_NOTIF_ATTR_ID_MESSAGE_SIZE: return std::to_string(n.message.size());
+    case BLE_ANCS_NOTIF_ATTR_ID_DATE: return n.date;
+    default: return "";
+    }
+}
+
+static uint32_t count_in_flight(uint8_t idx, bool app) {
+    uint32_t n = 0;
+    for (const Request& r : in_flight) {
+        n += (r.idx == idx && r.app == app) ? 1 : 0;
+    }
+    return n;
+}
+
+static void answer(const Request& r) {
+    if (r.app) {
+        std::string name = "Name of " + r.appId;
+        if (handlers.app_name) bt_call(false, [&]() { handlers.app_name(context, r.idx, name.c_str(), ESP_GATT_OK); });
+        return;
+    }
+
+    Notif n;
+    {
+        std::lock_guard<std::recursive_mutex> lock(ancs_lock);
+        auto it = notifs.find(r.uid);
+        if (it == notifs.end()) {
+            if (handlers.request_error) bt_call(false, [&]() { handlers.request_error(context, r.idx, r.uid, ANCS_STATUS_INVALID_PARAMETER); });
+            return;
+        }
+        n = it->second;
+    }
+
+    for (uint8_t i = 0; i < r.count; i ++) {
+        uint32_t id = r.attrIds[i];
+        std::string v = value(n, id);
+        if (r.maxLen[i] != 0 && v.size() > r.maxLen[i]) {
+            v.resize(r.maxLen[i]);
+        }
+
+        ble_ancs_c_attr_t attr {};
+        attr.attr_id = id;
+        attr.attr_len = (uint16_t)v.size();
+        if (r.data[i] != nullptr) {
+            size_t kept = std::min(v.size(), (size_t)r.cap[i] - 1);
+            memcpy(r.data[i], v.data(), kept);
+            r.data[i][kept] = '\0';
+            attr.p_attr_data = r.data[i];
+        } else if (handlers.attribute_chunk && !v.empty()) {
+            bt_call(false, [&]() { handlers.attribute_chunk(context, r.idx, r.uid, id, 0, (const uint8_t *)v.data(), (uint16_t)v.size()); });
+        }
+        if (handlers.attribute) bt_call(true, [&]() { handlers.attribute(context, r.idx, r.uid, &attr); });
+    }
+    if (handlers.attributes_done) bt_call(false, [&]() { handlers.attributes_done(context, r.idx, r.uid); });
+}
+
+/* Controls */
+
+void host_ancs_reset(void) {
+    std::lock_guard<std::recursive_mutex> lock(ancs_lock);
+    notifs.clear();
+    in_flight.clear();
+    requests = 0;
+    app_requests = 0;
+    max_in_flight = 0;
+    dwell = {};
+}
+
+void host_ancs_set_rtt(int64_t us) {
+    std::lock_guard<std::recursive_mutex> lock(ancs_lock);
+    rtt_us = us;
+}
+
+void host_ancs_add(const host_ancs_notif_t *n) {
+    std::lock_guard<std::recursive_mutex> lock(ancs_lock);
+    notifs[n->uid] = Notif { n->app_id, n->title, n->message, n->date };
+}
+
+void host_ancs_remove(uint32_t uid) {
+    std::lock_guard<std::recursive_mutex> lock(ancs_lock);
+    notifs.erase(uid);
+}
+
+void host_ancs_connect(uint8_t idx, const uint8_t bda[6]) {
+    uint8_t addr[6];
+    memcpy(addr, bda, sizeof(addr));
+    if (handlers.connect) bt_call(false, [&]() { handlers.connect(context, idx, addr); });
+}
+
+void host_ancs_disconnect(uint8_t idx) {
+    {
+        std::lock_guard<std::recursive_mutex> lock(ancs_lock);
+        in_flight.erase(std::remove_if(in_flight.begin(), in_flight.end(),
+            [idx](const Request& r) { return r.idx == idx; }), in_flight.end());
+    }
+    if (handlers.disconnect) bt_call(false, [&]() { handlers.disconnect(context, idx); });
+}
+
+void host_ancs_event(uint8_t idx, uint8_t evt_id, uint32_t uid, bool pre_existing) {
+    ble_ancs_c_evt_notif_t notif {};
+    notif.notif_uid = uid;
+    notif.evt_id = (ble_ancs_c_evt_id_values_t)evt_id;
+    notif.evt_flags.pre_existing = pre_existing ? 1 : 0;
+    notif.category_id = BLE_ANCS_CATEGORY_ID_SOCIAL;
+    if (handlers.notification) bt_call(false, [&]() { handlers.notification(context, idx, &notif); });
+}
+
+void host_ancs_bond_removed(const uint8_t bda[6]) {
+    uint8_t addr[6];
+    memcpy(addr, bda, sizeof(addr));
+    if (handlers.bond_removed) bt_call(false, [&]() { handlers.bond_removed(context, addr); });
+}
+
+int64_t host_ancs_next_due(void) {
+    std::lock_guard<std::recursive_mutex> lock(ancs_lock);
+    int64_t due = INT64_MAX;
+    for (const Request& r : in_flight) {
+        due = std::min(due, r.due);
+    }
+    return due;
+}
+
+void host_ancs_answer_due(void) {
+    while (1) {
+        Request r;
+        {
+            std::lock_guard<std::recursive_mutex> lock(ancs_lock);
+            auto next = in_flight.end();
+            for (auto it = in_flight.begin(); it != in_flight.end(); it ++) {
+                if (it->due <= esp_timer_get_time() && (next == in_flight.end() || it->due < next->due)) {
+                    next = it;
+                }
+            }
+            if (next == in_flight.end()) {
+                return;
+            }
+            r = *next;
+            in_flight.erase(next);
+        }
+        answer(r);
+    }
+}
+
+uint32_t host_ancs_requests(void) { return requests; }
+uint32_t host_ancs_app_requests(void) { return app_requests; }
+
+uint32_t host_ancs_in_flight(void) {
+    std::lock_guard<std::recursive_mutex> lock(ancs_lock);
+    return in_flight.size();
+}
+
+uint32_t host_ancs_max_in_flight(void) { return max_in_flight; }
+
+void host_ancs_set_handler_tail(void (*tail)(bool attribute)) {
+    handler_tail = tail;
+}
+
+void host_ancs_get_dwell(host_ancs_dwell_t *d) {
+    *d = dwell;
+}
+
+/* Driver API */
+
+esp_err_t ancs_init(void *ctx, ancs_handlers_t *h) {
+    context = ctx;
+    handlers = *h;
+    initialized = true;
+    return ESP_OK;
+}
+
+esp_err_t ancs_deinit(void *ctx) {
+    (void)ctx;
+    initialized = false;
+    return ESP_OK;
+}
+
+bool ancs_is_initialized(void) {
+    return initialized;
+}
+
+bool ancs_send_attrs_request(uint8_t idx, uint32_t uid, const ancs_attr_frame_t *frame) {
+    std::lock_guard<std::recursive_mutex> lock(ancs_lock);
+    if (count_in_flight(idx, false) >= ANCS_PIPELINE_DEPTH) {
+        return false;
+    }
+
+    Request r {};
+    r.idx = idx;
+    r.uid = uid;
+    r.due = esp_timer_get_time() + rtt_us;
+    for (size_t i = ANCS_ATTR_FRAME_UID_OFFSET + sizeof(uint32_t); i < frame->len; ) {
+        uint8_t id = frame->data[i ++];
+        uint16_t len = 0;
+        if (id == BLE_ANCS_NOTIF_ATTR_ID_TITLE || id == BLE_ANCS_NOTIF_ATTR_ID_SUBTITLE || id == BLE_ANCS_NOTIF_ATTR_ID_MESSAGE) {
+            len = frame->data[i] | (frame->data[i + 1] << 8);
+            i += 2;
+        }
+        uint16_t cap = 0;
+        uint8_t *data = handlers.attribute_buffer ? handlers.attribute_buffer(context, idx, uid, id, &cap) : nullptr;
+        if (data == nullptr && (cap == 0 || handlers.attribute_chunk == nullptr)) {
+            data = driver_buffer;
+            cap = sizeof(driver_buffer);
+        }
+        r.attrIds[r.count] = id;
+        r.maxLen[r.count] = len;
+        r.data[r.count] = data;
+        r.cap[r.count] = cap;
+        r.count ++;
+    }
+
+    in_flight.push_back(r);
+    requests ++;
+    max_in_flight = std::max(max_in_flight, count_in_flight(idx, false));
+    return true;
+}
+
+bool ancs_send_app_attrs_request(uint8_t idx, const char *app_id) {
+    std::lock_guard<std::recursive_mutex> lock(ancs_lock);
+    if (count_in_flight(idx, true) != 0) {
+        return false;
+    }
+
+    Request r {};
+    r.idx = idx;
+    r.app = true;
+    r.appId = app_id;
+    r.due = esp_timer_get_time() + rtt_us;
+    in_flight.push_back(r);
+    app_requests ++;
+    return true;
+}
+
+void ancs_set_backlog(uint8_t idx, uint32_t pending) {
+    (void)idx;
+    (void)pending;
+}
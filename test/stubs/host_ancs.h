@@ -0,0 +1,63 @@
+#pragma once
+
+// ANCS driver stand-in for tests of the Dispatcher alone, in place of ble_ancs.c: a phone that
+// answers Get Notification Attributes and Get App Attributes commands one round trip after they
+// are written, in esp_timer time. Events and responses reach the handlers on the calling thread
+// as the BT task.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "ble_ancs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// What the phone answers for a UID, strings are copied
+typedef struct {
+    uint32_t uid;
+    const char *app_id;
+    const char *title;
+    const char *message;
+    const char *date;       // ANCS format, yyyyMMdd'T'HHmmSS
+} host_ancs_notif_t;
+
+// Time spent in handler calls on the BT task, wall clock
+typedef struct {
+    uint32_t calls;
+    uint64_t total_ns;
+    uint64_t max_ns;
+} host_ancs_dwell_t;
+
+// Forget the notifications, the requests in flight and the counters, the handlers stay
+void host_ancs_reset(void);
+void host_ancs_set_rtt(int64_t us);
+void host_ancs_add(const host_ancs_notif_t *n);
+// Requests for the UID are answered with ANCS_STATUS_INVALID_PARAMETER from now on
+void host_ancs_remove(uint32_t uid);
+
+void host_ancs_connect(uint8_t idx, const uint8_t bda[6]);
+// Requests in flight are dropped unanswered, as the link is gone
+void host_ancs_disconnect(uint8_t idx);
+void host_ancs_event(uint8_t idx, uint8_t evt_id, uint32_t uid, bool pre_existing);
+void host_ancs_bond_removed(const uint8_t bda[6]);
+
+// esp_timer time of the next response, INT64_MAX if nothing is in flight
+int64_t host_ancs_next_due(void);
+// Deliver every response due by now, oldest first
+void host_ancs_answer_due(void);
+
+uint32_t host_ancs_requests(void);      // Get Notification Attributes commands written
+uint32_t host_ancs_app_requests(void);  // Get App Attributes commands written
+uint32_t host_ancs_in_flight(void);
+uint32_t host_ancs_max_in_flight(void);
+
+// Run at the end of every handler call, within its dwell, to model work the driver callback did
+// before returning. attribute is set for attribute events. NULL for none.
+void host_ancs_set_handler_tail(void (*tail)(bool attribute));
+void host_ancs_get_dwell(host_ancs_dwell_t *dwell);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,242 @@
+// Host implementation of the Bluedroid stand-ins, see host_bt.h
+//
+// Every call the driver makes into the stack returns at once. The ones a test looks at are
+// recorded, their completions are up to the test, through host_bt_gattc_event() and
+// host_bt_gap_event(). The GATT database is empty, handles come from the handle cache or are
+// not found.
+
+#include <mutex>
+#include <string.h>
+#include <vector>
+
+#include "host_bt.h"
+#include "esp_bt.h"
+#include "esp_bt_main.h"
+#include "esp_gatt_common_api.h"
+
+static std::recursive_mutex bt_lock;
+static std::vector<host_bt_call_t> calls[HOST_BT_CALL_TYPES];
+static struct {
+    esp_err_t err;
+    uint32_t count;
+} failures[HOST_BT_CALL_TYPES];
+
+static std::vector<esp_ble_bond_dev_t> bonds;
+static esp_gattc_cb_t gattc_cb;
+static esp_gap_ble_cb_t gap_cb;
+
+static esp_err_t record(host_bt_call_type_t type, esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t handle,
+                        const uint8_t *bda = nullptr, const uint8_t *data = nullptr, uint16_t len = 0) {
+    std::lock_guard<std::recursive_mutex> lock(bt_lock);
+    host_bt_call_t c {};
+    c.type = type;
+    c.gattc_if = gattc_if;
+    c.conn_id = conn_id;
+    c.handle = handle;
+    if (bda != nullptr) {
+        memcpy(c.bda, bda, sizeof(c.bda));
+    }
+    c.len = len;
+    if (data != nullptr) {
+        memcpy(c.data, data, (len < sizeof(c.data)) ? len : sizeof(c.data));
+    }
+    calls[type].push_back(c);
+
+    if (failures[type].count == 0) {
+        return ESP_OK;
+    }
+    failures[type].count --;
+    return failures[type].err;
+}
+
+/* Controls */
+
+void host_bt_reset(void) {
+    std::lock_guard<std::recursive_mutex> lock(bt_lock);
+    for (auto& v : calls) {
+        v.clear();
+    }
+    memset(failures, 0, sizeof(failures));
+}
+
+void host_bt_fail(host_bt_call_type_t type, esp_err_t err, uint32_t count) {
+    std::lock_guard<std::recursive_mutex> lock(bt_lock);
+    failures[type].err = err;
+    failures[type].count = count;
+}
+
+void host_bt_set_bonds(const esp_ble_bond_dev_t *list, int num) {
+    std::lock_guard<std::recursive_mutex> lock(bt_lock);
+    bonds.assign(list, list + num);
+}
+
+uint32_t host_bt_count(host_bt_call_type_t type) {
+    std::lock_guard<std::recursive_mutex> lock(bt_lock);
+    return calls[type].size();
+}
+
+const host_bt_call_t *host_bt_call(host_bt_call_type_t type, uint32_t n) {
+    std::lock_guard<std::recursive_mutex> lock(bt_lock);
+    return (n < calls[type].size()) ? &calls[type][n] : nullptr;
+}
+
+const host_bt_call_t *host_bt_last(host_bt_call_type_t type) {
+    std::lock_guard<std::recursive_mutex> lock(bt_lock);
+    return calls[type].empty() ? nullptr : &calls[type].back();
+}
+
+void host_bt_gattc_event(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param) {
+    if (gattc_cb != nullptr) {
+        gattc_cb(event, gattc_if, param);
+    }
+}
+
+void host_bt_gap_event(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param) {
+    if (gap_cb != nullptr) {
+        gap_cb(event, param);
+    }
+}
+
+/* Controller and host stack */
+
+esp_err_t esp_bt_controller_mem_release(esp_bt_mode_t) { return ESP_OK; }
+esp_err_t esp_bt_controller_init(esp_bt_controller_config_t *) { return ESP_OK; }
+esp_err_t esp_bt_controller_enable(esp_bt_mode_t) { return ESP_OK; }
+esp_err_t esp_bt_controller_disable(void) { return ESP_OK; }
+esp_err_t esp_bt_controller_deinit(void) { return ESP_OK; }
+esp_err_t esp_bluedroid_init(void) { return ESP_OK; }
+esp_err_t esp_bluedroid_enable(void) { return ESP_OK; }
+esp_err_t esp_bluedroid_disable(void) { return ESP_OK; }
+esp_err_t esp_bluedroid_deinit(void) { return ESP_OK; }
+esp_err_t esp_ble_gatt_set_local_mtu(uint16_t) { return ESP_OK; }
+
+/* GATT client */
+
+esp_err_t esp_ble_gattc_register_callback(esp_gattc_cb_t cb) {
+    gattc_cb = cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_app_register(uint16_t app_id) {
+    return record(HOST_BT_APP_REGISTER, ESP_GATT_IF_NONE, 0, app_id);
+}
+
+esp_err_t esp_ble_gattc_app_unregister(esp_gatt_if_t) { return ESP_OK; }
+
+esp_err_t esp_ble_gattc_open(esp_gatt_if_t gattc_if, esp_bd_addr_t bda, int, bool) {
+    return record(HOST_BT_OPEN, gattc_if, 0, 0, bda);
+}
+
+esp_err_t esp_ble_gattc_send_mtu_req(esp_gatt_if_t gattc_if, uint16_t conn_id) {
+    return record(HOST_BT_MTU_REQ, gattc_if, conn_id, 0);
+}
+
+esp_err_t esp_ble_gattc_search_service(esp_gatt_if_t gattc_if, uint16_t conn_id, esp_bt_uuid_t *) {
+    return record(HOST_BT_SEARCH_SERVICE, gattc_if, conn_id, 0);
+}
+
+esp_gatt_status_t esp_ble_gattc_get_attr_count(esp_gatt_if_t, uint16_t, esp_gatt_db_attr_type_t, uint16_t, uint16_t,
+                                               uint16_t, uint16_t *count) {
+    *count = 0;
+    return ESP_GATT_OK;
+}
+
+esp_gatt_status_t esp_ble_gattc_get_all_char(esp_gatt_if_t, uint16_t, uint16_t, uint16_t, esp_gattc_char_elem_t *,
+                                             uint16_t *count, uint16_t) {
+    *count = 0;
+    return ESP_GATT_NOT_FOUND;
+}
+
+esp_gatt_status_t esp_ble_gattc_get_all_descr(esp_gatt_if_t, uint16_t, uint16_t, esp_gattc_descr_elem_t *,
+                                              uint16_t *count, uint16_t) {
+    *count = 0;
+    return ESP_GATT_NOT_FOUND;
+}
+
+esp_err_t esp_ble_gattc_read_char(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t handle, esp_gatt_auth_req_t) {
+    return record(HOST_BT_READ_CHAR, gattc_if, conn_id, handle);
+}
+
+esp_err_t esp_ble_gattc_write_char(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t handle, uint16_t len,
+                                   uint8_t *value, esp_gatt_write_type_t, esp_gatt_auth_req_t) {
+    return record(HOST_BT_WRITE_CHAR, gattc_if, conn_id, handle, nullptr, value, len);
+}
+
+esp_err_t esp_ble_gattc_write_char_descr(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t handle, uint16_t len,
+                                         uint8_t *value, esp_gatt_write_type_t, esp_gatt_auth_req_t) {
+    return record(HOST_BT_WRITE_DESCR, gattc_if, conn_id, handle, nullptr, value, len);
+}
+
+esp_err_t esp_ble_gattc_register_for_notify(esp_gatt_if_t gattc_if, esp_bd_addr_t bda, uint16_t handle) {
+    return record(HOST_BT_REGISTER_FOR_NOTIFY, gattc_if, 0, handle, bda);
+}
+
+esp_err_t esp_ble_gattc_cache_refresh(esp_bd_addr_t) { return ESP_OK; }
+
+/* GAP */
+
+esp_err_t esp_ble_gap_register_callback(esp_gap_ble_cb_t cb) {
+    gap_cb = cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_start_advertising(esp_ble_adv_params_t *params) {
+    return record(HOST_BT_START_ADVERTISING, ESP_GATT_IF_NONE, 0, params->adv_int_min, nullptr,
+                  (const uint8_t *)params, sizeof(*params));
+}
+
+esp_err_t esp_ble_gap_stop_advertising(void) {
+    return record(HOST_BT_STOP_ADVERTISING, ESP_GATT_IF_NONE, 0, 0);
+}
+
+esp_err_t esp_ble_gap_config_adv_data(esp_ble_adv_data_t *) { return ESP_OK; }
+esp_err_t esp_ble_gap_set_device_name(const char *) { return ESP_OK; }
+esp_err_t esp_ble_gap_config_local_icon(uint16_t) { return ESP_OK; }
+esp_err_t esp_ble_gap_config_local_privacy(bool) { return ESP_OK; }
+
+esp_err_t esp_ble_gap_read_rssi(esp_bd_addr_t bda) {
+    return record(HOST_BT_READ_RSSI, ESP_GATT_IF_NONE, 0, 0, bda);
+}
+
+esp_err_t esp_ble_oob_req_reply(esp_bd_addr_t, uint8_t *, uint8_t) { return ESP_OK; }
+esp_err_t esp_ble_confirm_reply(esp_bd_addr_t, bool) { return ESP_OK; }
+esp_err_t esp_ble_gap_security_rsp(esp_bd_addr_t, bool) { return ESP_OK; }
+
+esp_err_t esp_ble_set_encryption(esp_bd_addr_t bda, esp_ble_sec_act_t) {
+    return record(HOST_BT_SET_ENCRYPTION, ESP_GATT_IF_NONE, 0, 0, bda);
+}
+
+esp_err_t esp_ble_gap_update_conn_params(esp_ble_conn_update_params_t *params) {
+    return record(HOST_BT_UPDATE_CONN_PARAMS, ESP_GATT_IF_NONE, 0, params->max_int, params->bda);
+}
+
+esp_err_t esp_ble_gap_disconnect(esp_bd_addr_t bda) {
+    return record(HOST_BT_DISCONNECT, ESP_GATT_IF_NONE, 0, 0, bda);
+}
+
+esp_err_t esp_ble_gap_set_pkt_data_len(esp_bd_addr_t bda, uint16_t len) {
+    return record(HOST_BT_SET_PKT_DATA_LEN, ESP_GATT_IF_NONE, 0, len, bda);
+}
+
+esp_err_t esp_ble_gap_update_whitelist(bool add, esp_bd_addr_t bda, esp_ble_wl_addr_type_t type) {
+    return add ? record(HOST_BT_UPDATE_WHITELIST, ESP_GATT_IF_NONE, 0, type, bda) : ESP_OK;
+}
+
+esp_err_t esp_ble_gap_clear_whitelist(void) {
+    return record(HOST_BT_CLEAR_WHITELIST, ESP_GATT_IF_NONE, 0, 0);
+}
+
+int esp_ble_get_bond_device_num(void) {
+    std::lock_guard<std::recursive_mutex> lock(bt_lock);
+    return (int)bonds.size();
+}
+
+esp_err_t esp_ble_get_bond_device_list(int *count, esp_ble_bond_dev_t *list) {
+    std::lock_guard<std::recursive_mutex> lock(bt_lock);
+    int n = (*count < (int)bonds.size()) ? *count : (int)bonds.size();
+    memcpy(list, bonds.data(), sizeof(list[0]) * n);
+    *count = n;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_set_security_param(esp_ble_sm_param_t, void *, uint8_t) { return ESP_OK; }
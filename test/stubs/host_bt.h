@@ -0,0 +1,65 @@
+#pragma once
+
+// Controls of the Bluedroid stand-in: the calls the driver made into the stack, their results, and
+// events delivered to the callbacks it registered, on the calling thread as the BT task
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_gap_ble_api.h"
+#include "esp_gattc_api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    HOST_BT_APP_REGISTER,
+    HOST_BT_OPEN,
+    HOST_BT_MTU_REQ,
+    HOST_BT_SEARCH_SERVICE,
+    HOST_BT_REGISTER_FOR_NOTIFY,
+    HOST_BT_READ_CHAR,
+    HOST_BT_WRITE_CHAR,
+    HOST_BT_WRITE_DESCR,
+    HOST_BT_SET_ENCRYPTION,
+    HOST_BT_SET_PKT_DATA_LEN,
+    HOST_BT_UPDATE_CONN_PARAMS,
+    HOST_BT_READ_RSSI,
+    HOST_BT_DISCONNECT,
+    HOST_BT_START_ADVERTISING,
+    HOST_BT_STOP_ADVERTISING,
+    HOST_BT_CLEAR_WHITELIST,
+    HOST_BT_UPDATE_WHITELIST,     // Additions
+    HOST_BT_CALL_TYPES
+} host_bt_call_type_t;
+
+typedef struct {
+    host_bt_call_type_t type;
+    esp_gatt_if_t gattc_if;
+    uint16_t conn_id;
+    uint16_t handle;    // Or the app ID, the MTU of a data length, the advertising interval, the address type
+    esp_bd_addr_t bda;
+    uint16_t len;
+    uint8_t data[64];   // Written value, truncated, or the advertising parameters
+} host_bt_call_t;
+
+// Forget the calls recorded and the failures set
+void host_bt_reset(void);
+// The next count calls of type return err instead of ESP_OK, and are still recorded
+void host_bt_fail(host_bt_call_type_t type, esp_err_t err, uint32_t count);
+
+// Bonds the stack reports from now on, none at first
+void host_bt_set_bonds(const esp_ble_bond_dev_t *bonds, int num);
+
+uint32_t host_bt_count(host_bt_call_type_t type);
+// Call n of type, oldest first, NULL past the last one
+const host_bt_call_t *host_bt_call(host_bt_call_type_t type, uint32_t n);
+const host_bt_call_t *host_bt_last(host_bt_call_type_t type);
+
+void host_bt_gattc_event(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param);
+void host_bt_gap_event(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,507 @@
+// Host implementation of the ESP-IDF and FreeRTOS stand-ins, see host.h
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <stdarg.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "host.h"
+#include "cJSON.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "nvs_flash.h"
+
+/* Log */
+
+static int log_level(void) {
+    static int level = -1;
+    if (level < 0) {
+        const char *env = getenv("NOWA_TEST_LOG");
+        level = (env != NULL) ? atoi(env) : ESP_LOG_ERROR;
+    }
+    return level;
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...) {
+    if ((int)level > log_level()) {
+        return;
+    }
+    static const char letters[] = "NEWIDV";
+    fprintf(stderr, "%c (%s) ", letters[level], tag);
+    va_list ap;
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level) {
+    (void)tag;
+    (void)level;
+}
+
+const char *esp_err_to_name(esp_err_t code) {
+    switch (code) {
+    case ESP_OK: return "ESP_OK";
+    case ESP_FAIL: return "ESP_FAIL";
+    case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NVS_NOT_FOUND: return "ESP_ERR_NVS_NOT_FOUND";
+    default: return "ESP_ERR";
+    }
+}
+
+#if !defined(__GLIBC__) || __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38)
+size_t strlcpy(char *dst, const char *src, size_t size) {
+    size_t len = strlen(src);
+    if (size != 0) {
+        size_t n = (len < size - 1) ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
+#endif
+
+void esp_restart(void) {
+    fprintf(stderr, "esp_restart\n");
+    abort();
+}
+
+/* Critical sections */
+
+static std::recursive_mutex critical;
+
+void host_critical_enter(portMUX_TYPE *mux) {
+    (void)mux;
+    critical.lock();
+}
+
+void host_critical_exit(portMUX_TYPE *mux) {
+    (void)mux;
+    critical.unlock();
+}
+
+/* Tasks */
+
+struct host_task {
+    TaskFunction_t fn;
+    void *arg;
+    uint32_t bits = 0;
+    bool waiting = false;
+};
+
+static std::mutex task_lock;
+static std::condition_variable task_cv;
+static std::vector<host_task *> tasks;
+static thread_local host_task *current_task = nullptr;
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio, TaskHandle_t *out) {
+    (void)name;
+    (void)stack;
+    (void)prio;
+    host_task *t = new host_task { fn, arg };
+    {
+        std::lock_guard<std::mutex> lock(task_lock);
+        tasks.push_back(t);
+    }
+    if (out != NULL) {
+        *out = t;
+    }
+    std::thread([t]() {
+        current_task = t;
+        t->fn(t->arg);
+    }).detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio, TaskHandle_t *out, BaseType_t core) {
+    (void)core;
+    return xTaskCreate(fn, name, stack, arg, prio, out);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    (void)task;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)(esp_timer_get_time() / 1000 / portTICK_PERIOD_MS);
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task) {
+    (void)task;
+    return 1;
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action) {
+    if (task == NULL) {
+        return pdFAIL;
+    }
+    std::lock_guard<std::mutex> lock(task_lock);
+    switch (action) {
+    case eSetBits: task->bits |= value; break;
+    case eIncrement: task->bits ++; break;
+    case eSetValueWithOverwrite:
+    case eSetValueWithoutOverwrite: task->bits = value; break;
+    default: break;
+    }
+    task_cv.notify_all();
+    return pdPASS;
+}
+
+// Only portMAX_DELAY and 0 are supported
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t *value, TickType_t ticks) {
+    host_task *t = current_task;
+    std::unique_lock<std::mutex> lock(task_lock);
+    t->bits &= ~clear_on_entry;
+    if (t->bits == 0 && ticks == 0) {
+        return pdFALSE;
+    }
+    t->waiting = true;
+    task_cv.notify_all();
+    task_cv.wait(lock, [t]() { return t->bits != 0; });
+    t->waiting = false;
+    if (value != NULL) {
+        *value = t->bits;
+    }
+    t->bits &= ~clear_on_exit;
+    return pdTRUE;
+}
+
+void host_idle(void) {
+    std::unique_lock<std::mutex> lock(task_lock);
+    task_cv.wait(lock, []() {
+        for (host_task *t : tasks) {
+            if (!t->waiting || t->bits != 0) {
+                return false;
+            }
+        }
+        return true;
+    });
+}
+
+/* Queues */
+
+struct host_queue {
+    std::mutex lock;
+    std::deque<std::vector<uint8_t>> items;
+    size_t length;
+    size_t size;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    host_queue *q = new host_queue;
+    q->length = length;
+    q->size = item_size;
+    return q;
+}
+
+// Never blocks, a full queue fails at once
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks) {
+    (void)ticks;
+    std::lock_guard<std::mutex> lock(queue->lock);
+    if (queue->items.size() >= queue->length) {
+        return pdFAIL;
+    }
+    const uint8_t *p = (const uint8_t *)item;
+    queue->items.emplace_back(p, p + queue->size);
+    return pdPASS;
+}
+
+// Never blocks, an empty queue fails at once
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks) {
+    (void)ticks;
+    std::lock_guard<std::mutex> lock(queue->lock);
+    if (queue->items.empty()) {
+        return pdFAIL;
+    }
+    memcpy(item, queue->items.front().data(), queue->size);
+    queue->items.pop_front();
+    return pdPASS;
+}
+
+/* Timers */
+
+struct esp_timer {
+    esp_timer_create_args_t args;
+    bool active = false;
+    int64_t due = 0;
+    uint64_t period = 0;    // 0: one shot
+};
+
+static std::atomic<int64_t> now_us { 0 };
+static std::recursive_mutex timer_lock;
+static std::vector<esp_timer *> timers;
+
+int64_t esp_timer_get_time(void) {
+    return now_us.load();
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out) {
+    std::lock_guard<std::recursive_mutex> lock(timer_lock);
+    esp_timer *t = new esp_timer;
+    t->args = *args;
+    timers.push_back(t);
+    *out = t;
+    return ESP_OK;
+}
+
+static esp_err_t timer_start(esp_timer_handle_t timer, uint64_t timeout, uint64_t period) {
+    std::lock_guard<std::recursive_mutex> lock(timer_lock);
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->active = true;
+    timer->due = now_us.load() + (int64_t)timeout;
+    timer->period = period;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    return timer_start(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us) {
+    return timer_start(timer, period_us, period_us);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    std::lock_guard<std::recursive_mutex> lock(timer_lock);
+    if (timer == NULL || !timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->active = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    std::lock_guard<std::recursive_mutex> lock(timer_lock);
+    for (auto it = timers.begin(); it != timers.end(); it ++) {
+        if (*it == timer) {
+            timers.erase(it);
+            delete timer;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_INVALID_ARG;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer) {
+    std::lock_guard<std::recursive_mutex> lock(timer_lock);
+    return timer != NULL && timer->active;
+}
+
+void host_time_set(int64_t us) {
+    now_us.store(us);
+}
+
+void host_time_advance(int64_t us) {
+    int64_t target = now_us.load() + us;
+    while (1) {
+        esp_timer *next = nullptr;
+        esp_timer_cb_t cb = nullptr;
+        void *arg = nullptr;
+        {
+            std::lock_guard<std::recursive_mutex> lock(timer_lock);
+            for (esp_timer *t : timers) {
+                if (t->active && t->due <= target && (next == nullptr || t->due < next->due)) {
+                    next = t;
+                }
+            }
+            if (next == nullptr) {
+                break;
+            }
+            if (next->due > now_us.load()) {
+                now_us.store(next->due);
+            }
+            if (next->period != 0) {
+                next->due += next->period;
+            } else {
+                next->active = false;
+            }
+            cb = next->args.callback;
+            arg = next->args.arg;
+        }
+        cb(arg);
+        host_idle();
+    }
+    now_us.store(target);
+}
+
+uint64_t host_wall_ns(void) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* NVS */
+
+static std::mutex nvs_lock;
+static std::map<std::string, std::map<std::string, std::vector<uint8_t>>> nvs_data;
+static std::vector<std::string> nvs_handles;
+static uint32_t nvs_commit_count = 0;
+
+esp_err_t nvs_flash_init(void) {
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void) {
+    host_nvs_clear();
+    return ESP_OK;
+}
+
+void host_nvs_clear(void) {
+    std::lock_guard<std::mutex> lock(nvs_lock);
+    nvs_data.clear();
+    nvs_commit_count = 0;
+}
+
+uint32_t host_nvs_commits(void) {
+    std::lock_guard<std::mutex> lock(nvs_lock);
+    return nvs_commit_count;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *out) {
+    std::lock_guard<std::mutex> lock(nvs_lock);
+    if (mode == NVS_READONLY && nvs_data.count(name) == 0) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    nvs_data[name];
+    nvs_handles.push_back(name);
+    *out = nvs_handles.size();
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle) {
+    (void)handle;
+}
+
+static std::map<std::string, std::vector<uint8_t>>& nvs_ns(nvs_handle_t handle) {
+    return nvs_data[nvs_handles.at(handle - 1)];
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out, size_t *len) {
+    std::lock_guard<std::mutex> lock(nvs_lock);
+    auto& ns = nvs_ns(handle);
+    auto it = ns.find(key);
+    if (it == ns.end()) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (out == NULL) {
+        *len = it->second.size();
+        return ESP_OK;
+    }
+    if (*len < it->second.size()) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(out, it->second.data(), it->second.size());
+    *len = it->second.size();
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t len) {
+    std::lock_guard<std::mutex> lock(nvs_lock);
+    const uint8_t *p = (const uint8_t *)value;
+    nvs_ns(handle)[key].assign(p, p + len);
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out, size_t *len) {
+    return nvs_get_blob(handle, key, out, len);
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value) {
+    return nvs_set_blob(handle, key, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out) {
+    size_t len = sizeof(*out);
+    return nvs_get_blob(handle, key, out, &len);
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value) {
+    return nvs_set_blob(handle, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+    std::lock_guard<std::mutex> lock(nvs_lock);
+    return (nvs_ns(handle).erase(key) != 0) ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    (void)handle;
+    std::lock_guard<std::mutex> lock(nvs_lock);
+    nvs_commit_count ++;
+    return ESP_OK;
+}
+
+/* cJSON */
+
+cJSON *cJSON_Parse(const char *value) {
+    (void)value;
+    return NULL;
+}
+
+void cJSON_Delete(cJSON *item) {
+    (void)item;
+}
+
+cJSON *cJSON_GetObjectItem(const cJSON *object, const char *string) {
+    (void)object;
+    (void)string;
+    return NULL;
+}
+
+int cJSON_IsString(const cJSON *item) {
+    (void)item;
+    return 0;
+}
+
+int cJSON_IsNumber(const cJSON *item) {
+    (void)item;
+    return 0;
+}
+
+/* Checks */
+
+static std::atomic<int> failures { 0 };
+
+bool host_check(bool ok, const char *expr, const char *file, int line) {
+    if (!ok) {
+        fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expr);
+        failures ++;
+    }
+    return ok;
+}
+
+int host_test_failures(void) {
+    return failures.load();
+}
+
+void host_test_exit(void) {
+    int n = failures.load();
+    printf("%s: %d check(s) failed\n", (n == 0) ? "PASS" : "FAIL", n);
+    fflush(stdout);
+    fflush(stderr);
+    _exit((n == 0) ? 0 : 1);
+}
@@ -0,0 +1,209 @@
+// DispatcherUtils::parseAncsDate() and formatAncsDate(): malformed and boundary dates, a round trip
+// against gmtime_r() over the whole four-digit range, and parse throughput next to the string
+// compare it replaced.
+
+#include <cstdio>
+#include <string>
+#include <time.h>
+#include <vector>
+#include "DispatcherUtils.h"
+#include "host.h"
+
+static constexpr int64_t UNTOUCHED = 0x5A5A5A5A;
+
+static bool parse(const char *s, int64_t *t) {
+    *t = UNTOUCHED;
+    return DispatcherUtils::parseAncsDate(s, t);
+}
+
+static bool rejected(const char *s) {
+    int64_t t;
+    return !parse(s, &t) && t == UNTOUCHED;
+}
+
+static int64_t parsed(const char *s) {
+    int64_t t;
+    return parse(s, &t) ? t : DispatcherUtils::INVALID_TIME;
+}
+
+static void testMalformed(void) {
+    // Length and separator
+    CHECK(rejected(""));
+    CHECK(rejected("20240101T12000"));
+    CHECK(rejected("20240101T1200000"));
+    CHECK(rejected("20240101 120000"));
+    CHECK(rejected("20240101t120000"));
+    CHECK(rejected("2024010T1120000"));
+    CHECK(rejected("2024-01-01T1200"));
+
+    // Digits only around the separator
+    CHECK(rejected("2024010AT120000"));
+    CHECK(rejected("20240101T12000:"));
+    CHECK(rejected(" 0240101T120000"));
+    CHECK(rejected("20240101T-20000"));
+    CHECK(rejected("20240101T12000/"));
+
+    // Embedded null is part of the view, not an early end
+    int64_t t = UNTOUCHED;
+    CHECK(!DispatcherUtils::parseAncsDate(std::string_view("20240101T12000\0", 15), &t) && t == UNTOUCHED);
+}
+
+static void testRanges(void) {
+    CHECK(rejected("20240001T120000"));
+    CHECK(rejected("20241301T120000"));
+    CHECK(rejected("20240100T120000"));
+    CHECK(rejected("20240132T120000"));
+    CHECK(rejected("20240431T120000"));
+    CHECK(rejected("20241131T120000"));
+    CHECK(parsed("20241231T120000") != DispatcherUtils::INVALID_TIME);
+
+    CHECK(rejected("20240101T240000"));
+    CHECK(rejected("20240101T126000"));
+    CHECK(rejected("20240101T120061"));
+    CHECK(parsed("20240101T235959") != DispatcherUtils::INVALID_TIME);
+
+    // A leap second reads as the first second of the next minute
+    CHECK(parsed("20161231T235960") == parsed("20170101T000000"));
+}
+
+static void testLeapYears(void) {
+    CHECK(parsed("20240229T000000") == parsed("20240301T000000") - 86400);
+    CHECK(rejected("20230229T000000"));
+    CHECK(rejected("20240230T000000"));
+    CHECK(parsed("20000229T000000") != DispatcherUtils::INVALID_TIME);   // Divisible by 400
+    CHECK(rejected("19000229T000000"));                                  // By 100 only
+    CHECK(rejected("21000229T000000"));
+    CHECK(parsed("21000301T000000") - parsed("21000228T000000") == 86400);
+}
+
+static void testEpoch(void) {
+    CHECK(parsed("19700101T000000") == 0);
+    CHECK(parsed("19691231T235959") == -1);
+    CHECK(parsed("20380119T031408") == 2147483648LL);   // Past 32-bit time_t
+    CHECK(parsed("00000101T000000") == -62167219200LL);
+    CHECK(parsed("99991231T235959") == 253402300799LL);
+
+    char out[16];
+    DispatcherUtils::formatAncsDate(DispatcherUtils::INVALID_TIME, out);
+    CHECK(strcmp(out, "-") == 0);
+    DispatcherUtils::formatAncsDate(-1, out);
+    CHECK(strcmp(out, "19691231T235959") == 0);
+}
+
+static uint64_t rng_state = 0x2545F4914F6CDD1DULL;
+
+static uint64_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static bool gmtimeDate(int64_t t, char out[16]) {
+    time_t tt = (time_t)t;
+    struct tm tm;
+    return gmtime_r(&tt, &tm) != nullptr && strftime(out, 16, "%Y%m%dT%H%M%S", &tm) == 15;
+}
+
+/**@brief Random times from year 0 to 9999, and every day boundary from 1900 to 2100.
+ *
+ * @details gmtime_r() gives the reference string, which must parse back to the time and match
+ *          what formatAncsDate() writes for it.
+ */
+static void testRoundTrip(void) {
+    constexpr int64_t FIRST = -62167219200LL;   // 00000101T000000
+    constexpr int64_t LAST = 253402300799LL;    // 99991231T235959
+    std::vector<int64_t> times;
+    for (int i = 0; i < 200000; i ++) {
+        times.push_back(FIRST + (int64_t)(rng() % (uint64_t)(LAST - FIRST + 1)));
+    }
+    for (int64_t day = -25567; day <= 47482; day ++) {         // 19000101 to 21000101
+        times.push_back(day * 86400);
+        times.push_back(day * 86400 - 1);
+    }
+    times.push_back(FIRST);
+    times.push_back(LAST);
+
+    int failures = 0;
+    for (int64_t t : times) {
+        char ref[16], out[16];
+        int64_t back;
+        if (!gmtimeDate(t, ref)) {
+            continue; // Years before 1000 are not zero-padded by every libc
+        }
+        DispatcherUtils::formatAncsDate(t, out);
+        bool ok = strcmp(ref, out) == 0 && DispatcherUtils::parseAncsDate(ref, &back) && back == t;
+        if (!ok && failures ++ < 5) {
+            printf("  %lld: gmtime %s, formatted %s\n", (long long)t, ref, out);
+        }
+    }
+    CHECK(failures == 0);
+    printf("round trip: %zu times\n", times.size());
+}
+
+// Integer order is the order of the strings, as the lexicographic compares were
+static void testOrder(void) {
+    int mismatches = 0;
+    for (int i = 0; i < 100000; i ++) {
+        int64_t a = (int64_t)(rng() % 4102444800ULL), b = a + (int64_t)(rng() % 200000) - 100000;
+        char sa[16], sb[16];
+        DispatcherUtils::formatAncsDate(a, sa);
+        DispatcherUtils::formatAncsDate(b, sb);
+        int byString = strcmp(sa, sb);
+        int64_t ta, tb;
+        DispatcherUtils::parseAncsDate(sa, &ta);
+        DispatcherUtils::parseAncsDate(sb, &tb);
+        mismatches += ((byString < 0) != (ta < tb) || (byString == 0) != (ta == tb)) ? 1 : 0;
+    }
+    CHECK(mismatches == 0);
+}
+
+static void benchParse(void) {
+    constexpr int N = 1000000;
+    std::vector<std::string> dates(1024);
+    for (size_t i = 0; i < dates.size(); i ++) {
+        char s[16];
+        DispatcherUtils::formatAncsDate(1700000000 + (int64_t)(rng() % 200000000), s);
+        dates[i] = s;
+    }
+
+    volatile int64_t sink = 0;
+    uint64_t start = host_wall_ns();
+    for (int i = 0; i < N; i ++) {
+        int64_t t;
+        DispatcherUtils::parseAncsDate(dates[i & 1023], &t);
+        sink = sink + t;
+    }
+    double parseNs = (double)(host_wall_ns() - start) / N;
+
+    volatile int sinkCmp = 0;
+    start = host_wall_ns();
+    for (int i = 0; i < N; i ++) {
+        sinkCmp = sinkCmp + (dates[i & 1023].compare(dates[(i + 1) & 1023]) > 0);
+    }
+    double compareNs = (double)(host_wall_ns() - start) / N;
+
+    std::vector<int64_t> times(1024);
+    for (size_t i = 0; i < times.size(); i ++) {
+        DispatcherUtils::parseAncsDate(dates[i], &times[i]);
+    }
+    start = host_wall_ns();
+    for (int i = 0; i < N; i ++) {
+        sinkCmp = sinkCmp + (times[i & 1023] > times[(i + 1) & 1023]);
+    }
+    double intNs = (double)(host_wall_ns() - start) / N;
+
+    printf("parse: %.1f ns per date (%.1f M/s), string compare %.1f ns, integer compare %.1f ns\n",
+           parseNs, 1000.0 / parseNs, compareNs, intNs);
+}
+
+int main(void) {
+    testMalformed();
+    testRanges();
+    testLeapYears();
+    testEpoch();
+    testRoundTrip();
+    testOrder();
+    benchParse();
+    host_test_exit();
+}
@@ -0,0 +1,593 @@
+// Differential test of ble_ancs_parse_get_attrs_response() against the per-byte parser it replaced.
+//
+// Generated Get Notification Attributes and Get App Attributes responses are fed to the reference in
+// one piece, and to the span parser split at every boundary, every pair of boundaries (sampled for
+// long responses) and one byte at a time. The events, their attribute bytes, the attribute buffers
+// and the final parse state must be identical.
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "ble_ancs_utils.h"
+#include "host.h"
+
+#define TAG "ANCSREF"
+
+#define MAX_EVTS        16
+#define MAX_BUF         64
+#define MAX_RESPONSE    512
+#define NB_SCENARIOS    400
+
+/* ---- Reference: the per-byte parser as it was before attribute data was parsed in spans ---- */
+
+static uint32_t ref_uint32_decode(const uint8_t * p_encoded_data)
+{
+    return ( (((uint32_t)((uint8_t *)p_encoded_data)[0]) << 0)  |
+             (((uint32_t)((uint8_t *)p_encoded_data)[1]) << 8)  |
+             (((uint32_t)((uint8_t *)p_encoded_data)[2]) << 16) |
+             (((uint32_t)((uint8_t *)p_encoded_data)[3]) << 24 ));
+}
+
+static bool ref_attr_is_requested(ble_ancs_c_t * p_ancs, ble_ancs_c_attr_t attr)
+{
+    if (p_ancs->parse_info.p_attr_list[attr.attr_id].get == true)
+    {
+        return true;
+    }
+    return false;
+}
+
+static ble_ancs_c_parse_state_t ref_command_id_parse(ble_ancs_c_t  * p_ancs,
+                                                     const uint8_t * p_data_src,
+                                                     uint32_t      * index)
+{
+    ble_ancs_c_parse_state_t parse_state;
+
+    p_ancs->parse_info.command_id = (ble_ancs_c_cmd_id_val_t) p_data_src[(*index)++];
+
+    switch (p_ancs->parse_info.command_id)
+    {
+        case BLE_ANCS_COMMAND_ID_GET_NOTIF_ATTRIBUTES:
+            p_ancs->evt.evt_type = BLE_ANCS_C_EVT_NOTIF_ATTRIBUTE;
+            p_ancs->parse_info.p_attr_list  = p_ancs->ancs_notif_attr_list;
+            p_ancs->parse_info.nb_of_attr   = BLE_ANCS_NB_OF_NOTIF_ATTR;
+            parse_state                     = BLE_ANCS_NOTIF_UID;
+            break;
+
+        case BLE_ANCS_COMMAND_ID_GET_APP_ATTRIBUTES:
+            p_ancs->evt.evt_type = BLE_ANCS_C_EVT_APP_ATTRIBUTE;
+            p_ancs->parse_info.p_attr_list  = p_ancs->ancs_app_attr_list;
+            p_ancs->parse_info.nb_of_attr   = BLE_ANCS_NB_OF_APP_ATTR;
+            parse_state                     = BLE_ANCS_APP_ID;
+            break;
+
+        default:
+            //no valid command_id, abort the rest of the parsing procedure.
+            ESP_LOGD(TAG, "Invalid Command ID");
+            parse_state = BLE_ANCS_ATTR_DONE;
+            break;
+    }
+    return parse_state;
+}
+
+// Reads all four bytes at once, the header is never split in the reference run
+static ble_ancs_c_parse_state_t ref_notif_uid_parse(ble_ancs_c_t  * p_ancs,
+                                                    const uint8_t * p_data_src,
+                                                    uint32_t      * index)
+{
+     p_ancs->evt.notif_uid = ref_uint32_decode(&p_data_src[*index]);
+     ESP_LOGD(TAG, "Notif UID %"PRIu32" ", p_ancs->evt.notif_uid);
+     *index               += sizeof(uint32_t);
+     return BLE_ANCS_ATTR_ID;
+}
+
+static ble_ancs_c_parse_state_t ref_app_id_parse(ble_ancs_c_t  * p_ancs,
+                                                 const uint8_t * p_data_src,
+                                                 uint32_t      * index)
+{
+    p_ancs->evt.app_id[p_ancs->parse_info.current_app_id_index] = p_data_src[(*index)++];
+
+    if (p_ancs->evt.app_id[p_ancs->parse_info.current_app_id_index] != '\0')
+    {
+        p_ancs->parse_info.current_app_id_index++;
+        return BLE_ANCS_APP_ID;
+    }
+    else
+    {
+        return BLE_ANCS_ATTR_ID;
+    }
+}
+
+static ble_ancs_c_parse_state_t ref_attr_id_parse(ble_ancs_c_t  * p_ancs,
+                                                  const uint8_t * p_data_src,
+                                                  uint32_t      * index)
+{
+    p_ancs->evt.attr.attr_id     = p_data_src[(*index)++];
+
+    if (p_ancs->evt.attr.attr_id >= p_ancs->parse_info.nb_of_attr)
+    {
+        ESP_LOGD(TAG, "Attribute ID Invalid.");
+        return BLE_ANCS_ATTR_DONE;
+    }
+    p_ancs->evt.attr.p_attr_data = p_ancs->parse_info.p_attr_list[p_ancs->evt.attr.attr_id].p_attr_data;
+
+    if (ble_ancs_all_req_attrs_parsed(p_ancs))
+    {
+        ESP_LOGD(TAG, "All requested attributes received. ");
+        return BLE_ANCS_ATTR_DONE;
+    }
+    else
+    {
+        if (ref_attr_is_requested(p_ancs, p_ancs->evt.attr))
+        {
+            p_ancs->parse_info.expected_number_of_attrs--;
+        }
+        ESP_LOGD(TAG, "Attribute ID %"PRIu32" ", p_ancs->evt.attr.attr_id);
+        return BLE_ANCS_ATTR_LEN1;
+    }
+}
+
+static ble_ancs_c_parse_state_t ref_attr_len1_parse(ble_ancs_c_t * p_ancs, const uint8_t * p_data_src, uint32_t * index)
+{
+    p_ancs->evt.attr.attr_len = p_data_src[(*index)++];
+    return BLE_ANCS_ATTR_LEN2;
+}
+
+static ble_ancs_c_parse_state_t ref_attr_len2_parse(ble_ancs_c_t * p_ancs, const uint8_t * p_data_src, uint32_t * index)
+{
+    p_ancs->evt.attr.attr_len |= (p_data_src[(*index)++] << 8);
+    p_ancs->parse_info.current_attr_index = 0;
+
+    if (p_ancs->evt.attr.attr_len != 0)
+    {
+        //If the attribute has a length but there is no allocated space for this attribute
+        if ((p_ancs->parse_info.p_attr_list[p_ancs->evt.attr.attr_id].attr_len == 0) ||
+           (p_ancs->parse_info.p_attr_list[p_ancs->evt.attr.attr_id].p_attr_data == NULL))
+        {
+            return BLE_ANCS_ATTR_SKIP;
+        }
+        else
+        {
+            return BLE_ANCS_ATTR_DATA;
+        }
+    }
+    else
+    {
+
+        ESP_LOGD(TAG, "Attribute LEN %u ", p_ancs->evt.attr.attr_len);
+        if (ref_attr_is_requested(p_ancs, p_ancs->evt.attr))
+        {
+            p_ancs->evt_handler(&p_ancs->evt, p_ancs->ctx);
+        }
+        if (ble_ancs_all_req_attrs_parsed(p_ancs))
+        {
+            return BLE_ANCS_ATTR_DONE;
+        }
+        else
+        {
+            return BLE_ANCS_ATTR_ID;
+        }
+    }
+}
+
+static ble_ancs_c_parse_state_t ref_attr_data_parse(ble_ancs_c_t  * p_ancs,
+                                                    const uint8_t * p_data_src,
+                                                    uint32_t      * index)
+{
+    // We have not reached the end of the attribute, nor our max allocated internal size.
+    // Proceed with copying data over to our buffer.
+    if (   (p_ancs->parse_info.current_attr_index < p_ancs->parse_info.p_attr_list[p_ancs->evt.attr.attr_id].attr_len)
+        && (p_ancs->parse_info.current_attr_index < p_ancs->evt.attr.attr_len))
+    {
+        p_ancs->evt.attr.p_attr_data[p_ancs->parse_info.current_attr_index++] = p_data_src[(*index)++];
+    }
+
+    // We have reached the end of the attribute, or our max allocated internal size.
+    // Stop copying data over to our buffer. NUL-terminate at the current index.
+    if ( (p_ancs->parse_info.current_attr_index == p_ancs->evt.attr.attr_len) ||
+         (p_ancs->parse_info.current_attr_index == p_ancs->parse_info.p_attr_list[p_ancs->evt.attr.attr_id].attr_len - 1))
+    {
+        if (ref_attr_is_requested(p_ancs, p_ancs->evt.attr))
+        {
+            p_ancs->evt.attr.p_attr_data[p_ancs->parse_info.current_attr_index] = '\0';
+        }
+
+        // If our max buffer size is smaller than the remaining attribute data, we must
+        // increase index to skip the data until the start of the next attribute.
+        if (p_ancs->parse_info.current_attr_index < p_ancs->evt.attr.attr_len)
+        {
+            return BLE_ANCS_ATTR_SKIP;
+        }
+        ESP_LOGD(TAG, "Attribute finished!");
+        if (ref_attr_is_requested(p_ancs, p_ancs->evt.attr))
+        {
+            p_ancs->evt_handler(&p_ancs->evt, p_ancs->ctx);
+        }
+        if (ble_ancs_all_req_attrs_parsed(p_ancs))
+        {
+            return BLE_ANCS_ATTR_DONE;
+        }
+        else
+        {
+            return BLE_ANCS_ATTR_ID;
+        }
+    }
+    return BLE_ANCS_ATTR_DATA;
+}
+
+static ble_ancs_c_parse_state_t ref_attr_skip(ble_ancs_c_t * p_ancs, const uint8_t * p_data_src, uint32_t * index)
+{
+    if (p_ancs->parse_info.current_attr_index < p_ancs->evt.attr.attr_len)
+    {
+        p_ancs->parse_info.current_attr_index++;
+        (*index)++;
+    }
+    // At the end of the attribute, determine if it should be passed to event handler and
+    // continue parsing the next attribute ID if we are not done with all the attributes.
+    if (p_ancs->parse_info.current_attr_index == p_ancs->evt.attr.attr_len)
+    {
+        if (ref_attr_is_requested(p_ancs, p_ancs->evt.attr))
+        {
+            p_ancs->evt_handler(&p_ancs->evt, p_ancs->ctx);
+        }
+        if (ble_ancs_all_req_attrs_parsed(p_ancs))
+        {
+            return BLE_ANCS_ATTR_DONE;
+        }
+        else
+        {
+            return BLE_ANCS_ATTR_ID;
+        }
+    }
+    return BLE_ANCS_ATTR_SKIP;
+}
+
+static void ref_parse_get_attrs_response(ble_ancs_c_t  * p_ancs,
+                                         const uint8_t * p_data_src,
+                                         const uint16_t  hvx_data_len)
+{
+    uint32_t index;
+
+    for (index = 0; index < hvx_data_len;)
+    {
+        switch (p_ancs->parse_info.parse_state)
+        {
+            case BLE_ANCS_COMMAND_ID:
+                p_ancs->parse_info.parse_state = ref_command_id_parse(p_ancs, p_data_src, &index);
+                break;
+
+            case BLE_ANCS_NOTIF_UID:
+                p_ancs->parse_info.parse_state = ref_notif_uid_parse(p_ancs, p_data_src, &index);
+                break;
+
+            case BLE_ANCS_APP_ID:
+                p_ancs->parse_info.parse_state = ref_app_id_parse(p_ancs, p_data_src, &index);
+                break;
+
+            case BLE_ANCS_ATTR_ID:
+                p_ancs->parse_info.parse_state = ref_attr_id_parse(p_ancs, p_data_src, &index);
+                break;
+
+            case BLE_ANCS_ATTR_LEN1:
+                p_ancs->parse_info.parse_state = ref_attr_len1_parse(p_ancs, p_data_src, &index);
+                break;
+
+            case BLE_ANCS_ATTR_LEN2:
+                p_ancs->parse_info.parse_state = ref_attr_len2_parse(p_ancs, p_data_src, &index);
+                break;
+
+            case BLE_ANCS_ATTR_DATA:
+                p_ancs->parse_info.parse_state = ref_attr_data_parse(p_ancs, p_data_src, &index);
+                break;
+
+            case BLE_ANCS_ATTR_SKIP:
+                p_ancs->parse_info.parse_state = ref_attr_skip(p_ancs, p_data_src, &index);
+                break;
+
+            case BLE_ANCS_ATTR_DONE:
+                index = hvx_data_len;
+                break;
+
+            default:
+                p_ancs->parse_info.parse_state = BLE_ANCS_ATTR_DONE;
+                break;
+        }
+    }
+}
+
+/* ---- Recording clients ---- */
+
+typedef struct {
+    ble_ancs_c_evt_type_t evt_type;
+    uint32_t notif_uid;
+    char app_id[BLE_ANCS_APP_ID_MAX];
+    uint32_t attr_id;
+    uint16_t attr_len;
+    uint8_t data[MAX_BUF];      // The whole attribute buffer at the time of the event
+} rec_evt_t;
+
+typedef struct {
+    ble_ancs_c_t ancs;
+    uint8_t notif_bufs[BLE_ANCS_NB_OF_NOTIF_ATTR][MAX_BUF];
+    uint8_t app_buf[MAX_BUF];
+    rec_evt_t evts[MAX_EVTS];
+    int nb_evts;
+    bool overflow;
+} client_t;
+
+static void record_evt(ble_ancs_c_evt_t * p_evt, void *ctx)
+{
+    client_t *c = ctx;
+    if (c->nb_evts == MAX_EVTS) {
+        c->overflow = true;
+        return;
+    }
+    rec_evt_t *r = &c->evts[c->nb_evts++];
+    memset(r, 0, sizeof(*r));
+    r->evt_type = p_evt->evt_type;
+    r->notif_uid = p_evt->notif_uid;
+    memcpy(r->app_id, p_evt->app_id, sizeof(r->app_id));
+    r->attr_id = p_evt->attr.attr_id;
+    r->attr_len = p_evt->attr.attr_len;
+    if (p_evt->attr.p_attr_data != NULL) {
+        memcpy(r->data, p_evt->attr.p_attr_data, MAX_BUF);
+    }
+}
+
+typedef struct {
+    bool app;                                   // Get App Attributes, else Get Notification Attributes
+    uint16_t buf_len[BLE_ANCS_NB_OF_NOTIF_ATTR]; // 0: attribute not requested
+    uint8_t response[MAX_RESPONSE];
+    uint16_t len;
+} scenario_t;
+
+static void client_reset(client_t *c, const scenario_t *s)
+{
+    memset(c, 0, sizeof(*c));
+    memset(c->notif_bufs, 0xA5, sizeof(c->notif_bufs));
+    memset(c->app_buf, 0xA5, sizeof(c->app_buf));
+    c->ancs.ctx = c;
+    c->ancs.evt_handler = record_evt;
+
+    uint8_t cmd[64];
+    if (s->app) {
+        ble_ancs_add_app_attr(&c->ancs, BLE_ANCS_APP_ATTR_ID_DISPLAY_NAME, c->app_buf, s->buf_len[0]);
+        ble_ancs_build_app_attrs_request(&c->ancs, "com.example.app", cmd, sizeof(cmd));
+    } else {
+        for (uint32_t id = 0; id < BLE_ANCS_NB_OF_NOTIF_ATTR; id ++) {
+            if (s->buf_len[id] != 0) {
+                ble_ancs_add_notif_attr(&c->ancs, id, c->notif_bufs[id], s->buf_len[id]);
+            }
+        }
+        ble_ancs_build_notif_attrs_request(&c->ancs, 0, cmd, sizeof(cmd));
+    }
+    c->ancs.parse_info.parse_state = BLE_ANCS_COMMAND_ID;
+}
+
+/* ---- Generated responses ---- */
+
+static uint32_t rng_state = 0x2545F491;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static uint32_t rng_range(uint32_t lo, uint32_t hi)
+{
+    return lo + rng() % (hi - lo + 1);
+}
+
+static bool put_attr(scenario_t *s, uint8_t id, uint16_t len)
+{
+    if (s->len + 3 + len > MAX_RESPONSE) {
+        return false;
+    }
+    s->response[s->len++] = id;
+    s->response[s->len++] = len & 0xFF;
+    s->response[s->len++] = len >> 8;
+    for (uint16_t i = 0; i < len; i ++) {
+        s->response[s->len++] = (uint8_t)rng_range(' ', '~');
+    }
+    return true;
+}
+
+// Lengths around the buffer size, where the copy, the terminator and the skip meet
+static uint16_t pick_len(uint16_t buf_len)
+{
+    switch (rng() % 6) {
+    case 0: return 0;
+    case 1: return rng_range(1, buf_len);
+    case 2: return buf_len > 1 ? buf_len - 1 : 1;
+    case 3: return buf_len;
+    case 4: return buf_len + 1;
+    default: return rng_range(1, 120);
+    }
+}
+
+static void make_scenario(scenario_t *s)
+{
+    memset(s, 0, sizeof(*s));
+    s->app = (rng() % 5) == 0;
+
+    if (s->app) {
+        s->buf_len[0] = rng_range(2, MAX_BUF);
+        s->response[s->len++] = BLE_ANCS_COMMAND_ID_GET_APP_ATTRIBUTES;
+        int id_len = snprintf((char *)&s->response[s->len], 40, "com.example.app%" PRIu32, rng() % 1000);
+        s->len += id_len + 1;
+        put_attr(s, BLE_ANCS_APP_ATTR_ID_DISPLAY_NAME, pick_len(s->buf_len[0]));
+    } else {
+        uint8_t order[BLE_ANCS_NB_OF_NOTIF_ATTR];
+        bool any = false;
+        for (uint32_t id = 0; id < BLE_ANCS_NB_OF_NOTIF_ATTR; id ++) {
+            if (rng() % 2) {
+                s->buf_len[id] = rng_range(2, MAX_BUF);
+                any = true;
+            }
+            order[id] = id;
+        }
+        if (!any) {
+            s->buf_len[BLE_ANCS_NOTIF_ATTR_ID_TITLE] = rng_range(2, MAX_BUF);
+        }
+        for (uint32_t i = BLE_ANCS_NB_OF_NOTIF_ATTR - 1; i > 0; i --) {
+            uint32_t j = rng() % (i + 1);
+            uint8_t t = order[i];
+            order[i] = order[j];
+            order[j] = t;
+        }
+
+        s->response[s->len++] = BLE_ANCS_COMMAND_ID_GET_NOTIF_ATTRIBUTES;
+        uint32_t uid = rng();
+        for (int i = 0; i < 4; i ++) {
+            s->response[s->len++] = (uid >> (8 * i)) & 0xFF;
+        }
+        for (uint32_t i = 0; i < BLE_ANCS_NB_OF_NOTIF_ATTR; i ++) {
+            uint8_t id = order[i];
+            if (rng() % 16 == 0) {
+                s->response[s->len++] = BLE_ANCS_NB_OF_NOTIF_ATTR + rng() % 8; // Invalid, ends parsing
+            }
+            // Unrequested attributes are sent now and then, they are skipped
+            if (s->buf_len[id] != 0 || rng() % 4 == 0) {
+                put_attr(s, id, pick_len(s->buf_len[id] ? s->buf_len[id] : 16));
+            }
+        }
+    }
+
+    // The Notification Provider may stop at any point after the header
+    uint16_t header = s->app ? 1 : 5;
+    if (rng() % 8 == 0 && s->len > header) {
+        s->len = rng_range(header, s->len - 1);
+    }
+}
+
+/* ---- Comparison ---- */
+
+static bool same_result(const client_t *ref, const client_t *dut)
+{
+    if (ref->overflow || dut->overflow || ref->nb_evts != dut->nb_evts) {
+        return false;
+    }
+    for (int i = 0; i < ref->nb_evts; i ++) {
+        const rec_evt_t *a = &ref->evts[i];
+        const rec_evt_t *b = &dut->evts[i];
+        if (a->evt_type != b->evt_type || a->attr_id != b->attr_id || a->attr_len != b->attr_len ||
+            memcmp(a->data, b->data, MAX_BUF) != 0) {
+            return false;
+        }
+        if (a->evt_type == BLE_ANCS_C_EVT_NOTIF_ATTRIBUTE ? a->notif_uid != b->notif_uid
+                                                          : strcmp(a->app_id, b->app_id) != 0) {
+            return false;
+        }
+    }
+    return memcmp(ref->notif_bufs, dut->notif_bufs, sizeof(ref->notif_bufs)) == 0 &&
+           memcmp(ref->app_buf, dut->app_buf, sizeof(ref->app_buf)) == 0 &&
+           ref->ancs.parse_info.parse_state == dut->ancs.parse_info.parse_state;
+}
+
+static client_t ref_client;
+static client_t dut_client;
+static uint32_t nb_runs;
+
+// Feeds the response to the span parser in fragments ending at the given offsets
+static bool check_split(const scenario_t *s, const uint16_t *cuts, int nb_cuts, int scenario)
+{
+    client_reset(&dut_client, s);
+    uint16_t start = 0;
+    for (int i = 0; i <= nb_cuts; i ++) {
+        uint16_t end = (i < nb_cuts) ? cuts[i] : s->len;
+        ble_ancs_parse_get_attrs_response(&dut_client.ancs, &s->response[start], end - start);
+        start = end;
+    }
+    nb_runs ++;
+
+    if (!CHECK(same_result(&ref_client, &dut_client))) {
+        printf("scenario %d, %u bytes, cuts:", scenario, s->len);
+        for (int i = 0; i < nb_cuts; i ++) {
+            printf(" %u", cuts[i]);
+        }
+        printf("\n");
+        return false;
+    }
+    return true;
+}
+
+static void check_scenario(const scenario_t *s, int scenario)
+{
+    client_reset(&ref_client, s);
+    ref_parse_get_attrs_response(&ref_client.ancs, s->response, s->len);
+
+    // Whole, and split at every boundary
+    for (uint16_t a = 0; a <= s->len; a ++) {
+        if (!check_split(s, &a, 1, scenario)) {
+            return;
+        }
+    }
+
+    // Split at every pair of boundaries, or a sample of them for a long response
+    if (s->len <= 96) {
+        for (uint16_t a = 1; a < s->len; a ++) {
+            for (uint16_t b = a + 1; b < s->len; b ++) {
+                uint16_t cuts[2] = { a, b };
+                if (!check_split(s, cuts, 2, scenario)) {
+                    return;
+                }
+            }
+        }
+    } else {
+        for (int i = 0; i < 300; i ++) {
+            uint16_t a = rng_range(1, s->len - 2);
+            uint16_t cuts[2] = { a, rng_range(a + 1, s->len - 1) };
+            if (!check_split(s, cuts, 2, scenario)) {
+                return;
+            }
+        }
+    }
+
+    // One byte at a time
+    uint16_t cuts[MAX_RESPONSE];
+    for (uint16_t i = 1; i < s->len; i ++) {
+        cuts[i - 1] = i;
+    }
+    check_split(s, cuts, s->len > 1 ? s->len - 1 : 0, scenario);
+}
+
+// A response that fills the attribute buffer exactly, split inside the UID and the length fields
+static void check_fixed(void)
+{
+    scenario_t s;
+    memset(&s, 0, sizeof(s));
+    s.buf_len[BLE_ANCS_NOTIF_ATTR_ID_TITLE] = 8;
+    s.buf_len[BLE_ANCS_NOTIF_ATTR_ID_MESSAGE] = 4;
+    static const uint8_t response[] = {
+        BLE_ANCS_COMMAND_ID_GET_NOTIF_ATTRIBUTES, 0x78, 0x56, 0x34, 0x12,
+        BLE_ANCS_NOTIF_ATTR_ID_TITLE, 7, 0, 'a', 'b', 'c', 'd', 'e', 'f', 'g',
+        BLE_ANCS_NOTIF_ATTR_ID_MESSAGE, 6, 0, 'h', 'i', 'j', 'k', 'l', 'm',
+    };
+    memcpy(s.response, response, sizeof(response));
+    s.len = sizeof(response);
+    check_scenario(&s, -1);
+
+    CHECK(dut_client.nb_evts == 2);
+    CHECK(dut_client.evts[0].notif_uid == 0x12345678);
+    CHECK(strcmp((char *)dut_client.notif_bufs[BLE_ANCS_NOTIF_ATTR_ID_TITLE], "abcdefg") == 0);
+    CHECK(strcmp((char *)dut_client.notif_bufs[BLE_ANCS_NOTIF_ATTR_ID_MESSAGE], "hij") == 0);
+    CHECK(dut_client.ancs.parse_info.parse_state == BLE_ANCS_ATTR_DONE);
+}
+
+int main(void)
+{
+    check_fixed();
+
+    static scenario_t s;
+    for (int i = 0; i < NB_SCENARIOS && host_test_failures() == 0; i ++) {
+        make_scenario(&s);
+        check_scenario(&s, i);
+    }
+    printf("%d scenarios, %" PRIu32 " fragmented runs compared\n", NB_SCENARIOS, nb_runs);
+    host_test_exit();
+}
@@ -0,0 +1,278 @@
+// AttrRequestScheduler: priority order, drop-lowest when full, coalescing, defer and backoff, and the
+// replay of a 200 notification burst with urgent ones mixed in, against the FIFO it replaced.
+
+#include <cstdio>
+#include <deque>
+#include <vector>
+#include "AttrRequestScheduler.h"
+#include "host.h"
+
+static constexpr uint8_t IMPORTANT = 1 << BLE_ANCS_EVENT_FLAG_IMPORTANT;
+
+static AttrRequest req(uint32_t uid, uint8_t category = BLE_ANCS_CATEGORY_ID_OTHER, uint8_t flags = 0,
+                       AttrRequest::Stage stage = AttrRequest::HEADER) {
+    return AttrRequest { uid, stage, category, flags, false };
+}
+
+static uint32_t serve(AttrRequestScheduler& s, int64_t now = 0) {
+    AttrRequest *r = s.next(now);
+    if (r == nullptr) {
+        return 0;
+    }
+    uint32_t uid = r->uid;
+    s.complete(uid);
+    return uid;
+}
+
+static void testPriorityOrder(void) {
+    static AttrRequestScheduler s;
+    s.clear();
+    s.setDepth(1);
+    s.push(req(1), 0);
+    s.push(req(2, BLE_ANCS_CATEGORY_ID_MISSED_CALL), 0);
+    s.push(req(3), 0);
+    s.push(req(4, BLE_ANCS_CATEGORY_ID_OTHER, IMPORTANT), 0);
+    s.push(req(5, BLE_ANCS_CATEGORY_ID_INCOMING_CALL), 0);
+    s.push(req(6, BLE_ANCS_CATEGORY_ID_OTHER, 0, AttrRequest::FULL), 0);
+
+    // Levels from sdkconfig: incoming call 7, on demand 6, missed call 5, important 4, default 1
+    static const uint32_t expected[] = { 5, 6, 2, 4, 3, 1 };
+    for (uint32_t uid : expected) {
+        CHECK(serve(s) == uid);
+    }
+    CHECK(s.empty());
+    CHECK(s.urgentStarted == 4);
+
+    // A request in flight is not preempted, and a pipeline of two fills in rank order
+    s.setDepth(2);
+    s.push(req(10), 0);
+    CHECK(s.next(0)->uid == 10);
+    s.push(req(11), 0);
+    s.push(req(12, BLE_ANCS_CATEGORY_ID_INCOMING_CALL), 0);
+    CHECK(s.next(0)->uid == 12);
+    CHECK(s.next(0) == nullptr);
+    CHECK(s.full() && s.inFlightCount() == 2);
+    s.setReserved(1); // An app name request takes a place of the pipeline
+    s.complete(10);
+    CHECK(s.full() && s.next(0) == nullptr);
+    s.setReserved(0);
+    CHECK(s.next(0)->uid == 11);
+}
+
+static void testDropLowestWhenFull(void) {
+    static AttrRequestScheduler s;
+    s.clear();
+    s.setDepth(1);
+    for (uint32_t uid = 100; uid < 100 + AttrRequestScheduler::CAPACITY; uid ++) {
+        CHECK(s.push(req(uid), 0));
+    }
+    CHECK(s.size() == AttrRequestScheduler::CAPACITY);
+    CHECK(s.next(0)->uid == 100 + AttrRequestScheduler::CAPACITY - 1);
+
+    // An older default one ranks below everything queued, it is the one dropped
+    CHECK(!s.push(req(50), 0));
+    CHECK(!s.holds(50));
+    CHECK(s.dropped == 1);
+
+    // An urgent one takes the place of the oldest pending, never of the one in flight
+    CHECK(s.push(req(40, BLE_ANCS_CATEGORY_ID_INCOMING_CALL), 0));
+    CHECK(s.holds(40) && !s.holds(100));
+    CHECK(s.dropped == 2);
+    CHECK(s.size() == AttrRequestScheduler::CAPACITY);
+
+    // A newer default one displaces the oldest default
+    CHECK(s.push(req(1000), 0));
+    CHECK(!s.holds(101) && s.holds(1000));
+
+    // Everything held is still served, urgent first, then newest first
+    s.complete(100 + AttrRequestScheduler::CAPACITY - 1);
+    CHECK(serve(s) == 40);
+    CHECK(serve(s) == 1000);
+    uint32_t last = UINT32_MAX;
+    size_t n = 0;
+    for (uint32_t uid; (uid = serve(s)) != 0; n ++) {
+        CHECK(uid < last && uid >= 102);
+        last = uid;
+    }
+    CHECK(n == AttrRequestScheduler::CAPACITY - 3);
+}
+
+static void testCoalescing(void) {
+    static AttrRequestScheduler s;
+    s.clear();
+    s.setDepth(2);
+
+    // A repeated event merges into the pending request, keeping the better level
+    s.push(req(1), 0);
+    s.push(req(2, BLE_ANCS_CATEGORY_ID_OTHER, IMPORTANT), 0);
+    s.push(req(1, BLE_ANCS_CATEGORY_ID_MISSED_CALL), 0);
+    s.push(req(1), 0);
+    CHECK(s.size() == 2 && s.coalesced == 2);
+    AttrRequest *r = s.next(0);
+    CHECK(r->uid == 1 && r->category == BLE_ANCS_CATEGORY_ID_OTHER);
+
+    // A header fetch in flight covers a new event for its UID
+    CHECK(s.push(req(1), 0));
+    CHECK(s.size() == 2 && s.coalesced == 3);
+
+    // A body fetch in flight does not, the new request waits until the body completes
+    CHECK(s.next(0)->uid == 2);
+    s.complete(1);
+    s.complete(2);
+    CHECK(s.empty());
+    s.pushNext(req(3, BLE_ANCS_CATEGORY_ID_OTHER, 0, AttrRequest::BODY), 0);
+    CHECK(s.next(0)->stage == AttrRequest::BODY);
+    s.push(req(3), 0);
+    CHECK(s.size() == 2);
+    CHECK(s.next(0) == nullptr);
+    s.complete(3);
+    r = s.next(0);
+    CHECK(r != nullptr && r->uid == 3 && r->stage == AttrRequest::HEADER);
+    s.complete(3);
+
+    // A pending full message fetch restarts from the header on a new event
+    s.push(req(4, BLE_ANCS_CATEGORY_ID_OTHER, 0, AttrRequest::FULL), 0);
+    s.push(req(4), 0);
+    CHECK(s.next(0)->stage == AttrRequest::HEADER);
+    s.complete(4);
+
+    // A continuation replaces the pending request for its UID
+    s.push(req(5), 0);
+    s.pushNext(req(5, BLE_ANCS_CATEGORY_ID_OTHER, 0, AttrRequest::BODY), 0);
+    CHECK(s.size() == 1);
+    CHECK(s.next(0)->stage == AttrRequest::BODY);
+    s.complete(5);
+
+    // Cancel drops a pending request, and only marks one in flight
+    s.push(req(6), 0);
+    s.push(req(7), 0);
+    CHECK(s.next(0)->uid == 7);
+    CHECK(s.cancel(6) && !s.holds(6));
+    CHECK(s.cancel(7) && s.inFlightCancelled(7));
+    CHECK(!s.cancel(7));
+    CHECK(s.cancelled == 2);
+    CHECK(s.complete(7) && s.empty());
+}
+
+static void testDeferBackoff(void) {
+    static AttrRequestScheduler s;
+    s.clear();
+    s.setDepth(1);
+
+    s.pushNext(req(1, BLE_ANCS_CATEGORY_ID_OTHER, 0, AttrRequest::BODY), 0);
+    CHECK(s.next(0)->uid == 1);
+    CHECK(s.nextDue() == 0);
+    CHECK(s.defer(1, 100, 1000));
+    CHECK(s.nextDue() == 1100);
+
+    // It backs off while others are served, and comes back from its header
+    s.push(req(2), 200);
+    CHECK(serve(s, 200) == 2);
+    CHECK(s.next(1099) == nullptr);
+    AttrRequest *r = s.next(1100);
+    CHECK(r != nullptr && r->uid == 1 && r->stage == AttrRequest::HEADER && r->attempts == 1);
+    CHECK(s.nextDue() == 0);
+
+    // A full message fetch is retried as is
+    s.complete(1);
+    s.push(req(3, BLE_ANCS_CATEGORY_ID_OTHER, 0, AttrRequest::FULL), 0);
+    s.next(0);
+    CHECK(s.defer(3, 0, 10));
+    r = s.next(10);
+    CHECK(r->stage == AttrRequest::FULL && r->attempts == 1);
+
+    // Cancelled, or superseded by a newer event: the request goes away instead
+    s.cancel(3);
+    CHECK(!s.defer(3, 10, 10) && s.empty());
+    s.push(req(4), 0);
+    s.next(0);
+    s.push(req(4, BLE_ANCS_CATEGORY_ID_OTHER, 0, AttrRequest::FULL), 0);
+    CHECK(s.size() == 1); // The header in flight covers it
+    s.complete(4);
+    s.pushNext(req(4, BLE_ANCS_CATEGORY_ID_OTHER, 0, AttrRequest::BODY), 0);
+    s.next(0);
+    s.push(req(4), 0);
+    CHECK(!s.defer(4, 0, 10));
+    CHECK(s.size() == 1 && s.next(0)->stage == AttrRequest::HEADER);
+    CHECK(!s.defer(99, 0, 10));
+}
+
+/**@brief Replay of 200 pre-existing notifications on reconnect, faster than they can be served.
+ *
+ * @details Events arrive four per request time, two of them are an incoming and a missed call late
+ *          in the burst. Each request takes one unit to complete, with two in flight. The urgent
+ *          ones must start within a pipeline's worth of time of their arrival, where the FIFO made
+ *          them wait behind the whole backlog.
+ */
+static void testBurstReplay(void) {
+    static constexpr uint32_t BURST = 200;
+    static constexpr uint32_t PER_TICK = 4;
+    static constexpr uint32_t CALL_UID = 1150;
+    static constexpr uint32_t MISSED_UID = 1120;
+    static AttrRequestScheduler s;
+    s.clear();
+    s.setDepth(AttrRequestScheduler::MAX_DEPTH);
+
+    std::vector<uint32_t> sent;     // Last request time, complete at the next one
+    std::vector<uint32_t> backlog;  // Default ones fetched once the burst is over, in order
+    std::deque<uint32_t> fifo;      // The FIFO it replaced, same depth and service time, unbounded
+    size_t fetched = 0;
+    bool missedFetched = false;
+    int64_t callArrival = -1;
+    int64_t callStart = -1;
+    int64_t fifoCallStart = -1;
+    uint32_t next = 0;
+
+    for (int64_t tick = 0; next < BURST || !s.empty() || !fifo.empty(); tick ++) {
+        for (uint32_t uid : sent) {
+            s.complete(uid);
+        }
+        sent.clear();
+
+        for (uint32_t i = 0; i < PER_TICK && next < BURST; i ++, next ++) {
+            uint32_t uid = 1000 + next;
+            uint8_t category = (uid == CALL_UID) ? BLE_ANCS_CATEGORY_ID_INCOMING_CALL :
+                               (uid == MISSED_UID) ? BLE_ANCS_CATEGORY_ID_MISSED_CALL : BLE_ANCS_CATEGORY_ID_SOCIAL;
+            s.push(req(uid, category, 1 << BLE_ANCS_EVENT_FLAG_PREEXISTING), tick);
+            fifo.push_back(uid);
+            callArrival = (uid == CALL_UID) ? tick : callArrival;
+        }
+
+        while (AttrRequest *r = s.next(tick)) {
+            sent.push_back(r->uid);
+            fetched ++;
+            callStart = (r->uid == CALL_UID) ? tick : callStart;
+            missedFetched |= (r->uid == MISSED_UID);
+            if (next == BURST && !AttrRequestScheduler::urgent(*r)) {
+                backlog.push_back(r->uid);
+            }
+        }
+        for (size_t i = 0; i < AttrRequestScheduler::MAX_DEPTH && !fifo.empty(); i ++) {
+            fifoCallStart = (fifo.front() == CALL_UID) ? tick : fifoCallStart;
+            fifo.pop_front();
+        }
+    }
+
+    CHECK(callStart >= 0 && callStart - callArrival <= 1);
+    CHECK(missedFetched);
+    CHECK(s.urgentStarted == 2);
+    CHECK(fetched + s.dropped == BURST);
+    // The backlog left once the burst is over goes newest first
+    CHECK(!backlog.empty());
+    for (size_t i = 1; i < backlog.size(); i ++) {
+        CHECK(backlog[i] < backlog[i - 1]);
+    }
+
+    printf("burst of %u: %zu fetched, %u dropped, incoming call sent %lld request time(s) after "
+           "arrival, %lld with the FIFO\n", BURST, fetched, s.dropped,
+           (long long)(callStart - callArrival), (long long)(fifoCallStart - callArrival));
+}
+
+int main(void) {
+    testPriorityOrder();
+    testDropLowestWhenFull();
+    testCoalescing();
+    testDeferBackoff();
+    testBurstReplay();
+    host_test_exit();
+}
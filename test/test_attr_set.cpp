@@ -0,0 +1,98 @@
+// Get Notification Attributes frames built at compile time by AttrSet, with the UID patched in as
+// ancs_send_attrs_request does, against ble_ancs_encode_notif_attrs_request on the equivalent
+// attribute list: the stage sets of the Dispatcher, then every set of attributes, byte for byte,
+// with the attribute count the parser is told to expect.
+
+#include <cstdio>
+#include <cstring>
+#include "AttrSet.h"
+#include "Notification.h"
+#include "ble_ancs_utils.h"
+#include "host.h"
+
+static const uint32_t UIDS[] = { 0, 1, 0x1234, 0x80000001, UINT32_MAX };
+
+// As DispatcherDriverInterface.cpp requests them
+static constexpr AttrSet headerAttrs = AttrSet()
+    .with(BLE_ANCS_NOTIF_ATTR_ID_APP_IDENTIFIER)
+    .with(BLE_ANCS_NOTIF_ATTR_ID_DATE);
+
+static constexpr AttrSet auxAttrs = AttrSet()
+    .with(BLE_ANCS_NOTIF_ATTR_ID_TITLE, detail::attrCapacity[BLE_ANCS_NOTIF_ATTR_ID_TITLE])
+    .with(BLE_ANCS_NOTIF_ATTR_ID_SUBTITLE, detail::attrCapacity[BLE_ANCS_NOTIF_ATTR_ID_SUBTITLE])
+    .with(BLE_ANCS_NOTIF_ATTR_ID_MESSAGE, NotificationBuffer::PREVIEW_MAX)
+    .with(BLE_ANCS_NOTIF_ATTR_ID_MESSAGE_SIZE);
+
+static constexpr AttrSet fullAttrs = AttrSet()
+    .with(BLE_ANCS_NOTIF_ATTR_ID_MESSAGE, NotificationBuffer::STREAMED_MAX)
+    .with(BLE_ANCS_NOTIF_ATTR_ID_MESSAGE_SIZE);
+
+// Encoded by the compiler, or these would not build
+static constexpr ancs_attr_frame_t headerFrame = headerAttrs.frame();
+static constexpr ancs_attr_frame_t auxFrame = auxAttrs.frame();
+static constexpr ancs_attr_frame_t fullFrame = fullAttrs.frame();
+static_assert(headerFrame.len == 1 + 4 + 2 && headerFrame.count == 2, "Header frame");
+static_assert(fullFrame.len == 1 + 4 + 3 + 1 && fullFrame.count == 2, "Full message frame");
+
+static bool matches(const AttrSet& set, const ancs_attr_frame_t& frame, uint32_t uid) {
+    ble_ancs_c_attr_list_t list[BLE_ANCS_NB_OF_NOTIF_ATTR] {};
+    for (uint32_t id = 0; id < BLE_ANCS_NB_OF_NOTIF_ATTR; id ++) {
+        list[id].get = set.has(id);
+        list[id].attr_id = id;
+        list[id].attr_len = set.maxLen[id];
+    }
+    uint8_t expected[ANCS_ATTR_FRAME_MAX];
+    uint32_t count = 0;
+    uint32_t len = ble_ancs_encode_notif_attrs_request(list, uid, expected, sizeof(expected), &count);
+
+    uint8_t sent[ANCS_ATTR_FRAME_MAX];
+    memcpy(sent, frame.data, frame.len);
+    uint8_t *p_uid = &sent[ANCS_ATTR_FRAME_UID_OFFSET];
+    p_uid[0] = (uint8_t)uid;
+    p_uid[1] = (uint8_t)(uid >> 8);
+    p_uid[2] = (uint8_t)(uid >> 16);
+    p_uid[3] = (uint8_t)(uid >> 24);
+
+    return len != 0 && frame.len == len && frame.count == count && frame.mask == set.mask &&
+           memcmp(sent, expected, len) == 0;
+}
+
+/* ---- Stage sets ---- */
+
+static void testStages(void) {
+    for (uint32_t uid : UIDS) {
+        CHECK(matches(headerAttrs, headerFrame, uid));
+        CHECK(matches(auxAttrs, auxFrame, uid));
+        CHECK(matches(fullAttrs, fullFrame, uid));
+    }
+}
+
+/* ---- Every set ---- */
+
+// Each attribute on or off, text attributes with a length that needs both bytes
+static void testEverySet(void) {
+    uint32_t sets = 0;
+    for (uint32_t mask = 0; mask < (1u << BLE_ANCS_NB_OF_NOTIF_ATTR); mask ++) {
+        AttrSet set;
+        for (uint32_t id = 0; id < BLE_ANCS_NB_OF_NOTIF_ATTR; id ++) {
+            if ((mask & (1u << id)) != 0) {
+                uint16_t len = AttrSet::hasLength(id) ? (uint16_t)(0x0100 * id + 0x21) : 0;
+                set = set.with((ble_ancs_c_notif_attr_id_val_t)id, len);
+            }
+        }
+        ancs_attr_frame_t frame = set.frame();
+        CHECK(frame.len <= ANCS_ATTR_FRAME_MAX);
+        for (uint32_t uid : UIDS) {
+            CHECK(matches(set, frame, uid));
+        }
+        sets ++;
+    }
+    printf("%u attribute sets, %u UIDs each, frames match the encoder\n", (unsigned)sets,
+           (unsigned)(sizeof(UIDS) / sizeof(UIDS[0])));
+}
+
+int main(void) {
+    testStages();
+    testEverySet();
+    host_test_exit();
+}
@@ -0,0 +1,135 @@
+// Attributes streamed into StreamPool blocks as the ANCS parser hands them over, one GATT packet at a
+// time: chunks for another UID or out of sequence dropped, an attribute started over at offset 0,
+// the pool running out part way through a 4096-byte message, and every block back on close.
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "AttrStream.h"
+#include "host.h"
+
+static constexpr uint16_t CHUNK = 185 - 3;  // Data Source packet at an ATT MTU of 185
+static constexpr size_t MESSAGE_LEN = 4096;
+
+static StreamPool& pool = StreamPool::instance();
+
+static std::vector<uint8_t> message(size_t len, uint8_t seed) {
+    std::vector<uint8_t> m(len);
+    for (size_t i = 0; i < len; i ++) {
+        m[i] = (uint8_t)(seed + i * 7);
+    }
+    return m;
+}
+
+// All of it in packets from offset on, true if none was dropped
+static bool feed(AttrStream& s, uint32_t uid, const std::vector<uint8_t>& m, size_t offset = 0) {
+    bool all = true;
+    for (size_t off = offset; off < m.size(); off += CHUNK) {
+        size_t n = (m.size() - off < CHUNK) ? m.size() - off : CHUNK;
+        all &= s.append(uid, (uint16_t)off, &m[off], n);
+    }
+    return all;
+}
+
+static bool holds(const AttrStream& s, const std::vector<uint8_t>& m, size_t len) {
+    std::vector<uint8_t> out(StreamPool::BLOCKS * StreamPool::BLOCK_SIZE);
+    return s.length() == len && s.copy(out.data(), out.size()) == len && memcmp(out.data(), m.data(), len) == 0;
+}
+
+/* ---- Sequence ---- */
+
+static void testWhole(void) {
+    AttrStream s;
+    std::vector<uint8_t> m = message(MESSAGE_LEN, 1);
+    CHECK(!s.append(11, 0, m.data(), CHUNK));   // Not open
+    s.open(11);
+    CHECK(feed(s, 11, m));
+    CHECK(holds(s, m, MESSAGE_LEN) && !s.truncated());
+    CHECK(pool.freeBlocks() == StreamPool::BLOCKS - MESSAGE_LEN / StreamPool::BLOCK_SIZE);
+
+    // Copy cut to what the caller has room for
+    uint8_t preview[100];
+    CHECK(s.copy(preview, sizeof(preview)) == sizeof(preview) && memcmp(preview, m.data(), sizeof(preview)) == 0);
+    s.close();
+    CHECK(pool.freeBlocks() == StreamPool::BLOCKS);
+}
+
+// A late response to a request given up, for the UID the stream was opened with before
+static void testOtherUid(void) {
+    AttrStream s;
+    std::vector<uint8_t> stale = message(500, 2), m = message(500, 3);
+    s.open(21);
+    s.open(22);
+    CHECK(!feed(s, 21, stale));
+    CHECK(s.length() == 0 && pool.freeBlocks() == StreamPool::BLOCKS);
+    CHECK(feed(s, 22, m));
+    CHECK(holds(s, m, m.size()));
+}
+
+// A packet lost or repeated: what follows the gap is dropped, what came before is kept
+static void testOutOfSequence(void) {
+    AttrStream s;
+    std::vector<uint8_t> m = message(1000, 4);
+    s.open(31);
+    CHECK(s.append(31, 0, m.data(), CHUNK));
+    CHECK(!s.append(31, 2 * CHUNK, &m[2 * CHUNK], CHUNK));
+    CHECK(!s.append(31, CHUNK / 2, &m[CHUNK / 2], CHUNK));
+    CHECK(holds(s, m, CHUNK));
+    CHECK(!feed(s, 31, m, 2 * CHUNK));
+    CHECK(holds(s, m, CHUNK));
+}
+
+// The phone answers a repeated request from the start: only the second copy is kept
+static void testRestart(void) {
+    AttrStream s;
+    std::vector<uint8_t> first = message(700, 5), second = message(400, 6);
+    s.open(41);
+    CHECK(feed(s, 41, first));
+    CHECK(feed(s, 41, second));
+    CHECK(holds(s, second, second.size()) && !s.truncated());
+    s.close();
+    CHECK(pool.freeBlocks() == StreamPool::BLOCKS);
+}
+
+/* ---- Exhaustion ---- */
+
+// Other streams hold all but 31 blocks: the message is cut at a block boundary, the rest dropped
+static void testExhausted(void) {
+    static constexpr size_t LEFT = 31;
+    AttrStream other, s;
+    std::vector<uint8_t> held = message((StreamPool::BLOCKS - LEFT) * StreamPool::BLOCK_SIZE, 7);
+    std::vector<uint8_t> m = message(MESSAGE_LEN, 8);
+    other.open(51);
+    CHECK(feed(other, 51, held));
+    CHECK(pool.freeBlocks() == LEFT);
+
+    uint32_t exhausted = pool.exhausted;
+    s.open(52);
+    CHECK(!feed(s, 52, m));
+    CHECK(s.truncated() && pool.exhausted == exhausted + 1);
+    CHECK(holds(s, m, LEFT * StreamPool::BLOCK_SIZE));
+    CHECK(s.length() == 3968);
+    CHECK(pool.freeBlocks() == 0 && pool.highWater() == StreamPool::BLOCKS);
+    CHECK(holds(other, held, held.size()));
+
+    // Started over once blocks are back, whole this time
+    other.close();
+    CHECK(feed(s, 52, m));
+    CHECK(holds(s, m, MESSAGE_LEN) && !s.truncated());
+    s.close();
+    CHECK(pool.freeBlocks() == StreamPool::BLOCKS);
+}
+
+int main(void) {
+    CHECK(pool.freeBlocks() == StreamPool::BLOCKS && StreamPool::BLOCKS == 64);
+
+    testWhole();
+    testOtherUid();
+    testOutOfSequence();
+    testRestart();
+    testExhausted();
+    CHECK(pool.freeBlocks() == StreamPool::BLOCKS);
+    printf("%u blocks of %u bytes, %u in use at most\n", (unsigned)StreamPool::BLOCKS,
+           (unsigned)StreamPool::BLOCK_SIZE, (unsigned)pool.highWater());
+    host_test_exit();
+}
@@ -0,0 +1,241 @@
+// Advertising policy against the Bluedroid stand-in, in esp_timer time: the fast window after boot
+// and after every disconnection, bonded phones only while it lasts, slow and open to every phone
+// after it, the accept list rewritten only when the bonds really change, reconnection times of
+// bonded phones, and their statistics kept for the most recently seen ones.
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "ble_adv_policy.h"
+#include "esp_timer.h"
+#include "host.h"
+#include "host_bt.h"
+#include "sdkconfig.h"
+
+static constexpr int64_t WINDOW_US = CONFIG_NOWA_ADV_FAST_WINDOW_S * 1000000LL;
+static constexpr uint16_t FAST = CONFIG_NOWA_ADV_FAST_INTERVAL_MS * 8 / 5;
+static constexpr uint16_t SLOW = CONFIG_NOWA_ADV_SLOW_INTERVAL_MS * 8 / 5;
+static constexpr uint8_t STRANGER[6] = { 0x70, 0x00, 0x00, 0x00, 0x00, 0x01 };
+
+static std::vector<esp_ble_bond_dev_t> bonds;
+
+static esp_ble_bond_dev_t bond(uint8_t n, esp_ble_addr_type_t type) {
+    esp_ble_bond_dev_t b {};
+    uint8_t bda[6] = { 0x60, 0x11, 0x22, 0x33, 0x44, n };
+    memcpy(b.bd_addr, bda, sizeof(bda));
+    b.bond_key.pid_key.addr_type = type;
+    return b;
+}
+
+static void setBonds(uint8_t count) {
+    bonds.clear();
+    for (uint8_t n = 0; n < count; n ++) {
+        bonds.push_back(bond(n, (n % 2 == 0) ? BLE_ADDR_TYPE_PUBLIC : BLE_ADDR_TYPE_RANDOM));
+    }
+    host_bt_set_bonds(bonds.data(), (int)bonds.size());
+}
+
+static const uint8_t *phone(uint8_t n) {
+    return bonds[n].bd_addr;
+}
+
+static ble_adv_state_t state(void) {
+    ble_adv_state_t s;
+    ble_adv_policy_state(&s);
+    return s;
+}
+
+// Last advertising started by the policy
+static esp_ble_adv_params_t advertised(void) {
+    esp_ble_adv_params_t p {};
+    const host_bt_call_t *c = host_bt_last(HOST_BT_START_ADVERTISING);
+    CHECK(c != nullptr);
+    if (c != nullptr) {
+        memcpy(&p, c->data, sizeof(p));
+    }
+    return p;
+}
+
+static bool advertisingFast(bool filtered) {
+    esp_ble_adv_params_t p = advertised();
+    ble_adv_state_t s = state();
+    esp_ble_adv_filter_t policy = filtered ? ADV_FILTER_ALLOW_SCAN_ANY_CON_WLST : ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY;
+    return s.phase == BLE_ADV_PHASE_FAST && s.filtered == filtered && s.interval == FAST &&
+           p.adv_int_min == FAST && p.adv_int_max == FAST && p.adv_filter_policy == policy;
+}
+
+static bool advertisingSlow(void) {
+    esp_ble_adv_params_t p = advertised();
+    ble_adv_state_t s = state();
+    return s.phase == BLE_ADV_PHASE_SLOW && !s.filtered && s.interval == SLOW && s.fast_until == 0 &&
+           p.adv_int_min == SLOW && p.adv_int_max == SLOW && p.adv_filter_policy == ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY;
+}
+
+static ble_adv_peer_t peerOf(const uint8_t bda[6]) {
+    ble_adv_peer_t peers[BLE_ADV_POLICY_PEERS];
+    size_t n = ble_adv_policy_peers(peers, BLE_ADV_POLICY_PEERS);
+    for (size_t i = 0; i < n; i ++) {
+        if (memcmp(peers[i].bda, bda, 6) == 0) {
+            return peers[i];
+        }
+    }
+    return {};
+}
+
+/* ---- Phases ---- */
+
+// No bond yet: the window is open to every phone, then slow
+static void testBoot(void) {
+    ble_adv_policy_disconnected(STRANGER);
+    CHECK(host_bt_count(HOST_BT_START_ADVERTISING) == 0);  // Advertising data not configured yet
+
+    int64_t start = esp_timer_get_time();
+    ble_adv_policy_start();
+    CHECK(advertisingFast(false));
+    CHECK(state().fast_until == start + WINDOW_US && state().fast_windows == 1);
+    CHECK(host_bt_count(HOST_BT_CLEAR_WHITELIST) == 1 && host_bt_count(HOST_BT_UPDATE_WHITELIST) == 0);
+
+    host_time_advance(WINDOW_US - 1);
+    CHECK(advertisingFast(false));
+    host_time_advance(1);
+    CHECK(advertisingSlow());
+    CHECK(host_bt_count(HOST_BT_CLEAR_WHITELIST) == 1);
+}
+
+// A phone paired: on the accept list with the type of its identity address, and only once
+static void testBondsChanged(void) {
+    host_bt_reset();
+    setBonds(2);
+    ble_adv_policy_bonds_changed();
+    CHECK(host_bt_count(HOST_BT_STOP_ADVERTISING) == 1);
+    CHECK(host_bt_count(HOST_BT_CLEAR_WHITELIST) == 1 && host_bt_count(HOST_BT_UPDATE_WHITELIST) == 2);
+    for (uint8_t n = 0; n < 2; n ++) {
+        const host_bt_call_t *c = host_bt_call(HOST_BT_UPDATE_WHITELIST, n);
+        CHECK(memcmp(c->bda, phone(n), 6) == 0);
+        CHECK(c->handle == ((n == 0) ? BLE_WL_ADDR_TYPE_PUBLIC : BLE_WL_ADDR_TYPE_RANDOM));
+    }
+    CHECK(state().accept_list == 2);
+    CHECK(advertisingSlow());   // The window is not opened again for a new bond
+
+    // Same bonds, as after an encryption with an existing one: advertising left alone
+    uint32_t restarts = state().restarts;
+    ble_adv_policy_bonds_changed();
+    CHECK(state().restarts == restarts && host_bt_count(HOST_BT_START_ADVERTISING) == 1);
+    CHECK(host_bt_count(HOST_BT_CLEAR_WHITELIST) == 1);
+}
+
+// Bonds exist: the window after a disconnection only lets them in
+static void testFiltered(void) {
+    host_bt_reset();
+    ble_adv_policy_connected(phone(0));
+    CHECK(advertisingSlow());
+    int64_t t = esp_timer_get_time();
+    ble_adv_policy_disconnected(phone(0));
+    CHECK(advertisingFast(true));
+    CHECK(state().fast_until == t + WINDOW_US);
+    CHECK(host_bt_count(HOST_BT_CLEAR_WHITELIST) == 0);
+
+    // Another disconnection restarts the window
+    host_time_advance(WINDOW_US / 2);
+    ble_adv_policy_disconnected(STRANGER);
+    CHECK(state().fast_until == t + WINDOW_US / 2 + WINDOW_US);
+    host_time_advance(WINDOW_US - 1);
+    CHECK(advertisingFast(true));
+    host_time_advance(1);
+    CHECK(advertisingSlow());
+}
+
+/* ---- Reconnection times ---- */
+
+static void testReconnects(void) {
+    // Back within the window
+    ble_adv_policy_connected(phone(1));
+    ble_adv_policy_disconnected(phone(1));
+    host_time_advance(1500 * 1000);
+    ble_adv_policy_connected(phone(1));
+    ble_adv_peer_t p = peerOf(phone(1));
+    CHECK(p.reconnects == 1 && p.in_fast == 1 && p.last_us == 1500 * 1000);
+    CHECK(p.disconnected_at == 0 && p.seen_at == esp_timer_get_time());
+
+    // Back after it
+    ble_adv_policy_disconnected(phone(1));
+    host_time_advance(WINDOW_US + 10 * 1000000LL);
+    ble_adv_policy_connected(phone(1));
+    p = peerOf(phone(1));
+    CHECK(p.reconnects == 2 && p.in_fast == 1);
+    CHECK(p.min_us == 1500 * 1000 && p.max_us == WINDOW_US + 10 * 1000000LL && p.last_us == p.max_us);
+    CHECK(p.total_us == p.min_us + p.max_us);
+
+    // Connected without a disconnection first: nothing to time
+    ble_adv_policy_connected(phone(1));
+    CHECK(peerOf(phone(1)).reconnects == 2);
+
+    // A phone without a bond has no statistics
+    ble_adv_policy_disconnected(STRANGER);
+    ble_adv_policy_connected(STRANGER);
+    CHECK(peerOf(STRANGER).seen_at == 0);
+    ble_adv_policy_disconnected(phone(1));
+}
+
+/* ---- Peers ---- */
+
+// The most recently seen first, the least recently seen replaced once all slots are taken
+static void testPeers(void) {
+    static constexpr uint8_t PHONES = BLE_ADV_POLICY_PEERS + 2;
+    setBonds(PHONES);
+    ble_adv_policy_bonds_changed();
+    CHECK(state().accept_list == PHONES);
+    for (uint8_t n = 0; n < PHONES; n ++) {
+        host_time_advance(1000);
+        ble_adv_policy_connected(phone(n));
+        host_time_advance(1000);
+        ble_adv_policy_disconnected(phone(n));
+    }
+
+    ble_adv_peer_t peers[BLE_ADV_POLICY_PEERS];
+    CHECK(ble_adv_policy_peers(peers, BLE_ADV_POLICY_PEERS) == BLE_ADV_POLICY_PEERS);
+    for (uint8_t i = 0; i < BLE_ADV_POLICY_PEERS; i ++) {
+        CHECK(memcmp(peers[i].bda, phone(PHONES - 1 - i), 6) == 0);
+        CHECK(peers[i].disconnected_at == peers[i].seen_at);
+    }
+    CHECK(peerOf(phone(0)).seen_at == 0 && peerOf(phone(1)).seen_at == 0);
+
+    // Fewer asked for: still the most recent ones
+    CHECK(ble_adv_policy_peers(peers, 2) == 2);
+    CHECK(memcmp(peers[0].bda, phone(PHONES - 1), 6) == 0 && memcmp(peers[1].bda, phone(PHONES - 2), 6) == 0);
+}
+
+// Stopped: disconnections no longer restart advertising, the window timer is gone
+static void testStop(void) {
+    ble_adv_policy_stop();
+    host_bt_reset();
+    ble_adv_policy_disconnected(phone(2));
+    host_time_advance(2 * WINDOW_US);
+    CHECK(host_bt_count(HOST_BT_START_ADVERTISING) == 0);
+    CHECK(state().phase == BLE_ADV_PHASE_OFF);
+
+    // Bonds changed while stopped are taken in, the list is written when advertising starts again
+    setBonds(1);
+    ble_adv_policy_bonds_changed();
+    CHECK(host_bt_count(HOST_BT_CLEAR_WHITELIST) == 0);
+    ble_adv_policy_start();
+    CHECK(advertisingFast(true));
+    CHECK(host_bt_count(HOST_BT_UPDATE_WHITELIST) == 1);
+}
+
+int main(void) {
+    host_time_set(1000000);
+    esp_ble_adv_params_t base {};
+    base.adv_type = ADV_TYPE_IND;
+    base.channel_map = ADV_CHNL_ALL;
+    base.adv_filter_policy = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY;
+    CHECK(ble_adv_policy_init(&base) == ESP_OK);
+
+    testBoot();
+    testBondsChanged();
+    testFiltered();
+    testReconnects();
+    testPeers();
+    testStop();
+    host_test_exit();
+}
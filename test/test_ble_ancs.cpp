@@ -0,0 +1,778 @@
+// The ANCS driver against the Bluedroid stand-in: events of several phones routed to their
+// profiles through connect, disconnect and reconnect, MTU and data length negotiations that fall
+// back to the defaults when refused, pipelined attribute requests matched to their responses by
+// UID, requests that time out mid-response giving their buffers back, their late responses
+// dropped whole, and a link dropped when its subscription cannot be written.
+
+#include <array>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <string.h>
+#include <vector>
+#include "AttrSet.h"
+#include "ble_ancs.h"
+#include "ble_gatt_ops.h"
+#include "ble_handle_cache.h"
+#include "host.h"
+#include "host_bt.h"
+
+static_assert(ANCS_PROFILE_NUM >= 2, "Routing needs more than one profile");
+
+static constexpr esp_gatt_if_t GATTC_IF_BASE = 3;    // As Bluedroid numbers the apps
+
+static esp_gatt_if_t gattcIf(uint8_t idx) {
+    return GATTC_IF_BASE + idx;
+}
+
+struct Phone {
+    esp_bd_addr_t bda;
+    uint16_t conn_id;
+};
+
+static Phone phone(uint8_t n, uint16_t conn_id) {
+    return Phone { { 0xc4, 0x1e, 0x5a, 0x00, 0x00, n }, conn_id };
+}
+
+/* ---- Driver handlers ---- */
+
+struct Connect {
+    uint8_t idx;
+    esp_bd_addr_t bda;
+};
+
+struct Attribute {
+    uint32_t uid;
+    uint32_t id;
+    const uint8_t *data;
+    std::string value;
+};
+
+static struct {
+    std::vector<Connect> connects;
+    std::vector<uint8_t> disconnects;
+    std::vector<Attribute> attributes;
+    std::vector<uint32_t> done;
+    std::vector<std::pair<uint32_t, uint16_t>> errors;
+    std::vector<std::string> appNames;
+    std::vector<std::array<uint8_t, 6>> bondsRemoved;
+} events;
+
+// Attribute buffers of each request, by UID, as the Dispatcher gives one per request
+static constexpr uint16_t ATTR_BUFFER_SIZE = 64;
+using AttrBuffers = std::array<std::array<uint8_t, ATTR_BUFFER_SIZE>, BLE_ANCS_NB_OF_NOTIF_ATTR>;
+static std::map<uint32_t, AttrBuffers> buffers;
+// Buffers as the request gave them back with its error, free for another request from then on
+static std::map<uint32_t, AttrBuffers> released;
+// Time jumps past the attribute timeout within the next attribute event, mid-packet
+static bool expireOnAttribute;
+
+static void onConnect(void *, uint8_t idx, uint8_t bda[6]) {
+    Connect c { idx, {} };
+    memcpy(c.bda, bda, sizeof(c.bda));
+    events.connects.push_back(c);
+}
+
+static void onDisconnect(void *, uint8_t idx) {
+    events.disconnects.push_back(idx);
+}
+
+static uint8_t *onAttributeBuffer(void *, uint8_t, uint32_t uid, uint32_t attr_id, uint16_t *len) {
+    *len = ATTR_BUFFER_SIZE;
+    return buffers[uid][attr_id].data();
+}
+
+static void onAttribute(void *, uint8_t, uint32_t uid, ble_ancs_c_attr_t *attr) {
+    events.attributes.push_back({ uid, attr->attr_id, attr->p_attr_data, std::string((const char *)attr->p_attr_data, attr->attr_len) });
+    if (expireOnAttribute) {
+        expireOnAttribute = false;
+        host_time_advance(CONFIG_NOWA_ATTR_TIMEOUT_MS * 1000LL);
+    }
+}
+
+static void onAttributesDone(void *, uint8_t, uint32_t uid) {
+    events.done.push_back(uid);
+}
+
+static void onRequestError(void *, uint8_t, uint32_t uid, uint16_t status) {
+    events.errors.push_back({ uid, status });
+    if (buffers.count(uid) != 0) {
+        released[uid] = buffers[uid];
+    }
+}
+
+static void onAppName(void *, uint8_t, const char *name, uint16_t status) {
+    events.appNames.push_back((name != nullptr) ? name : "#" + std::to_string(status));
+}
+
+static void onBondRemoved(void *, uint8_t bda[6]) {
+    std::array<uint8_t, 6> a;
+    memcpy(a.data(), bda, a.size());
+    events.bondsRemoved.push_back(a);
+}
+
+/* ---- Stack events ---- */
+
+// Registration of every profile's app, as Bluedroid answers esp_ble_gattc_app_register()
+static void registerApps(void) {
+    for (uint32_t i = 0; i < host_bt_count(HOST_BT_APP_REGISTER); i ++) {
+        esp_ble_gattc_cb_param_t param {};
+        param.reg.status = ESP_GATT_OK;
+        param.reg.app_id = host_bt_call(HOST_BT_APP_REGISTER, i)->handle;
+        host_bt_gattc_event(ESP_GATTC_REG_EVT, gattcIf(param.reg.app_id), &param);
+    }
+}
+
+// Connect, disconnect and Service Changed reach every app, in no particular order
+static void linkEvent(esp_gattc_cb_event_t event, esp_ble_gattc_cb_param_t *param) {
+    for (int idx = ANCS_PROFILE_NUM - 1; idx >= 0; idx --) {
+        host_bt_gattc_event(event, gattcIf(idx), param);
+    }
+}
+
+/**@brief Link of a phone up, the profile it was bound to, -1 if none.
+ *
+ * @details The driver must tell the Dispatcher and open the GATT connection through the app of
+ *          that profile, or do neither.
+ */
+static int connect(const Phone& p) {
+    size_t connects = events.connects.size();
+    uint32_t opens = host_bt_count(HOST_BT_OPEN);
+
+    esp_ble_gattc_cb_param_t param {};
+    param.connect.conn_id = p.conn_id;
+    memcpy(param.connect.remote_bda, p.bda, sizeof(p.bda));
+    param.connect.conn_params.interval = 24;
+    param.connect.conn_params.timeout = 400;
+    linkEvent(ESP_GATTC_CONNECT_EVT, &param);
+
+    if (events.connects.size() == connects) {
+        CHECK(host_bt_count(HOST_BT_OPEN) == opens);
+        return -1;
+    }
+    const Connect& c = events.connects.back();
+    const host_bt_call_t *open = host_bt_last(HOST_BT_OPEN);
+    CHECK(events.connects.size() == connects + 1 && memcmp(c.bda, p.bda, sizeof(p.bda)) == 0);
+    CHECK(host_bt_count(HOST_BT_OPEN) == opens + 1);
+    CHECK(open->gattc_if == gattcIf(c.idx) && memcmp(open->bda, p.bda, sizeof(p.bda)) == 0);
+    return c.idx;
+}
+
+// Link of a phone down, the profile it was released from, -1 if none
+static int disconnect(const Phone& p) {
+    size_t disconnects = events.disconnects.size();
+
+    esp_ble_gattc_cb_param_t param {};
+    param.disconnect.conn_id = p.conn_id;
+    param.disconnect.reason = 0x13; // Remote user terminated
+    memcpy(param.disconnect.remote_bda, p.bda, sizeof(p.bda));
+    linkEvent(ESP_GATTC_DISCONNECT_EVT, &param);
+
+    if (events.disconnects.size() == disconnects) {
+        return -1;
+    }
+    CHECK(events.disconnects.size() == disconnects + 1);
+    return events.disconnects.back();
+}
+
+static void openGatt(uint8_t idx, const Phone& p) {
+    esp_ble_gattc_cb_param_t param {};
+    param.open.status = ESP_GATT_OK;
+    param.open.conn_id = p.conn_id;
+    memcpy(param.open.remote_bda, p.bda, sizeof(p.bda));
+    host_bt_gattc_event(ESP_GATTC_OPEN_EVT, gattcIf(idx), &param);
+}
+
+static void cfgMtu(esp_gatt_if_t gattc_if, const Phone& p, esp_gatt_status_t status, uint16_t mtu) {
+    esp_ble_gattc_cb_param_t param {};
+    param.cfg_mtu.status = status;
+    param.cfg_mtu.conn_id = p.conn_id;
+    param.cfg_mtu.mtu = mtu;
+    host_bt_gattc_event(ESP_GATTC_CFG_MTU_EVT, gattc_if, &param);
+}
+
+static void pktLength(esp_bt_status_t status, uint16_t tx, uint16_t rx) {
+    esp_ble_gap_cb_param_t param {};
+    param.pkt_data_length_cmpl.status = status;
+    param.pkt_data_length_cmpl.params.tx_len = tx;
+    param.pkt_data_length_cmpl.params.rx_len = rx;
+    host_bt_gap_event(ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT, &param);
+}
+
+static bool connected(uint8_t idx) {
+    ancs_link_info_t info;
+    return ancs_get_link_info(idx, &info);
+}
+
+static uint16_t mtuOf(uint8_t idx) {
+    ancs_link_info_t info {};
+    return ancs_get_link_info(idx, &info) ? info.mtu : 0;
+}
+
+/* ---- Routing ---- */
+
+/**@brief Phones bind the lowest free profile, their events reach that profile only, and a profile
+ *        freed by a disconnect serves the next phone with a fresh state.
+ */
+static void testRouting(void) {
+    Phone phones[ANCS_PROFILE_NUM + 1];
+    for (uint8_t i = 0; i <= ANCS_PROFILE_NUM; i ++) {
+        phones[i] = phone(i + 1, i);
+    }
+
+    for (uint8_t i = 0; i < ANCS_PROFILE_NUM; i ++) {
+        CHECK(connect(phones[i]) == i);
+        CHECK(connected(i));
+    }
+
+    // One phone too many is not served, and a link is bound once
+    Phone& extra = phones[ANCS_PROFILE_NUM];
+    CHECK(connect(extra) == -1);
+    CHECK(connect(phones[1]) == -1);
+
+    // GATT events go by the app: profile 1 opens and exchanges the MTU of its own phone
+    openGatt(1, phones[1]);
+    const host_bt_call_t *mtuReq = host_bt_last(HOST_BT_MTU_REQ);
+    CHECK(mtuReq != nullptr && mtuReq->gattc_if == gattcIf(1) && mtuReq->conn_id == phones[1].conn_id);
+    CHECK(memcmp(host_bt_last(HOST_BT_SET_ENCRYPTION)->bda, phones[1].bda, 6) == 0);
+    cfgMtu(gattcIf(1), phones[1], ESP_GATT_OK, 185);
+    CHECK(mtuOf(1) == 185);
+    for (uint8_t i = 0; i < ANCS_PROFILE_NUM; i ++) {
+        CHECK(i == 1 || mtuOf(i) == ANCS_DEFAULT_MTU);
+    }
+
+    // Events of an app the driver did not register go nowhere
+    cfgMtu(0x40, phones[0], ESP_GATT_OK, 247);
+    CHECK(mtuOf(0) == ANCS_DEFAULT_MTU);
+
+    // Link events count once, for the first app, however many apps report them
+    esp_ble_gattc_cb_param_t param {};
+    param.disconnect.conn_id = phones[0].conn_id;
+    host_bt_gattc_event(ESP_GATTC_DISCONNECT_EVT, gattcIf(1), &param);
+    CHECK(connected(0) && events.disconnects.empty());
+
+    // A disconnect frees its profile only, an unbound link has none to free
+    CHECK(disconnect(phones[1]) == 1);
+    CHECK(!connected(1) && connected(0));
+    CHECK(disconnect(extra) == -1);
+    CHECK(disconnect(phones[1]) == -1);
+
+    // The freed profile serves the next phone, on a new link, from the defaults
+    extra.conn_id = ANCS_PROFILE_NUM + 1;
+    CHECK(connect(extra) == 1);
+    ancs_link_info_t info;
+    CHECK(ancs_get_link_info(1, &info));
+    CHECK(info.mtu == ANCS_DEFAULT_MTU && info.mtu_state == ANCS_NEGOTIATION_PENDING);
+    openGatt(1, extra);
+    CHECK(host_bt_last(HOST_BT_MTU_REQ)->conn_id == extra.conn_id);
+    cfgMtu(gattcIf(1), extra, ESP_GATT_OK, 247);
+    CHECK(mtuOf(1) == 247);
+
+    // The lowest profile goes first: free 0 and the last one, the next phone takes 0
+    CHECK(disconnect(phones[ANCS_PROFILE_NUM - 1]) == ANCS_PROFILE_NUM - 1);
+    CHECK(disconnect(phones[0]) == 0);
+    Phone late = phone(0x20, ANCS_PROFILE_NUM + 2);
+    CHECK(connect(late) == 0);
+    CHECK(connect(phones[ANCS_PROFILE_NUM - 1]) == ANCS_PROFILE_NUM - 1);
+
+    // All gone, then a phone back on a link ID used before by another profile
+    CHECK(disconnect(late) == 0);
+    CHECK(disconnect(extra) == 1);
+    CHECK(disconnect(phones[ANCS_PROFILE_NUM - 1]) == ANCS_PROFILE_NUM - 1);
+    for (uint8_t i = 0; i < ANCS_PROFILE_NUM; i ++) {
+        CHECK(!connected(i));
+    }
+    phones[0].conn_id = extra.conn_id;
+    CHECK(connect(phones[0]) == 0);
+    CHECK(disconnect(phones[0]) == 0);
+    CHECK(events.connects.size() == events.disconnects.size());
+}
+
+/* ---- MTU and data length ---- */
+
+static ancs_link_info_t linkOf(uint8_t idx) {
+    ancs_link_info_t info {};
+    CHECK(ancs_get_link_info(idx, &info));
+    return info;
+}
+
+static bool dataLength(uint8_t idx, uint8_t state, uint16_t tx, uint16_t rx) {
+    ancs_link_info_t info = linkOf(idx);
+    return info.dle_state == state && info.tx_octets == tx && info.rx_octets == rx;
+}
+
+static bool lastDataLengthFor(const Phone& p) {
+    const host_bt_call_t *c = host_bt_last(HOST_BT_SET_PKT_DATA_LEN);
+    return c != nullptr && memcmp(c->bda, p.bda, sizeof(p.bda)) == 0 && c->handle == CONFIG_NOWA_DATA_LENGTH;
+}
+
+/**@brief Data length requests, one link at a time, through completions, refusals and links lost
+ *        mid-request, then MTU exchanges. A refused negotiation keeps ANCS_DEFAULT_DATA_LEN or
+ *        ANCS_DEFAULT_MTU and the driver goes on.
+ */
+static void testNegotiation(void) {
+    ancs_setup_stats_t before;
+    ancs_get_setup_stats(&before);
+    Phone a = phone(0x40, 0x40), b = phone(0x41, 0x41), c = phone(0x42, 0x42);
+    Phone d = phone(0x43, 0x43), e = phone(0x44, 0x44);
+
+    // The request of a phone gone since completes, there is nothing else to ask for
+    uint32_t asked = host_bt_count(HOST_BT_SET_PKT_DATA_LEN);
+    pktLength(ESP_BT_STATUS_SUCCESS, 251, 251);
+    CHECK(host_bt_count(HOST_BT_SET_PKT_DATA_LEN) == asked);
+
+    // Requests go one at a time, in profile order
+    CHECK(connect(a) == 0);
+    CHECK(host_bt_count(HOST_BT_SET_PKT_DATA_LEN) == asked + 1 && lastDataLengthFor(a));
+    CHECK(connect(b) == 1);
+    CHECK(connect(c) == 2);
+    CHECK(host_bt_count(HOST_BT_SET_PKT_DATA_LEN) == asked + 1);
+    CHECK(dataLength(1, ANCS_NEGOTIATION_PENDING, ANCS_DEFAULT_DATA_LEN, ANCS_DEFAULT_DATA_LEN));
+
+    pktLength(ESP_BT_STATUS_SUCCESS, 251, 251);
+    CHECK(dataLength(0, ANCS_NEGOTIATION_DONE, 251, 251));
+    CHECK(host_bt_count(HOST_BT_SET_PKT_DATA_LEN) == asked + 2 && lastDataLengthFor(b));
+
+    // Refused by the peer: defaults kept, the next link goes on
+    pktLength(ESP_BT_STATUS_FAIL, 0, 0);
+    CHECK(dataLength(1, ANCS_NEGOTIATION_REFUSED, ANCS_DEFAULT_DATA_LEN, ANCS_DEFAULT_DATA_LEN));
+    CHECK(host_bt_count(HOST_BT_SET_PKT_DATA_LEN) == asked + 3 && lastDataLengthFor(c));
+
+    // c goes away mid-request and b makes room, the new links wait for the completion
+    CHECK(disconnect(c) == 2);
+    CHECK(connect(d) == 2);
+    CHECK(disconnect(b) == 1);
+    CHECK(connect(e) == 1);
+    CHECK(host_bt_count(HOST_BT_SET_PKT_DATA_LEN) == asked + 3);
+
+    // The completion for c lands on no profile. The request for e is refused by the stack
+    // right away, so d is asked next
+    host_bt_fail(HOST_BT_SET_PKT_DATA_LEN, ESP_ERR_INVALID_STATE, 1);
+    pktLength(ESP_BT_STATUS_SUCCESS, 251, 251);
+    CHECK(dataLength(1, ANCS_NEGOTIATION_REFUSED, ANCS_DEFAULT_DATA_LEN, ANCS_DEFAULT_DATA_LEN));
+    CHECK(dataLength(2, ANCS_NEGOTIATION_PENDING, ANCS_DEFAULT_DATA_LEN, ANCS_DEFAULT_DATA_LEN));
+    CHECK(host_bt_count(HOST_BT_SET_PKT_DATA_LEN) == asked + 5 && lastDataLengthFor(d));
+
+    // Asymmetric lengths are taken as they come, then nothing is left to ask for
+    pktLength(ESP_BT_STATUS_SUCCESS, 200, 251);
+    CHECK(dataLength(2, ANCS_NEGOTIATION_DONE, 200, 251));
+    CHECK(dataLength(0, ANCS_NEGOTIATION_DONE, 251, 251));
+    CHECK(host_bt_count(HOST_BT_SET_PKT_DATA_LEN) == asked + 5);
+
+    ancs_setup_stats_t after;
+    ancs_get_setup_stats(&after);
+    CHECK(after.dle_refused - before.dle_refused == 2);
+
+    // MTU exchange on the same links: done on a, refused by the phone on e, and not even sent on d.
+    // Setup goes on to discovery on every one of them
+    uint32_t searches = host_bt_count(HOST_BT_SEARCH_SERVICE);
+    openGatt(0, a);
+    cfgMtu(gattcIf(0), a, ESP_GATT_OK, 247);
+    CHECK(linkOf(0).mtu == 247 && linkOf(0).mtu_state == ANCS_NEGOTIATION_DONE);
+    CHECK(host_bt_count(HOST_BT_SEARCH_SERVICE) == searches + 1 && host_bt_last(HOST_BT_SEARCH_SERVICE)->gattc_if == gattcIf(0));
+
+    openGatt(1, e);
+    cfgMtu(gattcIf(1), e, ESP_GATT_ERROR, 0);
+    CHECK(linkOf(1).mtu == ANCS_DEFAULT_MTU && linkOf(1).mtu_state == ANCS_NEGOTIATION_REFUSED);
+    CHECK(host_bt_count(HOST_BT_SEARCH_SERVICE) == searches + 2 && host_bt_last(HOST_BT_SEARCH_SERVICE)->gattc_if == gattcIf(1));
+
+    host_bt_fail(HOST_BT_MTU_REQ, ESP_FAIL, 1);
+    openGatt(2, d);
+    CHECK(linkOf(2).mtu == ANCS_DEFAULT_MTU && linkOf(2).mtu_state == ANCS_NEGOTIATION_REFUSED);
+    CHECK(host_bt_count(HOST_BT_SEARCH_SERVICE) == searches + 3 && host_bt_last(HOST_BT_SEARCH_SERVICE)->gattc_if == gattcIf(2));
+
+    ancs_get_setup_stats(&after);
+    CHECK(after.mtu_refused - before.mtu_refused == 2);
+
+    // A phone back starts over from the defaults, and is asked for its data length again
+    CHECK(disconnect(a) == 0);
+    CHECK(connect(a) == 0);
+    CHECK(linkOf(0).mtu == ANCS_DEFAULT_MTU && linkOf(0).mtu_state == ANCS_NEGOTIATION_PENDING);
+    CHECK(dataLength(0, ANCS_NEGOTIATION_PENDING, ANCS_DEFAULT_DATA_LEN, ANCS_DEFAULT_DATA_LEN));
+    CHECK(host_bt_count(HOST_BT_SET_PKT_DATA_LEN) == asked + 6 && lastDataLengthFor(a));
+    pktLength(ESP_BT_STATUS_SUCCESS, 251, 251);
+    CHECK(dataLength(0, ANCS_NEGOTIATION_DONE, 251, 251));
+
+    CHECK(disconnect(a) == 0);
+    CHECK(disconnect(e) == 1);
+    CHECK(disconnect(d) == 2);
+}
+
+/* ---- Pipelined attribute requests ---- */
+
+// Handles of the phone's ANCS, cached so that setup skips discovery
+static constexpr uint16_t NOTIFICATION_SOURCE = 0x2a;
+static constexpr uint16_t DATA_SOURCE = 0x2d;
+static constexpr uint16_t CONTROL_POINT = 0x30;
+static constexpr uint16_t PACKET = ANCS_DEFAULT_MTU - 3;
+
+static constexpr ancs_attr_frame_t frame = AttrSet()
+    .with(BLE_ANCS_NOTIF_ATTR_ID_TITLE, 32)
+    .with(BLE_ANCS_NOTIF_ATTR_ID_MESSAGE, 48)
+    .frame();
+
+static void cacheHandles(const Phone& p) {
+    ble_handle_cache_t c {};
+    c.version = BLE_HANDLE_CACHE_VERSION;
+    c.anc_start = 0x28;
+    c.anc_end = 0x34;
+    c.notification_source = NOTIFICATION_SOURCE;
+    c.notification_source_cccd = NOTIFICATION_SOURCE + 1;
+    c.data_source = DATA_SOURCE;
+    c.data_source_cccd = DATA_SOURCE + 1;
+    c.control_point = CONTROL_POINT;
+    CHECK(ble_handle_cache_save(p.bda, &c) == ESP_OK);
+}
+
+static void appendAttr(std::vector<uint8_t>& r, uint8_t id, const std::string& value) {
+    r.push_back(id);
+    r.push_back((uint8_t)value.size());
+    r.push_back((uint8_t)(value.size() >> 8));
+    r.insert(r.end(), value.begin(), value.end());
+}
+
+// Get Notification Attributes response, attributes in the order of the frame
+static std::vector<uint8_t> notifResponse(uint32_t uid, const std::string& title, const std::string& message) {
+    std::vector<uint8_t> r { BLE_ANCS_COMMAND_ID_GET_NOTIF_ATTRIBUTES,
+                             (uint8_t)uid, (uint8_t)(uid >> 8), (uint8_t)(uid >> 16), (uint8_t)(uid >> 24) };
+    appendAttr(r, BLE_ANCS_NOTIF_ATTR_ID_TITLE, title);
+    appendAttr(r, BLE_ANCS_NOTIF_ATTR_ID_MESSAGE, message);
+    return r;
+}
+
+static std::vector<uint8_t> appResponse(const std::string& appId, const std::string& name) {
+    std::vector<uint8_t> r { BLE_ANCS_COMMAND_ID_GET_APP_ATTRIBUTES };
+    r.insert(r.end(), appId.begin(), appId.end());
+    r.push_back('\0');
+    appendAttr(r, BLE_ANCS_APP_ATTR_ID_DISPLAY_NAME, name);
+    return r;
+}
+
+// Data Source notifications of up to PACKET bytes, as the phone sends a response
+static void dataSource(uint8_t idx, const Phone& p, std::vector<uint8_t> response) {
+    for (size_t at = 0; at < response.size(); at += PACKET) {
+        esp_ble_gattc_cb_param_t param {};
+        param.notify.conn_id = p.conn_id;
+        memcpy(param.notify.remote_bda, p.bda, sizeof(p.bda));
+        param.notify.handle = DATA_SOURCE;
+        param.notify.value = &response[at];
+        param.notify.value_len = (uint16_t)std::min<size_t>(PACKET, response.size() - at);
+        param.notify.is_notify = true;
+        host_bt_gattc_event(ESP_GATTC_NOTIFY_EVT, gattcIf(idx), &param);
+    }
+}
+
+// Write response of the oldest Control Point write not answered yet
+static void writeResponse(uint8_t idx, const Phone& p, esp_gatt_status_t status) {
+    esp_ble_gattc_cb_param_t param {};
+    param.write.status = status;
+    param.write.conn_id = p.conn_id;
+    param.write.handle = CONTROL_POINT;
+    host_bt_gattc_event(ESP_GATTC_WRITE_CHAR_EVT, gattcIf(idx), &param);
+}
+
+// The Control Point write of a request: the frame with the UID patched in
+static bool sentRequest(uint8_t idx, uint32_t uid) {
+    const host_bt_call_t *w = host_bt_last(HOST_BT_WRITE_CHAR);
+    if (w == nullptr || w->gattc_if != gattcIf(idx) || w->handle != CONTROL_POINT || w->len != frame.len) {
+        return false;
+    }
+    ancs_attr_frame_t expected = frame;
+    memcpy(&expected.data[ANCS_ATTR_FRAME_UID_OFFSET], &uid, sizeof(uid));
+    return memcmp(w->data, expected.data, frame.len) == 0;
+}
+
+static std::string attributeOf(uint32_t uid, uint32_t id) {
+    for (const Attribute& a : events.attributes) {
+        if (a.uid == uid && a.id == id) {
+            // Parsed into the buffers of that request, not another one's
+            CHECK(a.data == buffers[uid][id].data());
+            return a.value;
+        }
+    }
+    return "-";
+}
+
+/**@brief Requests up to the pipeline depth in flight, answered out of order, each response landing in
+ *        the buffers of the request with its UID. Then the responses that match no request: never
+ *        asked for, refused by the write response, or too late.
+ */
+static void testPipelining(void) {
+    static_assert(ANCS_PIPELINE_DEPTH >= 2, "Pipelining needs two requests in flight");
+    Phone p = phone(0x50, 0x50);
+    cacheHandles(p);
+    CHECK(connect(p) == 0);
+    openGatt(0, p);
+    cfgMtu(gattcIf(0), p, ESP_GATT_OK, ANCS_DEFAULT_MTU);
+    CHECK(host_bt_last(HOST_BT_REGISTER_FOR_NOTIFY)->handle == DATA_SOURCE);
+    ancs_link_info_t before = linkOf(0);
+
+    // Depth requests are written, the next one waits for a free slot
+    for (uint32_t i = 0; i < ANCS_PIPELINE_DEPTH; i ++) {
+        CHECK(ancs_send_attrs_request(0, 101 + i, &frame));
+        CHECK(sentRequest(0, 101 + i));
+    }
+    uint32_t writes = host_bt_count(HOST_BT_WRITE_CHAR);
+    CHECK(!ancs_send_attrs_request(0, 199, &frame));
+    CHECK(host_bt_count(HOST_BT_WRITE_CHAR) == writes);
+    for (uint32_t i = 0; i < ANCS_PIPELINE_DEPTH; i ++) {
+        writeResponse(0, p, ESP_GATT_OK);
+    }
+
+    // Newest first, split over packets of the default MTU
+    for (uint32_t i = ANCS_PIPELINE_DEPTH; i > 0; i --) {
+        uint32_t uid = 100 + i;
+        dataSource(0, p, notifResponse(uid, "Title " + std::to_string(uid), "Message of notification " + std::to_string(uid)));
+        CHECK(events.done.size() == ANCS_PIPELINE_DEPTH - i + 1 && events.done.back() == uid);
+        CHECK(attributeOf(uid, BLE_ANCS_NOTIF_ATTR_ID_TITLE) == "Title " + std::to_string(uid));
+        CHECK(attributeOf(uid, BLE_ANCS_NOTIF_ATTR_ID_MESSAGE) == "Message of notification " + std::to_string(uid));
+        CHECK(buffers[101][BLE_ANCS_NOTIF_ATTR_ID_TITLE][0] == ((i == 1) ? 'T' : 0));
+    }
+    CHECK(linkOf(0).rtt_count - before.rtt_count == ANCS_PIPELINE_DEPTH);
+    CHECK(events.errors.empty());
+
+    // A response for a UID never asked for is dropped, the next one parses
+    size_t attributes = events.attributes.size();
+    dataSource(0, p, notifResponse(150, "Not asked", "for"));
+    CHECK(events.attributes.size() == attributes && events.done.size() == ANCS_PIPELINE_DEPTH);
+    CHECK(ancs_send_attrs_request(0, 103, &frame));
+    writeResponse(0, p, ESP_GATT_OK);
+    dataSource(0, p, notifResponse(103, "Third", "After a stray response"));
+    CHECK(events.done.back() == 103 && attributeOf(103, BLE_ANCS_NOTIF_ATTR_ID_MESSAGE) == "After a stray response");
+
+    // Notification and app requests side by side, told apart by their command
+    CHECK(ancs_send_attrs_request(0, 104, &frame));
+    CHECK(ancs_send_app_attrs_request(0, "com.apple.MobileSMS"));
+    writeResponse(0, p, ESP_GATT_OK);
+    writeResponse(0, p, ESP_GATT_OK);
+    dataSource(0, p, appResponse("com.apple.MobileSMS", "Messages"));
+    dataSource(0, p, notifResponse(104, "Fourth", "Next to an app name"));
+    CHECK(events.appNames.size() == 1 && events.appNames.back() == "Messages");
+    CHECK(events.done.back() == 104 && attributeOf(104, BLE_ANCS_NOTIF_ATTR_ID_TITLE) == "Fourth");
+
+    // An error write response ends the oldest request, the other one still gets its response
+    CHECK(ancs_send_attrs_request(0, 105, &frame));
+    CHECK(ancs_send_attrs_request(0, 106, &frame));
+    writeResponse(0, p, (esp_gatt_status_t)ANCS_STATUS_INVALID_PARAMETER);
+    writeResponse(0, p, ESP_GATT_OK);
+    CHECK(events.errors.size() == 1 && events.errors.back() == std::make_pair(105u, (uint16_t)ANCS_STATUS_INVALID_PARAMETER));
+    dataSource(0, p, notifResponse(106, "Sixth", "Despite the error before"));
+    CHECK(events.done.back() == 106 && attributeOf(106, BLE_ANCS_NOTIF_ATTR_ID_TITLE) == "Sixth");
+    CHECK(attributeOf(105, BLE_ANCS_NOTIF_ATTR_ID_TITLE) == "-");
+
+    // No response in time: the request ends with a timeout, its late response is dropped
+    CHECK(ancs_send_attrs_request(0, 107, &frame));
+    writeResponse(0, p, ESP_GATT_OK);
+    host_time_advance(CONFIG_NOWA_ATTR_TIMEOUT_MS * 1000LL);
+    CHECK(events.errors.size() == 2 && events.errors.back() == std::make_pair(107u, (uint16_t)ANCS_STATUS_TIMEOUT));
+    CHECK(linkOf(0).rtt_timeouts - before.rtt_timeouts == 1);
+    CHECK(ancs_send_attrs_request(0, 108, &frame));
+    writeResponse(0, p, ESP_GATT_OK);
+    size_t done = events.done.size();
+    dataSource(0, p, notifResponse(107, "Late", "x"));
+    CHECK(events.done.size() == done && attributeOf(107, BLE_ANCS_NOTIF_ATTR_ID_TITLE) == "-");
+    dataSource(0, p, notifResponse(108, "Eighth", "After a late response"));
+    CHECK(events.done.size() == done + 1 && events.done.back() == 108);
+    CHECK(attributeOf(108, BLE_ANCS_NOTIF_ATTR_ID_MESSAGE) == "After a late response");
+
+    // A disconnect drops what is in flight without a word, the next link starts empty
+    CHECK(ancs_send_attrs_request(0, 109, &frame));
+    CHECK(disconnect(p) == 0);
+    host_time_advance(CONFIG_NOWA_ATTR_TIMEOUT_MS * 1000LL);
+    CHECK(events.errors.size() == 2);
+    CHECK(connect(p) == 0);
+    for (uint32_t i = 0; i < ANCS_PIPELINE_DEPTH; i ++) {
+        CHECK(ancs_send_attrs_request(0, 110 + i, &frame));
+    }
+    CHECK(disconnect(p) == 0);
+}
+
+/**@brief A request that times out while its response is being parsed gets its buffers back with
+ *        the error: nothing is written to them once reported, whether the timeout falls between
+ *        packets or within one, and the rest of the response is dropped.
+ */
+static void testTimeoutMidResponse(void) {
+    Phone p = phone(0x51, 0x51);
+    cacheHandles(p);
+    CHECK(connect(p) == 0);
+    openGatt(0, p);
+    cfgMtu(gattcIf(0), p, ESP_GATT_OK, ANCS_DEFAULT_MTU);
+    const std::string message = "Message of a response that comes too late";
+    size_t errors = events.errors.size(), done = events.done.size();
+
+    // Between packets: first packet, timeout, then the rest
+    CHECK(ancs_send_attrs_request(0, 121, &frame));
+    writeResponse(0, p, ESP_GATT_OK);
+    std::vector<uint8_t> response = notifResponse(121, "Between", message);
+    dataSource(0, p, std::vector<uint8_t>(response.begin(), response.begin() + PACKET));
+    host_time_advance(CONFIG_NOWA_ATTR_TIMEOUT_MS * 1000LL);
+    CHECK(events.errors.size() == errors + 1 && events.errors.back() == std::make_pair(121u, (uint16_t)ANCS_STATUS_TIMEOUT));
+    dataSource(0, p, std::vector<uint8_t>(response.begin() + PACKET, response.end()));
+    CHECK(buffers[121] == released[121]);
+
+    // Within a packet: the title ends early in the first one, the timeout fires from its attribute
+    // event while the message is still to copy from that packet
+    CHECK(ancs_send_attrs_request(0, 122, &frame));
+    writeResponse(0, p, ESP_GATT_OK);
+    expireOnAttribute = true;
+    dataSource(0, p, notifResponse(122, "T", message));
+    CHECK(!expireOnAttribute);
+    CHECK(events.errors.size() == errors + 2 && events.errors.back() == std::make_pair(122u, (uint16_t)ANCS_STATUS_TIMEOUT));
+    CHECK(buffers[122] == released[122]);
+    CHECK(events.done.size() == done);
+
+    // The next request parses as usual
+    CHECK(ancs_send_attrs_request(0, 123, &frame));
+    writeResponse(0, p, ESP_GATT_OK);
+    dataSource(0, p, notifResponse(123, "Third", "In time"));
+    CHECK(events.done.size() == done + 1 && events.done.back() == 123);
+    CHECK(attributeOf(123, BLE_ANCS_NOTIF_ATTR_ID_MESSAGE) == "In time");
+    CHECK(disconnect(p) == 0);
+}
+
+/**@brief The late response of a request that timed out before it started, with a packet that
+ *        reads as the header of another outstanding request: it is dropped as a whole, the
+ *        requests after it get their own responses.
+ */
+static void testResyncAfterTimeout(void) {
+    Phone p = phone(0x52, 0x52);
+    cacheHandles(p);
+    CHECK(connect(p) == 0);
+    openGatt(0, p);
+    cfgMtu(gattcIf(0), p, ESP_GATT_OK, ANCS_DEFAULT_MTU);
+    size_t errors = events.errors.size(), done = events.done.size();
+
+    // 131 times out, 132 and 133 are outstanding after it
+    CHECK(ancs_send_attrs_request(0, 131, &frame));
+    writeResponse(0, p, ESP_GATT_OK);
+    host_time_advance(CONFIG_NOWA_ATTR_TIMEOUT_MS * 1000LL / 2);
+    CHECK(ancs_send_attrs_request(0, 132, &frame));
+    writeResponse(0, p, ESP_GATT_OK);
+    host_time_advance(CONFIG_NOWA_ATTR_TIMEOUT_MS * 1000LL / 2);
+    CHECK(events.errors.size() == errors + 1 && events.errors.back() == std::make_pair(131u, (uint16_t)ANCS_STATUS_TIMEOUT));
+    CHECK(ancs_send_attrs_request(0, 133, &frame));
+    writeResponse(0, p, ESP_GATT_OK);
+
+    // The message of 131 carries a whole response of 133, at the start of the second packet
+    std::vector<uint8_t> forged = notifResponse(133, "Forged", "x");
+    const std::string title = "Stale";
+    size_t messageAt = 5 + 3 + title.size() + 3;
+    std::string message(PACKET - messageAt, '-');
+    message.append(forged.begin(), forged.end());
+    message.append("tail");
+    dataSource(0, p, notifResponse(131, title, message));
+    CHECK(events.done.size() == done);
+
+    // Each in turn, the oldest first
+    dataSource(0, p, notifResponse(132, "Thirty-second", "In order"));
+    dataSource(0, p, notifResponse(133, "Thirty-third", "In order"));
+    CHECK(events.done.size() == done + 2 && events.done[done] == 132 && events.done[done + 1] == 133);
+    CHECK(attributeOf(133, BLE_ANCS_NOTIF_ATTR_ID_TITLE) == "Thirty-third");
+    CHECK(events.errors.size() == errors + 1);
+    CHECK(disconnect(p) == 0);
+}
+
+/**@brief A CCCD write the stack keeps refusing is given up, and the link with it: without the
+ *        subscription no notification would ever come, the phone reconnects and starts over.
+ */
+static void testSubscriptionGivenUp(void) {
+    Phone p = phone(0x53, 0x53);
+    cacheHandles(p);
+    CHECK(connect(p) == 0);
+    openGatt(0, p);
+    host_bt_fail(HOST_BT_WRITE_DESCR, ESP_FAIL, BLE_GATT_OPS_TRIES);
+    cfgMtu(gattcIf(0), p, ESP_GATT_OK, ANCS_DEFAULT_MTU);
+    uint32_t writes = host_bt_count(HOST_BT_WRITE_DESCR);
+    uint32_t disconnects = host_bt_count(HOST_BT_DISCONNECT);
+
+    esp_ble_gattc_cb_param_t param {};
+    param.reg_for_notify.status = ESP_GATT_OK;
+    param.reg_for_notify.handle = NOTIFICATION_SOURCE;
+    host_bt_gattc_event(ESP_GATTC_REG_FOR_NOTIFY_EVT, gattcIf(0), &param);
+    // Backoffs of every retry, doubling from BLE_GATT_OPS_RETRY_US
+    host_time_advance(((int64_t)BLE_GATT_OPS_RETRY_US << (BLE_GATT_OPS_TRIES - 1)) - BLE_GATT_OPS_RETRY_US - 1);
+    CHECK(host_bt_count(HOST_BT_DISCONNECT) == disconnects);
+    host_time_advance(1);
+    CHECK(host_bt_count(HOST_BT_WRITE_DESCR) == writes + BLE_GATT_OPS_TRIES);
+    CHECK(host_bt_count(HOST_BT_DISCONNECT) == disconnects + 1);
+    CHECK(memcmp(host_bt_last(HOST_BT_DISCONNECT)->bda, p.bda, sizeof(p.bda)) == 0);
+    CHECK(disconnect(p) == 0);
+}
+
+// A refused registration, or one past the profiles, routes nothing to that app
+static void testRegistration(void) {
+    esp_ble_gattc_cb_param_t param {};
+    param.reg.status = ESP_GATT_ERROR;
+    param.reg.app_id = 1;
+    host_bt_gattc_event(ESP_GATTC_REG_EVT, 0x30, &param);
+    param.reg.status = ESP_GATT_OK;
+    param.reg.app_id = ANCS_PROFILE_NUM;
+    host_bt_gattc_event(ESP_GATTC_REG_EVT, 0x31, &param);
+
+    Phone p = phone(0x30, 0x30);
+    esp_ble_gattc_cb_param_t up {};
+    up.connect.conn_id = p.conn_id;
+    memcpy(up.connect.remote_bda, p.bda, 6);
+    host_bt_gattc_event(ESP_GATTC_CONNECT_EVT, 0x30, &up);
+    host_bt_gattc_event(ESP_GATTC_CONNECT_EVT, 0x31, &up);
+    CHECK(events.connects.empty());
+
+    // Profile 1 keeps the app it registered first
+    Phone q = phone(0x31, 0x31);
+    CHECK(connect(p) == 0);
+    CHECK(connect(q) == 1);
+    cfgMtu(0x30, q, ESP_GATT_OK, 100);
+    CHECK(mtuOf(1) == ANCS_DEFAULT_MTU);
+    cfgMtu(gattcIf(1), q, ESP_GATT_OK, 100);
+    CHECK(mtuOf(1) == 100);
+    CHECK(disconnect(p) == 0);
+    CHECK(disconnect(q) == 1);
+}
+
+/* ---- Bond removal ---- */
+
+// Cached handles go with the bond, and the Dispatcher hears of it to drop its own
+static void testBondRemoval(void) {
+    Phone p = phone(0x40, 0x40);
+    cacheHandles(p);
+    ble_handle_cache_t c;
+
+    esp_ble_gap_cb_param_t param {};
+    param.remove_bond_dev_cmpl.status = ESP_BT_STATUS_FAIL;
+    memcpy(param.remove_bond_dev_cmpl.bd_addr, p.bda, 6);
+    host_bt_gap_event(ESP_GAP_BLE_REMOVE_BOND_DEV_COMPLETE_EVT, &param);
+    CHECK(ble_handle_cache_load(p.bda, &c) == ESP_OK);
+    CHECK(events.bondsRemoved.empty());
+
+    param.remove_bond_dev_cmpl.status = ESP_BT_STATUS_SUCCESS;
+    host_bt_gap_event(ESP_GAP_BLE_REMOVE_BOND_DEV_COMPLETE_EVT, &param);
+    CHECK(ble_handle_cache_load(p.bda, &c) == ESP_ERR_NVS_NOT_FOUND);
+    CHECK(events.bondsRemoved.size() == 1 && memcmp(events.bondsRemoved[0].data(), p.bda, 6) == 0);
+}
+
+int main(void) {
+    host_time_set(1000000);
+    ancs_handlers_t h {};
+    h.connect = onConnect;
+    h.disconnect = onDisconnect;
+    h.attribute = onAttribute;
+    h.attributes_done = onAttributesDone;
+    h.attribute_buffer = onAttributeBuffer;
+    h.request_error = onRequestError;
+    h.app_name = onAppName;
+    h.bond_removed = onBondRemoved;
+    CHECK(ancs_init(nullptr, &h) == ESP_OK);
+    CHECK(host_bt_count(HOST_BT_APP_REGISTER) == ANCS_PROFILE_NUM);
+    registerApps();
+
+    testRegistration();
+    events = {};
+    testRouting();
+    testNegotiation();
+    testPipelining();
+    testTimeoutMidResponse();
+    testResyncAfterTimeout();
+    testSubscriptionGivenUp();
+    testBondRemoval();
+    host_test_exit();
+}
@@ -0,0 +1,148 @@
+// The GATT operation queue of a link against the Bluedroid stand-in: operations handed to the
+// stack up to the depth, urgent ones first and the others held back, busy refusals at the call and
+// in the completion event retried with backoff, and operations out of tries given up to the owner.
+
+#include <cstdio>
+#include <vector>
+#include "ble_gatt_ops.h"
+#include "host.h"
+#include "host_bt.h"
+
+static constexpr esp_gatt_if_t GATTC_IF = 3;
+static constexpr uint16_t CONN_ID = 7;
+static const uint8_t NOTIFY_EN[2] = { 0x01, 0x00 };
+
+static ble_gatt_ops_t q;
+static std::vector<ble_gatt_op_t> givenUp;
+
+static void onGivenUp(void *ctx, const ble_gatt_op_t *op) {
+    CHECK(ctx == &givenUp);
+    givenUp.push_back(*op);
+}
+
+// Past the backoff before try n + 1
+static void backoff(uint32_t n) {
+    host_time_advance((int64_t)BLE_GATT_OPS_RETRY_US << (n - 1));
+}
+
+static bool lastIs(host_bt_call_type_t type, uint16_t handle) {
+    const host_bt_call_t *c = host_bt_last(type);
+    return c != nullptr && c->gattc_if == GATTC_IF && c->conn_id == CONN_ID && c->handle == handle;
+}
+
+/* ---- Order ---- */
+
+// CCCD writes while held, up to the depth, then the reads once released
+static void testOrder(void) {
+    ble_gatt_ops_bind(&q, GATTC_IF, CONN_ID);
+    ble_gatt_ops_hold(&q, true);
+    CHECK(ble_gatt_ops_read(&q, 0x10, false));
+    CHECK(ble_gatt_ops_read(&q, 0x11, false));
+    CHECK(ble_gatt_ops_write_descr(&q, 0x20, NOTIFY_EN, sizeof(NOTIFY_EN), true));
+    CHECK(ble_gatt_ops_write_descr(&q, 0x21, NOTIFY_EN, sizeof(NOTIFY_EN), true));
+    CHECK(ble_gatt_ops_write_descr(&q, 0x22, NOTIFY_EN, sizeof(NOTIFY_EN), true));
+    CHECK(host_bt_count(HOST_BT_READ_CHAR) == 0);
+    CHECK(host_bt_count(HOST_BT_WRITE_DESCR) == BLE_GATT_OPS_DEPTH);
+    CHECK(lastIs(HOST_BT_WRITE_DESCR, 0x21));
+
+    CHECK(ble_gatt_ops_complete(&q, BLE_GATT_OP_WRITE_DESCR, 0x20, ESP_GATT_OK));
+    CHECK(lastIs(HOST_BT_WRITE_DESCR, 0x22));
+    CHECK(ble_gatt_ops_complete(&q, BLE_GATT_OP_WRITE_DESCR, 0x21, ESP_GATT_OK));
+    CHECK(ble_gatt_ops_complete(&q, BLE_GATT_OP_WRITE_DESCR, 0x22, ESP_GATT_OK));
+    CHECK(host_bt_count(HOST_BT_READ_CHAR) == 0);
+
+    ble_gatt_ops_hold(&q, false);
+    CHECK(host_bt_count(HOST_BT_READ_CHAR) == 2 && lastIs(HOST_BT_READ_CHAR, 0x11));
+    CHECK(ble_gatt_ops_complete(&q, BLE_GATT_OP_READ_CHAR, 0x10, ESP_GATT_OK));
+    CHECK(ble_gatt_ops_complete(&q, BLE_GATT_OP_READ_CHAR, 0x11, ESP_GATT_OK));
+    CHECK(q.max_in_flight == BLE_GATT_OPS_DEPTH);
+    CHECK(q.in_flight == 0 && q.failed == 0 && givenUp.empty());
+
+    // A completion the queue did not issue is the caller's
+    CHECK(ble_gatt_ops_complete(&q, BLE_GATT_OP_READ_CHAR, 0x99, ESP_GATT_BUSY));
+}
+
+/* ---- Retries ---- */
+
+// Busy at the call: tried again once the backoff is over, no completion in between
+static void testRetryAtCall(void) {
+    host_bt_reset();
+    uint32_t retried = q.retried;
+    host_bt_fail(HOST_BT_READ_CHAR, ESP_FAIL, 1);
+    CHECK(ble_gatt_ops_read(&q, 0x30, false));
+    CHECK(host_bt_count(HOST_BT_READ_CHAR) == 1 && q.retried == retried + 1 && q.in_flight == 0);
+    host_time_advance(BLE_GATT_OPS_RETRY_US - 1);
+    CHECK(host_bt_count(HOST_BT_READ_CHAR) == 1);
+    host_time_advance(1);
+    CHECK(host_bt_count(HOST_BT_READ_CHAR) == 2 && lastIs(HOST_BT_READ_CHAR, 0x30));
+    CHECK(ble_gatt_ops_complete(&q, BLE_GATT_OP_READ_CHAR, 0x30, ESP_GATT_OK));
+    CHECK(givenUp.empty());
+}
+
+// Busy at every call: given up after the last try, and what waited behind it goes
+static void testGiveUpAtCall(void) {
+    host_bt_reset();
+    uint32_t failed = q.failed;
+    host_bt_fail(HOST_BT_WRITE_DESCR, ESP_FAIL, BLE_GATT_OPS_TRIES);
+    CHECK(ble_gatt_ops_write_descr(&q, 0x40, NOTIFY_EN, sizeof(NOTIFY_EN), true));
+    CHECK(ble_gatt_ops_read(&q, 0x41, false));
+    CHECK(host_bt_count(HOST_BT_READ_CHAR) == 0);
+    for (uint32_t n = 1; n < BLE_GATT_OPS_TRIES; n ++) {
+        CHECK(givenUp.empty());
+        backoff(n);
+        CHECK(host_bt_count(HOST_BT_WRITE_DESCR) == n + 1);
+    }
+    CHECK(givenUp.size() == 1 && givenUp[0].type == BLE_GATT_OP_WRITE_DESCR && givenUp[0].handle == 0x40);
+    CHECK(q.failed == failed + 1);
+    CHECK(host_bt_count(HOST_BT_READ_CHAR) == 1 && lastIs(HOST_BT_READ_CHAR, 0x41));
+    CHECK(ble_gatt_ops_complete(&q, BLE_GATT_OP_READ_CHAR, 0x41, ESP_GATT_OK));
+
+    // Nothing left to retry
+    backoff(BLE_GATT_OPS_TRIES);
+    CHECK(host_bt_count(HOST_BT_WRITE_DESCR) == BLE_GATT_OPS_TRIES);
+    givenUp.clear();
+}
+
+// Busy in every completion: the events are the queue's, the last one ends in given_up
+static void testGiveUpAtCompletion(void) {
+    host_bt_reset();
+    uint32_t failed = q.failed;
+    CHECK(ble_gatt_ops_read(&q, 0x50, false));
+    for (uint32_t n = 1; n < BLE_GATT_OPS_TRIES; n ++) {
+        CHECK(!ble_gatt_ops_complete(&q, BLE_GATT_OP_READ_CHAR, 0x50, ESP_GATT_BUSY));
+        CHECK(host_bt_count(HOST_BT_READ_CHAR) == n);
+        backoff(n);
+        CHECK(host_bt_count(HOST_BT_READ_CHAR) == n + 1);
+    }
+    CHECK(givenUp.empty());
+    CHECK(!ble_gatt_ops_complete(&q, BLE_GATT_OP_READ_CHAR, 0x50, ESP_GATT_CONGESTED));
+    CHECK(givenUp.size() == 1 && givenUp[0].type == BLE_GATT_OP_READ_CHAR && givenUp[0].handle == 0x50);
+    CHECK(q.failed == failed + 1 && q.in_flight == 0);
+    backoff(BLE_GATT_OPS_TRIES);
+    CHECK(host_bt_count(HOST_BT_READ_CHAR) == BLE_GATT_OPS_TRIES);
+    givenUp.clear();
+}
+
+// Link down: a pending retry is dropped with the queue, nothing is given up
+static void testReset(void) {
+    host_bt_reset();
+    host_bt_fail(HOST_BT_READ_CHAR, ESP_FAIL, 1);
+    CHECK(ble_gatt_ops_read(&q, 0x60, false));
+    ble_gatt_ops_reset(&q);
+    backoff(1);
+    CHECK(host_bt_count(HOST_BT_READ_CHAR) == 1);
+    CHECK(!ble_gatt_ops_read(&q, 0x61, false));
+    CHECK(givenUp.empty());
+}
+
+int main(void) {
+    host_time_set(1000000);
+    CHECK(ble_gatt_ops_init(&q, onGivenUp, &givenUp) == ESP_OK);
+
+    testOrder();
+    testRetryAtCall();
+    testGiveUpAtCall();
+    testGiveUpAtCompletion();
+    testReset();
+    host_test_exit();
+}
@@ -0,0 +1,112 @@
+// GATT handles of bonded phones kept in NVS: saved and loaded per BDA, erased, and entries of
+// another size or version ignored so that they only cost a service discovery.
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "ble_handle_cache.h"
+#include "host.h"
+#include "nvs.h"
+
+static constexpr uint8_t PHONE_A[6] = { 0x60, 0x11, 0x22, 0x33, 0x44, 0x55 };
+static constexpr uint8_t PHONE_B[6] = { 0x60, 0x11, 0x22, 0x33, 0x44, 0x66 };
+
+static ble_handle_cache_t entry(uint16_t base) {
+    ble_handle_cache_t c {};
+    c.version = BLE_HANDLE_CACHE_VERSION;
+    c.anc_start = base;
+    c.anc_end = base + 0x0c;
+    c.notification_source = base + 2;
+    c.notification_source_cccd = base + 3;
+    c.data_source = base + 5;
+    c.data_source_cccd = base + 6;
+    c.control_point = base + 8;
+    c.service_changed = 0x05;
+    c.service_changed_cccd = 0x06;
+    c.appearance = 0x00c0;
+    snprintf(c.name, sizeof(c.name), "Phone %x", base);
+    return c;
+}
+
+// Written as another build of the firmware would have
+static void putRaw(const uint8_t bda[6], const void *data, size_t len) {
+    char k[BLE_BDA_KEY_LEN];
+    ble_bda_key(bda, k);
+    nvs_handle_t h;
+    CHECK(nvs_open("nowa_gatt", NVS_READWRITE, &h) == ESP_OK);
+    CHECK(nvs_set_blob(h, k, data, len) == ESP_OK);
+    nvs_close(h);
+}
+
+static void testKey(void) {
+    char k[BLE_BDA_KEY_LEN];
+    ble_bda_key(PHONE_A, k);
+    CHECK(strcmp(k, "601122334455") == 0);
+}
+
+/* ---- Load, save, erase ---- */
+
+static void testRoundTrip(void) {
+    ble_handle_cache_t c;
+    // Nothing saved yet, not even the namespace
+    CHECK(ble_handle_cache_load(PHONE_A, &c) == ESP_ERR_NVS_NOT_FOUND);
+
+    ble_handle_cache_t a = entry(0x28), b = entry(0x40);
+    uint32_t commits = host_nvs_commits();
+    CHECK(ble_handle_cache_save(PHONE_A, &a) == ESP_OK);
+    CHECK(ble_handle_cache_save(PHONE_B, &b) == ESP_OK);
+    CHECK(host_nvs_commits() == commits + 2);
+
+    CHECK(ble_handle_cache_load(PHONE_A, &c) == ESP_OK && memcmp(&c, &a, sizeof(c)) == 0);
+    CHECK(ble_handle_cache_load(PHONE_B, &c) == ESP_OK && memcmp(&c, &b, sizeof(c)) == 0);
+
+    CHECK(ble_handle_cache_erase(PHONE_A) == ESP_OK);
+    CHECK(ble_handle_cache_load(PHONE_A, &c) == ESP_ERR_NVS_NOT_FOUND);
+    CHECK(ble_handle_cache_load(PHONE_B, &c) == ESP_OK && c.anc_start == 0x40);
+
+    // Erasing what is not there is not an error
+    CHECK(ble_handle_cache_erase(PHONE_A) == ESP_OK);
+}
+
+// A name saved without its terminator comes back terminated
+static void testNameTerminated(void) {
+    ble_handle_cache_t a = entry(0x28), c;
+    memset(a.name, 'n', sizeof(a.name));
+    putRaw(PHONE_A, &a, sizeof(a));
+    CHECK(ble_handle_cache_load(PHONE_A, &c) == ESP_OK);
+    CHECK(strlen(c.name) == sizeof(c.name) - 1 && c.anc_start == 0x28);
+}
+
+/* ---- Rejected entries ---- */
+
+static void testOutdated(void) {
+    ble_handle_cache_t a = entry(0x28), c;
+
+    a.version = BLE_HANDLE_CACHE_VERSION + 1;
+    putRaw(PHONE_A, &a, sizeof(a));
+    CHECK(ble_handle_cache_load(PHONE_A, &c) == ESP_ERR_INVALID_VERSION);
+
+    // Smaller layout of an earlier version, with a matching version byte
+    a.version = BLE_HANDLE_CACHE_VERSION;
+    putRaw(PHONE_A, &a, offsetof(ble_handle_cache_t, name));
+    CHECK(ble_handle_cache_load(PHONE_A, &c) == ESP_ERR_INVALID_VERSION);
+
+    // Larger layout of a later one
+    std::vector<uint8_t> larger(sizeof(a) + 16, 0);
+    memcpy(larger.data(), &a, sizeof(a));
+    putRaw(PHONE_A, larger.data(), larger.size());
+    CHECK(ble_handle_cache_load(PHONE_A, &c) == ESP_ERR_INVALID_VERSION);
+
+    // Saved again over it once discovery has run
+    CHECK(ble_handle_cache_save(PHONE_A, &a) == ESP_OK);
+    CHECK(ble_handle_cache_load(PHONE_A, &c) == ESP_OK && memcmp(&c, &a, sizeof(c)) == 0);
+}
+
+int main(void) {
+    testKey();
+    testRoundTrip();
+    testNameTerminated();
+    testOutdated();
+    host_test_exit();
+}
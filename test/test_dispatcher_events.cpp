@@ -0,0 +1,120 @@
+// Driver events through the Dispatcher: events per second and time spent in the driver callbacks on
+// the BT task, for the worker task queue against the inline handling it replaced.
+//
+// The phone posts bursts of live notifications and answers every attribute request at once, so
+// the Dispatcher is the bottleneck. A burst fits the request queue, so both paths do the same
+// work. The inline path is modelled on the same code: each callback returns only once the worker
+// task has handled its event, and an attribute event then sleeps one tick as ancs_c_evt_handler
+// did. A tick is 1 ms here, 10 ms on the target at CONFIG_FREERTOS_HZ=100, and logging is off, so
+// the target numbers differ but the ratio holds.
+
+#include <cstdio>
+#include "Dispatcher.h"
+#include "DispatcherUtils.h"
+#include "host.h"
+#include "host_ancs.h"
+
+static constexpr uint8_t IDX = 0;
+static constexpr uint8_t PHONE[6] = { 0x60, 0x11, 0x22, 0x33, 0x44, 0x66 };
+static constexpr uint32_t BURST = 40;
+static constexpr uint32_t BURSTS = 5;
+
+static Dispatcher disp;
+
+// Before: the Dispatcher ran in the callback, and slept a tick per attribute for the watchdog
+static void inlineHandling(bool attribute) {
+    host_idle();
+    if (attribute) {
+        vTaskDelay(1);
+    }
+}
+
+struct Result {
+    uint32_t events;
+    uint32_t stored;
+    double eventsPerS;
+    host_ancs_dwell_t dwell;
+    uint32_t stalls;
+    uint32_t maxBatch;
+};
+
+static void drain(void) {
+    while (1) {
+        host_idle();
+        if (host_ancs_in_flight() == 0) {
+            return;
+        }
+        host_ancs_answer_due();
+    }
+}
+
+static Result run(void (*tail)(bool attribute), uint32_t firstUid) {
+    host_ancs_connect(IDX, PHONE);
+    drain();
+
+    // Counters start over with the bursts
+    host_ancs_reset();
+    uint32_t lastUid = firstUid + BURST * BURSTS;
+    for (uint32_t uid = firstUid; uid < lastUid; uid ++) {
+        char title[32], date[16];
+        snprintf(title, sizeof(title), "Title %u", (unsigned)uid);
+        DispatcherUtils::formatAncsDate(1772366400 + uid, date); // Newer than anything stored before
+        host_ancs_notif_t n = { uid, "com.example.chat", title, "Message of the notification", date };
+        host_ancs_add(&n);
+    }
+    DispatcherStats& st = disp.stats();
+    uint32_t events = st.events, stored = st.notifsStored, stalls = st.producerStalls;
+    st.maxBatch = 0;
+    host_ancs_set_handler_tail(tail);
+
+    uint64_t start = host_wall_ns();
+    for (uint32_t uid = firstUid; uid < lastUid; uid ++) {
+        host_ancs_event(IDX, BLE_ANCS_EVENT_ID_NOTIFICATION_ADDED, uid, false);
+        host_ancs_answer_due();
+        if ((uid - firstUid) % BURST == BURST - 1) {
+            drain();
+        }
+    }
+    uint64_t wall = host_wall_ns() - start;
+
+    Result r {};
+    host_ancs_get_dwell(&r.dwell);
+    host_ancs_set_handler_tail(nullptr);
+    r.events = st.events - events;
+    r.stored = st.notifsStored - stored;
+    r.eventsPerS = r.events * 1e9 / wall;
+    r.stalls = st.producerStalls - stalls;
+    r.maxBatch = st.maxBatch;
+
+    host_ancs_disconnect(IDX);
+    host_idle();
+    return r;
+}
+
+static void print(const char *name, const Result& r) {
+    printf("%-8s %5u events, %8.0f events/s, callback %6.1f us average, %7.1f us max, %2u stalls, batches up to %u\n",
+           name, (unsigned)r.events, r.eventsPerS, r.dwell.total_ns / 1000.0 / r.dwell.calls, r.dwell.max_ns / 1000.0,
+           (unsigned)r.stalls, (unsigned)r.maxBatch);
+}
+
+int main(void) {
+    host_time_set(1000000);
+    host_ancs_set_rtt(0);
+    disp.filter().setRules({}, true);
+    CHECK(disp.initDriver() == ESP_OK);
+
+    Result before = run(inlineHandling, 1);
+    print("before", before);
+    Result after = run(nullptr, 1 + BURST * BURSTS);
+    print("after", after);
+
+    // Same work either way, only where it runs differs
+    CHECK(before.stored == BURST * BURSTS);
+    CHECK(after.stored == BURST * BURSTS);
+    CHECK(before.maxBatch == 1);
+
+    // A callback only copies its event now, it never waits for the Dispatcher or sleeps
+    CHECK(after.dwell.total_ns < before.dwell.total_ns);
+
+    host_test_exit();
+}
@@ -0,0 +1,260 @@
+// Reconnect of a phone that shows 150 notifications, through the Dispatcher and its worker task on
+// the ANCS driver stand-in: requests and connect-to-idle time with the known UIDs of the device
+// lost, as every reconnect was before they were kept, against kept, and against kept with some
+// notifications removed and added while away. Then a stored notification modified, fetched whole
+// and removed after a reconnect, a reconnect once the store has been cleared, and the known UIDs
+// of the device erased from NVS when it is forgotten or its bond removed.
+//
+// The phone replays one pre-existing notification per 30 ms connection interval, oldest first,
+// and answers each attribute request 60 ms after it is written. Idle is the last replayed event or
+// the last response, whichever comes later. All in esp_timer time, so the numbers repeat.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "Dispatcher.h"
+#include "KnownUids.h"
+#include "host.h"
+#include "host_ancs.h"
+
+static constexpr uint8_t IDX = 0;
+static constexpr uint8_t PHONE[6] = { 0x60, 0x11, 0x22, 0x33, 0x44, 0x55 };
+static constexpr uint32_t SHOWN = 150;
+static constexpr int64_t INTERVAL_US = 30 * 1000;
+static constexpr int64_t RTT_US = 60 * 1000;
+static const BDA PHONE_BDA { PHONE[0], PHONE[1], PHONE[2], PHONE[3], PHONE[4], PHONE[5] };
+static const char MESSAGE[] = "Message of the notification, long enough that only a preview of it is stored at first";
+
+static Dispatcher disp;
+
+/* ---- Phone ---- */
+
+static void show(uint32_t uid, const char *prefix = "Title") {
+    char app[32], title[32], date[16];
+    snprintf(app, sizeof(app), "com.example.app%u", (unsigned)(uid % 4));
+    snprintf(title, sizeof(title), "%s %u", prefix, (unsigned)uid);
+    // A minute apart, so UID order is Date order
+    snprintf(date, sizeof(date), "20260301T%02u%02u00", (unsigned)(8 + uid / 60), (unsigned)(uid % 60));
+    host_ancs_notif_t n = { uid, app, title, MESSAGE, date };
+    host_ancs_add(&n);
+}
+
+static void advanceTo(int64_t t) {
+    int64_t now = esp_timer_get_time();
+    if (t > now) {
+        host_time_advance(t - now);
+    }
+}
+
+// Responses due by t, each at its own time, and whatever the worker sends in return. Time of the
+// last one, 0 if none.
+static int64_t serveUntil(int64_t t) {
+    int64_t last = 0;
+    int64_t due;
+    while ((due = host_ancs_next_due()) != INT64_MAX && due <= t) {
+        advanceTo(due);
+        host_ancs_answer_due();
+        host_idle();
+        last = due;
+    }
+    if (t != INT64_MAX) {
+        advanceTo(t);
+    }
+    return last;
+}
+
+/* ---- Reconnect ---- */
+
+struct Run {
+    uint32_t requests;
+    uint32_t replayRequests;
+    uint32_t skipped;
+    uint32_t stored;
+    uint32_t dropped;   // Lost to a full request queue
+    int64_t idleUs;
+};
+
+static Run reconnect(const std::vector<uint32_t>& shown) {
+    DispatcherStats& st = disp.stats();
+    uint32_t requests = host_ancs_requests(), replayRequests = st.replayRequests;
+    uint32_t skipped = st.knownSkipped, stored = st.notifsStored;
+    uint32_t dropped = disp.m_attrScheduler[IDX].dropped;
+
+    int64_t start = esp_timer_get_time();
+    host_ancs_connect(IDX, PHONE);
+    host_idle();
+
+    int64_t idle = start;
+    for (size_t i = 0; i < shown.size(); i ++) {
+        int64_t t = start + (int64_t)(i + 1) * INTERVAL_US;
+        serveUntil(t);
+        host_ancs_event(IDX, BLE_ANCS_EVENT_ID_NOTIFICATION_ADDED, shown[i], true);
+        host_idle();
+        idle = t;
+    }
+    int64_t last = serveUntil(INT64_MAX);
+    idle = (last > idle) ? last : idle;
+
+    return { host_ancs_requests() - requests, st.replayRequests - replayRequests,
+             st.knownSkipped - skipped, st.notifsStored - stored, disp.m_attrScheduler[IDX].dropped - dropped,
+             idle - start };
+}
+
+static void disconnect(void) {
+    host_ancs_disconnect(IDX);
+    host_idle();
+    advanceTo(esp_timer_get_time() + 60 * 1000000LL);
+}
+
+static void print(const char *name, const Run& r) {
+    printf("%-28s %3u requests (%3u during the replay), %3u skipped, %3u stored, %2u dropped, idle %5lld ms\n",
+           name, (unsigned)r.requests, (unsigned)r.replayRequests, (unsigned)r.skipped, (unsigned)r.stored,
+           (unsigned)r.dropped, (long long)(r.idleUs / 1000));
+}
+
+/* ---- Stored notifications ---- */
+
+static bool knownSaved(void) {
+    KnownUids saved;
+    return saved.load(PHONE_BDA) == ESP_OK;
+}
+
+static uint32_t storedCount(void) {
+    return disp.withStore([]() { return disp.getNPById(IDX)->size(); });
+}
+
+static bool storedTitleIs(uint32_t uid, const char *title) {
+    return disp.withStore([&]() {
+        const Notification *n = disp.getNPById(IDX)->getNotification(uid);
+        return n != nullptr && strcmp(n->title(), title) == 0;
+    });
+}
+
+// A record stored before the reconnect is still reachable by its UID: fetched whole, modified in
+// place, then removed. Returns the UID, gone from the phone too.
+static uint32_t useAfterReconnect(void) {
+    DispatcherStats& st = disp.stats();
+    uint32_t uid = disp.withStore([]() {
+        uint32_t newest = 0;
+        disp.getNPById(IDX)->forEach([&](const Notification& n) { newest = std::max(newest, n.uid()); });
+        return newest;
+    });
+    uint32_t count = storedCount();
+
+    // Whole message on demand
+    uint32_t full = st.fullFetchDone;
+    CHECK(disp.fetchFullMessage(PHONE_BDA, uid));
+    host_idle();
+    serveUntil(INT64_MAX);
+    CHECK(st.fullFetchDone == full + 1);
+    CHECK(disp.withStore([&]() { return disp.getNPById(IDX)->getNotification(uid)->messageLength(); }) == strlen(MESSAGE));
+
+    // Modified in place, same Date
+    show(uid, "Edited");
+    host_ancs_event(IDX, BLE_ANCS_EVENT_ID_NOTIFICATION_MODIFIED, uid, false);
+    host_idle();
+    serveUntil(INT64_MAX);
+    char title[32];
+    snprintf(title, sizeof(title), "Edited %u", (unsigned)uid);
+    CHECK(storedTitleIs(uid, title));
+    CHECK(storedCount() == count);
+
+    // Removed
+    host_ancs_remove(uid);
+    host_ancs_event(IDX, BLE_ANCS_EVENT_ID_NOTIFICATION_REMOVED, uid, false);
+    host_idle();
+    CHECK(storedCount() == count - 1);
+    CHECK(disp.withStore([&]() { return disp.getNPById(IDX)->getNotification(uid) == nullptr; }));
+    return uid;
+}
+
+int main(void) {
+    host_time_set(1000000);
+    host_ancs_set_rtt(RTT_US);
+    disp.filter().setRules({}, true);
+    CHECK(disp.initDriver() == ESP_OK);
+
+    std::vector<uint32_t> shown;
+    for (uint32_t uid = 1; uid <= SHOWN; uid ++) {
+        show(uid);
+        shown.push_back(uid);
+    }
+
+    // Nothing stored yet, every notification is fetched, header then body, but for what the queue drops
+    Run first = reconnect(shown);
+    print("first connection", first);
+    CHECK(first.stored + first.dropped == SHOWN);
+    CHECK(first.requests == 2 * first.stored);
+    disconnect();
+
+    // Known UIDs lost: a header each, all found outdated against what is stored
+    host_nvs_clear();
+    Run lost = reconnect(shown);
+    print("reconnect, known UIDs lost", lost);
+    CHECK(lost.stored == 0);
+    CHECK(lost.skipped == 0);
+    CHECK(lost.requests == SHOWN);
+    CHECK(lost.dropped == 0);
+    disconnect();
+
+    // Known UIDs kept: nothing to fetch, idle with the last replayed event
+    Run kept = reconnect(shown);
+    print("reconnect, known UIDs kept", kept);
+    CHECK(kept.requests == 0);
+    CHECK(kept.skipped == SHOWN);
+    CHECK(kept.idleUs == (int64_t)SHOWN * INTERVAL_US);
+    CHECK(host_ancs_max_in_flight() <= ANCS_PIPELINE_DEPTH);
+    uint32_t used = useAfterReconnect();
+    CHECK(used > 10);
+    shown.erase(std::find(shown.begin(), shown.end(), used));
+    disconnect();
+
+    // 10 dismissed on the phone while away and 5 new: only the new ones are fetched, header and body
+    std::vector<uint32_t> changed(shown.begin() + 10, shown.end());
+    for (uint32_t uid = 1; uid <= 10; uid ++) {
+        host_ancs_remove(uid);
+    }
+    for (uint32_t uid = SHOWN + 1; uid <= SHOWN + 5; uid ++) {
+        show(uid);
+        changed.push_back(uid);
+    }
+    Run partial = reconnect(changed);
+    print("reconnect, 10 gone, 5 new", partial);
+    CHECK(partial.requests == 10);
+    CHECK(partial.skipped == SHOWN - 11);
+    CHECK(partial.stored == 5);
+
+    // The replay ends once idle long enough, UIDs not replayed are forgotten
+    advanceTo(esp_timer_get_time() + 40 * 1000000LL);
+    CHECK(disp.withStore([]() { return disp.m_knownUids[IDX].size(); }) == SHOWN - 6);
+    disconnect();
+
+    // Store cleared, as by a reboot or a retired device: known UIDs no longer stand for anything.
+    // A retired device takes its saved ones along.
+    CHECK(knownSaved());
+    RetentionConfig cfg = disp.retention();
+    disp.withStore([&]() {
+        RetentionConfig none = cfg;
+        none.maxProviders = 0;
+        disp.setRetention(none);
+        disp.setRetention(cfg);
+    });
+    host_idle();
+    CHECK(!knownSaved());
+    Run cleared = reconnect(changed);
+    print("reconnect, store cleared", cleared);
+    CHECK(cleared.skipped == 0);
+    CHECK(cleared.stored + cleared.dropped == changed.size());
+    CHECK(cleared.stored > 0);
+    CHECK(storedCount() > 0);
+    disconnect();
+
+    // Bond removed: the phone pairs again as a new one
+    CHECK(knownSaved());
+    host_ancs_bond_removed(PHONE);
+    host_idle();
+    CHECK(!knownSaved());
+
+    host_test_exit();
+}
@@ -0,0 +1,267 @@
+// Heap allocations and bytes copied per notification from its Data Source packets to the stored
+// record, with the attributes parsed into Dispatcher-owned slots and streamed, against the path
+// they replaced: every attribute parsed into the shared profile buffer, assigned to a std::string
+// field of a five-string notification, and the whole of it copied into the store.
+//
+// Both paths run the real parser over the same responses, cut into packets of an ATT MTU of 185.
+// Message is cut to the preview length the Dispatcher requests, so the difference is the ingest
+// path alone.
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+#include "AppIdTable.h"
+#include "DispatcherUtils.h"
+#include "Notification.h"
+#include "RecordPool.h"
+#include "ble_ancs.h"
+#include "ble_ancs_utils.h"
+#include "host.h"
+#include "notification_mix.h"
+
+static constexpr uint32_t N = 1000;
+static constexpr uint16_t PACKET_SIZE = 185 - 3;
+
+/* ---- Counted heap ---- */
+
+static size_t newCount = 0;
+
+void *operator new(size_t size) {
+    newCount ++;
+    void *p = malloc(size ? size : 1);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+/* ---- Responses ---- */
+
+static void putText(std::vector<uint8_t>& r, uint8_t id, const char *s, size_t len) {
+    r.push_back(id);
+    r.push_back(len & 0xFF);
+    r.push_back(len >> 8);
+    r.insert(r.end(), s, s + len);
+}
+
+// Message cut to the preview the Dispatcher requests, Message Size tells the whole length
+static std::vector<uint8_t> makeResponse(uint32_t uid) {
+    Sample s = makeSample(uid);
+    std::vector<uint8_t> r;
+    r.push_back(BLE_ANCS_COMMAND_ID_GET_NOTIF_ATTRIBUTES);
+    for (int i = 0; i < 4; i ++) {
+        r.push_back((uid >> (8 * i)) & 0xFF);
+    }
+    putText(r, BLE_ANCS_NOTIF_ATTR_ID_APP_IDENTIFIER, s.appId.data(), s.appId.size());
+    putText(r, BLE_ANCS_NOTIF_ATTR_ID_DATE, s.date.data(), s.date.size());
+    putText(r, BLE_ANCS_NOTIF_ATTR_ID_TITLE, s.title.data(), s.title.size());
+    putText(r, BLE_ANCS_NOTIF_ATTR_ID_SUBTITLE, s.subTitle.data(), s.subTitle.size());
+    putText(r, BLE_ANCS_NOTIF_ATTR_ID_MESSAGE, s.message.data(), std::min<size_t>(s.message.size(), NotificationBuffer::PREVIEW_MAX));
+    char size[8];
+    int sizeLen = snprintf(size, sizeof(size), "%u", (unsigned)s.message.size());
+    putText(r, BLE_ANCS_NOTIF_ATTR_ID_MESSAGE_SIZE, size, sizeLen);
+    return r;
+}
+
+static void feed(ble_ancs_c_t *ancs, const std::vector<uint8_t>& r) {
+    ancs->parse_info.parse_state = BLE_ANCS_COMMAND_ID;
+    for (size_t pos = 0; pos < r.size(); pos += PACKET_SIZE) {
+        size_t len = std::min<size_t>(PACKET_SIZE, r.size() - pos);
+        ble_ancs_parse_get_attrs_response(ancs, &r[pos], len);
+    }
+}
+
+static constexpr ble_ancs_c_notif_attr_id_val_t requested[] = {
+    BLE_ANCS_NOTIF_ATTR_ID_APP_IDENTIFIER,
+    BLE_ANCS_NOTIF_ATTR_ID_TITLE,
+    BLE_ANCS_NOTIF_ATTR_ID_SUBTITLE,
+    BLE_ANCS_NOTIF_ATTR_ID_MESSAGE,
+    BLE_ANCS_NOTIF_ATTR_ID_MESSAGE_SIZE,
+    BLE_ANCS_NOTIF_ATTR_ID_DATE
+};
+
+struct Result {
+    size_t allocs = 0;      // Heap allocations, operator new and pool chunks
+    size_t records = 0;     // Pool blocks left holding the stored notifications
+    size_t parsed = 0;      // Bytes written by the parser
+    size_t copied = 0;      // Bytes copied after parsing
+};
+
+static void print(const char *name, const Result& r) {
+    printf("  %-34s %5.2f heap allocations, %6.1f bytes parsed + %6.1f copied = %6.1f bytes/notification\n",
+           name, (double)r.allocs / N, (double)r.parsed / N, (double)r.copied / N,
+           (double)(r.parsed + r.copied) / N);
+}
+
+/* ---- Before: shared buffer, std::string per attribute ---- */
+
+// The notification of the original tree
+struct FiveStrings {
+    std::string timeStamp;
+    std::string appId;
+    std::string title;
+    std::string subTitle;
+    std::string message;
+};
+
+struct Legacy {
+    ble_ancs_c_t ancs;
+    uint8_t attrBuffer[MAX_NOTIF_ATTR_SIZE];
+    FiveStrings notifBuffer;
+    Result *result;
+};
+
+// As disp_attribute was: cleaned on the first attribute, then the field assigned from the buffer
+static void legacyAttribute(ble_ancs_c_evt_t *p_evt, void *ctx) {
+    Legacy *l = static_cast<Legacy *>(ctx);
+    if (p_evt->evt_type != BLE_ANCS_C_EVT_NOTIF_ATTRIBUTE) {
+        return;
+    }
+    ble_ancs_c_attr_t *attr = &p_evt->attr;
+    l->result->parsed += std::min<size_t>(attr->attr_len, sizeof(l->attrBuffer) - 1);
+    if (attr->attr_id == requested[0]) {
+        l->notifBuffer = FiveStrings();
+    }
+
+    std::string *field = nullptr;
+    switch (attr->attr_id) {
+        case BLE_ANCS_NOTIF_ATTR_ID_APP_IDENTIFIER: field = &l->notifBuffer.appId; break;
+        case BLE_ANCS_NOTIF_ATTR_ID_TITLE: field = &l->notifBuffer.title; break;
+        case BLE_ANCS_NOTIF_ATTR_ID_SUBTITLE: field = &l->notifBuffer.subTitle; break;
+        case BLE_ANCS_NOTIF_ATTR_ID_MESSAGE: field = &l->notifBuffer.message; break;
+        case BLE_ANCS_NOTIF_ATTR_ID_DATE: field = &l->notifBuffer.timeStamp; break;
+        default: return;
+    }
+    *field = (char *)attr->p_attr_data;
+    l->result->copied += field->size();
+}
+
+static Result runLegacy(const std::vector<std::vector<uint8_t>>& responses) {
+    Result result;
+    static Legacy l;
+    l.result = &result;
+    l.ancs.ctx = &l;
+    l.ancs.evt_handler = legacyAttribute;
+    for (auto id : requested) {
+        ble_ancs_add_notif_attr(&l.ancs, id, l.attrBuffer, sizeof(l.attrBuffer));
+    }
+
+    std::vector<FiveStrings> store;
+    store.reserve(N);
+    size_t before = newCount;
+    for (const auto& r : responses) {
+        uint8_t cmd[64];
+        ble_ancs_build_notif_attrs_request(&l.ancs, 0, cmd, sizeof(cmd));
+        feed(&l.ancs, r);
+        // As addNotification was: the buffer copied into the queue
+        store.push_back(l.notifBuffer);
+        const FiveStrings& s = store.back();
+        result.copied += s.timeStamp.size() + s.appId.size() + s.title.size() + s.subTitle.size() + s.message.size();
+    }
+    result.allocs = newCount - before;
+    l.notifBuffer = FiveStrings();
+    return result;
+}
+
+/* ---- After: Dispatcher-owned slots, streamed Message, pooled record ---- */
+
+struct Direct {
+    ble_ancs_c_t ancs;
+    NotificationBuffer buf;
+    Result *result;
+};
+
+// As disp_attribute is: the bytes are in place, only their length is recorded
+static void directAttribute(ble_ancs_c_evt_t *p_evt, void *ctx) {
+    Direct *d = static_cast<Direct *>(ctx);
+    if (p_evt->evt_type != BLE_ANCS_C_EVT_NOTIF_ATTRIBUTE) {
+        return;
+    }
+    d->buf.setLength(p_evt->attr.attr_id, p_evt->attr.attr_len);
+    if (p_evt->attr.attr_id != NotificationBuffer::STREAMED_ATTR) {
+        d->result->parsed += d->buf.length(p_evt->attr.attr_id);
+    }
+}
+
+static void directChunk(ble_ancs_c_evt_t const *p_evt, uint16_t offset, uint8_t const *p_data, uint16_t len, void *ctx) {
+    Direct *d = static_cast<Direct *>(ctx);
+    if (d->buf.append(p_evt->notif_uid, p_evt->attr.attr_id, offset, p_data, len)) {
+        d->result->parsed += len;
+    }
+}
+
+static Result runDirect(const std::vector<std::vector<uint8_t>>& responses) {
+    RecordPool& pool = RecordPool::instance();
+    Result result;
+    static Direct d;
+    d.result = &result;
+    d.ancs.ctx = &d;
+    d.ancs.evt_handler = directAttribute;
+    d.ancs.chunk_handler = directChunk;
+
+    std::vector<Notification> store;
+    store.reserve(N);
+    size_t before = newCount;
+    uint32_t chunks = pool.chunksTaken();
+    for (const auto& r : responses) {
+        // As ancs_send_attrs_request does with the slots handed out by attribute_buffer
+        uint32_t uid = r[1] | (r[2] << 8) | (r[3] << 16) | ((uint32_t)r[4] << 24);
+        d.buf.clear(uid);
+        for (auto id : requested) {
+            uint16_t len;
+            uint8_t *slot = d.buf.slot(id, &len);
+            ble_ancs_add_notif_attr(&d.ancs, id, slot, len);
+        }
+        uint8_t cmd[64];
+        ble_ancs_build_notif_attrs_request(&d.ancs, uid, cmd, sizeof(cmd));
+        feed(&d.ancs, r);
+
+        // As disp_attributes_done does: date parsed, record packed out of the buffer
+        int64_t t;
+        DispatcherUtils::parseAncsDate(d.buf.get(BLE_ANCS_NOTIF_ATTR_ID_DATE), &t);
+        store.emplace_back(d.buf, BLE_ANCS_CATEGORY_ID_SOCIAL, 0, t);
+        d.buf.release();
+        const Notification& n = store.back();
+        result.copied += n.size() - 3; // Without the terminators
+    }
+    result.allocs = newCount - before + (pool.chunksTaken() - chunks);
+    result.records = pool.blocks();
+
+    // Same text as the responses
+    const Notification& n = store.back();
+    CHECK(strlen(n.title()) > 0 && strcmp(n.appId(), "") != 0 && n.time() != DispatcherUtils::INVALID_TIME);
+    CHECK(n.messageLength() <= NotificationBuffer::PREVIEW_MAX);
+    return result;
+}
+
+int main(void) {
+    std::vector<std::vector<uint8_t>> responses;
+    for (uint32_t uid = 0; uid < N; uid ++) {
+        responses.push_back(makeResponse(1000 + uid));
+    }
+
+    Result legacy = runLegacy(responses);
+    Result direct = runDirect(responses);
+    printf("%" PRIu32 " notifications, 8 apps:\n", N);
+    print("shared buffer, std::string fields", legacy);
+    print("Dispatcher slots, pooled record", direct);
+
+    // Same attributes reach both. Then one allocation per notification at most, its pool block,
+    // which only takes from the heap when a chunk is due.
+    CHECK(direct.parsed == legacy.parsed);
+    CHECK(direct.records == N);
+    CHECK(direct.allocs <= N);
+    CHECK(direct.copied < legacy.copied / 2);
+    CHECK(legacy.allocs > 2 * N);
+    host_test_exit();
+}
@@ -0,0 +1,240 @@
+// RecordPool block recycling and chunk release, and bytes per stored notification for a realistic mix
+// with the record layouts the pool replaced: five std::string members, then one packed std::string.
+
+#include <cstdio>
+#include <malloc.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "AppIdTable.h"
+#include "DispatcherUtils.h"
+#include "Notification.h"
+#include "RecordPool.h"
+#include "host.h"
+#include "notification_mix.h"
+
+static RecordPool& pool = RecordPool::instance();
+
+static void testRecycle(void) {
+    uint8_t cls;
+    uint32_t taken = pool.chunksTaken();
+
+    // 100 bytes take 112 byte blocks, four to a chunk
+    std::vector<uint8_t *> blocks;
+    for (int i = 0; i < 8; i ++) {
+        blocks.push_back(pool.alloc(100, &cls));
+        CHECK(blocks.back() != nullptr && RecordPool::blockSize(cls) == 112);
+    }
+    CHECK(pool.chunksTaken() - taken == 2);
+    CHECK(pool.usedBytes() == 8 * 112);
+
+    // Freed blocks are reused, no chunk is taken
+    for (int i = 0; i < 3; i ++) {
+        pool.free(blocks[i], cls);
+    }
+    for (int i = 0; i < 3; i ++) {
+        blocks[i] = pool.alloc(112, &cls);
+    }
+    CHECK(pool.chunksTaken() - taken == 2);
+
+    // Once all are free one chunk goes back to the heap, the other is kept
+    for (uint8_t *p : blocks) {
+        pool.free(p, cls);
+    }
+    CHECK(pool.blocks() == 0 && pool.usedBytes() == 0);
+    CHECK(pool.chunks() == 1 && pool.reservedBytes() == 4 * 112);
+
+    // Back and forth over a chunk boundary takes a chunk once
+    blocks.clear();
+    for (int i = 0; i < 4; i ++) {
+        blocks.push_back(pool.alloc(112, &cls));
+    }
+    taken = pool.chunksTaken();
+    for (int i = 0; i < 100; i ++) {
+        uint8_t *p = pool.alloc(112, &cls);
+        CHECK(p != nullptr);
+        pool.free(p, cls);
+    }
+    CHECK(pool.chunksTaken() - taken == 1);
+    CHECK(pool.chunks() == 2);
+
+    // The kept empty chunk goes as soon as its class has another free block
+    pool.free(blocks[2], cls);
+    CHECK(pool.chunks() == 1 && pool.reservedBytes() == 4 * 112);
+    pool.free(blocks[0], cls);
+    pool.free(blocks[1], cls);
+    pool.free(blocks[3], cls);
+    CHECK(pool.chunks() == 1);
+
+    // Classes of long messages hold one block per chunk, and the pool keeps one empty chunk at most
+    uint8_t big;
+    uint8_t *a = pool.alloc(3000, &big);
+    uint8_t *b = pool.alloc(3000, &big);
+    CHECK(RecordPool::blockSize(big) == 3072 && pool.chunks() == 3);
+    pool.free(a, big);
+    pool.free(b, big);
+    CHECK(pool.chunks() == 1 && pool.reservedBytes() == 3072);
+
+    // Too long for any class
+    CHECK(pool.alloc(RecordPool::MAX_BLOCK_SIZE + 1, &cls) == nullptr);
+}
+
+/* ---- A realistic mix ---- */
+
+// The Notification Source of the original tree
+struct FiveStrings {
+    std::string timeStamp;
+    std::string appId;
+    std::string title;
+    std::string subTitle;
+    std::string message;
+
+    explicit FiveStrings(const Sample& s)
+        : timeStamp(s.date), appId(s.appId), title(s.title), subTitle(s.subTitle), message(s.message) { }
+};
+
+// Before the pool: all fields in one std::string, located by an offset table
+struct PackedString {
+    std::string data;
+    std::array<uint16_t, 5> offsets {};
+    uint32_t uid = 0;
+    uint8_t category = 0;
+    uint8_t flags = 0;
+    uint16_t events = 1;
+
+    explicit PackedString(const Sample& s) {
+        const std::string *fields[] = { &s.date, &s.appId, &s.title, &s.subTitle, &s.message };
+        size_t total = 0;
+        for (auto f : fields) {
+            total += f->size() + 1;
+        }
+        data.reserve(total);
+        for (size_t f = 0; f < 5; f ++) {
+            offsets[f] = data.size();
+            data.append(*fields[f]);
+            data.push_back('\0');
+        }
+    }
+};
+
+static void fill(NotificationBuffer& buf, uint32_t uid, const Sample& s) {
+    buf.clear(uid);
+    const std::pair<uint32_t, const std::string *> attrs[] = {
+        { BLE_ANCS_NOTIF_ATTR_ID_APP_IDENTIFIER, &s.appId },
+        { BLE_ANCS_NOTIF_ATTR_ID_TITLE, &s.title },
+        { BLE_ANCS_NOTIF_ATTR_ID_SUBTITLE, &s.subTitle },
+        { BLE_ANCS_NOTIF_ATTR_ID_DATE, &s.date },
+    };
+    for (auto& a : attrs) {
+        uint16_t len;
+        uint8_t *slot = buf.slot(a.first, &len);
+        memcpy(slot, a.second->data(), a.second->size());
+        slot[a.second->size()] = '\0';
+        buf.setLength(a.first, a.second->size());
+    }
+    buf.setStreamMax(s.message.size());
+    buf.append(uid, BLE_ANCS_NOTIF_ATTR_ID_MESSAGE, 0, (const uint8_t *)s.message.data(), s.message.size());
+}
+
+static Notification makeNotification(uint32_t uid, const Sample& s) {
+    static NotificationBuffer buf;
+    fill(buf, uid, s);
+    int64_t t;
+    DispatcherUtils::parseAncsDate(s.date, &t);
+    Notification n(buf, BLE_ANCS_CATEGORY_ID_SOCIAL, 0, t);
+    buf.release();
+    return n;
+}
+
+static size_t heapInUse(void) {
+    return mallinfo2().uordblks;
+}
+
+/**@brief Bytes per stored notification, object plus heap, for 1000 notifications of the mix.
+ *
+ * @details Heap is measured with mallinfo2(), so it includes the allocator's per-block overhead of
+ *          each std::string and the pool chunks. The pool figure also counts the interned app IDs.
+ */
+static void benchBytesPerNotification(void) {
+    static constexpr uint32_t N = 1000;
+    std::vector<Sample> samples;
+    for (uint32_t i = 0; i < N; i ++) {
+        samples.push_back(makeSample(i));
+    }
+
+    auto measure = [&](auto tag, const char *name) -> double {
+        using T = decltype(tag);
+        std::vector<T> store;
+        store.reserve(N);
+        size_t before = heapInUse();
+        size_t allocs = pool.chunksTaken();
+        for (uint32_t i = 0; i < N; i ++) {
+            if constexpr (std::is_same_v<T, Notification>) {
+                store.push_back(makeNotification(i, samples[i]));
+            } else {
+                store.emplace_back(samples[i]);
+            }
+        }
+        size_t heap = heapInUse() - before;
+        double perNotif = sizeof(T) + (double)heap / N;
+        printf("  %-26s %3zu object + %6.1f heap = %6.1f bytes/notification", name, sizeof(T), (double)heap / N, perNotif);
+        if constexpr (std::is_same_v<T, Notification>) {
+            printf(", %zu chunks taken", pool.chunksTaken() - allocs);
+        }
+        printf("\n");
+        return perNotif;
+    };
+
+    printf("1000 notifications, 8 apps:\n");
+    double five = measure(FiveStrings(samples[0]), "five std::string members");
+    double packed = measure(PackedString(samples[0]), "one packed std::string");
+    double pooled = measure(Notification(), "pooled record");
+    CHECK(pooled < packed && packed < five);
+    CHECK(pool.blocks() == 0);
+}
+
+/**@brief A burst of long messages, evicted by a later stream of short ones, must not keep its chunks.
+ *
+ * @details A rolling window of 64 stored notifications, like the per-device capacity. Before chunks
+ *          were released, the reserve stayed at the peak of the burst.
+ */
+static void testChurn(void) {
+    std::vector<Notification> window;
+    size_t peak = 0;
+    uint32_t uid = 0;
+
+    auto store = [&](bool longMessages) {
+        if (window.size() == 64) {
+            window.erase(window.begin());
+        }
+        window.push_back(makeNotification(uid, makeSample(uid, longMessages)));
+        uid ++;
+        peak = std::max(peak, pool.reservedBytes());
+    };
+
+    for (int i = 0; i < 500; i ++) {
+        store(true);
+    }
+    size_t afterLong = pool.reservedBytes();
+    for (int i = 0; i < 500; i ++) {
+        store(false);
+    }
+    size_t afterShort = pool.reservedBytes();
+    size_t used = pool.usedBytes();
+    window.clear();
+
+    printf("churn: %zu bytes reserved after the long burst, %zu once evicted (%zu in use), %zu once all "
+           "are gone\n", afterLong, afterShort, used, pool.reservedBytes());
+    CHECK(afterShort < afterLong / 2);
+    CHECK(afterShort <= used + 4 * 4096);
+    // Only one empty chunk per class is kept
+    CHECK(pool.blocks() == 0 && pool.chunks() <= 8);
+}
+
+int main(void) {
+    testRecycle();
+    benchBytesPerNotification();
+    testChurn();
+    CHECK(AppIdTable::instance().count() == 0);
+    host_test_exit();
+}